@@ -0,0 +1,56 @@
+#pragma once
+
+// Address-space geometry shared by the simulators: page size, page table
+// levels and bits per level, and virtual address width, all compile-time so
+// index and offset arithmetic folds to shifts and masks.
+//
+// Level 0 is the top (x86 PDX), LEVELS - 1 the leaf table (PTX). The top
+// level may use fewer than BITS_PER_LEVEL bits, like x86-64's PML4 with
+// 48-bit addresses or arm64's level 0 with a 16KB granule.
+//
+// Simulators pick one with -DVM_ADDRESS_SPACE=<preset>; the default is the
+// one each was written for. Frame numbers stay 32-bit (16TB of 4KB frames);
+// page numbers widen to 64 bits once they need more than 32.
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+template <unsigned PageShift, unsigned Levels, unsigned BitsPerLevel, unsigned AddressBits>
+struct AddressSpace {
+    static constexpr unsigned PAGE_SHIFT = PageShift;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PageShift;
+    static constexpr uint64_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr unsigned LEVELS = Levels;
+    static constexpr unsigned BITS_PER_LEVEL = BitsPerLevel;
+    static constexpr size_t ENTRIES = size_t(1) << BitsPerLevel;   // Per table
+    static constexpr unsigned ADDRESS_BITS = AddressBits;
+    static constexpr unsigned VPN_BITS = AddressBits - PageShift;
+
+    static_assert(PageShift >= 12 && PageShift < AddressBits, "page size out of range");
+    static_assert(AddressBits <= 64, "at most 64-bit addresses");
+    static_assert(Levels * BitsPerLevel >= VPN_BITS, "page table levels must cover the address");
+    static_assert((Levels - 1) * BitsPerLevel < VPN_BITS, "top level would be unused");
+
+    using vaddr_t = typename std::conditional<(AddressBits <= 32), uint32_t, uint64_t>::type;
+    using vpn_t = typename std::conditional<(VPN_BITS <= 32), uint32_t, uint64_t>::type;
+    using pfn_t = uint32_t;
+
+    // Table index of va at level (0 = top)
+    static constexpr size_t index(uint64_t va, unsigned level) {
+        return (va >> (PageShift + (Levels - 1 - level) * BitsPerLevel)) & (ENTRIES - 1);
+    }
+    static constexpr vpn_t page_number(uint64_t va) { return (vpn_t)(va >> PageShift); }
+    static constexpr uint64_t page_offset(uint64_t va) { return va & PAGE_MASK; }
+    static constexpr uint64_t round_down(uint64_t a) { return a & ~PAGE_MASK; }
+    static constexpr uint64_t round_up(uint64_t a) { return (a + PAGE_MASK) & ~PAGE_MASK; }
+    // Bytes one entry at level maps (a whole page at the leaf level)
+    static constexpr uint64_t span(unsigned level) {
+        return uint64_t(1) << (PageShift + (Levels - 1 - level) * BitsPerLevel);
+    }
+};
+
+using X86_32 = AddressSpace<12, 2, 10, 32>;     // Two-level, 4KB pages, 4MB per directory entry
+using X86_64 = AddressSpace<12, 4, 9, 48>;      // Four-level, 48-bit
+using Arm64_16K = AddressSpace<14, 4, 11, 48>;  // 16KB granule
+using Arm64_64K = AddressSpace<16, 3, 13, 48>;  // 64KB granule
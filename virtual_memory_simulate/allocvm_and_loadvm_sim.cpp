@@ -4,26 +4,43 @@
 #include <iomanip>
 #include <memory>
 #include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "address_space.h"
+#include "vm_trace.h"
+#include "page_ops.h"
+#include "bench.h"
+
+// x86 two-level geometry (address_space.h); the PDE/PTE formats below are 32-bit x86's
+using Geometry = X86_32;
 
 // Constants
-const uint32_t PAGE_SIZE = 4096;
-const uint32_t PAGE_SHIFT = 12;
-const uint32_t PAGE_MASK = 0xFFF;
+const uint32_t PAGE_SIZE = Geometry::PAGE_SIZE;
+const uint32_t PAGE_SHIFT = Geometry::PAGE_SHIFT;
+const uint32_t PAGE_MASK = Geometry::PAGE_MASK;
 
 // Page table constants
-const uint32_t PTE_ENTRIES = 1024;
-const uint32_t PDE_ENTRIES = 1024;
+const uint32_t PTE_ENTRIES = Geometry::ENTRIES;
+const uint32_t PDE_ENTRIES = Geometry::ENTRIES;
 
 // Page table entry flags
 const uint32_t PTE_PRESENT = 0x001;
 const uint32_t PTE_WRITE   = 0x002;
 const uint32_t PTE_USER    = 0x004;
+const uint32_t PTE_PS      = 0x080;   // PDE only: maps a 4MB page directly (PSE)
+
+// 4MB pages: one directory entry maps a whole page table's worth of memory
+const uint32_t LARGE_PAGE_SIZE = 4 * 1024 * 1024;
 
 // Extract indices and addresses
-#define PDX(va) (((va) >> 22) & 0x3FF)
-#define PTX(va) (((va) >> 12) & 0x3FF)
-#define PG_OFFSET(va) ((va) & 0xFFF)
-#define PTE_ADDR(pte) ((pte) & ~0xFFF)
+#define PDX(va) (((va) >> (PAGE_SHIFT + Geometry::BITS_PER_LEVEL)) & (PDE_ENTRIES - 1))
+#define PTX(va) (((va) >> PAGE_SHIFT) & (PTE_ENTRIES - 1))
+#define PG_OFFSET(va) ((va) & PAGE_MASK)
+#define PTE_ADDR(pte) ((pte) & ~PAGE_MASK)
+#define LARGE_PAGE_ADDR(pde) ((pde) & ~(LARGE_PAGE_SIZE - 1))
 #define PGROUNDUP(sz) (((sz) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
 #define PGROUNDDOWN(sz) ((sz) & ~(PAGE_SIZE - 1))
 
@@ -55,87 +72,509 @@ struct proghdr {
 #define ELF_PROG_LOAD 1
 
 // ==================== DISK SIMULATION ====================
+// One scatter-gather element for Disk::readv(): len bytes into base
+struct IoVec {
+    uint8_t* base;
+    uint32_t len;
+};
+
 class Disk {
 private:
-    std::map<std::string, std::vector<uint8_t>> files;
+    std::vector<std::vector<uint8_t>> inodes;   // File contents, indexed by inode number
+    std::vector<std::string> names;             // Inode number → filename, for logging
+    std::map<std::string, int> directory;       // Filename → inode number
+    
+    bool in_bounds(int inum, uint32_t offset, uint64_t size) {
+        if (inum < 0 || (size_t)inum >= inodes.size()) {
+            VM_LOG(ERROR) << "[DISK] ERROR: Bad inode " << inum << '\n';
+            return false;
+        }
+        if (offset + size > inodes[inum].size()) {
+            VM_LOG(ERROR) << "[DISK] ERROR: Read beyond file size\n";
+            return false;
+        }
+        return true;
+    }
     
 public:
     // Create a file on disk
     void create_file(const std::string& filename, const std::vector<uint8_t>& data) {
-        files[filename] = data;
-        std::cout << "[DISK] Created file '" << filename << "' with " 
-                  << data.size() << " bytes" << std::endl;
+        auto it = directory.find(filename);
+        if (it != directory.end()) {
+            inodes[it->second] = data;
+        } else {
+            directory[filename] = inodes.size();
+            inodes.push_back(data);
+            names.push_back(filename);
+        }
+        VM_LOG(INFO) << "[DISK] Created file '" << filename << "' with " 
+                     << data.size() << " bytes\n";
     }
     
-    // Read from file at offset
-    int read_file(const std::string& filename, uint8_t* buffer, 
-                  uint32_t offset, uint32_t size) {
-        if (files.find(filename) == files.end()) {
-            std::cout << "[DISK] ERROR: File '" << filename << "' not found" << std::endl;
+    // Resolve a filename once (like namei), -1 if there is no such file.
+    // The inode number stays valid for the life of the disk.
+    int namei(const std::string& filename) {
+        auto it = directory.find(filename);
+        if (it == directory.end()) {
+            VM_LOG(ERROR) << "[DISK] ERROR: File '" << filename << "' not found\n";
             return -1;
         }
-        
-        const auto& file = files[filename];
-        if (offset + size > file.size()) {
-            std::cout << "[DISK] ERROR: Read beyond file size" << std::endl;
+        return it->second;
+    }
+    
+    // Read from an open file at offset (like readi)
+    int readi(int inum, uint8_t* buffer, uint32_t offset, uint32_t size) {
+        if (!in_bounds(inum, offset, size)) {
             return -1;
         }
-        
-        std::memcpy(buffer, file.data() + offset, size);
-        std::cout << "[DISK] Read " << size << " bytes from '" << filename 
-                  << "' at offset " << offset << std::endl;
+        std::memcpy(buffer, inodes[inum].data() + offset, size);
+        VM_LOG(INFO) << "[DISK] Read " << size << " bytes from '" << names[inum] 
+                     << "' at offset " << offset << '\n';
+        VM_EVENT(DISK_READ, offset, size);
         return size;
     }
     
+    // Scatter-gather read: one contiguous file range starting at offset fills
+    // iov[0], iov[1], ... in order, straight into the destinations
+    int readv(int inum, uint32_t offset, const IoVec* iov, size_t count) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            total += iov[i].len;
+        }
+        if (!in_bounds(inum, offset, total)) {
+            return -1;
+        }
+        const uint8_t* src = inodes[inum].data() + offset;
+        for (size_t i = 0; i < count; i++) {
+            std::memcpy(iov[i].base, src, iov[i].len);
+            src += iov[i].len;
+        }
+        VM_LOG(INFO) << "[DISK] Read " << total << " bytes from '" << names[inum] 
+                     << "' at offset " << offset << " into " << count << " buffers\n";
+        VM_EVENT(DISK_READ, offset, total);
+        return total;
+    }
+    
+    // Read from file at offset
+    int read_file(const std::string& filename, uint8_t* buffer, 
+                  uint32_t offset, uint32_t size) {
+        int inum = namei(filename);
+        return inum < 0 ? -1 : readi(inum, buffer, offset, size);
+    }
+    
     bool file_exists(const std::string& filename) {
-        return files.find(filename) != files.end();
+        return directory.find(filename) != directory.end();
     }
     
     size_t file_size(const std::string& filename) {
-        if (files.find(filename) == files.end()) return 0;
-        return files[filename].size();
+        auto it = directory.find(filename);
+        return it == directory.end() ? 0 : inodes[it->second].size();
     }
 };
 
 // ==================== RAM SIMULATION ====================
+// Direct view of one page's storage starting at a physical address
+struct PageSpan {
+    uint8_t* data;      // Byte at the requested address, nullptr if the page is not allocated
+    uint32_t length;    // Bytes from there to the end of the page
+};
+
+// Flat frame pool: one preallocated, page-aligned arena indexed by PFN.
+// Free frames are chained through their own first 8 bytes (intrusive, doubly
+// linked free list), so alloc/free and unlinking a frame are O(1) and no heap
+// allocation happens per page.
+class FramePool {
+private:
+    enum FrameState : uint8_t { FREE, USED, IN_RUN };     // IN_RUN: held in free_runs, off the free list
+    enum Link { NEXT, PREV };
+
+    uint8_t* arena;
+    uint32_t base_addr;         // Physical address of frame 0
+    uint32_t num_frames;
+    uint32_t high_water;        // Frames [0, high_water) have been handed out at least once
+    uint32_t free_head;         // First frame on the free list
+    uint32_t used_frames;
+    std::vector<uint8_t> in_use;    // FrameState of each frame
+    std::vector<std::pair<uint32_t, uint32_t>> free_runs;   // (first frame, count) freed whole by free_run()
+    
+    uint32_t link(uint32_t index, Link which) const {
+        uint32_t value;
+        std::memcpy(&value, arena + (size_t)index * PAGE_SIZE + which * sizeof(value), sizeof(value));
+        return value;
+    }
+    
+    void set_link(uint32_t index, Link which, uint32_t value) {
+        std::memcpy(arena + (size_t)index * PAGE_SIZE + which * sizeof(value), &value, sizeof(value));
+    }
+    
+    void push_free(uint32_t index) {
+        set_link(index, NEXT, free_head);
+        set_link(index, PREV, NO_FRAME);
+        if (free_head != NO_FRAME) {
+            set_link(free_head, PREV, index);
+        }
+        free_head = index;
+    }
+    
+    uint32_t pop_free() {
+        uint32_t index = free_head;
+        free_head = link(index, NEXT);
+        if (free_head != NO_FRAME) {
+            set_link(free_head, PREV, NO_FRAME);
+        }
+        return index;
+    }
+    
+    void unlink_free(uint32_t index) {
+        uint32_t next = link(index, NEXT);
+        uint32_t prev = link(index, PREV);
+        if (prev == NO_FRAME) {
+            free_head = next;
+        } else {
+            set_link(prev, NEXT, next);
+        }
+        if (next != NO_FRAME) {
+            set_link(next, PREV, prev);
+        }
+    }
+    
+    // Hand a whole freed run to the free list once single frames run out
+    bool break_run() {
+        if (free_runs.empty()) {
+            return false;
+        }
+        auto run = free_runs.back();
+        free_runs.pop_back();
+        for (uint32_t index = run.first + run.second; index-- > run.first; ) {
+            push_free(index);
+            in_use[index] = FREE;
+        }
+        return true;
+    }
+    
+    // First align-boundary run of count frames on the free list, or NO_FRAME.
+    // Used once the never-used tail cannot hold a run any more; frames held
+    // in free_runs are not FREE, so a run is only taken here once broken.
+    uint32_t find_free_run(uint32_t count, uint32_t align) {
+        uint32_t step = align >> PAGE_SHIFT;
+        uint32_t start = (((base_addr + align - 1) & ~(align - 1)) - base_addr) >> PAGE_SHIFT;
+        for (; start + count <= high_water; start += step) {
+            uint32_t i = 0;
+            while (i < count && in_use[start + i] == FREE) {
+                i++;
+            }
+            if (i == count) {
+                return start;
+            }
+        }
+        return NO_FRAME;
+    }
+    
+    // Take frames [first, first + count) off the free list, O(count)
+    void unlink_free_range(uint32_t first, uint32_t count) {
+        for (uint32_t index = first; index < first + count; index++) {
+            unlink_free(index);
+        }
+    }
+    
+public:
+    static const uint32_t NO_FRAME = 0xFFFFFFFF;
+    
+    FramePool(uint32_t base, size_t bytes) 
+        : base_addr(base), high_water(0), free_head(NO_FRAME), used_frames(0) {
+        num_frames = bytes / PAGE_SIZE;
+        assert(num_frames > 0);
+        assert((uint64_t)base + (uint64_t)num_frames * PAGE_SIZE <= 0x100000000ULL);
+        // Large aligned allocations are served by fresh anonymous memory, so the
+        // OS only commits frames once they are touched
+        arena = static_cast<uint8_t*>(std::aligned_alloc(PAGE_SIZE, (size_t)num_frames * PAGE_SIZE));
+        assert(arena != nullptr);
+        in_use.assign(num_frames, 0);
+    }
+    
+    ~FramePool() { std::free(arena); }
+    
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    
+    // Pointer to an allocated frame's storage, nullptr if out of range or free
+    uint8_t* frame_ptr(uint32_t page_addr) {
+        uint32_t index = (page_addr - base_addr) >> PAGE_SHIFT;
+        if (page_addr < base_addr || index >= num_frames || in_use[index] != USED) {
+            return nullptr;
+        }
+        return arena + (size_t)index * PAGE_SIZE;
+    }
+    
+    // Allocate a zeroed frame, returns its physical address or 0 when exhausted
+    uint32_t alloc() {
+        uint32_t index;
+        if (free_head == NO_FRAME && high_water == num_frames) {
+            break_run();
+        }
+        if (free_head != NO_FRAME) {
+            index = pop_free();
+        } else if (high_water < num_frames) {
+            index = high_water++;
+        } else {
+            return 0;
+        }
+        page_ops::zero(arena + (size_t)index * PAGE_SIZE, PAGE_SIZE);
+        in_use[index] = USED;
+        used_frames++;
+        return base_addr + (index << PAGE_SHIFT);
+    }
+    
+    // Allocate up to count zeroed frames into out (free list first, then the
+    // untouched tail), returns how many were handed out
+    uint32_t alloc_bulk(uint32_t count, uint32_t* out) {
+        uint32_t got = 0;
+        for (;;) {
+            while (got < count && free_head != NO_FRAME) {
+                out[got++] = pop_free();
+            }
+            uint32_t tail = std::min(count - got, num_frames - high_water);
+            for (uint32_t i = 0; i < tail; i++) {
+                out[got++] = high_water++;
+            }
+            if (got == count || !break_run()) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < got; i++) {
+            page_ops::zero(arena + (size_t)out[i] * PAGE_SIZE, PAGE_SIZE);
+            in_use[out[i]] = USED;
+            out[i] = base_addr + (out[i] << PAGE_SHIFT);
+        }
+        used_frames += got;
+        return got;
+    }
+    
+    // Allocate count zeroed, physically contiguous frames starting on an align
+    // boundary: a run returned whole by free_run(), else carved from the
+    // never-used tail (skipped frames join the free list), else an aligned
+    // run on the free list, breaking the other freed runs onto it if needed
+    uint32_t alloc_contiguous(uint32_t count, uint32_t align) {
+        for (size_t i = 0; i < free_runs.size(); i++) {
+            uint32_t start = free_runs[i].first;
+            if (free_runs[i].second == count && ((base_addr + (start << PAGE_SHIFT)) & (align - 1)) == 0) {
+                free_runs.erase(free_runs.begin() + i);
+                page_ops::zero(arena + (size_t)start * PAGE_SIZE, (size_t)count * PAGE_SIZE);
+                std::fill(in_use.begin() + start, in_use.begin() + start + count, USED);
+                used_frames += count;
+                return base_addr + (start << PAGE_SHIFT);
+            }
+        }
+        
+        uint32_t first = high_water;
+        uint32_t misalign = (base_addr + (first << PAGE_SHIFT)) & (align - 1);
+        if (misalign != 0) {
+            first += (align - misalign) >> PAGE_SHIFT;
+        }
+        if (first <= num_frames && count <= num_frames - first) {
+            for (uint32_t index = high_water; index < first; index++) {
+                push_free(index);
+            }
+            high_water = first + count;
+        } else {
+            first = find_free_run(count, align);
+            if (first == NO_FRAME && !free_runs.empty()) {
+                while (break_run()) {}
+                first = find_free_run(count, align);
+            }
+            if (first == NO_FRAME) {
+                return 0;
+            }
+            unlink_free_range(first, count);
+        }
+        page_ops::zero(arena + (size_t)first * PAGE_SIZE, (size_t)count * PAGE_SIZE);
+        std::fill(in_use.begin() + first, in_use.begin() + first + count, USED);
+        used_frames += count;
+        return base_addr + (first << PAGE_SHIFT);
+    }
+    
+    // Return a frame to the free list
+    bool free(uint32_t page_addr) {
+        if (!frame_ptr(page_addr)) {
+            return false;
+        }
+        uint32_t index = (page_addr - base_addr) >> PAGE_SHIFT;
+        push_free(index);
+        in_use[index] = FREE;
+        used_frames--;
+        return true;
+    }
+    
+    // Free count frames from page_addr as one run, kept off the free list so
+    // alloc_contiguous() can hand it out again in O(1). False, freeing
+    // nothing, unless every frame of the run is allocated.
+    bool free_run(uint32_t page_addr, uint32_t count) {
+        uint32_t first = (page_addr - base_addr) >> PAGE_SHIFT;
+        if (page_addr < base_addr || (page_addr & PAGE_MASK) || first > num_frames || count > num_frames - first) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (in_use[first + i] != USED) {
+                return false;
+            }
+        }
+        std::fill(in_use.begin() + first, in_use.begin() + first + count, IN_RUN);
+        used_frames -= count;
+        free_runs.emplace_back(first, count);
+        return true;
+    }
+    
+    uint32_t allocated() const { return used_frames; }
+    uint32_t capacity() const { return num_frames; }
+};
+
 class PhysicalMemory {
 private:
-    std::map<uint32_t, std::vector<uint8_t>> pages;
+    std::map<uint32_t, std::vector<uint8_t>> pages;  // Map backend: one heap buffer per page
+    std::unique_ptr<FramePool> pool;                 // Arena backend, used when set
     uint32_t next_free_page;
     
+    // Storage of an allocated page, nullptr if the page is not allocated
+    uint8_t* frame_data(uint32_t page_addr) {
+        if (pool) {
+            return pool->frame_ptr(page_addr);
+        }
+        auto it = pages.find(page_addr);
+        return it == pages.end() ? nullptr : it->second.data();
+    }
+    
 public:
     PhysicalMemory() : next_free_page(0x100000) {}
     
+    // Arena-backed RAM of ram_bytes, starting at 1MB like the map backend
+    explicit PhysicalMemory(size_t ram_bytes) 
+        : pool(std::make_unique<FramePool>(0x100000, ram_bytes)), next_free_page(0x100000) {}
+    
     // Allocate a physical page (like kalloc())
     uint32_t kalloc() {
-        uint32_t page_addr = next_free_page;
-        pages[page_addr] = std::vector<uint8_t>(PAGE_SIZE, 0);
-        next_free_page += PAGE_SIZE;
-        std::cout << "  [RAM] kalloc() allocated physical page at 0x" 
-                  << std::hex << page_addr << std::dec << std::endl;
+        uint32_t page_addr;
+        if (pool) {
+            page_addr = pool->alloc();
+            if (page_addr == 0) {
+                VM_LOG(ERROR) << "  [RAM] kalloc() failed: out of physical memory\n";
+                return 0;
+            }
+        } else {
+            page_addr = next_free_page;
+            pages[page_addr] = std::vector<uint8_t>(PAGE_SIZE, 0);
+            next_free_page += PAGE_SIZE;
+        }
+        VM_LOG(INFO) << "  [RAM] kalloc() allocated physical page at 0x" 
+                     << std::hex << page_addr << std::dec << '\n';
+        VM_EVENT(FRAME_ALLOC, page_addr, 0);
+        return page_addr;
+    }
+    
+    // Allocate a 4MB-aligned run of LARGE_PAGE_SIZE bytes for a PTE_PS mapping,
+    // returns 0 when no such run is left. Freed with kfree_large().
+    uint32_t kalloc_large() {
+        uint32_t page_addr;
+        if (pool) {
+            page_addr = pool->alloc_contiguous(LARGE_PAGE_SIZE / PAGE_SIZE, LARGE_PAGE_SIZE);
+            if (page_addr == 0) {
+                return 0;
+            }
+        } else {
+            page_addr = (next_free_page + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+            for (uint32_t off = 0; off < LARGE_PAGE_SIZE; off += PAGE_SIZE) {
+                pages[page_addr + off] = std::vector<uint8_t>(PAGE_SIZE, 0);
+            }
+            next_free_page = page_addr + LARGE_PAGE_SIZE;
+        }
+        VM_LOG(INFO) << "  [RAM] kalloc_large() allocated 4MB page at 0x" 
+                     << std::hex << page_addr << std::dec << '\n';
+        VM_EVENT(FRAME_ALLOC, page_addr, LARGE_PAGE_SIZE);
         return page_addr;
     }
     
     // Free a physical page
     void kfree(uint32_t page_addr) {
-        if (pages.find(page_addr) != pages.end()) {
-            pages.erase(page_addr);
-            std::cout << "  [RAM] kfree() freed physical page at 0x" 
-                      << std::hex << page_addr << std::dec << std::endl;
+        bool freed = pool ? pool->free(page_addr) : pages.erase(page_addr) > 0;
+        if (freed) {
+            VM_LOG(INFO) << "  [RAM] kfree() freed physical page at 0x" 
+                         << std::hex << page_addr << std::dec << '\n';
+            VM_EVENT(FRAME_FREE, page_addr, 0);
+        }
+    }
+    
+    // Allocate count zeroed pages into out in one pass over the allocator.
+    // All or nothing: returns false (and keeps nothing) if RAM runs out.
+    bool kalloc_bulk(uint32_t count, uint32_t* out) {
+        if (pool) {
+            uint32_t got = pool->alloc_bulk(count, out);
+            if (got < count) {
+                for (uint32_t i = 0; i < got; i++) {
+                    pool->free(out[i]);
+                }
+                VM_LOG(ERROR) << "  [RAM] kalloc_bulk() failed: out of physical memory\n";
+                return false;
+            }
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                out[i] = next_free_page;
+                pages[next_free_page] = std::vector<uint8_t>(PAGE_SIZE, 0);
+                next_free_page += PAGE_SIZE;
+            }
+        }
+        VM_LOG(INFO) << "  [RAM] kalloc_bulk() allocated " << count << " pages\n";
+        for (uint32_t i = 0; i < count; i++) {
+            VM_EVENT(FRAME_ALLOC, out[i], 0);
+        }
+        return true;
+    }
+    
+    // Free a kalloc_large() page as a whole
+    void kfree_large(uint32_t page_addr) {
+        bool freed = true;
+        if (pool) {
+            freed = pool->free_run(page_addr, LARGE_PAGE_SIZE / PAGE_SIZE);
+        } else {
+            for (uint32_t off = 0; off < LARGE_PAGE_SIZE; off += PAGE_SIZE) {
+                pages.erase(page_addr + off);
+            }
+        }
+        if (freed) {
+            VM_LOG(INFO) << "  [RAM] kfree_large() freed 4MB page at 0x" 
+                         << std::hex << page_addr << std::dec << '\n';
+            VM_EVENT(FRAME_FREE, page_addr, LARGE_PAGE_SIZE);
+        }
+    }
+    
+    // Free count pages with one log line instead of one per page
+    void kfree_bulk(const uint32_t* page_addrs, uint32_t count) {
+        uint32_t freed = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (pool ? pool->free(page_addrs[i]) : pages.erase(page_addrs[i]) > 0) {
+                VM_EVENT(FRAME_FREE, page_addrs[i], 0);
+                freed++;
+            }
+        }
+        if (freed > 0) {
+            VM_LOG(INFO) << "  [RAM] kfree_bulk() freed " << freed << " pages\n";
         }
     }
     
+    size_t allocated_pages() const {
+        return pool ? pool->allocated() : pages.size();
+    }
+    
     // Read byte from physical address
     uint8_t read_byte(uint32_t phys_addr) {
         uint32_t page_addr = phys_addr & ~PAGE_MASK;
         uint32_t offset = phys_addr & PAGE_MASK;
         
-        if (pages.find(page_addr) == pages.end()) {
-            std::cout << "  [RAM] ERROR: Read from unmapped physical page 0x" 
-                      << std::hex << page_addr << std::dec << std::endl;
+        uint8_t* page = frame_data(page_addr);
+        if (!page) {
+            VM_LOG(ERROR) << "  [RAM] ERROR: Read from unmapped physical page 0x" 
+                          << std::hex << page_addr << std::dec << '\n';
             return 0;
         }
-        return pages[page_addr][offset];
+        return page[offset];
     }
     
     // Write byte to physical address
@@ -143,54 +582,123 @@ public:
         uint32_t page_addr = phys_addr & ~PAGE_MASK;
         uint32_t offset = phys_addr & PAGE_MASK;
         
-        if (pages.find(page_addr) == pages.end()) {
-            std::cout << "  [RAM] ERROR: Write to unmapped physical page 0x" 
-                      << std::hex << page_addr << std::dec << std::endl;
+        uint8_t* page = frame_data(page_addr);
+        if (!page) {
+            VM_LOG(ERROR) << "  [RAM] ERROR: Write to unmapped physical page 0x" 
+                          << std::hex << page_addr << std::dec << '\n';
             return;
         }
-        pages[page_addr][offset] = value;
+        page[offset] = value;
+    }
+    
+    // Raw pointer into the page holding phys_addr, valid until the page is freed
+    PageSpan page_span(uint32_t phys_addr) {
+        uint32_t offset = phys_addr & PAGE_MASK;
+        uint8_t* page = frame_data(phys_addr & ~PAGE_MASK);
+        if (!page) {
+            return {nullptr, 0};
+        }
+        return {page + offset, PAGE_SIZE - offset};
     }
     
-    // Write block of data to physical address
+    // Write block of data to physical address, one page lookup per page touched
     void write_block(uint32_t phys_addr, const uint8_t* data, size_t size) {
-        for (size_t i = 0; i < size; i++) {
-            write_byte(phys_addr + i, data[i]);
+        while (size > 0) {
+            PageSpan span = page_span(phys_addr);
+            if (!span.data) {
+                VM_LOG(ERROR) << "  [RAM] ERROR: Write to unmapped physical page 0x" 
+                              << std::hex << (phys_addr & ~PAGE_MASK) << std::dec << '\n';
+                return;
+            }
+            size_t n = std::min<size_t>(size, span.length);
+            std::memcpy(span.data, data, n);
+            phys_addr += n;
+            data += n;
+            size -= n;
         }
     }
     
-    // Read block of data from physical address
+    // Read block of data from physical address, one page lookup per page touched
     void read_block(uint32_t phys_addr, uint8_t* buffer, size_t size) {
-        for (size_t i = 0; i < size; i++) {
-            buffer[i] = read_byte(phys_addr + i);
+        while (size > 0) {
+            PageSpan span = page_span(phys_addr);
+            size_t n = span.data ? std::min<size_t>(size, span.length)
+                                 : std::min<size_t>(size, PAGE_SIZE - (phys_addr & PAGE_MASK));
+            if (!span.data) {
+                VM_LOG(ERROR) << "  [RAM] ERROR: Read from unmapped physical page 0x" 
+                              << std::hex << (phys_addr & ~PAGE_MASK) << std::dec << '\n';
+                std::memset(buffer, 0, n);
+            } else {
+                std::memcpy(buffer, span.data, n);
+            }
+            phys_addr += n;
+            buffer += n;
+            size -= n;
         }
     }
     
-    // Write uint32 (for page table entries)
-    void write_uint32(uint32_t phys_addr, uint32_t value) {
-        for (int i = 0; i < 4; i++) {
+    // Native-width load/store in host byte order (little-endian, same layout as the
+    // byte-wise path). Values straddling a page boundary fall back to single bytes.
+    template <typename T>
+    T read_word(uint32_t phys_addr) {
+        PageSpan span = page_span(phys_addr);
+        T value = 0;
+        if (span.data && span.length >= sizeof(T)) {
+            std::memcpy(&value, span.data, sizeof(T));
+            return value;
+        }
+        for (size_t i = 0; i < sizeof(T); i++) {
+            value |= (T)read_byte(phys_addr + i) << (i * 8);
+        }
+        return value;
+    }
+    
+    template <typename T>
+    void write_word(uint32_t phys_addr, T value) {
+        PageSpan span = page_span(phys_addr);
+        if (span.data && span.length >= sizeof(T)) {
+            std::memcpy(span.data, &value, sizeof(T));
+            return;
+        }
+        for (size_t i = 0; i < sizeof(T); i++) {
             write_byte(phys_addr + i, (value >> (i * 8)) & 0xFF);
         }
     }
     
+    // Write uint32 (for page table entries)
+    void write_uint32(uint32_t phys_addr, uint32_t value) {
+        write_word<uint32_t>(phys_addr, value);
+    }
+    
     // Read uint32 (for page table entries)
     uint32_t read_uint32(uint32_t phys_addr) {
-        uint32_t value = 0;
-        for (int i = 0; i < 4; i++) {
-            value |= (read_byte(phys_addr + i) << (i * 8));
-        }
-        return value;
+        return read_word<uint32_t>(phys_addr);
+    }
+    
+    void write_uint64(uint32_t phys_addr, uint64_t value) {
+        write_word<uint64_t>(phys_addr, value);
+    }
+    
+    uint64_t read_uint64(uint32_t phys_addr) {
+        return read_word<uint64_t>(phys_addr);
     }
     
     void print_stats() {
+        size_t allocated = pool ? pool->allocated() : pages.size();
         std::cout << "\n=== Physical RAM Stats ===" << std::endl;
-        std::cout << "Allocated pages: " << pages.size() << std::endl;
-        std::cout << "Memory used: " << pages.size() * PAGE_SIZE / 1024 << " KB" << std::endl;
+        std::cout << "Backend: " << (pool ? "flat frame pool" : "page map") << std::endl;
+        std::cout << "Allocated pages: " << allocated << std::endl;
+        std::cout << "Memory used: " << allocated * PAGE_SIZE / 1024 << " KB" << std::endl;
+        if (pool) {
+            std::cout << "Pool capacity: " << pool->capacity() << " pages" << std::endl;
+        }
     }
     
     // Print page contents (for debugging)
     void print_page_contents(uint32_t phys_addr, size_t bytes = 64) {
         uint32_t page_addr = phys_addr & ~PAGE_MASK;
-        if (pages.find(page_addr) == pages.end()) {
+        uint8_t* page = frame_data(page_addr);
+        if (!page) {
             std::cout << "Page not allocated" << std::endl;
             return;
         }
@@ -199,7 +707,7 @@ public:
         for (size_t i = 0; i < bytes && i < PAGE_SIZE; i++) {
             if (i % 16 == 0) std::cout << "  ";
             std::cout << std::hex << std::setw(2) << std::setfill('0') 
-                      << (int)pages[page_addr][i] << " ";
+                      << (int)page[i] << " ";
             if (i % 16 == 15) std::cout << std::dec << std::endl;
         }
         std::cout << std::dec << std::endl;
@@ -212,18 +720,106 @@ private:
     PhysicalMemory& phys_mem;
     uint32_t page_directory_phys;
     
+    // Lazy exec: segments recorded by lazyuvm(), keyed by start address.
+    // Their pages are read in (file part) or zero-filled (BSS) on first fault.
+    struct LazySegment {
+        uint32_t end;           // vaddr + memsz
+        Disk* disk;
+        int inum;               // File, resolved once by lazyuvm()
+        uint32_t offset;        // File offset of the segment's first byte
+        uint32_t filesz;        // Bytes backed by the file, the rest is BSS
+        int perm;
+    };
+    std::map<uint32_t, LazySegment> lazy_segments;
+    uint64_t lazy_faults;
+    uint64_t lazy_file_pages;   // Faults that read from disk
+    uint64_t lazy_zero_pages;   // Faults on pure BSS, no disk access
+    bool huge_pages;            // allocuvm may use 4MB pages (transparent_hugepage=always)
+    
 public:
-    PageTableManager(PhysicalMemory& pm) : phys_mem(pm) {
+    PageTableManager(PhysicalMemory& pm) 
+        : phys_mem(pm), lazy_faults(0), lazy_file_pages(0), lazy_zero_pages(0), huge_pages(true) {
         page_directory_phys = phys_mem.kalloc();
-        std::cout << "[PGT] Created page directory at physical 0x" 
-                  << std::hex << page_directory_phys << std::dec << std::endl;
+        VM_LOG(INFO) << "[PGT] Created page directory at physical 0x" 
+                     << std::hex << page_directory_phys << std::dec << '\n';
     }
     
     uint32_t get_page_directory() const {
         return page_directory_phys;
     }
     
-    // Walk page directory to find/create page table entry
+    void set_huge_pages(bool enabled) {
+        huge_pages = enabled;
+    }
+    
+private:
+    // Page table covering va as an array of its PTE_ENTRIES entries, created
+    // when alloc is set. nullptr if there is none or va lies in a 4MB page.
+    uint32_t* page_table(uint32_t va, bool alloc) {
+        uint32_t pde_addr = page_directory_phys + PDX(va) * 4;
+        uint32_t pde = phys_mem.read_uint32(pde_addr);
+        if (pde & PTE_PS)
+            return nullptr;
+        if (!(pde & PTE_PRESENT)) {
+            if (!alloc)
+                return nullptr;
+            uint32_t page_table_phys = phys_mem.kalloc();
+            if (page_table_phys == 0)
+                return nullptr;
+            VM_LOG(TRACE) << "    [PGT] Created page table at 0x" 
+                          << std::hex << page_table_phys << std::dec << '\n';
+            pde = page_table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER;
+            phys_mem.write_uint32(pde_addr, pde);
+        }
+        return reinterpret_cast<uint32_t*>(phys_mem.page_span(PTE_ADDR(pde)).data);
+    }
+    
+    // Enter count consecutive pages from va, all inside one page table. The
+    // frames come from frames[] when given, otherwise contiguously from pa.
+    // Nothing is written if any of the PTEs is already present.
+    int map_run(uint32_t va, uint32_t count, const uint32_t* frames, uint32_t pa, int perm) {
+        uint32_t* table = page_table(va, true);
+        if (!table) {
+            VM_LOG(ERROR) << "    [PGT] ERROR: No page table for 0x" << std::hex << va << std::dec << '\n';
+            return -1;
+        }
+        uint32_t first = PTX(va);
+        if (page_ops::pte_find(table + first, count, PTE_PRESENT, PTE_PRESENT) < count) {
+            VM_LOG(ERROR) << "    [PGT] ERROR: Remap attempted\n";
+            return -1;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t frame = frames ? frames[i] : pa + i * PAGE_SIZE;
+            table[first + i] = frame | perm | PTE_PRESENT;
+            VM_LOG(TRACE) << "    [PGT] mappages: Virtual 0x" << std::hex << va + i * PAGE_SIZE 
+                          << " → Physical 0x" << frame << std::dec << '\n';
+            VM_EVENT(MAP, va + i * PAGE_SIZE, frame);
+        }
+        return 0;
+    }
+    
+    // Replace a 4MB PDE with a page table of the same 1024 frames. False if
+    // no frame is free for the table; the 4MB entry then stays as it was.
+    bool split_large_page(uint32_t dir_index) {
+        uint32_t pde_addr = page_directory_phys + dir_index * 4;
+        uint32_t pde = phys_mem.read_uint32(pde_addr);
+        uint32_t page_table_phys = phys_mem.kalloc();
+        if (page_table_phys == 0) {
+            VM_LOG(ERROR) << "    [PGT] ERROR: No frame to split 4MB page at PDE " << dir_index << "\n";
+            return false;
+        }
+        uint32_t* table = reinterpret_cast<uint32_t*>(phys_mem.page_span(page_table_phys).data);
+        for (uint32_t i = 0; i < PTE_ENTRIES; i++) {
+            table[i] = (LARGE_PAGE_ADDR(pde) + i * PAGE_SIZE) | (pde & PAGE_MASK & ~PTE_PS);
+        }
+        phys_mem.write_uint32(pde_addr, page_table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER);
+        return true;
+    }
+    
+public:
+    
+    // Walk page directory to find/create page table entry. Inside a 4MB
+    // page the result is the equivalent 4KB PTE.
     uint32_t* walkpgdir(uint32_t virtual_addr, bool alloc) {
         uint32_t dir_index = PDX(virtual_addr);
         uint32_t table_index = PTX(virtual_addr);
@@ -233,6 +829,12 @@ public:
         uint32_t pde = phys_mem.read_uint32(pde_addr);
         
         uint32_t page_table_phys;
+        static uint32_t pte_storage;
+        
+        if ((pde & PTE_PRESENT) && (pde & PTE_PS)) {
+            pte_storage = (LARGE_PAGE_ADDR(pde) + table_index * PAGE_SIZE) | (pde & PAGE_MASK & ~PTE_PS);
+            return &pte_storage;
+        }
         
         if (!(pde & PTE_PRESENT)) {
             if (!alloc) {
@@ -241,8 +843,8 @@ public:
             
             // Allocate new page table
             page_table_phys = phys_mem.kalloc();
-            std::cout << "    [PGT] walkpgdir: Created page table at 0x" 
-                      << std::hex << page_table_phys << std::dec << std::endl;
+            VM_LOG(TRACE) << "    [PGT] walkpgdir: Created page table at 0x" 
+                          << std::hex << page_table_phys << std::dec << '\n';
             
             // Update page directory entry
             pde = page_table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER;
@@ -253,96 +855,215 @@ public:
         
         // Return address of page table entry
         uint32_t pte_addr = page_table_phys + table_index * 4;
-        static uint32_t pte_storage;
         pte_storage = phys_mem.read_uint32(pte_addr);
         return &pte_storage;
     }
     
-    // Map pages (used by allocuvm)
-    int mappages(uint32_t va, uint32_t size, uint32_t pa, int perm) {
+    // Map pages (used by allocuvm). With large set, every 4MB-aligned,
+    // 4MB-long stretch of va and pa gets one PTE_PS directory entry instead
+    // of a page table. Each page table is looked up once and filled in one pass.
+    int mappages(uint32_t va, uint32_t size, uint32_t pa, int perm, bool large = false) {
         uint32_t a = PGROUNDDOWN(va);
         uint32_t last = PGROUNDDOWN(va + size - 1);
         
         for (;;) {
-            uint32_t dir_index = PDX(a);
-            uint32_t table_index = PTX(a);
-            
-            // Get/create page table entry
-            uint32_t pde_addr = page_directory_phys + dir_index * 4;
+            uint32_t pde_addr = page_directory_phys + PDX(a) * 4;
             uint32_t pde = phys_mem.read_uint32(pde_addr);
             
-            uint32_t page_table_phys;
-            if (!(pde & PTE_PRESENT)) {
-                page_table_phys = phys_mem.kalloc();
-                pde = page_table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER;
-                phys_mem.write_uint32(pde_addr, pde);
-            } else {
-                page_table_phys = PTE_ADDR(pde);
-            }
-            
-            // Set page table entry
-            uint32_t pte_addr = page_table_phys + table_index * 4;
-            uint32_t pte = phys_mem.read_uint32(pte_addr);
-            
-            if (pte & PTE_PRESENT) {
-                std::cout << "    [PGT] ERROR: Remap attempted" << std::endl;
+            if (pde & PTE_PS) {
+                VM_LOG(ERROR) << "    [PGT] ERROR: Remap attempted inside a 4MB page\n";
                 return -1;
             }
+            if (large && !(pde & PTE_PRESENT) && ((a | pa) & (LARGE_PAGE_SIZE - 1)) == 0 &&
+                last - a >= LARGE_PAGE_SIZE - PAGE_SIZE) {
+                phys_mem.write_uint32(pde_addr, pa | perm | PTE_PS | PTE_PRESENT);
+                VM_LOG(TRACE) << "    [PGT] mappages: Virtual 0x" << std::hex << a 
+                              << " → 4MB page at physical 0x" << pa << std::dec << '\n';
+                VM_EVENT(MAP, a, pa);
+                if (last - a == LARGE_PAGE_SIZE - PAGE_SIZE)
+                    break;
+                a += LARGE_PAGE_SIZE;
+                pa += LARGE_PAGE_SIZE;
+                continue;
+            }
             
-            pte = pa | perm | PTE_PRESENT;
-            phys_mem.write_uint32(pte_addr, pte);
-            
-            std::cout << "    [PGT] mappages: Virtual 0x" << std::hex << a 
-                      << " → Physical 0x" << pa << std::dec << std::endl;
+            // The rest of the range inside this page table
+            uint32_t count = std::min(PTE_ENTRIES - PTX(a), (last - a) / PAGE_SIZE + 1);
+            if (map_run(a, count, nullptr, pa, perm) < 0)
+                return -1;
             
-            if (a == last)
+            if (last - a == (count - 1) * PAGE_SIZE)
                 break;
-                
-            a += PAGE_SIZE;
-            pa += PAGE_SIZE;
+            a += count * PAGE_SIZE;
+            pa += count * PAGE_SIZE;
         }
         return 0;
     }
     
-    // Allocate virtual memory (like allocuvm)
+    // Allocate virtual memory (like allocuvm). Works one 4MB chunk at a time:
+    // the chunk's frames come from a single kalloc_bulk() and are entered with
+    // a single page table walk.
     uint32_t allocuvm(uint32_t oldsz, uint32_t newsz) {
         if (newsz < oldsz)
             return oldsz;
             
-        std::cout << "\n[ALLOCUVM] Allocating virtual memory from 0x" << std::hex 
-                  << oldsz << " to 0x" << newsz << std::dec << std::endl;
+        VM_LOG(INFO) << "\n[ALLOCUVM] Allocating virtual memory from 0x" << std::hex 
+                     << oldsz << " to 0x" << newsz << std::dec << '\n';
         
-        uint32_t a = PGROUNDUP(oldsz);
-        for (; a < newsz; a += PAGE_SIZE) {
-            // Allocate physical page
-            uint32_t mem = phys_mem.kalloc();
-            if (mem == 0) {
-                std::cout << "  [ALLOCUVM] Out of memory!" << std::endl;
+        uint64_t end = PGROUNDUP((uint64_t)newsz);
+        uint32_t frames[PTE_ENTRIES];
+        uint64_t a = PGROUNDUP((uint64_t)oldsz);
+        while (a < end) {
+            uint64_t chunk_end = std::min<uint64_t>((a & ~(uint64_t)(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE, end);
+            
+            // A whole, still unmapped 4MB region gets one PTE_PS entry when a
+            // contiguous run is free; otherwise fall back to 4KB pages
+            if (huge_pages && chunk_end - a == LARGE_PAGE_SIZE &&
+                !(phys_mem.read_uint32(page_directory_phys + PDX(a) * 4) & PTE_PRESENT)) {
+                uint32_t mem = phys_mem.kalloc_large();
+                if (mem != 0 && mappages(a, LARGE_PAGE_SIZE, mem, PTE_WRITE | PTE_USER, true) == 0) {
+                    a = chunk_end;
+                    continue;
+                }
+                if (mem != 0) {
+                    phys_mem.kfree_large(mem);  // Not mapped: give the run back
+                }
+            }
+            
+            // Allocate the chunk's physical pages in one go
+            uint32_t count = (chunk_end - a) / PAGE_SIZE;
+            if (!phys_mem.kalloc_bulk(count, frames)) {
+                VM_LOG(ERROR) << "  [ALLOCUVM] Out of memory!\n";
+                deallocuvm(a, oldsz);
                 return 0;
             }
             
-            // Map virtual to physical
-            if (mappages(a, PAGE_SIZE, V2P(mem), PTE_WRITE | PTE_USER) < 0) {
-                phys_mem.kfree(mem);
+            // Map virtual to physical (kalloc() here already returns a physical
+            // address; xv6 returns a kernel virtual one, hence its V2P(mem))
+            if (map_run(a, count, frames, 0, PTE_WRITE | PTE_USER) < 0) {
+                phys_mem.kfree_bulk(frames, count);
+                deallocuvm(a, oldsz);
                 return 0;
             }
+            a = chunk_end;
+        }
+        
+        VM_LOG(INFO) << "[ALLOCUVM] Completed. New size: 0x" << std::hex 
+                     << newsz << std::dec << '\n';
+        return newsz;
+    }
+    
+    // Free user pages to shrink the process from oldsz to newsz (like
+    // deallocuvm), returns the new size, or oldsz if a 4MB page the range cuts
+    // cannot be split. Absent page tables are skipped whole, 4MB pages inside
+    // the range are freed whole, and page tables that end up covering nothing
+    // are freed too.
+    uint32_t deallocuvm(uint32_t oldsz, uint32_t newsz) {
+        if (newsz >= oldsz)
+            return oldsz;
+        
+        uint64_t end = PGROUNDUP((uint64_t)oldsz);
+        uint32_t frames[PTE_ENTRIES];
+        uint64_t a = PGROUNDUP((uint64_t)newsz);
+        
+        // A 4MB page the range only partly covers is split first, so that
+        // running out of frames for its page table leaves everything mapped
+        for (uint64_t edge : {a, end}) {
+            if (edge % LARGE_PAGE_SIZE == 0) continue;
+            uint32_t pde = phys_mem.read_uint32(page_directory_phys + PDX(edge) * 4);
+            if ((pde & PTE_PRESENT) && (pde & PTE_PS) && !split_large_page(PDX(edge))) {
+                VM_LOG(ERROR) << "  [DEALLOCUVM] Out of memory, nothing freed\n";
+                return oldsz;
+            }
+        }
+        
+        while (a < end) {
+            uint64_t chunk_start = a & ~(uint64_t)(LARGE_PAGE_SIZE - 1);
+            uint64_t chunk_end = std::min<uint64_t>(chunk_start + LARGE_PAGE_SIZE, end);
+            bool whole_chunk = a == chunk_start && chunk_end - a == LARGE_PAGE_SIZE;
+            uint32_t pde_addr = page_directory_phys + PDX(a) * 4;
+            uint32_t pde = phys_mem.read_uint32(pde_addr);
+            
+            if (!(pde & PTE_PRESENT)) {
+                a = chunk_start + LARGE_PAGE_SIZE;
+                continue;
+            }
+            if (pde & PTE_PS) {
+                // Partly covered ones were split above
+                phys_mem.kfree_large(LARGE_PAGE_ADDR(pde));
+                phys_mem.write_uint32(pde_addr, 0);
+                VM_EVENT(UNMAP, a, PTE_ENTRIES);
+                a = chunk_end;
+                continue;
+            }
+            
+            uint32_t* table = reinterpret_cast<uint32_t*>(phys_mem.page_span(PTE_ADDR(pde)).data);
+            uint32_t count = 0;
+            for (uint32_t i = PTX(a); i <= PTX(chunk_end - 1); i++) {
+                if (table[i] & PTE_PRESENT) {
+                    frames[count++] = PTE_ADDR(table[i]);
+                }
+                table[i] = 0;
+            }
+            phys_mem.kfree_bulk(frames, count);
+            VM_EVENT(UNMAP, a, count);
+            if (whole_chunk ||
+                page_ops::pte_find(table, PTE_ENTRIES, PTE_PRESENT, PTE_PRESENT) == PTE_ENTRIES) {
+                phys_mem.kfree(PTE_ADDR(pde));
+                phys_mem.write_uint32(pde_addr, 0);
+            }
+            a = chunk_end;
         }
         
-        std::cout << "[ALLOCUVM] Completed. New size: 0x" << std::hex 
-                  << newsz << std::dec << std::endl;
+        // Forget the lazy parts above newsz
+        for (auto it = lazy_segments.lower_bound(newsz); it != lazy_segments.end();) {
+            it = lazy_segments.erase(it);
+        }
+        if (!lazy_segments.empty()) {
+            auto last = std::prev(lazy_segments.end());
+            if (last->second.end > newsz) {
+                last->second.end = newsz;
+                last->second.filesz = std::min(last->second.filesz, newsz - last->first);
+            }
+        }
         return newsz;
     }
     
-    // Load data from disk into virtual memory (like loaduvm)
+    // Free the whole user address space, its page tables and the page
+    // directory (like freevm). The manager is unusable afterwards.
+    void freevm() {
+        if (page_directory_phys == 0)
+            return;
+        deallocuvm(KERNBASE, 0);
+        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
+            uint32_t pde = phys_mem.read_uint32(page_directory_phys + i * 4);
+            if ((pde & PTE_PRESENT) && !(pde & PTE_PS)) {
+                phys_mem.kfree(PTE_ADDR(pde));
+            }
+        }
+        phys_mem.kfree(page_directory_phys);
+        page_directory_phys = 0;
+        lazy_segments.clear();
+    }
+    
+    // Load data from disk into virtual memory (like loaduvm). The file is
+    // resolved once, and one scatter-gather read fills the target frames in
+    // place, with no bounce buffer.
     int loaduvm(uint32_t va, Disk& disk, const std::string& filename, 
                 uint32_t offset, uint32_t sz) {
-        std::cout << "\n[LOADUVM] Loading " << sz << " bytes from disk to virtual 0x" 
-                  << std::hex << va << std::dec << std::endl;
-        std::cout << "[LOADUVM] Reading from file '" << filename 
-                  << "' at offset " << offset << std::endl;
+        VM_LOG(INFO) << "\n[LOADUVM] Loading " << sz << " bytes from disk to virtual 0x" 
+                     << std::hex << va << std::dec << '\n';
+        VM_LOG(INFO) << "[LOADUVM] Reading from file '" << filename 
+                     << "' at offset " << offset << '\n';
+        
+        int inum = disk.namei(filename);
+        if (inum < 0) {
+            return -1;
+        }
         
         uint32_t i, pa, n;
-        uint8_t buffer[PAGE_SIZE];
+        std::vector<IoVec> iov;
+        iov.reserve((sz + PAGE_SIZE - 1) / PAGE_SIZE);
         
         for (i = 0; i < sz; i += PAGE_SIZE) {
             // Find page table entry for this virtual address
@@ -353,52 +1074,260 @@ public:
             uint32_t pde = phys_mem.read_uint32(pde_addr);
             
             if (!(pde & PTE_PRESENT)) {
-                std::cout << "  [LOADUVM] ERROR: Page table doesn't exist for VA 0x" 
-                          << std::hex << (va + i) << std::dec << std::endl;
+                VM_LOG(ERROR) << "  [LOADUVM] ERROR: Page table doesn't exist for VA 0x" 
+                              << std::hex << (va + i) << std::dec << '\n';
                 return -1;
             }
             
-            uint32_t page_table_phys = PTE_ADDR(pde);
-            uint32_t pte_addr = page_table_phys + table_index * 4;
-            uint32_t pte = phys_mem.read_uint32(pte_addr);
+            uint32_t pte;
+            if (pde & PTE_PS) {
+                // 4MB page: the frame comes straight from the directory entry
+                pte = (LARGE_PAGE_ADDR(pde) + table_index * PAGE_SIZE) | (pde & PAGE_MASK & ~PTE_PS);
+            } else {
+                uint32_t page_table_phys = PTE_ADDR(pde);
+                uint32_t pte_addr = page_table_phys + table_index * 4;
+                pte = phys_mem.read_uint32(pte_addr);
+            }
             
             if (!(pte & PTE_PRESENT)) {
-                std::cout << "  [LOADUVM] ERROR: Page not present for VA 0x" 
-                          << std::hex << (va + i) << std::dec << std::endl;
+                VM_LOG(ERROR) << "  [LOADUVM] ERROR: Page not present for VA 0x" 
+                              << std::hex << (va + i) << std::dec << '\n';
                 return -1;
             }
             
             // Get physical address from PTE
             pa = PTE_ADDR(pte);
-            std::cout << "  [LOADUVM] Virtual 0x" << std::hex << (va + i) 
-                      << " → Physical 0x" << pa << std::dec << std::endl;
+            VM_LOG(TRACE) << "  [LOADUVM] Virtual 0x" << std::hex << (va + i) 
+                          << " → Physical 0x" << pa << std::dec << '\n';
             
-            // Read from disk
+            // The frame's own storage is the read destination
             n = (sz - i < PAGE_SIZE) ? (sz - i) : PAGE_SIZE;
-            if (disk.read_file(filename, buffer, offset + i, n) != (int)n) {
-                std::cout << "  [LOADUVM] ERROR: Failed to read from disk" << std::endl;
+            PageSpan span = phys_mem.page_span(pa);
+            if (!span.data) {
+                VM_LOG(ERROR) << "  [LOADUVM] ERROR: Frame 0x" << std::hex << pa 
+                              << " is not allocated" << std::dec << '\n';
                 return -1;
             }
-            
-            // Write to physical memory
-            phys_mem.write_block(pa, buffer, n);
-            std::cout << "  [LOADUVM] Copied " << n << " bytes to physical 0x" 
-                      << std::hex << pa << std::dec << std::endl;
+            iov.push_back({span.data, n});
+        }
+        
+        // Read from disk straight into the frames
+        if (disk.readv(inum, offset, iov.data(), iov.size()) != (int)sz) {
+            VM_LOG(ERROR) << "  [LOADUVM] ERROR: Failed to read from disk\n";
+            return -1;
+        }
+        VM_LOG(TRACE) << "  [LOADUVM] Copied " << sz << " bytes into " << iov.size() << " frames\n";
+        
+        VM_LOG(INFO) << "[LOADUVM] Completed successfully\n";
+        return 0;
+    }
+    
+    // Lazy replacement for allocuvm + loaduvm on one segment: only record it.
+    // Pages of [va, va + memsz) are populated by handle_page_fault(); the
+    // first filesz bytes come from filename at offset, the rest is zero.
+    int lazyuvm(uint32_t va, uint32_t memsz, Disk& disk, const std::string& filename,
+                uint32_t offset, uint32_t filesz, int perm) {
+        int inum = disk.namei(filename);
+        if (inum < 0) {
+            return -1;
+        }
+        if (memsz < filesz || va + memsz < va) {
+            VM_LOG(ERROR) << "  [LAZY] ERROR: Bad segment at 0x" << std::hex << va << std::dec << '\n';
+            return -1;
+        }
+        auto next = lazy_segments.lower_bound(va);
+        if ((next != lazy_segments.end() && next->first < va + memsz) ||
+            (next != lazy_segments.begin() && std::prev(next)->second.end > va)) {
+            VM_LOG(ERROR) << "  [LAZY] ERROR: Segment at 0x" << std::hex << va 
+                          << " overlaps another" << std::dec << '\n';
+            return -1;
+        }
+        lazy_segments[va] = {va + memsz, &disk, inum, offset, filesz, perm};
+        VM_LOG(INFO) << "[LAZY] Recorded segment 0x" << std::hex << va << "-0x" << va + memsz 
+                     << std::dec << " (" << filesz << " bytes from '" << filename << "')\n";
+        return 0;
+    }
+    
+    // Populate the page holding va from the lazy segments that overlap it
+    // (two segments can share a boundary page). False if none does: a segfault.
+    bool handle_page_fault(uint32_t va) {
+        uint32_t page = PGROUNDDOWN(va);
+        uint64_t page_end = (uint64_t)page + PAGE_SIZE;
+        auto it = page_end > UINT32_MAX ? lazy_segments.end() 
+                                        : lazy_segments.lower_bound((uint32_t)page_end);
+        if (it == lazy_segments.begin() || std::prev(it)->second.end <= page) {
+            VM_LOG(ERROR) << "  [LAZY] Segfault at 0x" << std::hex << va << std::dec << '\n';
+            return false;
+        }
+        --it;
+        
+        uint32_t mem = phys_mem.kalloc();
+        if (mem == 0)
+            return false;
+        
+        // Read the file-backed bytes of each segment in this page directly
+        // into the frame; it is already zeroed, which takes care of BSS
+        int perm = 0;
+        bool from_file = false;
+        uint8_t* frame = phys_mem.page_span(mem).data;
+        for (;; --it) {
+            const LazySegment& seg = it->second;
+            if (seg.end <= page)
+                break;
+            perm |= seg.perm;
+            uint64_t lo = std::max<uint64_t>(page, it->first);
+            uint64_t hi = std::min<uint64_t>(page_end, (uint64_t)it->first + seg.filesz);
+            if (lo < hi) {
+                uint32_t n = hi - lo;
+                if (seg.disk->readi(seg.inum, frame + (lo - page), seg.offset + (lo - it->first), n) != (int)n) {
+                    phys_mem.kfree(mem);
+                    return false;
+                }
+                from_file = true;
+            }
+            if (it == lazy_segments.begin())
+                break;
         }
         
-        std::cout << "[LOADUVM] Completed successfully" << std::endl;
+        if (mappages(page, PAGE_SIZE, mem, perm) < 0) {
+            phys_mem.kfree(mem);
+            return false;
+        }
+        lazy_faults++;
+        (from_file ? lazy_file_pages : lazy_zero_pages)++;
+        VM_LOG(TRACE) << "  [LAZY] Fault at 0x" << std::hex << va << " → " 
+                      << (from_file ? "file" : "zero") << " page at physical 0x" << mem << std::dec << '\n';
+        return true;
+    }
+    
+    // Physical address of user va, faulting the page in if it is lazy.
+    // 0 when va is not part of the address space.
+    uint32_t uva2pa(uint32_t va) {
+        uint32_t* pte = walkpgdir(va, false);
+        if (!pte || !(*pte & PTE_PRESENT)) {
+            if (!handle_page_fault(va))
+                return 0;
+            pte = walkpgdir(va, false);
+        }
+        return PTE_ADDR(*pte) | PG_OFFSET(va);
+    }
+    
+    // Copy n bytes from user va, faulting pages in as needed (like copyin)
+    int copyin(uint8_t* dst, uint32_t va, uint32_t n) {
+        while (n > 0) {
+            uint32_t pa = uva2pa(va);
+            if (pa == 0)
+                return -1;
+            uint32_t chunk = std::min(n, PAGE_SIZE - PG_OFFSET(va));
+            phys_mem.read_block(pa, dst, chunk);
+            dst += chunk;
+            va += chunk;
+            n -= chunk;
+        }
         return 0;
     }
+    
+    void print_lazy_stats() const {
+        std::cout << "Lazy segments: " << lazy_segments.size() << ", faults: " << lazy_faults 
+                  << " (" << lazy_file_pages << " read from disk, " << lazy_zero_pages 
+                  << " zero-filled)" << std::endl;
+    }
 };
 
+// ==================== EXEC ====================
+// exec()'s segment loop. Eager runs allocuvm + loaduvm for every LOAD header;
+// lazy only records each one with lazyuvm(). Returns the new size, 0 on error.
+uint32_t exec_segments(PageTableManager& page_mgr, Disk& disk, const std::string& path, bool lazy) {
+    elfhdr elf;
+    if (disk.read_file(path, (uint8_t*)&elf, 0, sizeof(elf)) < 0 || elf.magic != ELF_MAGIC)
+        return 0;
+    
+    uint32_t sz = 0;
+    for (uint32_t i = 0; i < elf.phnum; i++) {
+        proghdr ph;
+        if (disk.read_file(path, (uint8_t*)&ph, elf.phoff + i * sizeof(ph), sizeof(ph)) < 0)
+            return 0;
+        if (ph.type != ELF_PROG_LOAD)
+            continue;
+        if (ph.memsz < ph.filesz)
+            return 0;
+        
+        if (lazy) {
+            int perm = PTE_USER | ((ph.flags & 0x2) ? PTE_WRITE : 0);
+            if (page_mgr.lazyuvm(ph.vaddr, ph.memsz, disk, path, ph.off, ph.filesz, perm) < 0)
+                return 0;
+            sz = std::max(sz, ph.vaddr + ph.memsz);
+        } else {
+            if ((sz = page_mgr.allocuvm(sz, ph.vaddr + ph.memsz)) == 0)
+                return 0;
+            if (page_mgr.loaduvm(ph.vaddr, disk, path, ph.off, ph.filesz) < 0)
+                return 0;
+        }
+    }
+    return sz;
+}
+
+// ==================== BENCHMARKS ====================
+// allocvm_and_loadvm_sim --bench [filter] [--json] [--min-time s], see bench.h
+void register_benchmarks(BenchRunner& runner) {
+    const uint32_t region = 256 * 1024 * 1024;
+    
+    // Page table construction alone for a 256MB region (the physical range is
+    // outside RAM, so no frames are touched), with 4KB PTEs or 4MB PDEs
+    for (bool large : {false, true}) {
+        runner.add(large ? "mappages/256MB/4mb_pages" : "mappages/256MB/4kb_pages", [=](BenchState& state) {
+            PhysicalMemory ram(16 * 1024 * 1024);
+            while (state.keep_running()) {
+                state.pause_timing();
+                PageTableManager page_mgr(ram);
+                state.resume_timing();
+                page_mgr.mappages(0, region, 0x40000000, PTE_WRITE | PTE_USER, large);
+                state.pause_timing();
+                page_mgr.freevm();
+                state.resume_timing();
+            }
+            state.bytes_processed = state.iterations() * region;
+        });
+    }
+    
+    // Growing a 64MB heap, including zeroing the frames, in 4KB or 4MB pages:
+    // allocuvm alone, and followed by the deallocuvm + freevm teardown
+    const uint32_t heap = 64 * 1024 * 1024;
+    for (bool large : {false, true}) {
+        for (bool teardown : {false, true}) {
+            std::string name = std::string(teardown ? "allocuvm+freevm" : "allocuvm") 
+                             + "/64MB" + (large ? "/4mb_pages" : "/4kb_pages");
+            runner.add(name, [=](BenchState& state) {
+                PhysicalMemory ram(heap + 4 * 1024 * 1024);
+                while (state.keep_running()) {
+                    PageTableManager page_mgr(ram);
+                    page_mgr.set_huge_pages(large);
+                    page_mgr.allocuvm(0, heap);
+                    if (!teardown) state.pause_timing();
+                    page_mgr.deallocuvm(heap, 0);
+                    page_mgr.freevm();
+                    if (!teardown) state.resume_timing();
+                }
+                state.bytes_processed = state.iterations() * heap;
+            });
+        }
+    }
+}
+
 // ==================== MAIN SIMULATION ====================
-int main() {
+int main(int argc, char** argv) {
+    if (argc >= 2 && std::string(argv[1]) == "--bench") {
+        BenchRunner runner;
+        register_benchmarks(runner);
+        return runner.main(argc, argv, 2);
+    }
+    
     std::cout << "=== Program Loading Simulation: Disk → RAM ===" << std::endl;
     std::cout << "Page size: " << PAGE_SIZE << " bytes\n" << std::endl;
     
     // Create disk and RAM
     Disk disk;
-    PhysicalMemory ram;
+    PhysicalMemory ram(256 * 1024 * 1024);  // 256MB flat frame pool
     PageTableManager page_mgr(ram);
     
     // ========== CREATE PROGRAM FILE ON DISK ==========
@@ -459,7 +1388,7 @@ int main() {
     std::cout << "\n=== Step 2: Load Program (exec system call) ===" << std::endl;
     
     // Read ELF header
-    uint8_t header_buf[sizeof(elfhdr)];
+    uint8_t header_buf[sizeof(elfhdr)] = {};
     disk.read_file("/bin/myprogram", header_buf, 0, sizeof(elfhdr));
     elfhdr* elf_ptr = (elfhdr*)header_buf;
     
@@ -470,7 +1399,7 @@ int main() {
     // Process each program header
     uint32_t sz = 0;
     for (uint32_t i = 0; i < elf_ptr->phnum; i++) {
-        uint8_t ph_buf[sizeof(proghdr)];
+        uint8_t ph_buf[sizeof(proghdr)] = {};
         disk.read_file("/bin/myprogram", ph_buf, 
                       elf_ptr->phoff + i * sizeof(proghdr), sizeof(proghdr));
         proghdr* ph = (proghdr*)ph_buf;
@@ -502,21 +1431,83 @@ int main() {
     // ========== VERIFY LOADED PROGRAM ==========
     std::cout << "\n=== Step 3: Verify Program Loaded Correctly ===" << std::endl;
     
-    // Show some loaded code
+    // Show some loaded code (look up the frames backing each segment)
+    uint32_t* code_pte = page_mgr.walkpgdir(0x08048000, false);
+    uint32_t code_pa = code_pte ? PTE_ADDR(*code_pte) : 0;
     std::cout << "\nCode segment at virtual 0x08048000:" << std::endl;
-    ram.print_page_contents(0x100000, 64);  // Physical address of first page
+    ram.print_page_contents(code_pa, 64);
     
+    uint32_t* data_pte = page_mgr.walkpgdir(0x08049000, false);
+    uint32_t data_pa = data_pte ? PTE_ADDR(*data_pte) : 0;
     std::cout << "\nData segment at virtual 0x08049000:" << std::endl;
-    ram.print_page_contents(0x101000, 64);  // Physical address of second page
+    ram.print_page_contents(data_pa, 64);
     
     // Show RAM statistics
     ram.print_stats();
     
+    // ========== TEAR DOWN (SIMULATING EXIT) ==========
+    std::cout << "\n=== Step 4: Process Exit (freevm) ===" << std::endl;
+    page_mgr.freevm();
+    std::cout << "Pages still allocated: " << ram.allocated_pages() << std::endl;
+    
+    // ========== LAZY EXEC OF A LARGE BINARY ==========
+    std::cout << "\n=== Step 5: Eager vs Lazy exec of a Large Binary ===" << std::endl;
+    
+    // 8MB of code, 2MB of data and 16MB of BSS; the run touches ~1% of the code
+    const uint32_t big_code = 8 * 1024 * 1024;
+    const uint32_t big_data = 2 * 1024 * 1024;
+    const uint32_t big_bss = 16 * 1024 * 1024;
+    
+    elfhdr big_elf = {ELF_MAGIC, 0, sizeof(elfhdr), 2};
+    proghdr big_text = {ELF_PROG_LOAD, PAGE_SIZE, 0, 0, big_code, big_code, 0x5, PAGE_SIZE};
+    proghdr big_rw = {ELF_PROG_LOAD, PAGE_SIZE + big_code, big_code, 0, 
+                      big_data, big_data + big_bss, 0x6, PAGE_SIZE};
+    std::vector<uint8_t> big_file(PAGE_SIZE + big_code + big_data);
+    std::memcpy(big_file.data(), &big_elf, sizeof(big_elf));
+    std::memcpy(big_file.data() + sizeof(big_elf), &big_text, sizeof(big_text));
+    std::memcpy(big_file.data() + sizeof(big_elf) + sizeof(big_text), &big_rw, sizeof(big_rw));
+    for (size_t i = PAGE_SIZE; i < big_file.size(); i++) {
+        big_file[i] = (uint8_t)(i * 31 + (i >> 12));
+    }
+    disk.create_file("/bin/bigprogram", big_file);
+    
+    for (bool lazy : {false, true}) {
+        std::cout.setstate(std::ios::failbit);
+        PhysicalMemory big_ram(64 * 1024 * 1024);
+        PageTableManager big_mgr(big_ram);
+        
+        auto start = std::chrono::steady_clock::now();
+        uint32_t big_sz = exec_segments(big_mgr, disk, "/bin/bigprogram", lazy);
+        auto exec_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        size_t exec_pages = big_ram.allocated_pages();
+        
+        // Run: every 128th code page, the start of the data, a few BSS pages
+        bool ok = big_sz != 0;
+        uint8_t byte;
+        for (uint32_t va = 0; va < big_code + big_data; va += (va < big_code ? 128 : 64) * PAGE_SIZE) {
+            ok = ok && big_mgr.copyin(&byte, va + 7, 1) == 0 && byte == big_file[PAGE_SIZE + va + 7];
+        }
+        for (uint32_t va = big_code + big_data; va < big_sz; va += 4 * 1024 * 1024) {
+            ok = ok && big_mgr.copyin(&byte, va, 1) == 0 && byte == 0;
+        }
+        std::cout.clear();
+        
+        std::cout << (lazy ? "Lazy:  " : "Eager: ") << "exec " << exec_us << " us, "
+                  << exec_pages << " pages after exec, " << big_ram.allocated_pages() 
+                  << " after run, contents " << (ok ? "OK" : "WRONG") << std::endl;
+        if (lazy) {
+            big_mgr.print_lazy_stats();
+        }
+    }
+    
     std::cout << "\n=== Summary ===" << std::endl;
     std::cout << "1. Created program file on DISK with code and data" << std::endl;
     std::cout << "2. allocuvm() allocated RAM pages and created page table mappings" << std::endl;
     std::cout << "3. loaduvm() copied data from DISK to RAM using page tables" << std::endl;
     std::cout << "4. Program is now loaded in RAM and ready to execute!" << std::endl;
+    std::cout << "5. freevm() returned every page, one page table walk per 4MB" << std::endl;
+    std::cout << "6. Lazy exec only records segments; pages are read or zero-filled on first touch" << std::endl;
     
     return 0;
 }
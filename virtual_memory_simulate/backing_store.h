@@ -0,0 +1,188 @@
+#pragma once
+
+// Storage for the simulated disk and swap devices, and the extent table that
+// maps a simulated file's pages onto disk blocks.
+//
+// BackingStore maps a real image file with mmap(2) (MAP_SHARED, so the host
+// kernel pages it in and out and the image survives the run) or, without a
+// path, an anonymous mapping. Either way a multi-GB device only costs the
+// pages actually touched, not process heap.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+class BackingStore {
+private:
+    char* base;
+    size_t bytes;
+    int fd;                 // -1 for anonymous memory
+    std::string path;
+
+    bool map_anonymous() {
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            std::cout << "BackingStore: cannot map " << bytes << " anonymous bytes: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        base = static_cast<char*>(p);
+        return true;
+    }
+
+    bool map_file() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cout << "BackingStore: cannot open '" << path << "': " << std::strerror(errno) << "\n";
+            return false;
+        }
+        struct stat st;
+        // Grow (sparsely) to the device size; a larger existing image is kept as is
+        if (::fstat(fd, &st) != 0 || ((size_t)st.st_size < bytes && ::ftruncate(fd, bytes) != 0)) {
+            std::cout << "BackingStore: cannot size '" << path << "': " << std::strerror(errno) << "\n";
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            std::cout << "BackingStore: cannot map '" << path << "': " << std::strerror(errno) << "\n";
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        base = static_cast<char*>(p);
+        return true;
+    }
+
+public:
+    // An unusable image file falls back to anonymous memory of the same size
+    explicit BackingStore(size_t size, const std::string& file = "")
+        : base(nullptr), bytes(size), fd(-1), path(file) {
+        if (bytes == 0) return;
+        if (!path.empty() && map_file()) return;
+        if (!path.empty()) {
+            std::cout << "BackingStore: falling back to anonymous memory\n";
+            path.clear();
+        }
+        if (!map_anonymous()) {
+            bytes = 0;
+        }
+    }
+
+    ~BackingStore() {
+        if (base) ::munmap(base, bytes);
+        if (fd >= 0) ::close(fd);
+    }
+
+    BackingStore(const BackingStore&) = delete;
+    BackingStore& operator=(const BackingStore&) = delete;
+
+    char* data() { return base; }
+    const char* data() const { return base; }
+    size_t size() const { return bytes; }
+    bool is_file() const { return fd >= 0; }
+    const std::string& file_path() const { return path; }
+
+    // Push dirty pages of a file image to the host file
+    void sync() {
+        if (base && fd >= 0) ::msync(base, bytes, MS_SYNC);
+    }
+};
+
+// A run of file pages stored on consecutive disk pages
+struct Extent {
+    uint64_t file_page;     // First page within the file
+    uint32_t disk_page;     // First disk page holding it
+    uint32_t pages;
+};
+
+// Simulated files: name -> fd, and per fd a sorted list of extents. fds start
+// at 3 like a process's first open file. Lookups are binary searches, so
+// large fragmented files stay cheap to resolve.
+class FileExtentTable {
+public:
+    static const int FIRST_FD = 3;
+    static const uint32_t NO_BLOCK = UINT32_MAX;
+
+private:
+    struct File {
+        std::string name;
+        uint64_t size;              // Bytes
+        std::vector<Extent> extents;
+    };
+    std::vector<File> files;        // Index fd - FIRST_FD
+
+    File* get(int fd) {
+        if (fd < FIRST_FD || (size_t)(fd - FIRST_FD) >= files.size()) return nullptr;
+        return &files[fd - FIRST_FD];
+    }
+    const File* get(int fd) const {
+        return const_cast<FileExtentTable*>(this)->get(fd);
+    }
+
+public:
+    // Existing fd for name, or -1
+    int lookup(const std::string& name) const {
+        for (size_t i = 0; i < files.size(); i++) {
+            if (files[i].name == name) return FIRST_FD + (int)i;
+        }
+        return -1;
+    }
+
+    int create(const std::string& name) {
+        int fd = lookup(name);
+        if (fd >= 0) return fd;
+        files.push_back(File{name, 0, {}});
+        return FIRST_FD + (int)files.size() - 1;
+    }
+
+    bool is_valid(int fd) const { return get(fd) != nullptr; }
+    uint64_t file_size(int fd) const { const File* f = get(fd); return f ? f->size : 0; }
+    const std::string& name_of(int fd) const { return get(fd)->name; }
+
+    void set_size(int fd, uint64_t size) {
+        if (File* f = get(fd)) f->size = size;
+    }
+
+    // Append an extent; merges with the last one when both runs continue
+    void add_extent(int fd, uint64_t file_page, uint32_t disk_page, uint32_t pages) {
+        File* f = get(fd);
+        if (!f || pages == 0) return;
+        if (!f->extents.empty()) {
+            Extent& last = f->extents.back();
+            if (last.file_page + last.pages == file_page && last.disk_page + last.pages == disk_page) {
+                last.pages += pages;
+                return;
+            }
+        }
+        f->extents.push_back(Extent{file_page, disk_page, pages});
+        std::sort(f->extents.begin(), f->extents.end(),
+                  [](const Extent& a, const Extent& b) { return a.file_page < b.file_page; });
+    }
+
+    // Disk page holding file_page, or NO_BLOCK (a hole or past the end). run
+    // is set to how many following file pages continue on consecutive blocks.
+    uint32_t resolve(int fd, uint64_t file_page, uint64_t* run = nullptr) const {
+        const File* f = get(fd);
+        if (!f) return NO_BLOCK;
+        auto it = std::upper_bound(f->extents.begin(), f->extents.end(), file_page,
+                                   [](uint64_t page, const Extent& e) { return page < e.file_page; });
+        if (it == f->extents.begin()) return NO_BLOCK;
+        --it;
+        if (file_page >= it->file_page + it->pages) return NO_BLOCK;
+        uint64_t skip = file_page - it->file_page;
+        if (run) *run = it->pages - skip;
+        return it->disk_page + (uint32_t)skip;
+    }
+
+    size_t extent_count(int fd) const { const File* f = get(fd); return f ? f->extents.size() : 0; }
+    size_t size() const { return files.size(); }
+};
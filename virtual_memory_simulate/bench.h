@@ -0,0 +1,242 @@
+#pragma once
+
+// Microbenchmarks for the simulators' --bench modes, in the style of Google
+// Benchmark. A benchmark is a function that does its setup, then loops
+//
+//     while (state.keep_running()) { ... }
+//
+// The runner calls it with a growing iteration count until one run lasts at
+// least min_time, and reports the time per iteration of that run. Work that
+// should not be measured goes between pause_timing() / resume_timing().
+//
+// Results print as a table, or with --json in Google Benchmark's JSON layout
+// (context + benchmarks), so tools written for it, e.g. compare.py, can diff
+// two releases. std::cout is muted while a benchmark runs, but VM_LOG
+// messages are still formatted: build with -DVM_LOG_LEVEL=0 for numbers
+// worth comparing. The level is recorded in the JSON context, and so is the
+// vector ISA the page_ops.h kernels were built for.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "vm_trace.h"
+#include "page_ops.h"
+
+class BenchState {
+private:
+    using clock = std::chrono::steady_clock;
+
+    uint64_t max_iterations;
+    uint64_t done;
+    bool running;
+    clock::time_point start;
+    std::clock_t cpu_start;
+    double real_ns;
+    double cpu_ns;
+
+    void stop() {
+        real_ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        cpu_ns += (std::clock() - cpu_start) * 1e9 / CLOCKS_PER_SEC;
+        running = false;
+    }
+
+public:
+    uint64_t items_processed;
+    uint64_t bytes_processed;
+    std::map<std::string, double> counters;     // Reported as set, e.g. "evictions"
+
+    explicit BenchState(uint64_t iterations)
+        : max_iterations(iterations), done(0), running(false),
+          real_ns(0), cpu_ns(0), items_processed(0), bytes_processed(0) {}
+
+    // True once per iteration; the clock starts on the first call
+    bool keep_running() {
+        if (done == 0 && !running) {
+            resume_timing();
+        }
+        if (done < max_iterations) {
+            done++;
+            return true;
+        }
+        if (running) {
+            stop();
+        }
+        return false;
+    }
+
+    void pause_timing() {
+        if (running) {
+            stop();
+        }
+    }
+
+    void resume_timing() {
+        start = clock::now();
+        cpu_start = std::clock();
+        running = true;
+    }
+
+    uint64_t iterations() const { return max_iterations; }
+    double elapsed_ns() const { return real_ns; }
+    double cpu_elapsed_ns() const { return cpu_ns; }
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double real_ns;         // Per iteration
+    double cpu_ns;
+    double items_per_second;
+    double bytes_per_second;
+    std::map<std::string, double> counters;
+};
+
+class BenchRunner {
+private:
+    std::vector<std::pair<std::string, std::function<void(BenchState&)>>> benchmarks;
+    double min_time_s;
+
+    static std::string json_escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    BenchResult run_one(const std::string& name, const std::function<void(BenchState&)>& fn) {
+        uint64_t iterations = 1;
+        for (;;) {
+            BenchState state(iterations);
+            std::cout.setstate(std::ios::failbit);
+            fn(state);
+            std::cout.clear();
+
+            double seconds = state.elapsed_ns() / 1e9;
+            if (seconds >= min_time_s || iterations >= 1000000000) {
+                BenchResult r;
+                r.name = name;
+                r.iterations = iterations;
+                r.real_ns = state.elapsed_ns() / iterations;
+                r.cpu_ns = state.cpu_elapsed_ns() / iterations;
+                r.items_per_second = seconds > 0 ? state.items_processed / seconds : 0;
+                r.bytes_per_second = seconds > 0 ? state.bytes_processed / seconds : 0;
+                r.counters = state.counters;
+                return r;
+            }
+            // Aim 40% past min_time, but grow at most 10x per attempt
+            double per_iteration = seconds / iterations;
+            uint64_t next = per_iteration > 0 ? (uint64_t)(min_time_s * 1.4 / per_iteration) : iterations * 10;
+            iterations = std::max(iterations + 1, std::min(next, iterations * 10));
+        }
+    }
+
+public:
+    BenchRunner() : min_time_s(0.2) {}
+
+    void add(const std::string& name, std::function<void(BenchState&)> fn) {
+        benchmarks.emplace_back(name, std::move(fn));
+    }
+
+    void set_min_time(double seconds) { min_time_s = seconds; }
+
+    // Run every benchmark whose name contains filter (all for "")
+    std::vector<BenchResult> run(const std::string& filter) {
+        std::vector<BenchResult> results;
+        for (const auto& b : benchmarks) {
+            if (b.first.find(filter) != std::string::npos) {
+                results.push_back(run_one(b.first, b.second));
+            }
+        }
+        return results;
+    }
+
+    static void print_table(const std::vector<BenchResult>& results, std::ostream& out) {
+        out << std::left << std::setw(40) << "Benchmark" << std::right << std::setw(14) << "Time (ns)"
+            << std::setw(14) << "CPU (ns)" << std::setw(12) << "Iterations" << "  Counters\n";
+        out << std::string(100, '-') << "\n";
+        for (const BenchResult& r : results) {
+            out << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(1)
+                << std::setw(14) << r.real_ns << std::setw(14) << r.cpu_ns << std::setw(12) << r.iterations;
+            out.unsetf(std::ios::fixed);
+            out << std::setprecision(4);
+            if (r.items_per_second > 0) out << "  items/s=" << r.items_per_second;
+            if (r.bytes_per_second > 0) out << "  bytes/s=" << r.bytes_per_second;
+            for (const auto& c : r.counters) out << "  " << c.first << "=" << c.second;
+            out << std::setprecision(6) << "\n";
+        }
+    }
+
+    static void print_json(const std::vector<BenchResult>& results, const std::string& executable,
+                           std::ostream& out) {
+        char date[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        out << "{\n  \"context\": {\n"
+            << "    \"date\": \"" << date << "\",\n"
+            << "    \"executable\": \"" << json_escape(executable) << "\",\n"
+            << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+            << "    \"library_build_type\": \"release\",\n"
+#else
+            << "    \"library_build_type\": \"debug\",\n"
+#endif
+            << "    \"vm_log_level\": " << VM_LOG_LEVEL << ",\n"
+            << "    \"vm_simd\": \"" << page_ops::isa() << "\"\n"
+            << "  },\n  \"benchmarks\": [";
+        out << std::setprecision(10);
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            out << (i ? "," : "") << "\n    {\n"
+                << "      \"name\": \"" << json_escape(r.name) << "\",\n"
+                << "      \"run_name\": \"" << json_escape(r.name) << "\",\n"
+                << "      \"run_type\": \"iteration\",\n"
+                << "      \"repetitions\": 1,\n"
+                << "      \"iterations\": " << r.iterations << ",\n"
+                << "      \"real_time\": " << r.real_ns << ",\n"
+                << "      \"cpu_time\": " << r.cpu_ns << ",\n"
+                << "      \"time_unit\": \"ns\"";
+            if (r.items_per_second > 0) out << ",\n      \"items_per_second\": " << r.items_per_second;
+            if (r.bytes_per_second > 0) out << ",\n      \"bytes_per_second\": " << r.bytes_per_second;
+            for (const auto& c : r.counters) {
+                out << ",\n      \"" << json_escape(c.first) << "\": " << c.second;
+            }
+            out << "\n    }";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Command line after --bench: [filter] [--json] [--min-time <seconds>]
+    int main(int argc, char** argv, int first) {
+        std::string filter;
+        bool json = false;
+        for (int i = first; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--json") {
+                json = true;
+            } else if (arg == "--min-time" && i + 1 < argc) {
+                min_time_s = std::strtod(argv[++i], nullptr);
+            } else {
+                filter = arg;
+            }
+        }
+        std::vector<BenchResult> results = run(filter);
+        if (json) {
+            print_json(results, argv[0], std::cout);
+        } else {
+            print_table(results, std::cout);
+        }
+        return results.empty() ? 1 : 0;
+    }
+};
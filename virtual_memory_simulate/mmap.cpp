@@ -1,54 +1,119 @@
 #include <iostream>
 #include <vector>
-#include <unordered_map>
 #include <fstream>
 #include <cstring>
 #include <cassert>
 #include <cstdint>  // For uintptr_t
+#include <cstdlib>
+#include <map>
+#include <limits>
+#include "address_space.h"
+#include "vm_trace.h"
+#include "page_ops.h"
+#include "radix_page_table.h"
+#include "backing_store.h"
+#include "readahead.h"
+#include "vma_tree.h"
+#include "bench.h"
+
+// Page size and page table shape (address_space.h), x86 two-level by default
+#ifndef VM_ADDRESS_SPACE
+#define VM_ADDRESS_SPACE X86_32
+#endif
+using Geometry = VM_ADDRESS_SPACE;
+
 // Configuration constants
-const size_t PAGE_SIZE = 4096;
-const size_t RAM_SIZE = 16 * PAGE_SIZE;  // 64KB RAM
-const size_t DISK_SIZE = 64 * PAGE_SIZE; // 256KB Disk
-const size_t VIRTUAL_ADDR_SPACE = 32 * PAGE_SIZE; // 128KB virtual space
+const size_t PAGE_SIZE = Geometry::PAGE_SIZE;
+const size_t DISK_SIZE = 64 * PAGE_SIZE; // 256KB Disk (default; see Disk)
 
 // Page frame number type
-using pfn_t = uint32_t;
-using vpn_t = uint32_t;  // Virtual page number
+using pfn_t = Geometry::pfn_t;
+using vpn_t = Geometry::vpn_t;  // Virtual page number
 
+const uintptr_t MMAP_BASE = 0x10000000;   // mmap places mappings from here up
+const vpn_t INVALID_VPN = std::numeric_limits<vpn_t>::max();
+const uint64_t VPN_LIMIT = std::min<uint64_t>(uint64_t(1) << Geometry::VPN_BITS, INVALID_VPN);   // Pages mmap can use
+
+// Simulated disk: a BackingStore (anonymous memory or an mmap'd image file)
+// plus an extent table for the files written to it. Blocks are handed out
+// in order, so each write_file call adds at most one extent.
 class Disk {
 private:
-    std::vector<char> storage;
+    BackingStore storage;
+    FileExtentTable files;
+    uint32_t next_free_page;
     
 public:
-    Disk() : storage(DISK_SIZE, 0) {
-        std::cout << "Disk initialized: " << DISK_SIZE << " bytes\n";
+    explicit Disk(size_t bytes = DISK_SIZE, const std::string& image = "") 
+        : storage(bytes, image), next_free_page(0) {
+        std::cout << "Disk initialized: " << storage.size() << " bytes";
+        if (storage.is_file()) std::cout << " (image '" << storage.file_path() << "')";
+        std::cout << "\n";
     }
     
+    size_t num_pages() const { return storage.size() / PAGE_SIZE; }
+    
     void read_page(pfn_t page_num, char* buffer) {
-        size_t offset = page_num * PAGE_SIZE;
-        if (offset + PAGE_SIZE <= DISK_SIZE) {
-            std::memcpy(buffer, &storage[offset], PAGE_SIZE);
-            std::cout << "Disk read: page " << page_num << "\n";
+        if (page_num < num_pages()) {
+            std::memcpy(buffer, storage.data() + (size_t)page_num * PAGE_SIZE, PAGE_SIZE);
+            VM_LOG(INFO) << "Disk read: page " << page_num << "\n";
+            VM_EVENT(DISK_READ, page_num, PAGE_SIZE);
+        }
+    }
+    
+    // One read for a run of adjacent disk pages (buffer holds count pages)
+    void read_pages(pfn_t first, size_t count, char* buffer) {
+        if (first + count <= num_pages()) {
+            std::memcpy(buffer, storage.data() + (size_t)first * PAGE_SIZE, count * PAGE_SIZE);
+            VM_LOG(INFO) << "Disk read: pages " << first << "-" << (first + count - 1) << "\n";
+            VM_EVENT(DISK_READ, first, count * PAGE_SIZE);
         }
     }
     
     void write_page(pfn_t page_num, const char* buffer) {
-        size_t offset = page_num * PAGE_SIZE;
-        if (offset + PAGE_SIZE <= DISK_SIZE) {
-            std::memcpy(&storage[offset], buffer, PAGE_SIZE);
-            std::cout << "Disk write: page " << page_num << "\n";
+        if (page_num < num_pages()) {
+            std::memcpy(storage.data() + (size_t)page_num * PAGE_SIZE, buffer, PAGE_SIZE);
+            VM_LOG(INFO) << "Disk write: page " << page_num << "\n";
+            VM_EVENT(DISK_WRITE, page_num, PAGE_SIZE);
         }
     }
     
-    // Simulate file operations
-    void write_file(const std::string& filename, const char* data, size_t size) {
-        // Simplified: write to beginning of disk
+    // Simulate file operations: (re)write a file, allocating blocks for any
+    // pages it does not have yet. Returns its fd, or -1 if the disk is full.
+    int write_file(const std::string& filename, const char* data, size_t size) {
+        int fd = files.create(filename);
         size_t pages_needed = (size + PAGE_SIZE - 1) / PAGE_SIZE;
-        for (size_t i = 0; i < pages_needed && i * PAGE_SIZE < DISK_SIZE; i++) {
-            size_t copy_size = std::min(PAGE_SIZE, size - i * PAGE_SIZE);
-            std::memcpy(&storage[i * PAGE_SIZE], data + i * PAGE_SIZE, copy_size);
+        for (size_t i = 0; i < pages_needed; ) {
+            uint64_t run = 0;
+            uint32_t block = files.resolve(fd, i, &run);
+            if (block == FileExtentTable::NO_BLOCK) {
+                run = pages_needed - i;
+                if (next_free_page + run > num_pages()) {
+                    std::cout << "Disk full: cannot store '" << filename << "'\n";
+                    return -1;
+                }
+                block = next_free_page;
+                files.add_extent(fd, i, block, run);
+                next_free_page += run;
+            }
+            run = std::min<uint64_t>(run, pages_needed - i);
+            for (size_t k = 0; k < run; k++, i++) {
+                char* dst = storage.data() + (size_t)(block + k) * PAGE_SIZE;
+                size_t copy_size = std::min(PAGE_SIZE, size - i * PAGE_SIZE);
+                std::memcpy(dst, data + i * PAGE_SIZE, copy_size);
+                std::memset(dst + copy_size, 0, PAGE_SIZE - copy_size);
+            }
         }
+        files.set_size(fd, size);
         std::cout << "File '" << filename << "' written to disk (" << size << " bytes)\n";
+        return fd;
+    }
+    
+    bool is_file(int fd) const { return files.is_valid(fd); }
+    
+    // Disk page backing a page of an open file (see FileExtentTable::resolve)
+    uint32_t resolve(int fd, uint64_t file_page, uint64_t* run = nullptr) const {
+        return files.resolve(fd, file_page, run);
     }
 };
 
@@ -58,16 +123,21 @@ private:
     std::vector<bool> allocated;
     
 public:
-    RAM() : memory(RAM_SIZE, 0), allocated(RAM_SIZE / PAGE_SIZE, false) {
-        std::cout << "RAM initialized: " << RAM_SIZE << " bytes (" 
-                  << RAM_SIZE / PAGE_SIZE << " pages)\n";
+    // bytes is rounded down to whole frames, at least one; 16 frames by default
+    explicit RAM(size_t bytes = 16 * PAGE_SIZE) 
+        : memory(std::max<size_t>(1, bytes / PAGE_SIZE) * PAGE_SIZE, 0), allocated(memory.size() / PAGE_SIZE, false) {
+        std::cout << "RAM initialized: " << memory.size() << " bytes (" 
+                  << total_frames() << " pages)\n";
     }
     
+    size_t total_frames() const { return allocated.size(); }
+    
     pfn_t allocate_page() {
         for (size_t i = 0; i < allocated.size(); i++) {
             if (!allocated[i]) {
                 allocated[i] = true;
-                std::cout << "RAM allocated: physical page " << i << "\n";
+                VM_LOG(INFO) << "RAM allocated: physical page " << i << "\n";
+                VM_EVENT(FRAME_ALLOC, i, 0);
                 return i;
             }
         }
@@ -77,7 +147,8 @@ public:
     void free_page(pfn_t page_num) {
         if (page_num < allocated.size()) {
             allocated[page_num] = false;
-            std::cout << "RAM freed: physical page " << page_num << "\n";
+            VM_LOG(INFO) << "RAM freed: physical page " << page_num << "\n";
+            VM_EVENT(FRAME_FREE, page_num, 0);
         }
     }
     
@@ -91,14 +162,14 @@ public:
     void read_page(pfn_t page_num, char* buffer) {
         char* page_ptr = get_page_ptr(page_num);
         if (page_ptr) {
-            std::memcpy(buffer, page_ptr, PAGE_SIZE);
+            page_ops::copy(buffer, page_ptr, PAGE_SIZE);
         }
     }
     
     void write_page(pfn_t page_num, const char* buffer) {
         char* page_ptr = get_page_ptr(page_num);
         if (page_ptr) {
-            std::memcpy(page_ptr, buffer, PAGE_SIZE);
+            page_ops::copy(page_ptr, buffer, PAGE_SIZE);
         }
     }
 };
@@ -108,71 +179,231 @@ struct PageTableEntry {
     bool present;           // Is page in RAM?
     bool dirty;            // Has page been modified?
     bool file_backed;      // Is this a file-backed mapping?
+    bool readable;         // Mapping allows reads (any protection but PROT_NONE)
+    bool writable;         // Mapping allows writes (PROT_WRITE)
     pfn_t disk_page;       // Which disk page backs this?
     
     PageTableEntry() : physical_page(0), present(false), dirty(false), 
-                      file_backed(false), disk_page(0) {}
+                      file_backed(false), readable(false), writable(false), disk_page(0) {}
 };
 
+// mmap_sim keeps nothing per area beyond what Vma already holds
+struct NoVmaAttr {
+    bool operator==(const NoVmaAttr&) const { return true; }
+};
+
+using Area = Vma<NoVmaAttr>;
+
 class MMU {
 private:
-    std::unordered_map<vpn_t, PageTableEntry> page_table;
+    // Indexed like x86 (PDX/PTX) with the default geometry, covering the 32-bit VPN range
+    RadixPageTable<PageTableEntry, Geometry::LEVELS, Geometry::BITS_PER_LEVEL> page_table;
     RAM& ram;
     Disk& disk;
     pfn_t next_disk_page;
     
+    // Mapped areas (mmap, munmap, mprotect). PTEs exist only inside them and
+    // carry their protection, so an access needs no VMA lookup to be checked
+    VmaTree<NoVmaAttr> vmas;
+    uint64_t protection_faults;
+    
+    // File readahead (readahead.h). Each file-backed map_pages call is one
+    // mapping with its own window, keyed by its first page.
+    struct FileMapping {
+        vpn_t end;
+        ReadaheadWindow window;
+    };
+    std::map<vpn_t, FileMapping> file_mappings;
+    ReadaheadConfig ra_config;
+    ReadaheadStats ra_stats;
+    PageCache page_cache;
+    uint64_t faults;
+    
+    // A free frame, dropping the oldest cached readahead pages if RAM is full
+    pfn_t allocate_frame() {
+        pfn_t frame = ram.allocate_page();
+        while (frame == (pfn_t)-1 && page_cache.size() > 0) {
+            ram.free_page(page_cache.pop_oldest());
+            ra_stats.cache_dropped++;
+            frame = ram.allocate_page();
+        }
+        return frame;
+    }
+    
+    // The disk copy is about to change, so a cached read of it is stale
+    void drop_cached(pfn_t disk_page) {
+        pfn_t frame = page_cache.take(disk_page);
+        if (frame != PageCache::NONE) {
+            ram.free_page(frame);
+        }
+    }
+    
+    FileMapping* find_file_mapping(vpn_t vpn, vpn_t* start = nullptr) {
+        auto it = file_mappings.upper_bound(vpn);
+        if (it == file_mappings.begin()) return nullptr;
+        --it;
+        if (vpn >= it->second.end) return nullptr;
+        if (start) *start = it->first;
+        return &it->second;
+    }
+    
+    // Forget mappings overlapping [start, end); pieces outside it remain
+    void drop_file_mappings(vpn_t start, vpn_t end) {
+        auto it = file_mappings.upper_bound(start);
+        if (it != file_mappings.begin()) --it;
+        while (it != file_mappings.end() && it->first < end) {
+            vpn_t m_start = it->first;
+            vpn_t m_end = it->second.end;
+            if (m_end <= start) {
+                ++it;
+                continue;
+            }
+            it = file_mappings.erase(it);
+            if (m_start < start) file_mappings[m_start] = FileMapping{start, ReadaheadWindow()};
+            if (m_end > end) file_mappings[end] = FileMapping{m_end, ReadaheadWindow()};
+        }
+    }
+    
+    // Read the mapped, not yet resident file pages in [first, first + count)
+    // into the page cache, one disk read per run of consecutive disk pages
+    void read_ahead(vpn_t first, uint32_t count) {
+        std::vector<std::pair<pfn_t, pfn_t>> run;   // (disk page, frame)
+        auto read_run = [&]() {
+            if (run.empty()) return;
+            std::vector<char> buffer(run.size() * PAGE_SIZE);
+            disk.read_pages(run[0].first, run.size(), buffer.data());
+            for (size_t k = 0; k < run.size(); k++) {
+                ram.write_page(run[k].second, &buffer[k * PAGE_SIZE]);
+                page_cache.insert(run[k].first, run[k].second);
+            }
+            ra_stats.readahead_ios++;
+            ra_stats.readahead_pages += run.size();
+            run.clear();
+        };
+        
+        for (vpn_t vpn = first; vpn < first + count; vpn++) {
+            PageTableEntry* pte = page_table.find(vpn);
+            bool wanted = pte && pte->file_backed && !pte->present && !page_cache.contains(pte->disk_page);
+            if (!run.empty() && (!wanted || pte->disk_page != run.back().first + 1)) {
+                read_run();
+            }
+            if (!wanted) continue;
+            // Readahead only takes free frames; it never drops other cached pages
+            pfn_t frame = ram.allocate_page();
+            if (frame == (pfn_t)-1) break;
+            run.emplace_back(pte->disk_page, frame);
+        }
+        read_run();
+    }
+    
+    // Advance the faulting mapping's readahead window, at most half of RAM
+    void read_ahead_for(vpn_t vpn) {
+        vpn_t start;
+        FileMapping* mapping = find_file_mapping(vpn, &start);
+        if (!ra_config.enabled || !mapping) return;
+        ReadaheadConfig limits = ra_config;
+        limits.max_pages = (uint32_t)std::min<size_t>(limits.max_pages, ram.total_frames() / 2);
+        limits.initial_pages = std::min(limits.initial_pages, limits.max_pages);
+        uint64_t first;
+        uint32_t count;
+        if (!mapping->window.on_fault(vpn, vpn == start, limits, first, count)) return;
+        if (first >= mapping->end) return;
+        read_ahead(first, (uint32_t)std::min<uint64_t>(count, mapping->end - first));
+    }
+    
+    // Map cached neighbours of vpn in its aligned fault_around_bytes block
+    void fault_around(vpn_t vpn) {
+        vpn_t pages = ra_config.fault_around_bytes / PAGE_SIZE;
+        if (!ra_config.enabled || pages < 2 || page_cache.size() == 0) return;
+        vpn_t first = vpn - vpn % pages;
+        for (vpn_t v = first; v < first + pages; v++) {
+            PageTableEntry* pte = page_table.find(v);
+            if (v == vpn || !pte || !pte->file_backed || pte->present) continue;
+            pfn_t frame = page_cache.take(pte->disk_page);
+            if (frame == PageCache::NONE) continue;
+            pte->physical_page = frame;
+            pte->present = true;
+            ra_stats.fault_around_pages++;
+        }
+    }
+    
 public:
-    MMU(RAM& r, Disk& d) : ram(r), disk(d), next_disk_page(0) {
+    MMU(RAM& r, Disk& d) 
+        : ram(r), disk(d), next_disk_page(0), vmas(MMAP_BASE / PAGE_SIZE, VPN_LIMIT), protection_faults(0), 
+          faults(0) {
         std::cout << "MMU initialized\n";
     }
     
     // Handle page fault - load page from disk to RAM
     bool handle_page_fault(vpn_t virtual_page) {
-        std::cout << "Page fault: virtual page " << virtual_page << "\n";
-        
-        auto& pte = page_table[virtual_page];
+        VM_LOG(INFO) << "Page fault: virtual page " << virtual_page << "\n";
+        VM_EVENT(PAGE_FAULT, virtual_page, 0);
         
-        // Allocate physical page
-        pfn_t phys_page = ram.allocate_page();
-        if (phys_page == (pfn_t)-1) {
-            std::cout << "Out of RAM! Need to implement swapping\n";
+        PageTableEntry* entry = page_table.find(virtual_page);
+        if (!entry) {
+            VM_LOG(ERROR) << "Page fault on unmapped virtual page " << virtual_page << "\n";
             return false;
         }
+        PageTableEntry& pte = *entry;
+        faults++;
         
-        // Load from disk if file-backed
-        if (pte.file_backed) {
-            char buffer[PAGE_SIZE];
-            disk.read_page(pte.disk_page, buffer);
-            ram.write_page(phys_page, buffer);
-        } else {
-            // Zero-fill anonymous page
-            char buffer[PAGE_SIZE] = {0};
-            ram.write_page(phys_page, buffer);
+        // A file page read ahead earlier is a minor fault: no disk I/O
+        pfn_t phys_page = pte.file_backed ? page_cache.take(pte.disk_page) : PageCache::NONE;
+        bool minor = (phys_page != PageCache::NONE);
+        
+        if (!minor) {
+            // Allocate physical page
+            phys_page = allocate_frame();
+            if (phys_page == (pfn_t)-1) {
+                VM_LOG(ERROR) << "Out of RAM! Need to implement swapping\n";
+                return false;
+            }
+            
+            // Load from disk if file-backed, straight into the frame
+            char* frame = ram.get_page_ptr(phys_page);
+            if (pte.file_backed) {
+                disk.read_page(pte.disk_page, frame);
+            } else {
+                // Zero-fill anonymous page
+                page_ops::zero(frame, PAGE_SIZE);
+            }
         }
         
         pte.physical_page = phys_page;
         pte.present = true;
         
+        if (pte.file_backed) {
+            ra_stats.file_faults++;
+            (minor ? ra_stats.minor_faults : ra_stats.major_faults)++;
+            read_ahead_for(virtual_page);
+            fault_around(virtual_page);
+        }
+        
         return true;
     }
     
-    // Translate virtual address to physical
-    char* translate_address(void* virtual_addr) {
+    // Translate virtual address to physical; nullptr if it is unmapped or
+    // the mapping's protection forbids the access (a protection fault)
+    char* translate_address(void* virtual_addr, bool write_access = false) {
         uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtual_addr);
         vpn_t virtual_page = vaddr / PAGE_SIZE;
         size_t page_offset = vaddr % PAGE_SIZE;
         
-        auto it = page_table.find(virtual_page);
-        if (it == page_table.end()) {
-            std::cout << "Invalid virtual address: " << virtual_addr << "\n";
+        PageTableEntry* entry = page_table.find(virtual_page);
+        if (!entry) {
+            VM_LOG(ERROR) << "Invalid virtual address: " << virtual_addr << "\n";
             return nullptr;
         }
         
-        PageTableEntry& pte = it->second;
+        PageTableEntry& pte = *entry;
+        if (!(write_access ? pte.writable : pte.readable)) {
+            protection_faults++;
+            VM_LOG(ERROR) << "Protection fault: " << (write_access ? "write to " : "read of ") << virtual_addr << "\n";
+            return nullptr;
+        }
         
         // Handle page fault
         if (!pte.present) {
-            //bugs here handle page would create page, but shouldve have error of seg fault
             if (!handle_page_fault(virtual_page)) {
                 return nullptr;
             }
@@ -182,49 +413,115 @@ public:
         return phys_addr + page_offset;
     }
     
-    // Map virtual pages (used by mmap)
-    bool map_pages(vpn_t start_page, size_t num_pages, bool file_backed = false, pfn_t disk_start = 0) {
-        for (size_t i = 0; i < num_pages; i++) {
-            vpn_t virtual_page = start_page + i;
-            PageTableEntry pte;
+    // Map virtual pages (used by mmap), filling one leaf table at a time
+    bool map_pages(vpn_t start_page, size_t num_pages, bool file_backed = false, pfn_t disk_start = 0,
+                   int prot = PROT_READ | PROT_WRITE) {
+        bool mapped = page_table.map_range(start_page, num_pages, [&](uint64_t vpn, PageTableEntry& pte) {
+            pte.readable = prot != PROT_NONE;
+            pte.writable = prot & PROT_WRITE;
             pte.file_backed = file_backed;
             if (file_backed) {
-                pte.disk_page = disk_start + i;
+                pte.disk_page = disk_start + (vpn - start_page);
             }
-            page_table[virtual_page] = pte;
+        });
+        if (!mapped) {
+            VM_LOG(ERROR) << "Cannot map " << num_pages << " pages at " << start_page << ": outside page table range or already mapped\n";
+            return false;
         }
-        std::cout << "Mapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        drop_file_mappings(start_page, start_page + num_pages);
+        if (file_backed) {
+            file_mappings[start_page] = FileMapping{(vpn_t)(start_page + num_pages), ReadaheadWindow()};
+        }
+        VM_LOG(INFO) << "Mapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        VM_EVENT(MAP, start_page, num_pages);
         return true;
     }
     
-    // Unmap virtual pages (used by munmap)
+    // Unmap virtual pages (used by munmap); empty leaf tables are skipped and freed
     bool unmap_pages(vpn_t start_page, size_t num_pages) {
-        for (size_t i = 0; i < num_pages; i++) {
-            vpn_t virtual_page = start_page + i;
-            auto it = page_table.find(virtual_page);
-            if (it != page_table.end()) {
-                PageTableEntry& pte = it->second;
-                if (pte.present) {
-                    // Write back if dirty and file-backed
-                    if (pte.dirty && pte.file_backed) {
-                        char buffer[PAGE_SIZE];
-                        ram.read_page(pte.physical_page, buffer);
-                        disk.write_page(pte.disk_page, buffer);
-                    }
-                    ram.free_page(pte.physical_page);
+        page_table.unmap_range(start_page, num_pages, [&](uint64_t, PageTableEntry& pte) {
+            if (pte.present) {
+                // Write back if dirty and file-backed
+                if (pte.dirty && pte.file_backed) {
+                    drop_cached(pte.disk_page);
+                    disk.write_page(pte.disk_page, ram.get_page_ptr(pte.physical_page));
                 }
-                page_table.erase(it);
+                ram.free_page(pte.physical_page);
             }
-        }
-        std::cout << "Unmapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        });
+        drop_file_mappings(start_page, start_page + num_pages);
+        VM_LOG(INFO) << "Unmapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        VM_EVENT(UNMAP, start_page, num_pages);
         return true;
     }
     
+    // ---- VMAs ----
+    
+    const Area* find_vma(vpn_t vpn) const { return vmas.find(vpn); }
+    bool is_unmapped(vpn_t start_page, size_t num_pages) const { return vmas.is_free(start_page, num_pages); }
+    
+    // First page of the best-fitting free gap, INVALID_VPN if none is big enough
+    vpn_t get_unmapped_area(size_t num_pages) const {
+        uint64_t start = vmas.get_unmapped_area(num_pages);
+        return start == VmaTree<NoVmaAttr>::NONE ? INVALID_VPN : (vpn_t)start;
+    }
+    
+    // Record a mapping over free pages once map_pages has made its PTEs
+    void add_vma(const Area& area) { vmas.insert(area); }
+    
+    // munmap: only the mapped parts of the range are walked, however large
+    // it is. Returns the pages unmapped.
+    uint64_t unmap_area(vpn_t start_page, uint64_t num_pages) {
+        return vmas.remove(start_page, start_page + num_pages, [&](const Area& piece) {
+            unmap_pages((vpn_t)piece.start, piece.pages());
+        });
+    }
+    
+    // mprotect; false, changing nothing, if part of the range is unmapped
+    bool protect_area(vpn_t start_page, uint64_t num_pages, int prot) {
+        return vmas.protect(start_page, start_page + num_pages, prot, [&](const Area& area) {
+            page_table.for_each_in(area.start, area.pages(), [&](uint64_t, PageTableEntry& pte) {
+                pte.readable = prot != PROT_NONE;
+                pte.writable = prot & PROT_WRITE;
+            });
+        });
+    }
+    
+    size_t get_vma_count() const { return vmas.size(); }
+    uint64_t get_protection_faults() const { return protection_faults; }
+    
+    // Like /proc/<pid>/maps
+    void print_vmas() {
+        std::cout << "\n=== VMAs (" << vmas.size() << " areas, " << vmas.mapped_pages() << " pages, "
+                  << vmas.gap_count() << " free gaps) ===\n";
+        vmas.for_each([](const Area& area) {
+            std::cout << std::hex << area.start * PAGE_SIZE << "-" << area.end * PAGE_SIZE << std::dec << " "
+                      << ((area.prot & PROT_READ) ? 'r' : '-') << ((area.prot & PROT_WRITE) ? 'w' : '-')
+                      << ((area.prot & PROT_EXEC) ? 'x' : '-') << ((area.flags & MAP_SHARED) ? 's' : 'p');
+            if (area.anonymous()) {
+                std::cout << " anon";
+            } else {
+                std::cout << " fd " << area.fd << " page " << area.pgoff;
+            }
+            std::cout << " (" << area.pages() << " pages)\n";
+        });
+    }
+    
+    void set_readahead(const ReadaheadConfig& config) { ra_config = config; }
+    uint64_t get_faults() const { return faults; }
+    
+    void print_readahead_stats() {
+        std::cout << "Faults: " << faults << ", file faults: " << ra_stats.file_faults << " ("
+                  << ra_stats.major_faults << " major, " << ra_stats.minor_faults << " minor)\n";
+        std::cout << "Readahead: " << ra_stats.readahead_pages << " pages in " << ra_stats.readahead_ios
+                  << " reads, fault-around mapped " << ra_stats.fault_around_pages
+                  << ", dropped unused " << ra_stats.cache_dropped << "\n";
+    }
+    
     void print_page_table() {
         std::cout << "\n=== Page Table ===\n";
-        for (const auto& entry : page_table) {
-            const auto& pte = entry.second;
-            std::cout << "VPN " << entry.first << " -> ";
+        page_table.for_each([](uint64_t vpn, const PageTableEntry& pte) {
+            std::cout << "VPN " << vpn << " -> ";
             if (pte.present) {
                 std::cout << "PFN " << pte.physical_page;
             } else {
@@ -234,7 +531,9 @@ public:
                 std::cout << " (file-backed, disk page " << pte.disk_page << ")";
             }
             std::cout << "\n";
-        }
+        });
+        std::cout << page_table.size() << " entries in " << page_table.leaf_tables() << " leaf tables ("
+                  << page_table.memory_bytes() / 1024 << " KB)\n";
         std::cout << "================\n\n";
     }
 };
@@ -244,95 +543,225 @@ private:
     RAM ram;
     Disk disk;
     MMU mmu;
-    uintptr_t next_virtual_addr;
     
 public:
-    VirtualMemorySystem() : mmu(ram, disk), next_virtual_addr(0x10000000) {
+    explicit VirtualMemorySystem(size_t disk_bytes = DISK_SIZE, const std::string& disk_image = "") 
+        : disk(disk_bytes, disk_image), mmu(ram, disk) {
         std::cout << "Virtual Memory System initialized\n\n";
     }
     
-    // Simplified mmap implementation
+    // POSIX mmap; nullptr on failure (MAP_FAILED). Without MAP_FIXED, addr is
+    // a hint, used if that range is free; otherwise the mapping goes in the
+    // best-fitting free gap above MMAP_BASE, so holes munmap left are reused.
+    // MAP_FIXED replaces whatever is mapped there, MAP_FIXED_NOREPLACE fails
+    // instead.
     void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) {
-        // Simplified: ignore most parameters, allocate next available virtual address
-        size_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
-        
-        uintptr_t virtual_addr = next_virtual_addr;
-        vpn_t start_page = virtual_addr / PAGE_SIZE;
-        
-        bool file_backed = (fd != -1);
-        pfn_t disk_start = 0;
+        uintptr_t hint = reinterpret_cast<uintptr_t>(addr);
+        uint64_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        int sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+        bool fixed = flags & (MAP_FIXED | MAP_FIXED_NOREPLACE);
+        bool file_backed = !(flags & MAP_ANONYMOUS);
+        if (length == 0 || (sharing != MAP_SHARED && sharing != MAP_PRIVATE) || offset % PAGE_SIZE != 0 ||
+            (fixed && (hint % PAGE_SIZE != 0 || hint / PAGE_SIZE + pages_needed > VPN_LIMIT))) {
+            VM_LOG(ERROR) << "mmap: invalid arguments\n";
+            return nullptr;
+        }
+        if (file_backed && !disk.is_file(fd)) {
+            VM_LOG(ERROR) << "mmap: bad file descriptor " << fd << "\n";
+            return nullptr;
+        }
+        if (file_backed && sharing == MAP_PRIVATE && (prot & PROT_WRITE)) {
+            VM_LOG(ERROR) << "mmap: writable private file mappings need copy-on-write, not simulated\n";
+            return nullptr;
+        }
         
-        if (file_backed) {
-            disk_start = offset / PAGE_SIZE;
+        uint64_t start_page = Geometry::round_up(hint) / PAGE_SIZE;
+        if (flags & MAP_FIXED_NOREPLACE) {
+            if (!mmu.is_unmapped(start_page, pages_needed)) {
+                VM_LOG(ERROR) << "mmap: " << addr << " is already mapped\n";
+                return nullptr;
+            }
+        } else if (flags & MAP_FIXED) {
+            mmu.unmap_area(start_page, pages_needed);
+        } else if (hint == 0 || start_page + pages_needed > VPN_LIMIT || !mmu.is_unmapped(start_page, pages_needed)) {
+            start_page = mmu.get_unmapped_area(pages_needed);
+            if (start_page == INVALID_VPN) {
+                VM_LOG(ERROR) << "mmap: no free range of " << pages_needed << " pages\n";
+                return nullptr;
+            }
         }
         
-        if (mmu.map_pages(start_page, pages_needed, file_backed, disk_start)) {
-            next_virtual_addr += pages_needed * PAGE_SIZE;
-            std::cout << "mmap returned: " << std::hex << virtual_addr << std::dec 
-                      << " (" << length << " bytes, " << pages_needed << " pages)\n\n";
-            return reinterpret_cast<void*>(virtual_addr);
+        // File pages are mapped one extent at a time; holes and pages past
+        // the end of the file are zero-filled like anonymous memory. A failed
+        // map_pages maps nothing, so only the extents before it are undone.
+        if (!file_backed && !mmu.map_pages(start_page, pages_needed, false, 0, prot)) {
+            return nullptr;
+        }
+        for (size_t i = 0; file_backed && i < pages_needed; ) {
+            uint64_t run = 1;
+            uint32_t block = disk.resolve(fd, offset / PAGE_SIZE + i, &run);
+            run = std::min<uint64_t>(run, pages_needed - i);
+            if (!mmu.map_pages(start_page + i, run, block != FileExtentTable::NO_BLOCK, block, prot)) {
+                if (i > 0) mmu.unmap_pages(start_page, i);
+                return nullptr;
+            }
+            i += run;
         }
         
-        return nullptr;
+        mmu.add_vma(Area{start_page, start_page + pages_needed, prot, flags & (MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS),
+                         file_backed ? fd : -1, file_backed ? (uint64_t)offset / PAGE_SIZE : 0, NoVmaAttr()});
+        uintptr_t virtual_addr = start_page * PAGE_SIZE;
+        VM_LOG(INFO) << "mmap returned: " << std::hex << virtual_addr << std::dec 
+                     << " (" << length << " bytes, " << pages_needed << " pages)\n\n";
+        return reinterpret_cast<void*>(virtual_addr);
     }
     
-    // Simplified munmap implementation
+    // Unmapping a range with nothing mapped in it is not an error
     int munmap(void* addr, size_t length) {
         uintptr_t virtual_addr = reinterpret_cast<uintptr_t>(addr);
-        vpn_t start_page = virtual_addr / PAGE_SIZE;
-        size_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
-        
-        if (mmu.unmap_pages(start_page, pages_needed)) {
-            std::cout << "munmap successful\n\n";
-            return 0;
+        if (virtual_addr % PAGE_SIZE != 0 || length == 0) {
+            VM_LOG(ERROR) << "munmap: invalid arguments\n";
+            return -1;
         }
-        return -1;
+        uint64_t start_page = virtual_addr / PAGE_SIZE;
+        uint64_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        mmu.unmap_area(start_page, pages_needed);
+        VM_LOG(INFO) << "munmap successful\n\n";
+        return 0;
+    }
+    
+    // -1 if part of the range is not mapped (ENOMEM), or it would make a
+    // private file mapping writable
+    int mprotect(void* addr, size_t length, int prot) {
+        uintptr_t virtual_addr = reinterpret_cast<uintptr_t>(addr);
+        if (virtual_addr % PAGE_SIZE != 0) {
+            VM_LOG(ERROR) << "mprotect: invalid arguments\n";
+            return -1;
+        }
+        uint64_t start_page = virtual_addr / PAGE_SIZE;
+        uint64_t end_page = start_page + (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        for (uint64_t page = start_page; (prot & PROT_WRITE) && page < end_page; ) {
+            const Area* area = mmu.find_vma(page);
+            if (!area) break;
+            if (!area->anonymous() && (area->flags & MAP_PRIVATE)) {
+                VM_LOG(ERROR) << "mprotect: private file mapping cannot become writable\n";
+                return -1;
+            }
+            page = area->end;
+        }
+        if (!mmu.protect_area(start_page, end_page - start_page, prot)) {
+            VM_LOG(ERROR) << "mprotect: " << addr << " is not mapped throughout\n";
+            return -1;
+        }
+        return 0;
     }
     
     // Memory access simulation
     void write_memory(void* addr, const char* data, size_t size) {
-        std::cout << "Writing " << size << " bytes to " << addr << "\n";
-        char* phys_addr = mmu.translate_address(addr);
+        VM_LOG(INFO) << "Writing " << size << " bytes to " << addr << "\n";
+        char* phys_addr = mmu.translate_address(addr, true);
         if (phys_addr) {
             std::memcpy(phys_addr, data, size);
-            std::cout << "Write successful\n";
+            VM_LOG(INFO) << "Write successful\n";
         } else {
-            std::cout << "Write failed - invalid address\n";
+            VM_LOG(ERROR) << "Write failed - invalid address\n";
         }
-        std::cout << "\n";
+        VM_LOG(INFO) << "\n";
     }
     
     void read_memory(void* addr, char* buffer, size_t size) {
-        std::cout << "Reading " << size << " bytes from " << addr << "\n";
+        VM_LOG(INFO) << "Reading " << size << " bytes from " << addr << "\n";
         char* phys_addr = mmu.translate_address(addr);
         if (phys_addr) {
             std::memcpy(buffer, phys_addr, size);
-            std::cout << "Read successful: '" << std::string(buffer, size) << "'\n";
+            VM_LOG(INFO) << "Read successful: '" << std::string(buffer, size) << "'\n";
         } else {
-            std::cout << "Read failed - invalid address\n";
+            VM_LOG(ERROR) << "Read failed - invalid address\n";
         }
-        std::cout << "\n";
+        VM_LOG(INFO) << "\n";
     }
     
     void print_status() {
         mmu.print_page_table();
     }
     
-    // Simulate creating a file on disk
-    void create_file(const std::string& filename, const std::string& content) {
-        disk.write_file(filename, content.c_str(), content.size());
+    void print_vmas() { mmu.print_vmas(); }
+    size_t get_vma_count() const { return mmu.get_vma_count(); }
+    uint64_t get_protection_faults() const { return mmu.get_protection_faults(); }
+    
+    void set_readahead(const ReadaheadConfig& config) { mmu.set_readahead(config); }
+    uint64_t get_faults() const { return mmu.get_faults(); }
+    void print_readahead_stats() { mmu.print_readahead_stats(); }
+    
+    // Simulate creating a file on disk; returns the fd to pass to mmap
+    int create_file(const std::string& filename, const std::string& content) {
+        return disk.write_file(filename, content.c_str(), content.size());
     }
 };
 
-int main() {
-    VirtualMemorySystem vm_system;
+// mmap_sim --bench [filter] [--json] [--min-time s], see bench.h
+void register_benchmarks(BenchRunner& runner) {
+    // First touch of a fresh anonymous page
+    runner.add("fault/anonymous", [](BenchState& state) {
+        VirtualMemorySystem sim;
+        char byte = 'a';
+        while (state.keep_running()) {
+            state.pause_timing();
+            void* page = sim.mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            state.resume_timing();
+            sim.write_memory(page, &byte, 1);
+            state.pause_timing();
+            sim.munmap(page, PAGE_SIZE);
+            state.resume_timing();
+        }
+        state.items_processed = state.iterations();
+    });
+    
+    // Sequential scan of a fresh 12-page file mapping, one page per fault
+    // vs readahead + fault-around; time is per scan
+    for (bool readahead : {false, true}) {
+        runner.add(readahead ? "file_scan/12_pages/readahead" : "file_scan/12_pages/no_readahead",
+                   [readahead](BenchState& state) {
+            const size_t pages = 12;
+            uint64_t faults = 0;
+            char byte;
+            while (state.keep_running()) {
+                state.pause_timing();
+                VirtualMemorySystem sim;
+                ReadaheadConfig config;
+                config.enabled = readahead;
+                sim.set_readahead(config);
+                int fd = sim.create_file("scan.dat", std::string(pages * PAGE_SIZE, 'r'));
+                char* file = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0));
+                state.resume_timing();
+                for (size_t i = 0; i < pages; i++) sim.read_memory(file + i * PAGE_SIZE, &byte, 1);
+                state.pause_timing();
+                faults += sim.get_faults();
+            }
+            state.items_processed = state.iterations() * pages;
+            state.counters["faults_per_scan"] = faults * 1.0 / state.iterations();
+        });
+    }
+}
+
+// mmap_sim [disk image [size in MB]]: back the disk with a real file
+//          --bench [filter] [--json] [--min-time s]: microbenchmarks
+int main(int argc, char** argv) {
+    if (argc >= 2 && std::string(argv[1]) == "--bench") {
+        BenchRunner runner;
+        register_benchmarks(runner);
+        return runner.main(argc, argv, 2);
+    }
+    std::string disk_image = argc >= 2 ? argv[1] : "";
+    size_t disk_bytes = argc >= 3 ? std::strtoull(argv[2], nullptr, 0) << 20 : DISK_SIZE;
+    VirtualMemorySystem vm_system(disk_bytes, disk_image);
     
     // Create a file on disk
-    vm_system.create_file("test.txt", "Hello, this is file content for mmap testing!");
+    int fd = vm_system.create_file("test.txt", "Hello, this is file content for mmap testing!");
     
     std::cout << "\n=== Testing Anonymous mmap ===\n";
     // Test anonymous mapping
-    void* anon_mem = vm_system.mmap(nullptr, 8192, 0, 0, -1, 0);
+    void* anon_mem = vm_system.mmap(nullptr, 8192, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     vm_system.print_status();
     
     // Write to anonymous memory
@@ -345,7 +774,7 @@ int main() {
     
     std::cout << "\n=== Testing File-backed mmap ===\n";
     // Test file-backed mapping
-    void* file_mem = vm_system.mmap(nullptr, 4096, 0, 0, 1, 0);  // fd=1 indicates file
+    void* file_mem = vm_system.mmap(nullptr, 4096, PROT_READ, MAP_SHARED, fd, 0);
     vm_system.print_status();
     
     // Read from file-backed memory (triggers page fault and disk read)
@@ -357,5 +786,59 @@ int main() {
     vm_system.munmap(file_mem, 4096);
     vm_system.print_status();
     
+    std::cout << "\n=== Sequential File Scan: Readahead ===\n";
+    
+    // Read one byte from each page of a 12-page file mapping
+    uint64_t scan_faults[2] = {0, 0};
+    for (bool readahead : {false, true}) {
+        std::cout.setstate(std::ios::failbit);    // Quiet while setting up and scanning
+        VirtualMemorySystem sim;
+        ReadaheadConfig config;
+        config.enabled = readahead;
+        sim.set_readahead(config);
+        int scan_fd = sim.create_file("scan.dat", std::string(12 * PAGE_SIZE, 'r'));
+        char* file = static_cast<char*>(sim.mmap(nullptr, 12 * PAGE_SIZE, PROT_READ, MAP_SHARED, scan_fd, 0));
+        char byte;
+        for (int i = 0; i < 12; i++) sim.read_memory(file + i * PAGE_SIZE, &byte, 1);
+        std::cout.clear();
+        
+        std::cout << (readahead ? "Readahead + fault-around:\n" : "One page per fault:\n");
+        sim.print_readahead_stats();
+        scan_faults[readahead] = sim.get_faults();
+    }
+    std::cout << "Readahead cut faults from " << scan_faults[0] << " to " << scan_faults[1] << "\n";
+    
+    std::cout << "\n=== VMAs: Hole Reuse, MAP_FIXED and mprotect ===\n";
+    
+    // Unmapping the middle of three mappings leaves a hole the next mapping
+    // that fits goes into; MAP_FIXED replaces part of a mapping, and a page
+    // mprotect made read-only refuses writes
+    {
+        std::cout.setstate(std::ios::failbit);
+        VirtualMemorySystem sim;
+        const int anon = MAP_PRIVATE | MAP_ANONYMOUS;
+        const int rw = PROT_READ | PROT_WRITE;
+        char* a = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+        char* b = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+        char* c = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+        sim.write_memory(c + PAGE_SIZE, "old", 3);
+        sim.munmap(b, 4 * PAGE_SIZE);
+        char* reused = static_cast<char*>(sim.mmap(nullptr, 2 * PAGE_SIZE, rw, anon, -1, 0));
+        char* fixed = static_cast<char*>(sim.mmap(c + PAGE_SIZE, PAGE_SIZE, PROT_READ, anon | MAP_FIXED, -1, 0));
+        char* dup = static_cast<char*>(sim.mmap(c, PAGE_SIZE, rw, anon | MAP_FIXED_NOREPLACE, -1, 0));
+        char data[4] = {0};
+        sim.read_memory(fixed, data, 3);
+        sim.mprotect(a, PAGE_SIZE, PROT_READ);
+        sim.write_memory(a, "x", 1);
+        sim.write_memory(fixed, "x", 1);
+        std::cout.clear();
+        
+        std::cout << "2-page mmap after unmapping the middle: " << (reused == b ? "reused the hole" : "placed elsewhere")
+                  << "; MAP_FIXED over c+1 reads '" << data << "' (fresh page); MAP_FIXED_NOREPLACE over c "
+                  << (dup ? "succeeded" : "refused") << "\n";
+        std::cout << "Writes to the read-only pages: " << sim.get_protection_faults() << " protection faults\n";
+        sim.print_vmas();
+    }
+    
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,230 @@
+#pragma once
+
+// Bulk page kernels shared by the simulators: zero, copy and fill whole
+// pages in place, the all-zero / same-filled test zswap uses, and scans over
+// arrays of 32-bit PTEs. The vector width is picked at compile time: AVX2
+// when the compiler targets it (-mavx2, -march=native), NEON on AArch64, SSE2
+// on any other x86-64, 8-byte words otherwise. -DVM_NO_SIMD forces the word
+// loops, so the same --bench run can compare the two.
+//
+// Byte counts are whole pages, multiples of 64, so no path has a tail loop.
+// Loads and stores are unaligned: frames sit in plain arrays and the cost on
+// aligned data is the same. The tests return at the first 64 bytes that
+// differ, so a page that is not zero usually costs one load.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(VM_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define VM_SIMD_AVX2 1
+#elif !defined(VM_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VM_SIMD_NEON 1
+#elif !defined(VM_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define VM_SIMD_SSE2 1
+#endif
+
+namespace page_ops {
+
+#if defined(VM_SIMD_AVX2)
+inline const char* isa() { return "avx2"; }
+#elif defined(VM_SIMD_NEON)
+inline const char* isa() { return "neon"; }
+#elif defined(VM_SIMD_SSE2)
+inline const char* isa() { return "sse2"; }
+#else
+inline const char* isa() { return "scalar"; }
+#endif
+
+// Every byte set to the low byte of each 8-byte word of fill, in order
+inline void fill(void* dst, size_t bytes, uint64_t fill) {
+    char* d = static_cast<char*>(dst);
+#if defined(VM_SIMD_AVX2)
+    __m256i v = _mm256_set1_epi64x((long long)fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i + 32), v);
+    }
+#elif defined(VM_SIMD_NEON)
+    uint64x2_t v = vdupq_n_u64(fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        vst1q_u64(reinterpret_cast<uint64_t*>(d + i), v);
+        vst1q_u64(reinterpret_cast<uint64_t*>(d + i + 16), v);
+        vst1q_u64(reinterpret_cast<uint64_t*>(d + i + 32), v);
+        vst1q_u64(reinterpret_cast<uint64_t*>(d + i + 48), v);
+    }
+#elif defined(VM_SIMD_SSE2)
+    __m128i v = _mm_set1_epi64x((long long)fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i + 16), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i + 32), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i + 48), v);
+    }
+#else
+    for (size_t i = 0; i < bytes; i += sizeof(fill)) {
+        std::memcpy(d + i, &fill, sizeof(fill));
+    }
+#endif
+}
+
+// Zero and copy go to libc: glibc picks AVX2/AVX-512 or rep stosb/movsb at
+// run time and matches or beats a fixed-width loop on a 4KB page. What the
+// simulators gain is not bouncing pages through stack buffers.
+inline void zero(void* dst, size_t bytes) {
+    std::memset(dst, 0, bytes);
+}
+
+// dst and src must not overlap
+inline void copy(void* dst, const void* src, size_t bytes) {
+    std::memcpy(dst, src, bytes);
+}
+
+// True if every 8-byte word equals fill
+inline bool is_filled(const void* src, size_t bytes, uint64_t fill) {
+    const char* s = static_cast<const char*>(src);
+#if defined(VM_SIMD_AVX2)
+    __m256i v = _mm256_set1_epi64x((long long)fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        __m256i a = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)), v);
+        __m256i b = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + 32)), v);
+        __m256i diff = _mm256_or_si256(a, b);
+        if (!_mm256_testz_si256(diff, diff)) return false;
+    }
+#elif defined(VM_SIMD_NEON)
+    uint64x2_t v = vdupq_n_u64(fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        const uint64_t* p = reinterpret_cast<const uint64_t*>(s + i);
+        uint64x2_t diff = vorrq_u64(vorrq_u64(veorq_u64(vld1q_u64(p), v), veorq_u64(vld1q_u64(p + 2), v)),
+                                    vorrq_u64(veorq_u64(vld1q_u64(p + 4), v), veorq_u64(vld1q_u64(p + 6), v)));
+        if (vmaxvq_u32(vreinterpretq_u32_u64(diff)) != 0) return false;
+    }
+#elif defined(VM_SIMD_SSE2)
+    __m128i v = _mm_set1_epi64x((long long)fill);
+    for (size_t i = 0; i < bytes; i += 64) {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)), v);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 16)), v);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 32)), v);
+        __m128i e = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 48)), v);
+        __m128i same = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, e));
+        if (_mm_movemask_epi8(same) != 0xFFFF) return false;
+    }
+#else
+    for (size_t i = 0; i < bytes; i += sizeof(fill)) {
+        uint64_t word;
+        std::memcpy(&word, s + i, sizeof(word));
+        if (word != fill) return false;
+    }
+#endif
+    return true;
+}
+
+inline bool is_zero(const void* src, size_t bytes) {
+    return is_filled(src, bytes, 0);
+}
+
+// True if the page repeats its first 8-byte word; fill gets that word
+inline bool same_filled(const void* src, size_t bytes, uint64_t& fill) {
+    std::memcpy(&fill, src, sizeof(fill));
+    return is_filled(src, bytes, fill);
+}
+
+#if defined(VM_SIMD_AVX2)
+const size_t PTE_LANES = 8;
+#elif defined(VM_SIMD_NEON) || defined(VM_SIMD_SSE2)
+const size_t PTE_LANES = 4;
+#else
+const size_t PTE_LANES = 1;
+#endif
+
+// Entries with (pte & mask) == value: mask = value = PTE_PRESENT counts
+// present pages, mask = ~0 and value = 0 counts empty slots
+inline size_t pte_count(const uint32_t* ptes, size_t n, uint32_t mask, uint32_t value) {
+    size_t count = 0;
+    size_t i = 0;
+    // The odd n % PTE_LANES entries first, so the vector loop ends at n exactly
+    for (; i < n % PTE_LANES; i++) {
+        count += (ptes[i] & mask) == value;
+    }
+    // A match compares to all ones, so subtracting it adds one to its lane
+#if defined(VM_SIMD_AVX2)
+    __m256i m = _mm256_set1_epi32((int)mask);
+    __m256i v = _mm256_set1_epi32((int)value);
+    __m256i sum = _mm256_setzero_si256();
+    for (; i < n; i += 8) {
+        __m256i e = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptes + i)), m);
+        sum = _mm256_sub_epi32(sum, _mm256_cmpeq_epi32(e, v));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+    for (uint32_t lane : lanes) count += lane;
+#elif defined(VM_SIMD_NEON)
+    uint32x4_t m = vdupq_n_u32(mask);
+    uint32x4_t v = vdupq_n_u32(value);
+    uint32x4_t sum = vdupq_n_u32(0);
+    for (; i < n; i += 4) {
+        sum = vsubq_u32(sum, vceqq_u32(vandq_u32(vld1q_u32(ptes + i), m), v));
+    }
+    count += vaddvq_u32(sum);
+#elif defined(VM_SIMD_SSE2)
+    __m128i m = _mm_set1_epi32((int)mask);
+    __m128i v = _mm_set1_epi32((int)value);
+    __m128i sum = _mm_setzero_si128();
+    for (; i < n; i += 4) {
+        __m128i e = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptes + i)), m);
+        sum = _mm_sub_epi32(sum, _mm_cmpeq_epi32(e, v));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    for (uint32_t lane : lanes) count += lane;
+#else
+    for (; i < n; i++) {
+        count += (ptes[i] & mask) == value;
+    }
+#endif
+    return count;
+}
+
+// Index of the first entry with (pte & mask) == value, or n if none
+inline size_t pte_find(const uint32_t* ptes, size_t n, uint32_t mask, uint32_t value) {
+    size_t i = 0;
+    for (; i < n % PTE_LANES; i++) {
+        if ((ptes[i] & mask) == value) return i;
+    }
+#if defined(VM_SIMD_AVX2)
+    __m256i m = _mm256_set1_epi32((int)mask);
+    __m256i v = _mm256_set1_epi32((int)value);
+    for (; i < n; i += 8) {
+        __m256i e = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptes + i)), m);
+        unsigned hits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(e, v)));
+        if (hits) return i + __builtin_ctz(hits);
+    }
+#elif defined(VM_SIMD_NEON)
+    uint32x4_t m = vdupq_n_u32(mask);
+    uint32x4_t v = vdupq_n_u32(value);
+    for (; i < n; i += 4) {
+        if (vmaxvq_u32(vceqq_u32(vandq_u32(vld1q_u32(ptes + i), m), v)) != 0) {
+            while ((ptes[i] & mask) != value) i++;
+            return i;
+        }
+    }
+#elif defined(VM_SIMD_SSE2)
+    __m128i m = _mm_set1_epi32((int)mask);
+    __m128i v = _mm_set1_epi32((int)value);
+    for (; i < n; i += 4) {
+        __m128i e = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptes + i)), m);
+        unsigned hits = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(e, v)));
+        if (hits) return i + __builtin_ctz(hits);
+    }
+#else
+    for (; i < n; i++) {
+        if ((ptes[i] & mask) == value) return i;
+    }
+#endif
+    return n;
+}
+
+}  // namespace page_ops
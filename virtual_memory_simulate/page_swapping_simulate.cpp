@@ -1,159 +1,654 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <fstream>
 #include <cstring>
 #include <cassert>
 #include <cstdint>
 #include <algorithm>
 #include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
+#include "address_space.h"
+#include "vm_trace.h"
+#include "page_ops.h"
+#include "radix_page_table.h"
+#include "backing_store.h"
+#include "readahead.h"
+#include "zswap.h"
+#include "working_set.h"
+#include "vma_tree.h"
+#include "vm_metrics.h"
+#include "bench.h"
 
-// Configuration constants
-const size_t PAGE_SIZE = 4096;
-const size_t RAM_SIZE = 8 * PAGE_SIZE;   // 32KB RAM (reduced to force swapping)
-const size_t DISK_SIZE = 64 * PAGE_SIZE; // 256KB Disk
-const size_t SWAP_SIZE = 32 * PAGE_SIZE; // 128KB Swap space
-const size_t VIRTUAL_ADDR_SPACE = 32 * PAGE_SIZE; // 128KB virtual space
+// Page size and page table shape, -DVM_ADDRESS_SPACE=X86_64 etc. (address_space.h).
+// The default is 4KB pages under a three-level, 10 bits per level table.
+#ifndef VM_ADDRESS_SPACE
+#define VM_ADDRESS_SPACE AddressSpace<12, 3, 10, 42>
+#endif
+using Geometry = VM_ADDRESS_SPACE;
 
-using pfn_t = uint32_t;
-using vpn_t = uint32_t;
+// Configuration constants; device and RAM sizes are runtime, see StorageConfig
+const size_t PAGE_SIZE = Geometry::PAGE_SIZE;
+const uintptr_t MMAP_BASE = 0x10000000;   // mmap places mappings from here up
+
+using pfn_t = Geometry::pfn_t;
+using vpn_t = Geometry::vpn_t;
 using swap_slot_t = uint32_t;
 using timestamp_t = uint64_t;
 
-// Page metadata structure
+// Returned by the allocators when nothing is free
+const pfn_t INVALID_FRAME = std::numeric_limits<pfn_t>::max();
+const swap_slot_t INVALID_SWAP_SLOT = UINT32_MAX;
+const vpn_t INVALID_VPN = std::numeric_limits<vpn_t>::max();   // "No incoming page" for background reclaim
+const uint64_t VPN_LIMIT = std::min<uint64_t>(uint64_t(1) << Geometry::VPN_BITS, INVALID_VPN);   // Pages mmap can use
+
+// Page metadata flag bits, packed like PTE_PRESENT/PTE_WRITE/PTE_USER
+const uint32_t PM_PRESENT     = 0x001;   // Page is in RAM
+const uint32_t PM_DIRTY       = 0x002;   // Modified since it was loaded
+const uint32_t PM_FILE_BACKED = 0x004;   // Backed by a disk file page
+const uint32_t PM_SWAPPED     = 0x008;   // Contents live in a swap slot
+const uint32_t PM_LOCKED      = 0x010;   // Being faulted in with the fault lock dropped
+const uint32_t PM_SWAPCACHE   = 0x020;   // Resident, and its swap slot still holds a clean copy
+const uint32_t PM_READ        = 0x040;   // Mapping allows reads (any protection but PROT_NONE)
+const uint32_t PM_WRITE       = 0x080;   // Mapping allows writes (PROT_WRITE)
+
+// Page metadata structure, 12 bytes per mapped virtual page. The accessed bit,
+// last access time and VPN back reference only matter while a page is
+// resident, so RAM keeps them in per-frame arrays instead.
 struct PageMetadata {
-    bool present;           // Is page in RAM?
-    bool dirty;            // Has page been modified?
-    bool accessed;         // Recently accessed (for LRU)
-    bool file_backed;      // Is this a file-backed mapping?
-    bool swapped;          // Is page in swap space?
-    pfn_t physical_page;   // Physical page frame number
-    pfn_t disk_page;       // Disk page number (for file-backed)
-    swap_slot_t swap_slot; // Swap slot number (for swapped pages)
-    timestamp_t last_access; // For LRU algorithm
-    vpn_t virtual_page;    // Back reference to virtual page
-    
-    PageMetadata() : present(false), dirty(false), accessed(false), 
-                    file_backed(false), swapped(false), physical_page(0), 
-                    disk_page(0), swap_slot(0), last_access(0), virtual_page(0) {}
+    uint32_t flags;          // PM_* bits
+    pfn_t physical_page;     // Physical page frame number (while PM_PRESENT)
+    uint32_t backing;        // Disk page if PM_FILE_BACKED, else swap slot while PM_SWAPPED or PM_SWAPCACHE
+    
+    PageMetadata() : flags(0), physical_page(0), backing(0) {}
+    
+    bool present() const { return flags & PM_PRESENT; }
+    bool dirty() const { return flags & PM_DIRTY; }
+    bool file_backed() const { return flags & PM_FILE_BACKED; }
+    bool swapped() const { return flags & PM_SWAPPED; }
+    bool locked() const { return flags & PM_LOCKED; }
+    bool swap_cached() const { return flags & PM_SWAPCACHE; }
+    pfn_t disk_page() const { return backing; }
+    swap_slot_t swap_slot() const { return backing; }
+    
+    void set(uint32_t bits) { flags |= bits; }
+    void clear(uint32_t bits) { flags &= ~bits; }
+};
+
+static_assert(sizeof(PageMetadata) == 12, "page metadata should stay packed");
+
+// Bitmap allocator for frames and swap slots: one bit per unit, set = in use.
+// Allocation scans 64 units per word with ctz, starting at the word of the
+// last allocation, and the free count is kept incrementally.
+//
+// Lock-free, so concurrent faults never serialize on it: a caller first
+// reserves a unit by decrementing free_units, which guarantees a clear bit
+// exists, then claims one with a compare-and-swap on its word.
+class BitmapAllocator {
+private:
+    std::vector<std::atomic<uint64_t>> words;
+    size_t total;
+    std::atomic<size_t> free_units;
+    std::atomic<size_t> hint;   // Word to start the next search from
+    
+public:
+    static const size_t NONE = SIZE_MAX;
+    
+    explicit BitmapAllocator(size_t capacity) 
+        : words((capacity + 63) / 64), total(capacity), free_units(capacity), hint(0) {
+        // Mark the tail bits past capacity as permanently used
+        if (capacity % 64 != 0) {
+            words.back().store(~0ULL << (capacity % 64), std::memory_order_relaxed);
+        }
+    }
+    
+    size_t allocate() {
+        size_t available = free_units.load(std::memory_order_relaxed);
+        do {
+            if (available == 0) {
+                return NONE;
+            }
+        } while (!free_units.compare_exchange_weak(available, available - 1, std::memory_order_acquire));
+        
+        // A bit is reserved for us; only a racing claim can make us rescan
+        for (;;) {
+            size_t start = hint.load(std::memory_order_relaxed);
+            for (size_t n = 0; n < words.size(); n++) {
+                size_t w = (start + n) % words.size();
+                uint64_t bits = words[w].load(std::memory_order_relaxed);
+                while (bits != ~0ULL) {
+                    size_t bit = __builtin_ctzll(~bits);
+                    if (words[w].compare_exchange_weak(bits, bits | (1ULL << bit), std::memory_order_acq_rel)) {
+                        hint.store(w, std::memory_order_relaxed);
+                        return w * 64 + bit;
+                    }
+                }
+            }
+        }
+    }
+    
+    // Freeing an already free unit is a no-op so the count stays exact
+    bool release(size_t index) {
+        if (index >= total) {
+            return false;
+        }
+        uint64_t mask = 1ULL << (index % 64);
+        if (!(words[index / 64].fetch_and(~mask, std::memory_order_acq_rel) & mask)) {
+            return false;
+        }
+        free_units.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    
+    bool test(size_t index) const {
+        return index < total && (words[index / 64].load(std::memory_order_relaxed) >> (index % 64)) & 1;
+    }
+    
+    size_t free_count() const { return free_units.load(std::memory_order_relaxed); }
+    size_t capacity() const { return total; }
 };
 
 class SwapSpace {
 private:
-    std::vector<char> swap_storage;
-    std::vector<bool> allocated_slots;
+    BackingStore swap_storage;      // Anonymous memory or an mmap'd swap file
+    BitmapAllocator allocated_slots;
+    std::chrono::microseconds io_latency;   // Simulated cost of each read/write request
+    std::atomic<uint64_t> read_ios;
+    std::atomic<uint64_t> write_ios;
+    
+    void simulate_io() const {
+        if (io_latency.count() > 0) std::this_thread::sleep_for(io_latency);
+    }
     
 public:
-    SwapSpace() : swap_storage(SWAP_SIZE, 0), allocated_slots(SWAP_SIZE / PAGE_SIZE, false) {
-        std::cout << "Swap space initialized: " << SWAP_SIZE << " bytes ("
-                  << SWAP_SIZE / PAGE_SIZE << " slots)\n";
+    explicit SwapSpace(size_t bytes, const std::string& file = "") 
+        : swap_storage(bytes, file), allocated_slots(swap_storage.size() / PAGE_SIZE), io_latency(0),
+          read_ios(0), write_ios(0) {
+        assert(allocated_slots.capacity() < INVALID_SWAP_SLOT && "swap slots must fit swap_slot_t");
+        std::cout << "Swap space initialized: " << swap_storage.size() << " bytes ("
+                  << allocated_slots.capacity() << " slots)";
+        if (swap_storage.is_file()) std::cout << " (file '" << swap_storage.file_path() << "')";
+        std::cout << "\n";
     }
     
+    // Returns INVALID_SWAP_SLOT when the swap device is full
     swap_slot_t allocate_slot() {
-        for (size_t i = 0; i < allocated_slots.size(); i++) {
-            if (!allocated_slots[i]) {
-                allocated_slots[i] = true;
-                std::cout << "Swap allocated: slot " << i << "\n";
-                return i;
-            }
+        size_t slot = allocated_slots.allocate();
+        if (slot == BitmapAllocator::NONE) {
+            VM_LOG(ERROR) << "Swap full: no free slots\n";
+            return INVALID_SWAP_SLOT;
         }
-        return -1; // No free slots
+        VM_LOG(INFO) << "Swap allocated: slot " << slot << "\n";
+        return slot;
     }
     
     void free_slot(swap_slot_t slot) {
-        if (slot < allocated_slots.size()) {
-            allocated_slots[slot] = false;
-            std::cout << "Swap freed: slot " << slot << "\n";
+        if (allocated_slots.release(slot)) {
+            VM_LOG(INFO) << "Swap freed: slot " << slot << "\n";
         }
     }
     
+    size_t get_free_slots() const { return allocated_slots.free_count(); }
+    // Like Linux vm_swap_full(): over half the slots in use
+    bool mostly_full() const { return allocated_slots.free_count() * 2 < allocated_slots.capacity(); }
+    void set_io_latency(std::chrono::microseconds latency) { io_latency = latency; }
+    uint64_t get_read_ios() const { return read_ios; }
+    uint64_t get_write_ios() const { return write_ios; }
+    
     void write_page(swap_slot_t slot, const char* data) {
-        if (slot < allocated_slots.size()) {
-            size_t offset = slot * PAGE_SIZE;
-            std::memcpy(&swap_storage[offset], data, PAGE_SIZE);
-            std::cout << "Swap write: slot " << slot << "\n";
+        if (slot < allocated_slots.capacity()) {
+            size_t offset = (size_t)slot * PAGE_SIZE;
+            simulate_io();
+            write_ios++;
+            std::memcpy(swap_storage.data() + offset, data, PAGE_SIZE);
+            VM_LOG(INFO) << "Swap write: slot " << slot << "\n";
+            VM_EVENT(SWAP_WRITE, slot, PAGE_SIZE);
+        }
+    }
+    
+    // One write for a run of adjacent slots (data holds count pages)
+    void write_pages(swap_slot_t first, size_t count, const char* data) {
+        if (first + count <= allocated_slots.capacity()) {
+            simulate_io();
+            write_ios++;
+            std::memcpy(swap_storage.data() + (size_t)first * PAGE_SIZE, data, count * PAGE_SIZE);
+            VM_LOG(INFO) << "Swap write: slots " << first << "-" << (first + count - 1) << "\n";
+            VM_EVENT(SWAP_WRITE, first, count * PAGE_SIZE);
         }
     }
     
     void read_page(swap_slot_t slot, char* buffer) {
-        if (slot < allocated_slots.size()) {
-            size_t offset = slot * PAGE_SIZE;
-            std::memcpy(buffer, &swap_storage[offset], PAGE_SIZE);
-            std::cout << "Swap read: slot " << slot << "\n";
+        if (slot < allocated_slots.capacity()) {
+            size_t offset = (size_t)slot * PAGE_SIZE;
+            simulate_io();
+            read_ios++;
+            std::memcpy(buffer, swap_storage.data() + offset, PAGE_SIZE);
+            VM_LOG(INFO) << "Swap read: slot " << slot << "\n";
+            VM_EVENT(SWAP_READ, slot, PAGE_SIZE);
+        }
+    }
+};
+
+// Compressed cache in front of SwapSpace, like Linux zswap. Evicted
+// anonymous pages keep their swap slot but are stored here, compressed
+// (zswap.h), and a swap-in decompresses instead of reading the device.
+// Pages filled with one repeated word take no pool memory at all. Only when
+// the pool is full do its least recently stored pages go out to their swap
+// slots. Pages that compress to over half a page go straight to swap.
+//
+// The pool is counted apart from RAM's frames: frames_saved() is the extra
+// RAM the cache is worth, pages held minus the zspages holding them.
+// Thread-safe: concurrent faults call it with the fault lock dropped, and
+// its own lock is not held across compression or a write-back's device I/O.
+class Zswap {
+private:
+    using ZsPool = ::ZsPool<PAGE_SIZE>;     // One zspage per frame
+    
+    struct Entry {
+        uint32_t handle;        // ZsPool object, or ZsPool::NONE if same-filled
+        uint32_t length;        // Compressed bytes
+        uint64_t fill;          // The repeated word of a same-filled page
+        std::list<swap_slot_t>::iterator lru;   // lru.end() once picked for write-back
+    };
+    // Per-thread buffers, like zswap's per-CPU ones: the page being stored,
+    // compressed, and a write-back victim before and after decompression
+    struct Scratch {
+        std::vector<uint8_t> compressed = std::vector<uint8_t>(ZsPool::MAX_OBJECT);
+        std::vector<uint8_t> victim = std::vector<uint8_t>(ZsPool::MAX_OBJECT);
+        std::vector<char> page = std::vector<char>(PAGE_SIZE);
+    };
+    SwapSpace& backend;
+    std::unique_ptr<SwapCodec> codec;
+    ZsPool pool;
+    std::unordered_map<swap_slot_t, Entry> entries;
+    std::list<swap_slot_t> lru;     // Entries holding pool memory, oldest first
+    std::unordered_set<swap_slot_t> writing;    // Write-backs in progress
+    ZswapStats stats;
+    std::mutex lock;
+    std::condition_variable written;
+    
+    static Scratch& scratch() {
+        thread_local Scratch buffers;
+        return buffers;
+    }
+    
+    // Decompress length bytes at src into a page; returns the time it took
+    uint64_t decompress(const uint8_t* src, uint32_t length, char* buffer) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = codec->decompress(src, length, reinterpret_cast<uint8_t*>(buffer), PAGE_SIZE);
+        assert(ok && "zswap object failed to decompress");
+        (void)ok;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    
+    void drop(std::unordered_map<swap_slot_t, Entry>::iterator it) {
+        Entry& entry = it->second;
+        if (entry.handle == ZsPool::NONE) {
+            stats.same_filled_pages--;
+        } else {
+            pool.release(entry.handle);
+            if (entry.lru != lru.end()) lru.erase(entry.lru);
+            stats.compressed_bytes -= entry.length;
+        }
+        stats.stored_pages--;
+        entries.erase(it);
+    }
+    
+    // A slot still being written back must not be freed or refilled until
+    // the write lands, or it could overwrite the slot's next page
+    void wait_for_write(swap_slot_t slot, std::unique_lock<std::mutex>& guard) {
+        while (writing.count(slot)) written.wait(guard);
+    }
+    
+    // Write the oldest entry out to its swap slot, with the lock dropped for
+    // the decompression and the device write. The entry keeps its pool
+    // object until then, so a load meanwhile still finds it. False if no
+    // entry is left to write.
+    bool write_back_oldest(std::unique_lock<std::mutex>& guard) {
+        if (lru.empty()) return false;
+        swap_slot_t slot = lru.front();
+        Entry& entry = entries.find(slot)->second;
+        lru.pop_front();
+        entry.lru = lru.end();
+        Scratch& buffers = scratch();
+        uint32_t length = entry.length;
+        std::memcpy(buffers.victim.data(), pool.data(entry.handle), length);
+        writing.insert(slot);
+        
+        guard.unlock();
+        uint64_t ns = decompress(buffers.victim.data(), length, buffers.page.data());
+        backend.write_page(slot, buffers.page.data());
+        VM_LOG(INFO) << "Zswap write-back: slot " << slot << "\n";
+        guard.lock();
+        
+        stats.decompressions++;
+        stats.decompress_ns += ns;
+        stats.written_back++;
+        writing.erase(slot);
+        written.notify_all();
+        auto it = entries.find(slot);
+        if (it != entries.end()) drop(it);  // Unless a load took it meanwhile
+        return true;
+    }
+    
+public:
+    Zswap(SwapSpace& swap, std::unique_ptr<SwapCodec> page_codec, size_t max_pool_pages)
+        : backend(swap), codec(std::move(page_codec)), pool(max_pool_pages) {}
+    
+    // False if the page must be written to its swap slot instead
+    bool store(swap_slot_t slot, const char* data) {
+        uint64_t fill;
+        if (page_ops::same_filled(data, PAGE_SIZE, fill)) {
+            std::unique_lock<std::mutex> guard(lock);
+            wait_for_write(slot, guard);
+            auto old = entries.find(slot);
+            if (old != entries.end()) drop(old);
+            Entry entry{ZsPool::NONE, 0, fill, lru.end()};
+            entries.emplace(slot, entry);
+            stats.stores++;
+            stats.stored_pages++;
+            stats.same_filled_pages++;
+            VM_LOG(INFO) << "Zswap store: slot " << slot << " (same-filled)\n";
+            return true;
+        }
+        
+        std::vector<uint8_t>& compressed = scratch().compressed;
+        auto start = std::chrono::steady_clock::now();
+        size_t length = codec->compress(reinterpret_cast<const uint8_t*>(data), PAGE_SIZE,
+                                        compressed.data(), compressed.size());
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        
+        std::unique_lock<std::mutex> guard(lock);
+        wait_for_write(slot, guard);
+        stats.compressions++;
+        stats.compress_ns += ns;
+        auto old = entries.find(slot);
+        if (old != entries.end()) drop(old);
+        if (length == 0) {
+            stats.rejected++;
+            return false;
+        }
+        uint32_t handle = pool.alloc(length);
+        while (handle == ZsPool::NONE && write_back_oldest(guard)) {
+            handle = pool.alloc(length);
+        }
+        if (handle == ZsPool::NONE) {
+            stats.rejected++;
+            return false;
         }
+        std::memcpy(pool.data(handle), compressed.data(), length);
+        lru.push_back(slot);
+        entries.emplace(slot, Entry{handle, (uint32_t)length, 0, std::prev(lru.end())});
+        stats.stores++;
+        stats.stored_pages++;
+        stats.compressed_bytes += length;
+        VM_LOG(INFO) << "Zswap store: slot " << slot << " (" << length << " bytes)\n";
+        return true;
+    }
+    
+    // Fill buffer and drop the entry (the slot is about to be freed). False
+    // if the page is not cached and must be read from swap.
+    bool load(swap_slot_t slot, char* buffer) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(slot);
+        if (it == entries.end()) return false;
+        if (it->second.handle == ZsPool::NONE) {
+            page_ops::fill(buffer, PAGE_SIZE, it->second.fill);
+        } else {
+            stats.decompressions++;
+            stats.decompress_ns += decompress(pool.data(it->second.handle), it->second.length, buffer);
+        }
+        drop(it);
+        stats.loads++;
+        VM_LOG(INFO) << "Zswap load: slot " << slot << "\n";
+        return true;
+    }
+    
+    // The slot is being freed: forget any copy of it
+    void invalidate(swap_slot_t slot) {
+        std::unique_lock<std::mutex> guard(lock);
+        wait_for_write(slot, guard);
+        auto it = entries.find(slot);
+        if (it != entries.end()) drop(it);
+    }
+    
+    const char* codec_name() const { return codec->name(); }
+    
+    ZswapStats get_stats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+    
+    size_t pool_pages() {
+        std::lock_guard<std::mutex> guard(lock);
+        return pool.pages_used();
+    }
+    
+    size_t frames_saved() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats.stored_pages - pool.pages_used();
     }
 };
 
+// Simulated disk: a BackingStore (anonymous memory or an mmap'd image file)
+// plus an extent table for the files written to it. Blocks are handed out
+// in order, so each write_file call adds at most one extent.
 class Disk {
 private:
-    std::vector<char> storage;
+    BackingStore storage;
+    FileExtentTable files;
+    uint32_t next_free_page;
+    std::chrono::microseconds io_latency;   // Simulated cost of each read/write request
+    
+    void simulate_io() const {
+        if (io_latency.count() > 0) std::this_thread::sleep_for(io_latency);
+    }
     
 public:
-    Disk() : storage(DISK_SIZE, 0) {
-        std::cout << "Disk initialized: " << DISK_SIZE << " bytes\n";
+    explicit Disk(size_t bytes, const std::string& image = "") 
+        : storage(bytes, image), next_free_page(0), io_latency(0) {
+        std::cout << "Disk initialized: " << storage.size() << " bytes";
+        if (storage.is_file()) std::cout << " (image '" << storage.file_path() << "')";
+        std::cout << "\n";
     }
     
+    size_t num_pages() const { return storage.size() / PAGE_SIZE; }
+    
     void read_page(pfn_t page_num, char* buffer) {
-        size_t offset = page_num * PAGE_SIZE;
-        if (offset + PAGE_SIZE <= DISK_SIZE) {
-            std::memcpy(buffer, &storage[offset], PAGE_SIZE);
-            std::cout << "Disk read: page " << page_num << "\n";
+        if (page_num < num_pages()) {
+            simulate_io();
+            std::memcpy(buffer, storage.data() + (size_t)page_num * PAGE_SIZE, PAGE_SIZE);
+            VM_LOG(INFO) << "Disk read: page " << page_num << "\n";
+            VM_EVENT(DISK_READ, page_num, PAGE_SIZE);
         }
     }
     
     void write_page(pfn_t page_num, const char* buffer) {
-        size_t offset = page_num * PAGE_SIZE;
-        if (offset + PAGE_SIZE <= DISK_SIZE) {
-            std::memcpy(&storage[offset], buffer, PAGE_SIZE);
-            std::cout << "Disk write: page " << page_num << "\n";
+        if (page_num < num_pages()) {
+            simulate_io();
+            std::memcpy(storage.data() + (size_t)page_num * PAGE_SIZE, buffer, PAGE_SIZE);
+            VM_LOG(INFO) << "Disk write: page " << page_num << "\n";
+            VM_EVENT(DISK_WRITE, page_num, PAGE_SIZE);
+        }
+    }
+    
+    // One read for a run of adjacent disk pages (buffer holds count pages)
+    void read_pages(pfn_t first, size_t count, char* buffer) {
+        if (first + count <= num_pages()) {
+            simulate_io();
+            std::memcpy(buffer, storage.data() + (size_t)first * PAGE_SIZE, count * PAGE_SIZE);
+            VM_LOG(INFO) << "Disk read: pages " << first << "-" << (first + count - 1) << "\n";
+            VM_EVENT(DISK_READ, first, count * PAGE_SIZE);
+        }
+    }
+    
+    // One write for a run of adjacent disk pages (buffer holds count pages)
+    void write_pages(pfn_t first, size_t count, const char* buffer) {
+        if (first + count <= num_pages()) {
+            simulate_io();
+            std::memcpy(storage.data() + (size_t)first * PAGE_SIZE, buffer, count * PAGE_SIZE);
+            VM_LOG(INFO) << "Disk write: pages " << first << "-" << (first + count - 1) << "\n";
+            VM_EVENT(DISK_WRITE, first, count * PAGE_SIZE);
         }
     }
     
-    void write_file(const std::string& filename, const char* data, size_t size) {
+    // (Re)write a file, allocating blocks for any pages it does not have
+    // yet. Returns its fd, or -1 if the disk is full.
+    int write_file(const std::string& filename, const char* data, size_t size) {
+        int fd = files.create(filename);
         size_t pages_needed = (size + PAGE_SIZE - 1) / PAGE_SIZE;
-        for (size_t i = 0; i < pages_needed && i * PAGE_SIZE < DISK_SIZE; i++) {
-            size_t copy_size = std::min(PAGE_SIZE, size - i * PAGE_SIZE);
-            std::memcpy(&storage[i * PAGE_SIZE], data + i * PAGE_SIZE, copy_size);
+        for (size_t i = 0; i < pages_needed; ) {
+            uint64_t run = 0;
+            uint32_t block = files.resolve(fd, i, &run);
+            if (block == FileExtentTable::NO_BLOCK) {
+                run = pages_needed - i;
+                if (next_free_page + run > num_pages()) {
+                    std::cout << "Disk full: cannot store '" << filename << "'\n";
+                    return -1;
+                }
+                block = next_free_page;
+                files.add_extent(fd, i, block, run);
+                next_free_page += run;
+            }
+            run = std::min<uint64_t>(run, pages_needed - i);
+            for (size_t k = 0; k < run; k++, i++) {
+                char* dst = storage.data() + (size_t)(block + k) * PAGE_SIZE;
+                size_t copy_size = std::min(PAGE_SIZE, size - i * PAGE_SIZE);
+                std::memcpy(dst, data + i * PAGE_SIZE, copy_size);
+                std::memset(dst + copy_size, 0, PAGE_SIZE - copy_size);
+            }
         }
+        files.set_size(fd, size);
         std::cout << "File '" << filename << "' written to disk (" << size << " bytes)\n";
+        return fd;
     }
+    
+    bool is_file(int fd) const { return files.is_valid(fd); }
+    
+    // Disk page backing a page of an open file (see FileExtentTable::resolve)
+    uint32_t resolve(int fd, uint64_t file_page, uint64_t* run = nullptr) const {
+        return files.resolve(fd, file_page, run);
+    }
+    
+    void set_io_latency(std::chrono::microseconds latency) { io_latency = latency; }
 };
 
+// Sizes and optional host files for the simulated devices
+struct StorageConfig {
+    size_t ram_bytes = 8 * PAGE_SIZE;       // 32KB with 4KB pages, small to force swapping
+    size_t disk_bytes = 64 * PAGE_SIZE;
+    size_t swap_bytes = 32 * PAGE_SIZE;
+    size_t numa_nodes = 1;      // RAM split into this many memory nodes
+    std::string disk_image;     // Empty: anonymous memory
+    std::string swap_file;
+};
+
+// Physical frames, split into NUMA nodes of contiguous frames (the last
+// one may be smaller), each with its own allocator
 class RAM {
 private:
     std::vector<char> memory;
     std::vector<PageMetadata*> frame_to_page; // Track which page is in each frame
-    std::vector<bool> allocated;
+    
+    // Hot per-frame state, one array per field so replacement scans stay dense.
+    // Hits update the access fields under a PTE lock only, so they are atomic.
+    std::vector<vpn_t> frame_vpn;
+    std::vector<std::atomic<timestamp_t>> frame_last_access;
+    std::vector<std::atomic<uint8_t>> frame_accessed;
+    std::vector<std::atomic<uint8_t>> frame_access_node;    // Node of the CPU that last touched it
+    std::vector<std::unique_ptr<BitmapAllocator>> nodes;
+    size_t frames_per_node;
+    std::atomic<uint64_t> numa_hits;    // Allocations on the requested node
+    std::atomic<uint64_t> numa_misses;  // Fell back to another node
     
 public:
-    RAM() : memory(RAM_SIZE, 0), frame_to_page(RAM_SIZE / PAGE_SIZE, nullptr),
-            allocated(RAM_SIZE / PAGE_SIZE, false) {
-        std::cout << "RAM initialized: " << RAM_SIZE << " bytes (" 
-                  << RAM_SIZE / PAGE_SIZE << " pages)\n";
+    // bytes is rounded down to whole frames, at least one; at most one node per frame
+    explicit RAM(size_t bytes, size_t num_nodes = 1) 
+        : memory(std::max<size_t>(1, bytes / PAGE_SIZE) * PAGE_SIZE, 0), frame_to_page(memory.size() / PAGE_SIZE, nullptr),
+          frame_vpn(frame_to_page.size(), 0), frame_last_access(frame_to_page.size()),
+          frame_accessed(frame_to_page.size()), frame_access_node(frame_to_page.size()), numa_hits(0), numa_misses(0) {
+        assert(frame_to_page.size() < INVALID_FRAME && "frames must fit pfn_t");
+        num_nodes = std::max<size_t>(1, std::min<size_t>({num_nodes, frame_to_page.size(), UINT8_MAX}));
+        frames_per_node = (frame_to_page.size() + num_nodes - 1) / num_nodes;
+        for (size_t first = 0; first < frame_to_page.size(); first += frames_per_node) {
+            nodes.push_back(std::make_unique<BitmapAllocator>(std::min(frames_per_node, frame_to_page.size() - first)));
+        }
+        std::cout << "RAM initialized: " << memory.size() << " bytes (" 
+                  << total_frames() << " pages";
+        if (nodes.size() > 1) std::cout << ", " << nodes.size() << " NUMA nodes";
+        std::cout << ")\n";
     }
     
-    pfn_t allocate_page(PageMetadata* page_meta = nullptr) {
-        for (size_t i = 0; i < allocated.size(); i++) {
-            if (!allocated[i]) {
-                allocated[i] = true;
-                frame_to_page[i] = page_meta;
-                std::cout << "RAM allocated: physical page " << i << "\n";
-                return i;
+    // Returns INVALID_FRAME when RAM is full. Tries node first, then the
+    // others in order unless fallback is false.
+    pfn_t allocate_page(PageMetadata* page_meta = nullptr, vpn_t vpn = 0, size_t node = 0, bool fallback = true) {
+        for (size_t n = 0; n < nodes.size(); n++) {
+            size_t target = (node + n) % nodes.size();
+            size_t index = nodes[target]->allocate();
+            if (index == BitmapAllocator::NONE) {
+                if (!fallback) break;
+                continue;
             }
+            pfn_t frame = (pfn_t)(target * frames_per_node + index);
+            (n == 0 ? numa_hits : numa_misses).fetch_add(1, std::memory_order_relaxed);
+            assign_page(frame, page_meta, vpn);
+            VM_LOG(INFO) << "RAM allocated: physical page " << frame << "\n";
+            VM_EVENT(FRAME_ALLOC, frame, 0);
+            return frame;
         }
-        return -1; // No free pages
+        return INVALID_FRAME;
+    }
+    
+    // Hand an allocated frame (e.g. a page cache frame) to a page
+    void assign_page(pfn_t frame, PageMetadata* page_meta, vpn_t vpn) {
+        frame_to_page[frame] = page_meta;
+        frame_vpn[frame] = vpn;
+        frame_last_access[frame].store(0, std::memory_order_relaxed);
+        frame_accessed[frame].store(0, std::memory_order_relaxed);
+        frame_access_node[frame].store((uint8_t)node_of(frame), std::memory_order_relaxed);
+    }
+    
+    // Another PTE takes over as the frame's owner (a shared frame's first
+    // mapper went away); recency is kept
+    void set_owner(pfn_t frame, PageMetadata* page_meta, vpn_t vpn) {
+        frame_to_page[frame] = page_meta;
+        frame_vpn[frame] = vpn;
+    }
+    
+    // Copy a page and its per-frame state to the allocated frame to; from
+    // is left to the caller to free
+    void migrate_page(pfn_t from, pfn_t to) {
+        page_ops::copy(get_page_ptr(to), get_page_ptr(from), PAGE_SIZE);
+        frame_to_page[to] = frame_to_page[from];
+        frame_vpn[to] = frame_vpn[from];
+        frame_last_access[to].store(get_last_access(from), std::memory_order_relaxed);
+        frame_accessed[to].store(is_accessed(from), std::memory_order_relaxed);
+        frame_access_node[to].store(get_access_node(from), std::memory_order_relaxed);
     }
     
     void free_page(pfn_t page_num) {
-        if (page_num < allocated.size()) {
-            allocated[page_num] = false;
+        if (page_num < total_frames() && nodes[node_of(page_num)]->release(page_num % frames_per_node)) {
             frame_to_page[page_num] = nullptr;
-            std::cout << "RAM freed: physical page " << page_num << "\n";
+            VM_LOG(INFO) << "RAM freed: physical page " << page_num << "\n";
+            VM_EVENT(FRAME_FREE, page_num, 0);
         }
     }
     
     char* get_page_ptr(pfn_t page_num) {
-        if (page_num < allocated.size()) {
+        if (page_num < total_frames()) {
             return &memory[page_num * PAGE_SIZE];
         }
         return nullptr;
@@ -162,14 +657,14 @@ public:
     void read_page(pfn_t page_num, char* buffer) {
         char* page_ptr = get_page_ptr(page_num);
         if (page_ptr) {
-            std::memcpy(buffer, page_ptr, PAGE_SIZE);
+            page_ops::copy(buffer, page_ptr, PAGE_SIZE);
         }
     }
     
     void write_page(pfn_t page_num, const char* buffer) {
         char* page_ptr = get_page_ptr(page_num);
         if (page_ptr) {
-            std::memcpy(page_ptr, buffer, PAGE_SIZE);
+            page_ops::copy(page_ptr, buffer, PAGE_SIZE);
         }
     }
     
@@ -181,332 +676,2940 @@ public:
         return nullptr;
     }
     
-    // Find LRU page for eviction
-    pfn_t find_lru_page() {
-        timestamp_t oldest_time = UINT64_MAX;
-        pfn_t lru_frame = -1;
-        
-        for (size_t i = 0; i < frame_to_page.size(); i++) {
-            if (allocated[i] && frame_to_page[i]) {
-                if (frame_to_page[i]->last_access < oldest_time) {
-                    oldest_time = frame_to_page[i]->last_access;
-                    lru_frame = i;
-                }
-            }
-        }
-        return lru_frame;
+    vpn_t get_frame_vpn(pfn_t frame_num) const { return frame_vpn[frame_num]; }
+    timestamp_t get_last_access(pfn_t frame_num) const { return frame_last_access[frame_num].load(std::memory_order_relaxed); }
+    bool is_accessed(pfn_t frame_num) const { return frame_accessed[frame_num].load(std::memory_order_relaxed); }
+    uint8_t get_access_node(pfn_t frame_num) const { return frame_access_node[frame_num].load(std::memory_order_relaxed); }
+    
+    void touch(pfn_t frame_num, timestamp_t now) {
+        frame_last_access[frame_num].store(now, std::memory_order_relaxed);
+        frame_accessed[frame_num].store(1, std::memory_order_relaxed);
     }
     
-    size_t get_free_frames() {
-        size_t count = 0;
-        for (bool alloc : allocated) {
-            if (!alloc) count++;
-        }
-        return count;
+    // Remember which node's CPU touched the frame (NUMA balancing)
+    void touch_from(pfn_t frame_num, size_t node) {
+        frame_access_node[frame_num].store((uint8_t)node, std::memory_order_relaxed);
     }
+    
+    // CLOCK's second chance: returns the old accessed bit and clears it
+    bool test_and_clear_accessed(pfn_t frame_num) {
+        return frame_accessed[frame_num].exchange(0, std::memory_order_relaxed);
+    }
+    
+    size_t get_free_frames() const {
+        size_t free = 0;
+        for (const auto& node : nodes) free += node->free_count();
+        return free;
+    }
+    
+    size_t total_frames() const { return frame_to_page.size(); }
+    
+    size_t num_nodes() const { return nodes.size(); }
+    size_t node_of(pfn_t frame_num) const { return frame_num / frames_per_node; }
+    size_t node_free_frames(size_t node) const { return nodes[node]->free_count(); }
+    size_t node_frames(size_t node) const { return nodes[node]->capacity(); }
+    uint64_t get_numa_hits() const { return numa_hits.load(std::memory_order_relaxed); }
+    uint64_t get_numa_misses() const { return numa_misses.load(std::memory_order_relaxed); }
 };
 
-class MMU {
+// ==================== PAGE REPLACEMENT POLICIES ====================
+
+// Intrusive doubly linked list of frames; links live in arrays indexed by frame
+class FrameList {
 private:
-    std::unordered_map<vpn_t, PageMetadata> page_table;
-    RAM& ram;
-    Disk& disk;
-    SwapSpace& swap_space;
-    pfn_t next_disk_page;
-    timestamp_t current_time;
-    
-    // Page replacement algorithm
-    pfn_t evict_page() {
-        std::cout << "RAM full! Evicting LRU page...\n";
-        
-        pfn_t victim_frame = ram.find_lru_page();
-        if (victim_frame == (pfn_t)-1) {
-            std::cout << "ERROR: No page to evict!\n";
-            return -1;
-        }
-        
-        PageMetadata* victim_meta = ram.get_page_metadata(victim_frame);
-        if (!victim_meta) {
-            std::cout << "ERROR: Invalid victim page metadata!\n";
-            return -1;
-        }
-        
-        std::cout << "Evicting virtual page " << victim_meta->virtual_page 
-                  << " from physical frame " << victim_frame << "\n";
-        
-        // If page is dirty, write it to appropriate storage
-        if (victim_meta->dirty) {
-            char buffer[PAGE_SIZE];
-            ram.read_page(victim_frame, buffer);
-            
-            if (victim_meta->file_backed) {
-                // Write back to original file
-                disk.write_page(victim_meta->disk_page, buffer);
-            } else {
-                // Write to swap space
-                if (!victim_meta->swapped) {
-                    victim_meta->swap_slot = swap_space.allocate_slot();
-                    victim_meta->swapped = true;
-                }
-                swap_space.write_page(victim_meta->swap_slot, buffer);
-            }
-        } else if (!victim_meta->file_backed && !victim_meta->swapped) {
-            // Clean anonymous page needs swap slot for future access
-            victim_meta->swap_slot = swap_space.allocate_slot();
-            victim_meta->swapped = true;
-            char buffer[PAGE_SIZE];
-            ram.read_page(victim_frame, buffer);
-            swap_space.write_page(victim_meta->swap_slot, buffer);
-        }
-        
-        // Update page metadata
-        victim_meta->present = false;
-        victim_meta->dirty = false;
-        victim_meta->physical_page = 0;
-        
-        // Free the physical frame
-        ram.free_page(victim_frame);
-        
-        return victim_frame;
-    }
+    std::vector<pfn_t> prev;
+    std::vector<pfn_t> next;
+    std::vector<uint8_t> member;
+    pfn_t head;
+    pfn_t tail;
+    size_t count;
     
 public:
-    MMU(RAM& r, Disk& d, SwapSpace& s) : ram(r), disk(d), swap_space(s), 
-                                         next_disk_page(0), current_time(0) {
-        std::cout << "MMU initialized\n";
-    }
+    explicit FrameList(size_t frames) 
+        : prev(frames, INVALID_FRAME), next(frames, INVALID_FRAME), member(frames, 0),
+          head(INVALID_FRAME), tail(INVALID_FRAME), count(0) {}
     
-    bool handle_page_fault(vpn_t virtual_page) {
-        std::cout << "Page fault: virtual page " << virtual_page << "\n";
-        
-        auto it = page_table.find(virtual_page);
-        if (it == page_table.end()) {
-            std::cout << "Invalid page access!\n";
-            return false;
-        }
-        
-        PageMetadata& pte = it->second;
-        
-        // Try to allocate physical page
-        pfn_t phys_page = ram.allocate_page(&pte);
-        
-        // If allocation failed, evict a page
-        if (phys_page == (pfn_t)-1) {
-            phys_page = evict_page();
-            if (phys_page == (pfn_t)-1) {
-                return false;
-            }
-            // Now allocate the freed page
-            ram.free_page(phys_page); // Make sure it's marked free
-            phys_page = ram.allocate_page(&pte);
-        }
-        
-        // Load page content
-        char buffer[PAGE_SIZE];
-        
-        if (pte.swapped) {
-            // Load from swap space
-            swap_space.read_page(pte.swap_slot, buffer);
-            swap_space.free_slot(pte.swap_slot);
-            pte.swapped = false;
-        } else if (pte.file_backed) {
-            // Load from file
-            disk.read_page(pte.disk_page, buffer);
-        } else {
-            // Zero-fill anonymous page
-            std::memset(buffer, 0, PAGE_SIZE);
-        }
-        
-        ram.write_page(phys_page, buffer);
-        
-        // Update page metadata
-        pte.physical_page = phys_page;
-        pte.present = true;
-        pte.last_access = ++current_time;
-        
-        return true;
+    void push_front(pfn_t frame) {
+        prev[frame] = INVALID_FRAME;
+        next[frame] = head;
+        if (head != INVALID_FRAME) prev[head] = frame;
+        head = frame;
+        if (tail == INVALID_FRAME) tail = frame;
+        member[frame] = 1;
+        count++;
     }
     
-    char* translate_address(void* virtual_addr, bool write_access = false) {
-        uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtual_addr);
-        vpn_t virtual_page = vaddr / PAGE_SIZE;
-        size_t page_offset = vaddr % PAGE_SIZE;
-        
-        auto it = page_table.find(virtual_page);
-        if (it == page_table.end()) {
-            std::cout << "Invalid virtual address: " << virtual_addr << "\n";
-            return nullptr;
-        }
-        
-        PageMetadata& pte = it->second;
-        
-        // Handle page fault
-        if (!pte.present) {
-            if (!handle_page_fault(virtual_page)) {
-                return nullptr;
-            }
-        }
-        
-        // Update access information
-        pte.last_access = ++current_time;
-        pte.accessed = true;
-        if (write_access) {
-            pte.dirty = true;
-        }
-        
-        char* phys_addr = ram.get_page_ptr(pte.physical_page);
-        return phys_addr + page_offset;
+    void remove(pfn_t frame) {
+        if (!contains(frame)) return;
+        if (prev[frame] != INVALID_FRAME) next[prev[frame]] = next[frame];
+        else head = next[frame];
+        if (next[frame] != INVALID_FRAME) prev[next[frame]] = prev[frame];
+        else tail = prev[frame];
+        member[frame] = 0;
+        count--;
     }
     
-    bool map_pages(vpn_t start_page, size_t num_pages, bool file_backed = false, pfn_t disk_start = 0) {
-        for (size_t i = 0; i < num_pages; i++) {
-            vpn_t virtual_page = start_page + i;
-            PageMetadata pte;
-            pte.file_backed = file_backed;
-            pte.virtual_page = virtual_page;
-            if (file_backed) {
-                pte.disk_page = disk_start + i;
-            }
-            page_table[virtual_page] = pte;
-        }
-        std::cout << "Mapped " << num_pages << " virtual pages starting at " << start_page << "\n";
-        return true;
+    void move_to_front(pfn_t frame) {
+        remove(frame);
+        push_front(frame);
     }
     
-    bool unmap_pages(vpn_t start_page, size_t num_pages) {
-        for (size_t i = 0; i < num_pages; i++) {
-            vpn_t virtual_page = start_page + i;
-            auto it = page_table.find(virtual_page);
-            if (it != page_table.end()) {
-                PageMetadata& pte = it->second;
-                if (pte.present) {
-                    // Write back if dirty and file-backed
-                    if (pte.dirty && pte.file_backed) {
-                        char buffer[PAGE_SIZE];
-                        ram.read_page(pte.physical_page, buffer);
-                        disk.write_page(pte.disk_page, buffer);
-                    }
-                    ram.free_page(pte.physical_page);
-                }
-                if (pte.swapped) {
-                    swap_space.free_slot(pte.swap_slot);
-                }
-                page_table.erase(it);
-            }
-        }
-        std::cout << "Unmapped " << num_pages << " virtual pages starting at " << start_page << "\n";
-        return true;
+    // to takes from's place in the list (the page moved frames)
+    void replace(pfn_t from, pfn_t to) {
+        if (!contains(from)) return;
+        prev[to] = prev[from];
+        next[to] = next[from];
+        if (prev[to] != INVALID_FRAME) next[prev[to]] = to;
+        else head = to;
+        if (next[to] != INVALID_FRAME) prev[next[to]] = to;
+        else tail = to;
+        member[from] = 0;
+        member[to] = 1;
     }
     
-    void print_memory_status() {
-        std::cout << "\n=== Memory Status ===\n";
-        std::cout << "RAM free frames: " << ram.get_free_frames() << "/" << (RAM_SIZE / PAGE_SIZE) << "\n";
-        std::cout << "Page table entries: " << page_table.size() << "\n";
-        
-        std::cout << "\n=== Page Table ===\n";
-        for (const auto& entry : page_table) {
-            const auto& pte = entry.second;
-            std::cout << "VPN " << entry.first << " -> ";
-            if (pte.present) {
-                std::cout << "PFN " << pte.physical_page;
-                if (pte.dirty) std::cout << " [DIRTY]";
-                if (pte.accessed) std::cout << " [ACCESSED]";
-            } else if (pte.swapped) {
-                std::cout << "SWAP slot " << pte.swap_slot;
-            } else {
-                std::cout << "Not loaded";
-            }
-            if (pte.file_backed) {
-                std::cout << " (file-backed, disk page " << pte.disk_page << ")";
-            }
-            std::cout << " [LRU: " << pte.last_access << "]\n";
-        }
-        std::cout << "==================\n\n";
-    }
+    bool contains(pfn_t frame) const { return frame < member.size() && member[frame]; }
+    pfn_t back() const { return tail; }
+    size_t size() const { return count; }
 };
 
-class VirtualMemorySystem {
+// Recently evicted pages (no frame any more), newest at the front
+class GhostList {
 private:
-    RAM ram;
-    Disk disk;
-    SwapSpace swap_space;
-    MMU mmu;
-    uintptr_t next_virtual_addr;
+    std::list<vpn_t> order;
+    std::unordered_map<vpn_t, std::list<vpn_t>::iterator> index;
     
 public:
-    VirtualMemorySystem() : mmu(ram, disk, swap_space), next_virtual_addr(0x10000000) {
-        std::cout << "Virtual Memory System with Swapping initialized\n\n";
+    void push_front(vpn_t vpn) {
+        erase(vpn);
+        order.push_front(vpn);
+        index[vpn] = order.begin();
     }
     
-    void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) {
-        size_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
-        
-        uintptr_t virtual_addr = next_virtual_addr;
-        vpn_t start_page = virtual_addr / PAGE_SIZE;
-        
-        bool file_backed = (fd != -1);
-        pfn_t disk_start = 0;
-        
-        if (file_backed) {
-            disk_start = offset / PAGE_SIZE;
-        }
-        
-        if (mmu.map_pages(start_page, pages_needed, file_backed, disk_start)) {
-            next_virtual_addr += pages_needed * PAGE_SIZE;
-            std::cout << "mmap returned: " << std::hex << virtual_addr << std::dec 
-                      << " (" << length << " bytes, " << pages_needed << " pages)\n\n";
-            return reinterpret_cast<void*>(virtual_addr);
-        }
-        
-        return nullptr;
+    bool erase(vpn_t vpn) {
+        auto it = index.find(vpn);
+        if (it == index.end()) return false;
+        order.erase(it->second);
+        index.erase(it);
+        return true;
     }
     
-    int munmap(void* addr, size_t length) {
-        uintptr_t virtual_addr = reinterpret_cast<uintptr_t>(addr);
-        vpn_t start_page = virtual_addr / PAGE_SIZE;
-        size_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
-        
-        if (mmu.unmap_pages(start_page, pages_needed)) {
-            std::cout << "munmap successful\n\n";
-            return 0;
-        }
-        return -1;
+    void pop_back() {
+        if (order.empty()) return;
+        index.erase(order.back());
+        order.pop_back();
     }
     
-    void write_memory(void* addr, const char* data, size_t size) {
-        std::cout << "Writing " << size << " bytes to " << addr << "\n";
-        char* phys_addr = mmu.translate_address(addr, true); // write_access = true
-        if (phys_addr) {
-            std::memcpy(phys_addr, data, size);
-            std::cout << "Write successful\n";
-        } else {
-            std::cout << "Write failed - invalid address\n";
-        }
-        std::cout << "\n";
-    }
+    bool contains(vpn_t vpn) const { return index.count(vpn) != 0; }
+    size_t size() const { return order.size(); }
+};
+
+enum class ReplacementPolicyKind { LRU, CLOCK, TWO_Q, ARC };
+
+// Hooks the MMU calls as pages move in and out of frames. select_victim only
+// picks a frame; the MMU confirms with on_evict once the page is written out.
+class ReplacementPolicy {
+protected:
+    size_t num_frames;
+    uint64_t scan_steps;    // Frames examined while choosing victims (eviction CPU cost)
     
-    void read_memory(void* addr, char* buffer, size_t size) {
-        std::cout << "Reading " << size << " bytes from " << addr << "\n";
-        char* phys_addr = mmu.translate_address(addr, false); // write_access = false
-        if (phys_addr) {
-            std::memcpy(buffer, phys_addr, size);
-            std::cout << "Read successful: '" << std::string(buffer, size) << "'\n";
-        } else {
-            std::cout << "Read failed - invalid address\n";
-        }
-        std::cout << "\n";
-    }
+public:
+    explicit ReplacementPolicy(size_t frames) : num_frames(frames), scan_steps(0) {}
+    virtual ~ReplacementPolicy() {}
     
-    void print_status() {
-        mmu.print_memory_status();
+    virtual const char* name() const = 0;
+    // Start of a page fault for vpn, before any victim is chosen
+    virtual void on_fault(vpn_t vpn) { (void)vpn; }
+    // Frame to evict so that incoming_vpn can be loaded
+    virtual pfn_t select_victim(vpn_t incoming_vpn) = 0;
+    // Page vpn now occupies frame
+    virtual void on_insert(pfn_t frame, vpn_t vpn) = 0;
+    // Access to a resident page
+    virtual void on_access(pfn_t frame) = 0;
+    // Victim was evicted (remembered in history by adaptive policies)
+    virtual void on_evict(pfn_t frame) { on_remove(frame); }
+    // Frame released without eviction (munmap)
+    virtual void on_remove(pfn_t frame) = 0;
+    // Page moved from one frame to another (NUMA migration), history kept
+    virtual void on_migrate(pfn_t from, pfn_t to) = 0;
+    
+    uint64_t get_scan_steps() const { return scan_steps; }
+};
+
+// Exact LRU: access moves the frame to the front, the victim is the tail. O(1).
+class LRUPolicy : public ReplacementPolicy {
+private:
+    FrameList lru;
+    
+public:
+    explicit LRUPolicy(size_t frames) : ReplacementPolicy(frames), lru(frames) {}
+    
+    const char* name() const override { return "LRU"; }
+    
+    pfn_t select_victim(vpn_t) override {
+        scan_steps++;
+        return lru.back();
+    }
+    
+    void on_insert(pfn_t frame, vpn_t) override { lru.move_to_front(frame); }
+    void on_access(pfn_t frame) override { lru.move_to_front(frame); }
+    void on_remove(pfn_t frame) override { lru.remove(frame); }
+    void on_migrate(pfn_t from, pfn_t to) override { lru.replace(from, to); }
+};
+
+// CLOCK / second chance: sweep the frames, clearing each frame's accessed bit,
+// and take the first frame whose bit is already clear
+class ClockPolicy : public ReplacementPolicy {
+private:
+    RAM& ram;
+    size_t hand;
+    
+public:
+    ClockPolicy(size_t frames, RAM& r) : ReplacementPolicy(frames), ram(r), hand(0) {}
+    
+    const char* name() const override { return "CLOCK"; }
+    
+    pfn_t select_victim(vpn_t) override {
+        // Two full sweeps always find a frame: the first clears every bit
+        for (size_t n = 0; n < 2 * num_frames; n++) {
+            pfn_t frame = hand;
+            hand = (hand + 1) % num_frames;
+            scan_steps++;
+            
+            if (!ram.get_page_metadata(frame)) continue;
+            if (!ram.test_and_clear_accessed(frame)) {
+                return frame;
+            }
+        }
+        return INVALID_FRAME;
+    }
+    
+    // The per-frame accessed bits in RAM are the only state CLOCK needs
+    void on_insert(pfn_t, vpn_t) override {}
+    void on_access(pfn_t) override {}
+    void on_remove(pfn_t) override {}
+    void on_migrate(pfn_t, pfn_t) override {}
+};
+
+// 2Q (Johnson & Shasha): new pages enter the FIFO A1in; pages re-faulted while
+// remembered in the A1out ghost queue are promoted to the LRU queue Am
+class TwoQPolicy : public ReplacementPolicy {
+private:
+    FrameList a1in;
+    FrameList am;
+    GhostList a1out;
+    std::vector<vpn_t> frame_vpn;
+    size_t kin;     // Target size of A1in (25% of frames)
+    size_t kout;    // Capacity of A1out (50% of frames)
+    
+public:
+    explicit TwoQPolicy(size_t frames) 
+        : ReplacementPolicy(frames), a1in(frames), am(frames), frame_vpn(frames, 0),
+          kin(std::max<size_t>(1, frames / 4)), kout(std::max<size_t>(1, frames / 2)) {}
+    
+    const char* name() const override { return "2Q"; }
+    
+    pfn_t select_victim(vpn_t) override {
+        scan_steps++;
+        if (a1in.size() > kin || am.size() == 0) {
+            return a1in.back();
+        }
+        return am.back();
+    }
+    
+    void on_insert(pfn_t frame, vpn_t vpn) override {
+        frame_vpn[frame] = vpn;
+        if (a1out.erase(vpn)) {
+            am.push_front(frame);
+        } else {
+            a1in.push_front(frame);
+        }
+    }
+    
+    void on_access(pfn_t frame) override {
+        // Hits in A1in do not promote: a second touch soon after the first is correlated
+        if (am.contains(frame)) {
+            am.move_to_front(frame);
+        }
+    }
+    
+    void on_evict(pfn_t frame) override {
+        if (a1in.contains(frame)) {
+            a1out.push_front(frame_vpn[frame]);
+            while (a1out.size() > kout) {
+                a1out.pop_back();
+            }
+        }
+        on_remove(frame);
+    }
+    
+    void on_remove(pfn_t frame) override {
+        a1in.remove(frame);
+        am.remove(frame);
+    }
+    
+    void on_migrate(pfn_t from, pfn_t to) override {
+        frame_vpn[to] = frame_vpn[from];
+        a1in.replace(from, to);
+        am.replace(from, to);
+    }
+};
+
+// ARC (Megiddo & Modha): T1 holds pages seen once, T2 pages seen twice or more.
+// Ghost lists B1/B2 remember evictions from each and move the target size p of
+// T1 toward whichever list is currently producing re-faults.
+class ARCPolicy : public ReplacementPolicy {
+private:
+    FrameList t1;
+    FrameList t2;
+    GhostList b1;
+    GhostList b2;
+    std::vector<vpn_t> frame_vpn;
+    size_t p;           // Target size of T1
+    bool ghost_hit;     // Current fault was found in B1 or B2
+    
+public:
+    explicit ARCPolicy(size_t frames) 
+        : ReplacementPolicy(frames), t1(frames), t2(frames), frame_vpn(frames, 0),
+          p(0), ghost_hit(false) {}
+    
+    const char* name() const override { return "ARC"; }
+    
+    void on_fault(vpn_t vpn) override {
+        ghost_hit = false;
+        if (b1.contains(vpn)) {
+            size_t delta = std::max<size_t>(1, b2.size() / std::max<size_t>(1, b1.size()));
+            p = std::min(num_frames, p + delta);
+            ghost_hit = true;
+        } else if (b2.contains(vpn)) {
+            size_t delta = std::max<size_t>(1, b1.size() / std::max<size_t>(1, b2.size()));
+            p = (p > delta) ? p - delta : 0;
+            ghost_hit = true;
+        } else {
+            // Keep history bounded to the cache size (ARC case IV)
+            if (t1.size() + b1.size() >= num_frames && b1.size() > 0) {
+                b1.pop_back();
+            } else if (t1.size() + t2.size() + b1.size() + b2.size() >= 2 * num_frames && b2.size() > 0) {
+                b2.pop_back();
+            }
+        }
+    }
+    
+    // ARC's REPLACE step
+    pfn_t select_victim(vpn_t incoming_vpn) override {
+        scan_steps++;
+        bool in_b2 = b2.contains(incoming_vpn);
+        if (t1.size() > 0 && (t1.size() > p || (in_b2 && t1.size() == p) || t2.size() == 0)) {
+            return t1.back();
+        }
+        return t2.back();
+    }
+    
+    void on_insert(pfn_t frame, vpn_t vpn) override {
+        frame_vpn[frame] = vpn;
+        if (ghost_hit && (b1.erase(vpn) || b2.erase(vpn))) {
+            t2.push_front(frame);
+        } else {
+            t1.push_front(frame);
+        }
+        ghost_hit = false;
+    }
+    
+    void on_access(pfn_t frame) override {
+        // Any hit moves the page to the frequency side
+        t1.remove(frame);
+        t2.move_to_front(frame);
+    }
+    
+    void on_evict(pfn_t frame) override {
+        if (t1.contains(frame)) {
+            b1.push_front(frame_vpn[frame]);
+        } else if (t2.contains(frame)) {
+            b2.push_front(frame_vpn[frame]);
+        }
+        on_remove(frame);
+    }
+    
+    void on_remove(pfn_t frame) override {
+        t1.remove(frame);
+        t2.remove(frame);
+    }
+    
+    void on_migrate(pfn_t from, pfn_t to) override {
+        frame_vpn[to] = frame_vpn[from];
+        t1.replace(from, to);
+        t2.replace(from, to);
+    }
+};
+
+std::unique_ptr<ReplacementPolicy> make_replacement_policy(ReplacementPolicyKind kind, size_t frames, RAM& ram) {
+    switch (kind) {
+        case ReplacementPolicyKind::CLOCK: return std::make_unique<ClockPolicy>(frames, ram);
+        case ReplacementPolicyKind::TWO_Q: return std::make_unique<TwoQPolicy>(frames);
+        case ReplacementPolicyKind::ARC:   return std::make_unique<ARCPolicy>(frames);
+        case ReplacementPolicyKind::LRU:
+        default:                           return std::make_unique<LRUPolicy>(frames);
+    }
+}
+
+// Where a mapping's pages get their frames on a multi-node RAM: the node of
+// the CPU that first touches each page, round-robin over the nodes by page,
+// or one node (falling back to the others only when it is full, since reclaim
+// is global)
+enum class NumaPolicy { FIRST_TOUCH, INTERLEAVE, BIND };
+
+// Kept per VMA, so areas with different policies never merge
+struct NumaPlacement {
+    NumaPolicy policy;
+    size_t node;    // BIND target
+    
+    bool operator==(const NumaPlacement& other) const { return policy == other.policy && node == other.node; }
+};
+
+using Area = Vma<NumaPlacement>;
+
+struct NumaStats {
+    uint64_t local_accesses = 0;
+    uint64_t remote_accesses = 0;
+    uint64_t memory_ns = 0;         // Simulated DRAM time of those accesses
+    uint64_t remote_penalty_ns = 0; // Share of it over all-local
+    uint64_t preferred_allocs = 0;  // Frames from the node the policy asked for
+    uint64_t fallback_allocs = 0;
+    uint64_t pages_migrated = 0;
+    uint64_t migrate_failures = 0;  // Target node had no free frame
+};
+
+// Translations that hit are timed one in this many per thread, so most add
+// no clock read or histogram update past the one every access takes
+const uint32_t TRANSLATE_SAMPLE_RATE = 64;
+
+class MMU {
+private:
+    // PDX/PTX indexed like x86 plus one directory level above, so replayed
+    // traces are not limited to a 4GB space. Entries never move, which is
+    // what lets RAM::frame_to_page hold pointers into the table.
+    RadixPageTable<PageMetadata, Geometry::LEVELS, Geometry::BITS_PER_LEVEL> page_table;
+    // Mapped areas (mmap, munmap, mprotect). PTEs exist only inside them and
+    // carry their protection as PM_READ / PM_WRITE, so hits need no VMA
+    // lookup. Changed with the mmap lock held exclusive and the fault lock.
+    VmaTree<NumaPlacement> vmas;
+    RAM& ram;
+    Disk& disk;
+    SwapSpace& swap_space;
+    pfn_t next_disk_page;
+    std::atomic<timestamp_t> current_time;
+    std::unique_ptr<ReplacementPolicy> policy;
+    
+    // Replacement statistics. The hot ones are sharded (vm_metrics.h), so
+    // concurrent hits and faults do not share a cache line.
+    ShardedCounter hits;        // Accesses to resident pages
+    ShardedCounter faults;
+    std::atomic<uint64_t> protection_faults;    // Accesses the mapping's protection refused
+    ShardedCounter evictions;
+    uint64_t eviction_ns;       // Time spent choosing victims
+    ShardedCounter minor_faults;    // Page found without device I/O: zero fill, page cache, zswap
+    ShardedCounter major_faults;    // Read from the disk or the swap device
+    ShardedCounter swap_ins;        // Pages read from the swap device
+    ShardedCounter swap_outs;       // Pages written to the swap device
+    ShardedCounter writebacks;      // Dirty file pages written back to the disk
+    ShardedCounter page_table_pages_allocated;
+    std::atomic<uint64_t> page_table_pages;     // Directories and leaf tables in use
+    LatencyHistogram fault_latency;     // Whole fault, as the accessing thread saw it
+    LatencyHistogram eviction_latency;  // Victim selection through its write-out
+    LatencyHistogram translate_latency; // Hits, one in TRANSLATE_SAMPLE_RATE per thread
+    std::chrono::steady_clock::time_point created;
+    
+    // Background write-back (see WritebackDaemon). All MMU state is guarded by
+    // lock once a daemon runs; callers hold it across translate + copy, except
+    // for hits in concurrent mode (see below).
+    std::mutex lock;
+    std::condition_variable reclaim_wanted;
+    bool writeback_enabled;
+    size_t low_watermark;       // Wake the daemon below this many free frames
+    size_t high_watermark;      // The daemon reclaims up to this many
+    uint64_t direct_reclaims;   // Evictions done on the fault path
+    uint64_t background_reclaims;
+    uint64_t write_ios;         // Write-back I/Os issued by the daemon
+    uint64_t pages_written;     // Pages those I/Os covered
+    
+    // Where a victim's contents must go before its frame is reused
+    struct PendingWrite {
+        pfn_t frame;
+        uint32_t block;         // Disk page or swap slot
+        bool to_disk;
+        bool needed;
+    };
+    std::vector<PendingWrite> inflight;     // Writes in progress with lock released
+    std::condition_variable writeback_done;
+    
+    // Concurrent mode (enable_concurrency). Lock order: mmap_lock, lock (the
+    // fault lock), one PTE lock, lru_lock. Accesses hold mmap_lock shared and
+    // mmap/munmap hold it exclusive, so the page table's shape only changes
+    // when nobody is walking it. A hit then takes just its page's PTE lock
+    // (striped by VPN, like split page table locks) and lru_lock if the
+    // policy tracks hits. Faults and reclaim take the fault lock but drop it
+    // around device I/O; a page being loaded is marked PM_LOCKED meanwhile.
+    static const size_t PTE_LOCK_STRIPES = 64;
+    bool concurrent;
+    std::shared_mutex mmap_lock;
+    std::mutex pte_locks[PTE_LOCK_STRIPES];
+    std::mutex lru_lock;                    // The replacement policy's state
+    std::condition_variable page_unlocked;  // A PM_LOCKED page was loaded
+    std::atomic<uint64_t> fault_lock_waits; // Acquisitions that found the lock held
+    std::atomic<uint64_t> pte_lock_waits;
+    std::atomic<uint64_t> lru_lock_waits;
+    
+    // File readahead (readahead.h). Each file-backed map_pages call is one
+    // mapping with its own window, keyed by its first page.
+    struct FileMapping {
+        vpn_t end;
+        ReadaheadWindow window;
+    };
+    std::map<vpn_t, FileMapping> file_mappings;
+    ReadaheadConfig ra_config;
+    ReadaheadStats ra_stats;
+    PageCache page_cache;
+    
+    // Resident file pages by disk page, shared by every mapping of them. A
+    // disk page belongs to one (file, page index) through the extent table,
+    // so mappings of the same file page find the same frame. RAM's
+    // frame_to_page holds a frame's first mapper; the others are listed in
+    // shared_mappers, so eviction can unmap them all.
+    std::unordered_map<uint32_t, pfn_t> file_frames;
+    std::unordered_map<pfn_t, std::vector<std::pair<vpn_t, PageMetadata*>>> shared_mappers;
+    std::unordered_set<uint32_t> file_loads;    // Disk pages being read with the fault lock dropped
+    uint64_t shared_faults;     // Faults that mapped a frame another mapping had loaded
+    
+    // Compressed swap cache (enable_zswap); swap slots go through it when set
+    std::unique_ptr<Zswap> zswap;
+    
+    // Swap cache: an anonymous page read back from a swap slot keeps the
+    // slot (PM_SWAPCACHE) while swap is at most half full, so evicting it
+    // again clean just drops the frame. A write frees the slot, as does slot
+    // pressure, SWAP_CACHE_BATCH pages at a time.
+    static const size_t SWAP_CACHE_BATCH = 32;
+    bool swap_cache_enabled;
+    std::atomic<size_t> swap_cached_pages;
+    std::atomic<uint64_t> swap_cache_write_drops;   // Writes hit without the fault lock
+    uint64_t swap_cache_hits;           // Clean re-evictions that skipped the write
+    uint64_t swap_cache_pressure_drops;
+    
+    // NUMA (StorageConfig::numa_nodes > 1). CPU c sits on node c % nodes and
+    // each thread says which CPU it runs on with set_cpu. Every access is
+    // charged local or remote latency by the frame's node; the placement
+    // policy is the page's VMA's.
+    static inline thread_local unsigned current_cpu = 0;
+    uint32_t numa_local_ns;
+    uint32_t numa_remote_ns;
+    std::atomic<uint64_t> local_accesses;
+    std::atomic<uint64_t> remote_accesses;
+    timestamp_t last_numa_scan;     // current_time of the previous migration pass
+    uint64_t pages_migrated;
+    uint64_t migrate_failures;
+    
+    // Lock m, counting acquisitions that had to wait for another thread
+    static std::unique_lock<std::mutex> acquire(std::mutex& m, std::atomic<uint64_t>& waits) {
+        std::unique_lock<std::mutex> held(m, std::try_to_lock);
+        if (!held) {
+            waits.fetch_add(1, std::memory_order_relaxed);
+            held.lock();
+        }
+        return held;
+    }
+    
+    // After map_range / unmap_range: tables they added count as allocated
+    void count_page_table_pages() {
+        uint64_t now = page_table.leaf_tables() + page_table.directories();
+        uint64_t before = page_table_pages.exchange(now, std::memory_order_relaxed);
+        if (now > before) page_table_pages_allocated += now - before;
+    }
+    
+    static uint32_t prot_bits(int prot) {
+        return (prot != PROT_NONE ? PM_READ : 0) | ((prot & PROT_WRITE) ? PM_WRITE : 0);
+    }
+    
+    // The mapping's protection allows this access; otherwise a SIGSEGV
+    bool access_permitted(const PageMetadata& pte, void* virtual_addr, bool write_access) {
+        if (pte.flags & (write_access ? PM_WRITE : PM_READ)) return true;
+        protection_faults++;
+        VM_LOG(ERROR) << "Protection fault: " << (write_access ? "write to " : "read of ") << virtual_addr << "\n";
+        return false;
+    }
+    
+    size_t cpu_node() const { return current_cpu % ram.num_nodes(); }
+    
+    // Node a newly loaded page of vpn should come from
+    size_t home_node(vpn_t vpn) const {
+        if (ram.num_nodes() > 1 && vpn != INVALID_VPN) {
+            const Area* vma = vmas.find(vpn);
+            if (vma && vma->attr.policy == NumaPolicy::INTERLEAVE) return vpn % ram.num_nodes();
+            if (vma && vma->attr.policy == NumaPolicy::BIND) return vma->attr.node % ram.num_nodes();
+        }
+        return cpu_node();
+    }
+    
+    // Charge an access to frame as local or remote to the running CPU
+    void account_access(pfn_t frame) {
+        if (ram.num_nodes() < 2) return;
+        size_t node = cpu_node();
+        ram.touch_from(frame, node);
+        (node == ram.node_of(frame) ? local_accesses : remote_accesses).fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Only concurrent mode needs these; otherwise they return an empty lock
+    std::unique_lock<std::mutex> lock_pte(vpn_t vpn) {
+        if (!concurrent) return std::unique_lock<std::mutex>();
+        return acquire(pte_locks[vpn % PTE_LOCK_STRIPES], pte_lock_waits);
+    }
+    std::unique_lock<std::mutex> lock_lru() {
+        if (!concurrent) return std::unique_lock<std::mutex>();
+        return acquire(lru_lock, lru_lock_waits);
+    }
+    
+    // Device I/O on the fault path: with a guard (concurrent mode) it runs
+    // with the fault lock released
+    template <typename Fn>
+    static void with_lock_dropped(std::unique_lock<std::mutex>* guard, Fn io) {
+        if (guard) guard->unlock();
+        io();
+        if (guard) guard->lock();
+    }
+    
+    // Swap slot I/O, through the compressed cache when there is one.
+    // swap_in returns true if the slot still holds the page afterwards
+    // (zswap loads are exclusive and drop their copy).
+    void swap_out(swap_slot_t slot, const char* data) {
+        if (!zswap || !zswap->store(slot, data)) {
+            swap_space.write_page(slot, data);
+            swap_outs++;
+        }
+    }
+    bool swap_in(swap_slot_t slot, char* buffer) {
+        if (zswap && zswap->load(slot, buffer)) {
+            return false;
+        }
+        swap_space.read_page(slot, buffer);
+        swap_ins++;
+        return true;
+    }
+    void release_slot(swap_slot_t slot) {
+        if (zswap) zswap->invalidate(slot);
+        swap_space.free_slot(slot);
+    }
+    
+    // Set PM_DIRTY on a write, under the page's PTE lock in concurrent mode.
+    // The swap cache's copy goes stale, so its slot is freed.
+    void mark_dirty(PageMetadata& pte) {
+        if (pte.swap_cached()) {
+            swap_space.free_slot(pte.swap_slot());
+            pte.clear(PM_SWAPCACHE);
+            swap_cached_pages--;
+            swap_cache_write_drops++;
+        }
+        pte.set(PM_DIRTY);
+    }
+    
+    // Swap is full: free the slots of up to SWAP_CACHE_BATCH resident pages.
+    // Takes each page's PTE lock unless it is owner_vpn's stripe, which the
+    // caller holds, like unmap_sharers.
+    size_t drop_swap_cache(vpn_t owner_vpn) {
+        size_t dropped = 0;
+        if (swap_cached_pages == 0) return 0;
+        page_table.for_each([&](uint64_t vpn, PageMetadata& pte) {
+            if (dropped >= SWAP_CACHE_BATCH) return;
+            std::unique_lock<std::mutex> pte_guard;
+            if (vpn % PTE_LOCK_STRIPES != owner_vpn % PTE_LOCK_STRIPES) {
+                pte_guard = lock_pte(vpn);
+            }
+            if (!pte.swap_cached()) return;
+            swap_space.free_slot(pte.swap_slot());
+            pte.clear(PM_SWAPCACHE);
+            swap_cached_pages--;
+            dropped++;
+        });
+        swap_cache_pressure_drops += dropped;
+        if (dropped > 0) {
+            VM_LOG(INFO) << "Swap cache: freed " << dropped << " slots under pressure\n";
+        }
+        return dropped;
+    }
+    
+    // Take the policy's next victim away from its page. Reserves a swap slot
+    // for anonymous pages and fills in write; the frame is not freed yet.
+    pfn_t detach_victim(vpn_t incoming_vpn, PendingWrite& write) {
+        auto start = std::chrono::steady_clock::now();
+        pfn_t victim_frame;
+        {
+            auto lru = lock_lru();
+            victim_frame = policy->select_victim(incoming_vpn);
+        }
+        eviction_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (victim_frame == INVALID_FRAME) {
+            VM_LOG(ERROR) << "ERROR: No page to evict!\n";
+            return INVALID_FRAME;
+        }
+        
+        PageMetadata* victim_meta = ram.get_page_metadata(victim_frame);
+        if (!victim_meta) {
+            VM_LOG(ERROR) << "ERROR: Invalid victim page metadata!\n";
+            return INVALID_FRAME;
+        }
+        
+        vpn_t victim_vpn = ram.get_frame_vpn(victim_frame);
+        VM_LOG(INFO) << "Evicting virtual page " << victim_vpn 
+                     << " from physical frame " << victim_frame << "\n";
+        VM_EVENT(EVICT, victim_vpn, victim_frame);
+        
+        // Waits for any hit still copying to or from the frame
+        auto pte_guard = lock_pte(victim_vpn);
+        
+        // Anonymous pages need a swap slot before the frame can be dropped,
+        // unless the swap cache still has their clean copy in one
+        bool cached = victim_meta->swap_cached();
+        bool needs_slot = !victim_meta->file_backed() && !victim_meta->swapped() && !cached;
+        if (cached) {
+            VM_LOG(INFO) << "Swap cache: slot " << victim_meta->swap_slot() << " still holds page "
+                         << victim_vpn << ", no write\n";
+            victim_meta->clear(PM_SWAPCACHE);
+            victim_meta->set(PM_SWAPPED);
+            swap_cached_pages--;
+            swap_cache_hits++;
+        }
+        if (needs_slot) {
+            if (swap_space.get_free_slots() == 0) {
+                drop_swap_cache(victim_vpn);
+            }
+            swap_slot_t slot = swap_space.allocate_slot();
+            if (slot == INVALID_SWAP_SLOT) {
+                VM_LOG(ERROR) << "ERROR: Swap space exhausted, cannot evict!\n";
+                return INVALID_FRAME;
+            }
+            victim_meta->backing = slot;
+            victim_meta->set(PM_SWAPPED);
+        }
+        
+        // Dirty pages and fresh anonymous pages must be written out
+        bool sharer_dirty = unmap_sharers(victim_frame, victim_vpn);
+        write.frame = victim_frame;
+        write.block = victim_meta->backing;
+        write.to_disk = victim_meta->file_backed();
+        write.needed = victim_meta->dirty() || sharer_dirty || needs_slot;
+        if (write.to_disk) {
+            file_frames.erase(write.block);
+        }
+        if (write.needed && write.to_disk) {
+            drop_cached(write.block);
+        }
+        
+        // Update page metadata
+        victim_meta->clear(PM_PRESENT | PM_DIRTY);
+        victim_meta->physical_page = 0;
+        
+        {
+            auto lru = lock_lru();
+            policy->on_evict(victim_frame);
+        }
+        evictions++;
+        
+        return victim_frame;
+    }
+    
+    // Page replacement algorithm, synchronous on the fault path. With a guard
+    // (concurrent mode) the write runs with the fault lock dropped, tracked in
+    // inflight, and the frame is returned still allocated so no other fault
+    // can take it meanwhile.
+    pfn_t evict_page(vpn_t incoming_vpn, std::unique_lock<std::mutex>* guard = nullptr) {
+        VM_LOG(INFO) << "RAM full! Evicting " << policy->name() << " page...\n";
+        
+        auto start = std::chrono::steady_clock::now();
+        PendingWrite write;
+        pfn_t victim_frame = detach_victim(incoming_vpn, write);
+        if (victim_frame == INVALID_FRAME) {
+            return INVALID_FRAME;
+        }
+        
+        // The frame stays allocated until the write is done, so the device
+        // reads it in place
+        const char* data = ram.get_page_ptr(victim_frame);
+        if (guard) {
+            ram.assign_page(victim_frame, nullptr, 0);  // Unowned: CLOCK skips it
+        }
+        
+        if (write.needed) {
+            if (guard) inflight.push_back(write);
+            with_lock_dropped(guard, [&] {
+                if (write.to_disk) {
+                    // Write back to original file
+                    disk.write_page(write.block, data);
+                    writebacks++;
+                } else {
+                    // Write to swap space
+                    swap_out(write.block, data);
+                }
+            });
+            if (guard) finish_writes({write});
+        }
+        
+        // Free the physical frame
+        if (!guard) {
+            ram.free_page(victim_frame);
+        }
+        direct_reclaims++;
+        eviction_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        
+        return victim_frame;
+    }
+    
+    // Drop finished writes from inflight and wake faults waiting on them
+    void finish_writes(const std::vector<PendingWrite>& writes) {
+        for (const PendingWrite& done : writes) {
+            auto it = std::find_if(inflight.begin(), inflight.end(), [&](const PendingWrite& w) {
+                return w.block == done.block && w.to_disk == done.to_disk;
+            });
+            if (it != inflight.end()) inflight.erase(it);
+        }
+        writeback_done.notify_all();
+    }
+    
+    // A free frame not yet owned by any page, so the replacement policy
+    // cannot pick it. Cached readahead pages are dropped before evicting.
+    pfn_t allocate_frame(vpn_t incoming_vpn, std::unique_lock<std::mutex>* guard = nullptr) {
+        size_t node = home_node(incoming_vpn);
+        pfn_t frame = ram.allocate_page(nullptr, 0, node);
+        while (frame == INVALID_FRAME && page_cache.size() > 0) {
+            ram.free_page(page_cache.pop_oldest());
+            ra_stats.cache_dropped++;
+            frame = ram.allocate_page(nullptr, 0, node);
+        }
+        if (frame == INVALID_FRAME) {
+            frame = evict_page(incoming_vpn, guard);
+            if (frame == INVALID_FRAME || guard) {
+                return frame;
+            }
+            // Now allocate the freed page
+            ram.free_page(frame); // Make sure it's marked free
+            frame = ram.allocate_page(nullptr, 0, node);
+        }
+        return frame;
+    }
+    
+    // Unmap a victim's other mappers; true if any of them dirtied the page.
+    // Each sharer's PTE lock is taken unless it is the victim's own stripe,
+    // which the caller holds. Only one thread at a time does this, under
+    // the fault lock, so holding two stripes cannot deadlock.
+    bool unmap_sharers(pfn_t frame, vpn_t owner_vpn) {
+        auto it = shared_mappers.find(frame);
+        if (it == shared_mappers.end()) return false;
+        bool dirty = false;
+        for (auto& mapper : it->second) {
+            std::unique_lock<std::mutex> pte_guard;
+            if (mapper.first % PTE_LOCK_STRIPES != owner_vpn % PTE_LOCK_STRIPES) {
+                pte_guard = lock_pte(mapper.first);
+            }
+            dirty = dirty || mapper.second->dirty();
+            mapper.second->clear(PM_PRESENT | PM_DIRTY);
+            mapper.second->physical_page = 0;
+        }
+        shared_mappers.erase(it);
+        return dirty;
+    }
+    
+    // vpn stops mapping frame. Returns true if other mappings still use it;
+    // when the owner leaves, the last sharer becomes the owner.
+    bool drop_mapper(pfn_t frame, vpn_t vpn) {
+        auto it = shared_mappers.find(frame);
+        if (it == shared_mappers.end()) return false;
+        auto& mappers = it->second;
+        if (ram.get_frame_vpn(frame) == vpn) {
+            ram.set_owner(frame, mappers.back().second, mappers.back().first);
+            mappers.pop_back();
+        } else {
+            mappers.erase(std::find_if(mappers.begin(), mappers.end(),
+                                       [&](const std::pair<vpn_t, PageMetadata*>& m) { return m.first == vpn; }));
+        }
+        if (mappers.empty()) shared_mappers.erase(it);
+        return true;
+    }
+    
+    // The disk copy is about to change, so a cached read of it is stale
+    void drop_cached(uint32_t disk_page) {
+        pfn_t frame = page_cache.take(disk_page);
+        if (frame != PageCache::NONE) {
+            ram.free_page(frame);
+        }
+    }
+    
+    FileMapping* find_file_mapping(vpn_t vpn, vpn_t* start = nullptr) {
+        auto it = file_mappings.upper_bound(vpn);
+        if (it == file_mappings.begin()) return nullptr;
+        --it;
+        if (vpn >= it->second.end) return nullptr;
+        if (start) *start = it->first;
+        return &it->second;
+    }
+    
+    // Forget mappings overlapping [start, end); pieces outside it remain
+    void drop_file_mappings(vpn_t start, vpn_t end) {
+        auto it = file_mappings.upper_bound(start);
+        if (it != file_mappings.begin()) --it;
+        while (it != file_mappings.end() && it->first < end) {
+            vpn_t m_start = it->first;
+            vpn_t m_end = it->second.end;
+            if (m_end <= start) {
+                ++it;
+                continue;
+            }
+            it = file_mappings.erase(it);
+            if (m_start < start) file_mappings[m_start] = FileMapping{start, ReadaheadWindow()};
+            if (m_end > end) file_mappings[end] = FileMapping{m_end, ReadaheadWindow()};
+        }
+    }
+    
+    // Read the mapped, not yet resident file pages in [first, first + count)
+    // into the page cache, one disk read per run of consecutive disk pages.
+    // Without may_evict only free frames are used.
+    void read_ahead(vpn_t first, uint32_t count, bool may_evict) {
+        std::vector<std::pair<uint32_t, pfn_t>> run;   // (disk page, frame)
+        auto read_run = [&]() {
+            if (run.empty()) return;
+            std::vector<char> buffer(run.size() * PAGE_SIZE);
+            disk.read_pages(run[0].first, run.size(), buffer.data());
+            for (size_t k = 0; k < run.size(); k++) {
+                ram.write_page(run[k].second, &buffer[k * PAGE_SIZE]);
+                page_cache.insert(run[k].first, run[k].second);
+            }
+            ra_stats.readahead_ios++;
+            ra_stats.readahead_pages += run.size();
+            run.clear();
+        };
+        
+        for (vpn_t vpn = first; vpn < first + count; vpn++) {
+            PageMetadata* pte = page_table.find(vpn);
+            bool wanted = false;
+            if (pte) {
+                auto pte_guard = lock_pte(vpn);
+                wanted = pte->file_backed() && !pte->present() && !pte->locked();
+            }
+            wanted = wanted && !page_cache.contains(pte->disk_page()) && !file_frames.count(pte->disk_page()) &&
+                     !file_loads.count(pte->disk_page()) && !is_inflight(pte->disk_page(), true);
+            if (!run.empty() && (!wanted || pte->disk_page() != run.back().first + 1)) {
+                read_run();
+            }
+            if (!wanted) continue;
+            // Concurrent faults only read ahead into free frames, so this
+            // path never writes a victim out under the fault lock
+            pfn_t frame = (concurrent || !may_evict) ? ram.allocate_page(nullptr, 0, home_node(vpn))
+                                                     : allocate_frame(INVALID_VPN);
+            if (frame == INVALID_FRAME) break;
+            run.emplace_back(pte->disk_page(), frame);
+        }
+        read_run();
+    }
+    
+    // Advance the faulting mapping's readahead window, at most half of RAM
+    void read_ahead_for(vpn_t vpn, bool may_evict = true) {
+        vpn_t start;
+        FileMapping* mapping = find_file_mapping(vpn, &start);
+        if (!ra_config.enabled || !mapping) return;
+        ReadaheadConfig limits = ra_config;
+        limits.max_pages = (uint32_t)std::min<size_t>(limits.max_pages, ram.total_frames() / 2);
+        limits.initial_pages = std::min(limits.initial_pages, limits.max_pages);
+        uint64_t first;
+        uint32_t count;
+        if (!mapping->window.on_fault(vpn, vpn == start, limits, first, count)) return;
+        if (first >= mapping->end) return;
+        read_ahead(first, (uint32_t)std::min<uint64_t>(count, mapping->end - first), may_evict);
+    }
+    
+    // Map cached or already resident neighbours of vpn in its aligned
+    // fault_around_bytes block
+    void fault_around(vpn_t vpn) {
+        vpn_t pages = ra_config.fault_around_bytes / PAGE_SIZE;
+        if (!ra_config.enabled || pages < 2 || (page_cache.size() == 0 && file_frames.empty())) return;
+        vpn_t first = vpn - vpn % pages;
+        for (vpn_t v = first; v < first + pages; v++) {
+            PageMetadata* pte = page_table.find(v);
+            if (v == vpn || !pte) continue;
+            auto pte_guard = lock_pte(v);
+            if (!pte->file_backed() || pte->present() || pte->locked()) continue;
+            auto resident = file_frames.find(pte->disk_page());
+            bool shared = (resident != file_frames.end());
+            pfn_t frame = shared ? resident->second : page_cache.take(pte->disk_page());
+            if (frame == PageCache::NONE) continue;
+            install_file_page(*pte, v, frame, shared);
+            ra_stats.fault_around_pages++;
+        }
+    }
+    
+    // Point a file page's PTE at frame, called with its PTE lock held. A
+    // shared frame gains a mapper and counts as an access; a new one goes
+    // to the replacement policy and into file_frames.
+    void install_file_page(PageMetadata& pte, vpn_t vpn, pfn_t frame, bool shared) {
+        auto lru = lock_lru();
+        if (shared) {
+            shared_mappers[frame].emplace_back(vpn, &pte);
+            policy->on_access(frame);
+        } else {
+            ram.assign_page(frame, &pte, vpn);
+            policy->on_insert(frame, vpn);
+            file_frames[pte.disk_page()] = frame;
+        }
+        pte.physical_page = frame;
+        pte.set(PM_PRESENT);
+    }
+    
+    bool is_inflight(uint32_t block, bool to_disk) const {
+        for (const PendingWrite& w : inflight) {
+            if (w.block == block && w.to_disk == to_disk) return true;
+        }
+        return false;
+    }
+    
+    // Called with lock held (by a lock_guard up the stack): sleep until the
+    // daemon's current batch no longer covers this disk page / swap slot
+    void wait_for_writeback(uint32_t block, bool to_disk) {
+        if (!is_inflight(block, to_disk)) return;
+        std::unique_lock<std::mutex> held(lock, std::adopt_lock);
+        writeback_done.wait(held, [&] { return !is_inflight(block, to_disk); });
+        held.release();
+    }
+    
+    // Concurrent mode: mark the page PM_LOCKED so this thread loads it, or
+    // wait while another thread does. Returns false once it is present.
+    bool claim_fault(PageMetadata& pte, vpn_t vpn, std::unique_lock<std::mutex>& guard) {
+        for (;;) {
+            auto pte_guard = lock_pte(vpn);
+            if (pte.present()) return false;
+            if (!pte.locked()) {
+                pte.set(PM_LOCKED);
+                return true;
+            }
+            pte_guard.unlock();
+            page_unlocked.wait(guard);
+        }
+    }
+    
+public:
+    MMU(RAM& r, Disk& d, SwapSpace& s, ReplacementPolicyKind kind = ReplacementPolicyKind::LRU) 
+        : vmas(MMAP_BASE / PAGE_SIZE, VPN_LIMIT),
+          ram(r), disk(d), swap_space(s), next_disk_page(0), current_time(0),
+          policy(make_replacement_policy(kind, r.total_frames(), r)),
+          protection_faults(0), eviction_ns(0), page_table_pages(0), created(std::chrono::steady_clock::now()),
+          writeback_enabled(false),
+          low_watermark(0), high_watermark(0), direct_reclaims(0), background_reclaims(0),
+          write_ios(0), pages_written(0), concurrent(false), fault_lock_waits(0),
+          pte_lock_waits(0), lru_lock_waits(0), shared_faults(0), swap_cache_enabled(true),
+          swap_cached_pages(0), swap_cache_write_drops(0), swap_cache_hits(0), swap_cache_pressure_drops(0),
+          numa_local_ns(90), numa_remote_ns(150), local_accesses(0), remote_accesses(0), last_numa_scan(0),
+          pages_migrated(0), migrate_failures(0) {
+        std::cout << "MMU initialized (" << policy->name() << " replacement)\n";
+    }
+    
+    // Load virtual_page. In concurrent mode guard holds the fault lock, which
+    // is dropped for device I/O, and zeroed_frame may be a frame the caller
+    // allocated and cleared beforehand for a zero-fill fault (freed if unused).
+    bool handle_page_fault(vpn_t virtual_page, std::unique_lock<std::mutex>* guard = nullptr,
+                           pfn_t zeroed_frame = INVALID_FRAME) {
+        VM_LOG(INFO) << "Page fault: virtual page " << virtual_page << "\n";
+        VM_EVENT(PAGE_FAULT, virtual_page, 0);
+        
+        PageMetadata* entry = page_table.find(virtual_page);
+        if (!entry) {
+            VM_LOG(ERROR) << "Invalid page access!\n";
+            return false;
+        }
+        
+        PageMetadata& pte = *entry;
+        if (guard && !claim_fault(pte, virtual_page, *guard)) {
+            ram.free_page(zeroed_frame);
+            return true;    // Another thread loaded it
+        }
+        faults++;
+        {
+            auto lru = lock_lru();
+            policy->on_fault(virtual_page);
+        }
+        
+        // A file page another mapping has resident, or one read ahead
+        // earlier, is a minor fault: no disk I/O
+        bool major = false;
+        pfn_t phys_page = PageCache::NONE;
+        bool shared = false;
+        if (pte.file_backed()) {
+            // Another mapping's fault may be reading the same file page
+            while (guard && file_loads.count(pte.disk_page())) {
+                page_unlocked.wait(*guard);
+            }
+            auto resident = file_frames.find(pte.disk_page());
+            shared = (resident != file_frames.end());
+            phys_page = shared ? resident->second : page_cache.take(pte.disk_page());
+        }
+        bool minor = (phys_page != PageCache::NONE);
+        if (!minor && guard && pte.file_backed()) {
+            file_loads.insert(pte.disk_page());
+        }
+        
+        if (!minor && zeroed_frame != INVALID_FRAME && !pte.file_backed() && !pte.swapped()) {
+            phys_page = zeroed_frame;
+            zeroed_frame = INVALID_FRAME;
+        } else if (!minor) {
+            // Try to allocate physical page, evicting one if RAM is full. The
+            // frame stays unowned until the page is installed below, so the
+            // readahead in between cannot evict it.
+            phys_page = allocate_frame(virtual_page, guard);
+            if (phys_page == INVALID_FRAME) {
+                if (guard) {
+                    file_loads.erase(pte.disk_page());
+                    auto pte_guard = lock_pte(virtual_page);
+                    pte.clear(PM_LOCKED);
+                    page_unlocked.notify_all();
+                }
+                ram.free_page(zeroed_frame);
+                return false;
+            }
+            
+            // Load page content straight into the frame: nothing else can
+            // reach it until the page is installed below
+            char* frame = ram.get_page_ptr(phys_page);
+            
+            // A fresh zero-fill page has nothing in flight: its backing of 0 is not swap slot 0
+            if (pte.swapped() || pte.file_backed()) {
+                wait_for_writeback(pte.backing, pte.file_backed());
+            }
+            if (pte.swapped()) {
+                // Load from swap space; the slot stays with the page if the
+                // swap cache keeps it
+                swap_slot_t slot = pte.swap_slot();
+                bool on_device = false;
+                with_lock_dropped(guard, [&] { on_device = swap_in(slot, frame); });
+                major = on_device;
+                bool keep = on_device && swap_cache_enabled && !swap_space.mostly_full();
+                if (!keep) {
+                    release_slot(slot);
+                }
+                auto pte_guard = lock_pte(virtual_page);
+                pte.clear(PM_SWAPPED);
+                if (keep) {
+                    pte.set(PM_SWAPCACHE);
+                    swap_cached_pages++;
+                }
+            } else if (pte.file_backed()) {
+                // Load from file
+                with_lock_dropped(guard, [&] { disk.read_page(pte.disk_page(), frame); });
+                major = true;
+            } else {
+                // Zero-fill anonymous page
+                page_ops::zero(frame, PAGE_SIZE);
+            }
+        }
+        ram.free_page(zeroed_frame);
+        (major ? major_faults : minor_faults)++;
+        
+        if (pte.file_backed()) {
+            ra_stats.file_faults++;
+            (minor ? ra_stats.minor_faults : ra_stats.major_faults)++;
+            shared_faults += shared;
+            // A shared frame is owned and evictable, so it must not be
+            // chosen to make room for readahead before it is mapped here
+            read_ahead_for(virtual_page, !shared);
+        }
+        
+        // Update page metadata. The policy learns of the frame before hits
+        // can see the page present.
+        if (pte.file_backed()) {
+            file_loads.erase(pte.disk_page());
+            auto pte_guard = lock_pte(virtual_page);
+            install_file_page(pte, virtual_page, phys_page, shared);
+            pte.clear(PM_LOCKED);
+        } else {
+            ram.assign_page(phys_page, &pte, virtual_page);
+            auto pte_guard = lock_pte(virtual_page);
+            {
+                auto lru = lock_lru();
+                policy->on_insert(phys_page, virtual_page);
+            }
+            pte.physical_page = phys_page;
+            pte.set(PM_PRESENT);
+            pte.clear(PM_LOCKED);
+        }
+        if (guard) {
+            page_unlocked.notify_all();
+        }
+        
+        if (pte.file_backed()) {
+            fault_around(virtual_page);
+        }
+        
+        if (writeback_enabled && ram.get_free_frames() < low_watermark) {
+            reclaim_wanted.notify_one();
+        }
+        return true;
+    }
+    
+    // ---- Background write-back, all called with get_lock() held ----
+    
+    void enable_writeback(size_t low, size_t high) {
+        writeback_enabled = true;
+        low_watermark = low;
+        high_watermark = std::max(low + 1, high);
+    }
+    
+    std::mutex& get_lock() { return lock; }
+    std::condition_variable& get_reclaim_signal() { return reclaim_wanted; }
+    
+    bool below_low_watermark() const {
+        return ram.get_free_frames() < low_watermark;
+    }
+    
+    // Evict victims until high_watermark frames are free. Dirty contents are
+    // copied out and the frames freed at once; the device writes then run with
+    // the lock dropped, sorted so each run of adjacent disk pages or swap
+    // slots is one I/O. Faults on those blocks wait in wait_for_writeback.
+    // Returns the number of frames freed.
+    size_t reclaim(std::unique_lock<std::mutex>& guard) {
+        std::vector<PendingWrite> writes;
+        std::vector<pfn_t> victims;
+        
+        while (ram.get_free_frames() + victims.size() < high_watermark) {
+            PendingWrite write;
+            pfn_t frame = detach_victim(INVALID_VPN, write);
+            if (frame == INVALID_FRAME) break;
+            victims.push_back(frame);
+            if (write.needed) {
+                writes.push_back(write);
+            }
+        }
+        
+        std::sort(writes.begin(), writes.end(), [](const PendingWrite& a, const PendingWrite& b) {
+            return a.to_disk != b.to_disk ? a.to_disk : a.block < b.block;
+        });
+        std::vector<char> buffer(writes.size() * PAGE_SIZE);
+        for (size_t i = 0; i < writes.size(); i++) {
+            ram.read_page(writes[i].frame, &buffer[i * PAGE_SIZE]);
+        }
+        for (pfn_t frame : victims) {
+            ram.free_page(frame);
+        }
+        background_reclaims += victims.size();
+        inflight.insert(inflight.end(), writes.begin(), writes.end());
+        
+        guard.unlock();
+        // Pages the compressed cache takes need no I/O; the rest are packed
+        // down so adjacent blocks still coalesce
+        std::vector<PendingWrite> io_writes;
+        for (size_t i = 0; i < writes.size(); i++) {
+            if (!writes[i].to_disk && zswap && zswap->store(writes[i].block, &buffer[i * PAGE_SIZE])) {
+                continue;
+            }
+            if (io_writes.size() != i) {
+                std::memcpy(&buffer[io_writes.size() * PAGE_SIZE], &buffer[i * PAGE_SIZE], PAGE_SIZE);
+            }
+            io_writes.push_back(writes[i]);
+        }
+        uint64_t ios = 0;
+        for (size_t i = 0; i < io_writes.size(); ) {
+            size_t j = i + 1;
+            while (j < io_writes.size() && io_writes[j].to_disk == io_writes[i].to_disk &&
+                   io_writes[j].block == io_writes[j - 1].block + 1) j++;
+            if (io_writes[i].to_disk) {
+                disk.write_pages(io_writes[i].block, j - i, &buffer[i * PAGE_SIZE]);
+                writebacks += j - i;
+            } else {
+                swap_space.write_pages(io_writes[i].block, j - i, &buffer[i * PAGE_SIZE]);
+                swap_outs += j - i;
+            }
+            ios++;
+            i = j;
+        }
+        guard.lock();
+        
+        finish_writes(writes);
+        write_ios += ios;
+        pages_written += io_writes.size();
+        return victims.size();
+    }
+    
+    // ---- Concurrent mode ----
+    
+    // Hits stop taking the fault lock (see translate_concurrent). Call before
+    // any other thread uses the MMU.
+    void enable_concurrency() { concurrent = true; }
+    bool is_concurrent() const { return concurrent; }
+    std::shared_mutex& get_mmap_lock() { return mmap_lock; }
+    
+    struct LockWaits {
+        uint64_t fault_lock;
+        uint64_t pte_locks;
+        uint64_t lru_lock;
+    };
+    LockWaits get_lock_waits() const {
+        return LockWaits{fault_lock_waits.load(), pte_lock_waits.load(), lru_lock_waits.load()};
+    }
+    
+    // The caller holds get_mmap_lock() shared. A hit takes only the page's
+    // PTE lock; a fault takes the fault lock and lets handle_page_fault drop
+    // it for I/O. On success pte_guard holds the PTE lock, which keeps the
+    // page resident until the caller has copied its data and releases it.
+    char* translate_concurrent(void* virtual_addr, bool write_access, std::unique_lock<std::mutex>& pte_guard,
+                               bool& faulted) {
+        uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtual_addr);
+        vpn_t virtual_page = vaddr / PAGE_SIZE;
+        size_t page_offset = vaddr % PAGE_SIZE;
+        faulted = false;
+        
+        PageMetadata* entry = page_table.find(virtual_page);
+        if (!entry) {
+            VM_LOG(ERROR) << "Invalid virtual address: " << virtual_addr << "\n";
+            return nullptr;
+        }
+        
+        PageMetadata& pte = *entry;
+        for (;;) {
+            pte_guard = lock_pte(virtual_page);
+            if (!access_permitted(pte, virtual_addr, write_access)) return nullptr;
+            if (pte.present()) break;
+            bool zero_fill = !pte.file_backed() && !pte.swapped();
+            pte_guard.unlock();
+            
+            // Zero-fill faults take a frame from the lock-free allocator and
+            // clear it before queueing on the fault lock
+            pfn_t zeroed = zero_fill ? ram.allocate_page(nullptr, 0, home_node(virtual_page)) : INVALID_FRAME;
+            if (zeroed != INVALID_FRAME) {
+                page_ops::zero(ram.get_page_ptr(zeroed), PAGE_SIZE);
+            }
+            std::unique_lock<std::mutex> guard = acquire(lock, fault_lock_waits);
+            if (!handle_page_fault(virtual_page, &guard, zeroed)) {
+                return nullptr;
+            }
+            faulted = true;     // Loop: the page may be evicted again before we relock
+        }
+        
+        if (!faulted) {
+            hits++;
+            auto lru = lock_lru();
+            policy->on_access(pte.physical_page);
+        }
+        ram.touch(pte.physical_page, ++current_time);
+        account_access(pte.physical_page);
+        if (write_access) {
+            mark_dirty(pte);
+        }
+        return ram.get_page_ptr(pte.physical_page) + page_offset;
+    }
+    
+    void set_readahead(const ReadaheadConfig& config) { ra_config = config; }
+    void set_swap_cache(bool enabled) { swap_cache_enabled = enabled; }
+    
+    // Put a compressed cache of max_pool_pages zspages in front of swap.
+    // Call before any page is swapped out.
+    void enable_zswap(std::unique_ptr<SwapCodec> codec, size_t max_pool_pages) {
+        zswap = std::make_unique<Zswap>(swap_space, std::move(codec), max_pool_pages);
+    }
+    ZswapStats get_zswap_stats() { return zswap ? zswap->get_stats() : ZswapStats(); }
+    
+    // ---- NUMA ----
+    
+    // The simulated CPU the calling thread runs on, for its later accesses
+    static void set_cpu(unsigned cpu) { current_cpu = cpu; }
+    
+    void set_numa_latency(uint32_t local_ns, uint32_t remote_ns) {
+        numa_local_ns = local_ns;
+        numa_remote_ns = remote_ns;
+    }
+    
+    // Balancing pass, like NUMA balancing's scan: a page touched since the
+    // previous pass whose last access came from another node's CPU moves to
+    // a free frame on that node, at most max_pages of them. Shared and
+    // unowned frames and pages being faulted in stay put. Called with the
+    // fault lock held; each page's PTE lock keeps hits off it meanwhile.
+    size_t migrate_hot_pages(size_t max_pages) {
+        timestamp_t since = last_numa_scan;
+        last_numa_scan = current_time.load(std::memory_order_relaxed);
+        if (ram.num_nodes() < 2) return 0;
+        size_t moved = 0;
+        for (pfn_t frame = 0; frame < ram.total_frames() && moved < max_pages; frame++) {
+            PageMetadata* owner = ram.get_page_metadata(frame);
+            size_t target = ram.get_access_node(frame);
+            if (!owner || target == ram.node_of(frame) || shared_mappers.count(frame)) continue;
+            if (!ram.is_accessed(frame) || ram.get_last_access(frame) <= since) continue;
+            
+            vpn_t vpn = ram.get_frame_vpn(frame);
+            auto pte_guard = lock_pte(vpn);
+            if (!owner->present() || owner->locked() || owner->physical_page != frame) continue;
+            pfn_t dest = ram.allocate_page(nullptr, 0, target, false);
+            if (dest == INVALID_FRAME) {
+                migrate_failures++;
+                continue;
+            }
+            ram.migrate_page(frame, dest);
+            owner->physical_page = dest;
+            if (owner->file_backed()) {
+                file_frames[owner->disk_page()] = dest;
+            }
+            {
+                auto lru = lock_lru();
+                policy->on_migrate(frame, dest);
+            }
+            ram.free_page(frame);
+            VM_LOG(INFO) << "NUMA: page " << vpn << " migrated from frame " << frame << " to frame "
+                         << dest << " on node " << target << "\n";
+            pages_migrated++;
+            moved++;
+        }
+        return moved;
+    }
+    
+    NumaStats get_numa_stats() const {
+        NumaStats stats;
+        stats.local_accesses = local_accesses.load();
+        stats.remote_accesses = remote_accesses.load();
+        stats.memory_ns = stats.local_accesses * numa_local_ns + stats.remote_accesses * numa_remote_ns;
+        stats.remote_penalty_ns = stats.remote_accesses * (numa_remote_ns - std::min(numa_local_ns, numa_remote_ns));
+        stats.preferred_allocs = ram.get_numa_hits();
+        stats.fallback_allocs = ram.get_numa_misses();
+        stats.pages_migrated = pages_migrated;
+        stats.migrate_failures = migrate_failures;
+        return stats;
+    }
+    
+    // Present PTEs: the summed RSS of every mapping, counting shared frames
+    // once per mapper
+    size_t get_resident_pages() {
+        size_t resident = 0;
+        page_table.for_each([&](uint64_t, const PageMetadata& pte) { resident += pte.present(); });
+        return resident;
+    }
+    
+    // Mappings beyond the first of every shared frame (RSS saved by sharing)
+    size_t shared_mapper_count() const {
+        size_t extra = 0;
+        for (const auto& entry : shared_mappers) extra += entry.second.size();
+        return extra;
+    }
+    
+    uint64_t get_faults() const { return faults; }
+    uint64_t get_hits() const { return hits; }
+    uint64_t get_evictions() const { return evictions; }
+    uint64_t get_eviction_ns() const { return eviction_ns; }
+    void record_fault_latency(uint64_t ns) { fault_latency.record(ns); }
+    void record_translate_latency(uint64_t ns) { translate_latency.record(ns); }
+    
+    // Counters, gauges and latency histograms for MetricsExporter. Lock-free:
+    // safe from any thread while others fault.
+    MetricsSnapshot metrics_snapshot() const {
+        MetricsSnapshot s;
+        s.uptime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - created).count();
+        s.add_counter("hits", "Accesses to resident pages", hits);
+        s.add_counter("faults", "Page faults", faults);
+        s.add_counter("minor_faults", "Faults served without device I/O", minor_faults);
+        s.add_counter("major_faults", "Faults that read the disk or swap device", major_faults);
+        s.add_counter("protection_faults", "Accesses the mapping's protection refused", protection_faults.load());
+        s.add_counter("evictions", "Frames taken from resident pages", evictions);
+        s.add_counter("swap_ins", "Pages read from the swap device", swap_ins);
+        s.add_counter("swap_outs", "Pages written to the swap device", swap_outs);
+        s.add_counter("writebacks", "Dirty file pages written back to disk", writebacks);
+        s.add_counter("page_table_pages_allocated", "Page directories and leaf tables allocated",
+                      page_table_pages_allocated);
+        s.add_gauge("free_frames", "Free RAM frames", ram.get_free_frames());
+        s.add_gauge("swap_free_slots", "Free swap slots", swap_space.get_free_slots());
+        s.add_gauge("page_table_pages", "Page directories and leaf tables in use", page_table_pages.load());
+        s.add_histogram("fault_latency", "Page fault latency", fault_latency.snapshot());
+        s.add_histogram("eviction_latency", "Eviction latency, victim selection to write-out",
+                        eviction_latency.snapshot());
+        s.add_histogram("translate_latency", "Latency of translations that hit, sampled",
+                        translate_latency.snapshot());
+        return s;
+    }
+    
+    // faulted, if given, is set when the access had to load the page
+    char* translate_address(void* virtual_addr, bool write_access = false, bool* faulted = nullptr) {
+        uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtual_addr);
+        vpn_t virtual_page = vaddr / PAGE_SIZE;
+        size_t page_offset = vaddr % PAGE_SIZE;
+        
+        PageMetadata* entry = page_table.find(virtual_page);
+        if (!entry) {
+            VM_LOG(ERROR) << "Invalid virtual address: " << virtual_addr << "\n";
+            return nullptr;
+        }
+        
+        PageMetadata& pte = *entry;
+        if (!access_permitted(pte, virtual_addr, write_access)) {
+            return nullptr;
+        }
+        
+        // Handle page fault
+        if (faulted) *faulted = !pte.present();
+        if (!pte.present()) {
+            if (!handle_page_fault(virtual_page)) {
+                return nullptr;
+            }
+        } else {
+            hits++;
+            policy->on_access(pte.physical_page);
+        }
+        
+        // Update access information
+        ram.touch(pte.physical_page, ++current_time);
+        account_access(pte.physical_page);
+        if (write_access) {
+            mark_dirty(pte);
+        }
+        
+        char* phys_addr = ram.get_page_ptr(pte.physical_page);
+        return phys_addr + page_offset;
+    }
+    
+    // Fills whole leaf tables at a time; one directory walk per 1024 pages
+    bool map_pages(vpn_t start_page, size_t num_pages, bool file_backed = false, pfn_t disk_start = 0,
+                   int prot = PROT_READ | PROT_WRITE) {
+        uint32_t access = prot_bits(prot);
+        bool mapped = page_table.map_range(start_page, num_pages, [&](uint64_t vpn, PageMetadata& pte) {
+            pte.set(access);
+            if (file_backed) {
+                pte.set(PM_FILE_BACKED);
+                pte.backing = disk_start + (vpn - start_page);
+            }
+        });
+        count_page_table_pages();
+        if (!mapped) {
+            VM_LOG(ERROR) << "Cannot map " << num_pages << " pages at " << start_page << ": outside page table range or already mapped\n";
+            return false;
+        }
+        drop_file_mappings(start_page, start_page + num_pages);
+        if (file_backed) {
+            file_mappings[start_page] = FileMapping{(vpn_t)(start_page + num_pages), ReadaheadWindow()};
+        }
+        VM_LOG(INFO) << "Mapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        VM_EVENT(MAP, start_page, num_pages);
+        return true;
+    }
+    
+    // Skips unmapped leaf tables and frees the ones it empties
+    bool unmap_pages(vpn_t start_page, size_t num_pages) {
+        page_table.unmap_range(start_page, num_pages, [&](uint64_t vpn, PageMetadata& pte) {
+            if (pte.present()) {
+                // Write back if dirty and file-backed
+                if (pte.dirty() && pte.file_backed()) {
+                    drop_cached(pte.disk_page());
+                    disk.write_page(pte.disk_page(), ram.get_page_ptr(pte.physical_page));
+                    writebacks++;
+                }
+                // A frame other mappings still use stays resident
+                if (!drop_mapper(pte.physical_page, vpn)) {
+                    if (pte.file_backed()) file_frames.erase(pte.disk_page());
+                    policy->on_remove(pte.physical_page);
+                    ram.free_page(pte.physical_page);
+                }
+            }
+            if (pte.swapped()) {
+                wait_for_writeback(pte.swap_slot(), false);
+                release_slot(pte.swap_slot());
+            } else if (pte.swap_cached()) {
+                release_slot(pte.swap_slot());
+                swap_cached_pages--;
+            }
+        });
+        count_page_table_pages();
+        drop_file_mappings(start_page, start_page + num_pages);
+        VM_LOG(INFO) << "Unmapped " << num_pages << " virtual pages starting at " << start_page << "\n";
+        VM_EVENT(UNMAP, start_page, num_pages);
+        return true;
+    }
+    
+    // ---- VMAs, called with the mmap lock held exclusive and the fault lock ----
+    
+    const Area* find_vma(vpn_t vpn) const { return vmas.find(vpn); }
+    bool is_unmapped(vpn_t start_page, size_t num_pages) const { return vmas.is_free(start_page, num_pages); }
+    
+    // First page of the best-fitting free gap, INVALID_VPN if none is big enough
+    vpn_t get_unmapped_area(size_t num_pages) const {
+        uint64_t start = vmas.get_unmapped_area(num_pages);
+        return start == VmaTree<NumaPlacement>::NONE ? INVALID_VPN : (vpn_t)start;
+    }
+    
+    // Record a mapping over free pages once map_pages has made its PTEs
+    void add_vma(const Area& area) { vmas.insert(area); }
+    
+    // munmap: only the mapped parts of the range are walked, however large
+    // it is. Returns the pages unmapped.
+    uint64_t unmap_area(vpn_t start_page, uint64_t num_pages) {
+        return vmas.remove(start_page, start_page + num_pages, [&](const Area& piece) {
+            unmap_pages((vpn_t)piece.start, piece.pages());
+        });
+    }
+    
+    // mprotect; false, changing nothing, if part of the range is unmapped
+    bool protect_area(vpn_t start_page, uint64_t num_pages, int prot) {
+        uint32_t access = prot_bits(prot);
+        return vmas.protect(start_page, start_page + num_pages, prot, [&](const Area& area) {
+            page_table.for_each_in(area.start, area.pages(), [&](uint64_t, PageMetadata& pte) {
+                pte.clear(PM_READ | PM_WRITE);
+                pte.set(access);
+            });
+        });
+    }
+    
+    size_t get_vma_count() const { return vmas.size(); }
+    size_t get_vma_gaps() const { return vmas.gap_count(); }
+    
+    // Like /proc/<pid>/maps
+    void print_vmas() {
+        std::cout << "\n=== VMAs (" << vmas.size() << " areas, " << vmas.mapped_pages() << " pages, "
+                  << vmas.gap_count() << " free gaps) ===\n";
+        vmas.for_each([](const Area& area) {
+            std::cout << std::hex << area.start * PAGE_SIZE << "-" << area.end * PAGE_SIZE << std::dec << " "
+                      << ((area.prot & PROT_READ) ? 'r' : '-') << ((area.prot & PROT_WRITE) ? 'w' : '-')
+                      << ((area.prot & PROT_EXEC) ? 'x' : '-') << ((area.flags & MAP_SHARED) ? 's' : 'p');
+            if (area.anonymous()) {
+                std::cout << " anon";
+            } else {
+                std::cout << " fd " << area.fd << " page " << area.pgoff;
+            }
+            std::cout << " (" << area.pages() << " pages)\n";
+        });
+    }
+    
+    void print_memory_status() {
+        std::cout << "\n=== Memory Status ===\n";
+        std::cout << "RAM free frames: " << ram.get_free_frames() << "/" << ram.total_frames();
+        for (size_t node = 0; ram.num_nodes() > 1 && node < ram.num_nodes(); node++) {
+            std::cout << (node == 0 ? " (" : ", ") << "node " << node << ": " << ram.node_free_frames(node) << "/"
+                      << ram.node_frames(node) << (node + 1 == ram.num_nodes() ? ")" : "");
+        }
+        std::cout << "\n";
+        std::cout << "Page table entries: " << page_table.size() << " (" << page_table.leaf_tables()
+                  << " leaf tables, " << page_table.memory_bytes() / 1024 << " KB)\n";
+        
+        std::cout << "\n=== Page Table ===\n";
+        page_table.for_each([this](uint64_t vpn, const PageMetadata& pte) {
+            std::cout << "VPN " << vpn << " -> ";
+            if (pte.present()) {
+                std::cout << "PFN " << pte.physical_page;
+                if (ram.num_nodes() > 1) std::cout << " [NODE " << ram.node_of(pte.physical_page) << "]";
+                if (pte.dirty()) std::cout << " [DIRTY]";
+                if (ram.is_accessed(pte.physical_page)) std::cout << " [ACCESSED]";
+                if (shared_mappers.count(pte.physical_page)) std::cout << " [SHARED]";
+                if (pte.swap_cached()) std::cout << " [SWAPCACHE slot " << pte.swap_slot() << "]";
+            } else if (pte.swapped()) {
+                std::cout << "SWAP slot " << pte.swap_slot();
+            } else {
+                std::cout << "Not loaded";
+            }
+            if (pte.file_backed()) {
+                std::cout << " (file-backed, disk page " << pte.disk_page() << ")";
+            }
+            if (pte.present()) {
+                std::cout << " [LRU: " << ram.get_last_access(pte.physical_page) << "]";
+            }
+            std::cout << "\n";
+        });
+        std::cout << "==================\n\n";
+    }
+    
+    void print_replacement_stats() {
+        uint64_t accesses = hits + faults;
+        std::cout << "\n=== Replacement Stats (" << policy->name() << ") ===\n";
+        std::cout << "Accesses: " << accesses << ", hits: " << hits << ", faults: " << faults;
+        if (accesses > 0) {
+            std::cout << " (hit ratio " << (hits * 100.0 / accesses) << "%)";
+        }
+        std::cout << "\nEvictions: " << evictions << ", frames scanned: " << policy->get_scan_steps();
+        if (evictions > 0) {
+            std::cout << " (" << (policy->get_scan_steps() * 1.0 / evictions) << " per eviction, "
+                      << (eviction_ns / evictions) << " ns per victim selection)";
+        }
+        std::cout << "\n";
+        HistogramSnapshot latency = fault_latency.snapshot();
+        if (latency.count > 0) {
+            std::cout << "Fault latency (ns): p50 " << latency.percentile(50)
+                      << ", p90 " << latency.percentile(90)
+                      << ", p99 " << latency.percentile(99)
+                      << ", max " << latency.max << "\n";
+        }
+        if (ra_stats.file_faults > 0) {
+            std::cout << "File faults: " << ra_stats.file_faults << " (" << ra_stats.major_faults << " major, "
+                      << ra_stats.minor_faults << " minor); readahead " << ra_stats.readahead_pages << " pages in "
+                      << ra_stats.readahead_ios << " reads, fault-around mapped " << ra_stats.fault_around_pages
+                      << ", dropped unused " << ra_stats.cache_dropped << "\n";
+        }
+        if (protection_faults > 0) {
+            std::cout << "Protection faults: " << protection_faults << "\n";
+        }
+        if (shared_faults > 0 || !shared_mappers.empty()) {
+            size_t mapped = get_resident_pages();
+            size_t frames = mapped - shared_mapper_count();
+            std::cout << "Sharing: " << shared_faults << " faults mapped a resident frame; " << mapped
+                      << " resident pages in " << frames << " frames\n";
+        }
+        if (writeback_enabled) {
+            std::cout << "Write-back: " << direct_reclaims << " direct reclaims, " << background_reclaims
+                      << " background, " << pages_written << " pages in " << write_ios << " I/Os\n";
+        }
+        if (swap_cache_hits + swap_cache_write_drops + swap_cache_pressure_drops > 0) {
+            std::cout << "Swap cache: " << swap_cache_hits << " clean re-evictions skipped the write; slots freed "
+                      << swap_cache_write_drops << " on write, " << swap_cache_pressure_drops
+                      << " under slot pressure\n";
+        }
+        if (zswap) {
+            ZswapStats z = zswap->get_stats();
+            size_t pool_pages = zswap->pool_pages();
+            size_t compressed = z.stored_pages - z.same_filled_pages;
+            std::cout << "Zswap (" << zswap->codec_name() << "): " << z.stored_pages << " pages in "
+                      << pool_pages << " pool pages (" << z.same_filled_pages << " same-filled";
+            if (compressed > 0) {
+                std::cout << ", " << compressed << " compressed at "
+                          << (compressed * PAGE_SIZE * 1.0 / z.compressed_bytes) << "x";
+            }
+            std::cout << "), " << zswap->frames_saved() << " frames saved; " << z.loads << " loads, "
+                      << z.written_back << " written back, " << z.rejected << " rejected\n";
+            std::cout << "Zswap CPU: " << z.compress_ns / std::max<uint64_t>(1, z.compressions)
+                      << " ns per compress, " << z.decompress_ns / std::max<uint64_t>(1, z.decompressions)
+                      << " ns per decompress; swap I/O " << swap_space.get_read_ios() << " reads, "
+                      << swap_space.get_write_ios() << " writes\n";
+        }
+        if (ram.num_nodes() > 1) {
+            NumaStats n = get_numa_stats();
+            uint64_t numa_accesses = n.local_accesses + n.remote_accesses;
+            std::cout << "NUMA (" << ram.num_nodes() << " nodes, " << numa_local_ns << "/" << numa_remote_ns
+                      << " ns local/remote): " << n.remote_accesses << " of " << numa_accesses << " accesses remote";
+            if (numa_accesses > 0) {
+                std::cout << " (" << (n.remote_accesses * 100.0 / numa_accesses) << "%), "
+                          << (n.memory_ns * 1.0 / numa_accesses) << " ns per access, remote penalty "
+                          << n.remote_penalty_ns << " ns";
+            }
+            std::cout << "\nNUMA placement: " << n.preferred_allocs << " frames on the wanted node, "
+                      << n.fallback_allocs << " fell back; " << n.pages_migrated << " pages migrated, "
+                      << n.migrate_failures << " target node full\n";
+        }
+        if (concurrent) {
+            std::cout << "Lock waits: fault lock " << fault_lock_waits << ", PTE locks " << pte_lock_waits
+                      << ", lru_lock " << lru_lock_waits << "\n";
+        }
+    }
+};
+
+// Background reclaim in the spirit of kswapd: sleeps until a fault leaves
+// fewer than the low watermark of free frames, then evicts up to the high
+// watermark with write-back batched and coalesced, so most faults find a
+// free frame instead of writing a victim out first.
+class WritebackDaemon {
+private:
+    MMU& mmu;
+    bool stopping;
+    std::thread worker;
+    
+    void run() {
+        std::unique_lock<std::mutex> guard(mmu.get_lock());
+        while (!stopping) {
+            // A batch that frees nothing (swap full) waits for the next fault
+            if (mmu.below_low_watermark() && mmu.reclaim(guard) > 0) {
+                continue;
+            }
+            mmu.get_reclaim_signal().wait(guard);
+        }
+    }
+    
+public:
+    explicit WritebackDaemon(MMU& m) : mmu(m), stopping(false), worker(&WritebackDaemon::run, this) {}
+    
+    ~WritebackDaemon() {
+        {
+            std::lock_guard<std::mutex> guard(mmu.get_lock());
+            stopping = true;
+        }
+        mmu.get_reclaim_signal().notify_all();
+        worker.join();
+    }
+};
+
+// Periodic NUMA balancing in the spirit of task_numa_work: every period it
+// takes the fault lock and migrates the pages touched since its last pass
+// toward the node whose CPU touched them
+class NumaBalancer {
+private:
+    MMU& mmu;
+    std::chrono::milliseconds period;
+    bool stopping;
+    std::condition_variable wake;
+    std::thread worker;
+    
+    void run() {
+        std::unique_lock<std::mutex> guard(mmu.get_lock());
+        while (!wake.wait_for(guard, period, [this] { return stopping; })) {
+            mmu.migrate_hot_pages(SIZE_MAX);
+        }
+    }
+    
+public:
+    NumaBalancer(MMU& m, std::chrono::milliseconds every) 
+        : mmu(m), period(every), stopping(false), worker(&NumaBalancer::run, this) {}
+    
+    ~NumaBalancer() {
+        {
+            std::lock_guard<std::mutex> guard(mmu.get_lock());
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+};
+
+class VirtualMemorySystem {
+private:
+    RAM ram;
+    Disk disk;
+    SwapSpace swap_space;
+    MMU mmu;
+    std::unique_ptr<WritebackDaemon> writeback;    // Declared after mmu so it stops first
+    std::unique_ptr<NumaBalancer> balancer;
+    std::unique_ptr<MetricsExporter> exporter;
+    
+    // System V style shared memory. A segment's pages live in a zero-filled
+    // file on the simulated disk, so every attachment maps the same frames
+    // through the MMU's shared file pages, and eviction writes them back to
+    // the segment's blocks (the way shmem pages go to swap).
+    struct ShmSegment {
+        int fd;
+        size_t size;
+        uint32_t attached;      // Current attachments
+    };
+    std::map<int, ShmSegment> shm_segments;     // By id
+    std::map<uintptr_t, int> shm_attachments;   // Attach address -> id
+    int next_shm_id;
+    std::mutex shm_lock;                        // Taken before the mmap lock
+    
+    // Translate; faulting accesses record their latency, including any wait
+    // for the write-back daemon or, in concurrent mode, for other threads
+    char* translate_timed(void* addr, bool write, std::unique_lock<std::mutex>* pte_guard = nullptr) {
+        thread_local uint32_t hits_until_sample = 0;
+        bool faulted = false;
+        auto start = std::chrono::steady_clock::now();
+        char* phys_addr;
+        if (pte_guard) {
+            phys_addr = mmu.translate_concurrent(addr, write, *pte_guard, faulted);
+        } else {
+            phys_addr = mmu.translate_address(addr, write, &faulted);
+        }
+        if (faulted) {
+            mmu.record_fault_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        } else if (hits_until_sample-- == 0) {
+            hits_until_sample = TRANSLATE_SAMPLE_RATE - 1;
+            mmu.record_translate_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+        return phys_addr;
+    }
+    
+    // Run fn(phys_addr) with the page pinned: under the MMU lock, or in
+    // concurrent mode under the mmap lock (shared) and the page's PTE lock
+    template <typename Fn>
+    void with_translation(void* addr, bool write, Fn fn) {
+        if (!mmu.is_concurrent()) {
+            std::lock_guard<std::mutex> guard(mmu.get_lock());
+            fn(translate_timed(addr, write));
+            return;
+        }
+        std::shared_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::unique_lock<std::mutex> pte_guard;
+        fn(translate_timed(addr, write, &pte_guard));
+    }
+    
+public:
+    VirtualMemorySystem(ReplacementPolicyKind policy = ReplacementPolicyKind::LRU, bool async_writeback = false,
+                        const StorageConfig& storage = StorageConfig()) 
+        : ram(storage.ram_bytes, storage.numa_nodes), disk(storage.disk_bytes, storage.disk_image), swap_space(storage.swap_bytes, storage.swap_file),
+          mmu(ram, disk, swap_space, policy), next_shm_id(0) {
+        if (async_writeback) {
+            // Keep 1/8 to 1/4 of RAM free
+            size_t frames = ram.total_frames();
+            mmu.enable_writeback(std::max<size_t>(1, frames / 8), std::max<size_t>(2, frames / 4));
+            writeback = std::make_unique<WritebackDaemon>(mmu);
+        }
+        std::cout << "Virtual Memory System with Swapping initialized\n\n";
+    }
+    
+    // POSIX mmap; nullptr on failure (MAP_FAILED). Without MAP_FIXED, addr is
+    // a hint, used if that range is free; otherwise the mapping goes in the
+    // best-fitting free gap above MMAP_BASE. MAP_FIXED replaces whatever is
+    // mapped there, MAP_FIXED_NOREPLACE fails instead. With several NUMA
+    // nodes, numa_policy picks where the frames come from (node is the BIND
+    // target).
+    void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset,
+               NumaPolicy numa_policy = NumaPolicy::FIRST_TOUCH, size_t node = 0) {
+        uintptr_t hint = reinterpret_cast<uintptr_t>(addr);
+        uint64_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        int sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+        bool fixed = flags & (MAP_FIXED | MAP_FIXED_NOREPLACE);
+        bool file_backed = !(flags & MAP_ANONYMOUS);
+        if (length == 0 || (sharing != MAP_SHARED && sharing != MAP_PRIVATE) || offset % PAGE_SIZE != 0 ||
+            (fixed && (hint % PAGE_SIZE != 0 || hint / PAGE_SIZE + pages_needed > VPN_LIMIT))) {
+            VM_LOG(ERROR) << "mmap: invalid arguments\n";
+            return nullptr;
+        }
+        if (file_backed && !disk.is_file(fd)) {
+            VM_LOG(ERROR) << "mmap: bad file descriptor " << fd << "\n";
+            return nullptr;
+        }
+        if (file_backed && sharing == MAP_PRIVATE && (prot & PROT_WRITE)) {
+            VM_LOG(ERROR) << "mmap: writable private file mappings need copy-on-write, not simulated\n";
+            return nullptr;
+        }
+        
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        uint64_t start_page = Geometry::round_up(hint) / PAGE_SIZE;
+        if (flags & MAP_FIXED_NOREPLACE) {
+            if (!mmu.is_unmapped(start_page, pages_needed)) {
+                VM_LOG(ERROR) << "mmap: " << addr << " is already mapped\n";
+                return nullptr;
+            }
+        } else if (flags & MAP_FIXED) {
+            mmu.unmap_area(start_page, pages_needed);
+        } else if (hint == 0 || start_page + pages_needed > VPN_LIMIT || !mmu.is_unmapped(start_page, pages_needed)) {
+            start_page = mmu.get_unmapped_area(pages_needed);
+            if (start_page == INVALID_VPN) {
+                VM_LOG(ERROR) << "mmap: no free range of " << pages_needed << " pages\n";
+                return nullptr;
+            }
+        }
+        
+        // File pages are mapped one extent at a time; holes and pages past
+        // the end of the file are zero-filled like anonymous memory
+        bool mapped = true;
+        if (!file_backed) {
+            mapped = mmu.map_pages(start_page, pages_needed, false, 0, prot);
+        }
+        for (size_t i = 0; file_backed && mapped && i < pages_needed; ) {
+            uint64_t run = 1;
+            uint32_t block = disk.resolve(fd, offset / PAGE_SIZE + i, &run);
+            run = std::min<uint64_t>(run, pages_needed - i);
+            mapped = mmu.map_pages(start_page + i, run, block != FileExtentTable::NO_BLOCK, block, prot);
+            i += run;
+        }
+        if (!mapped) {
+            mmu.unmap_pages(start_page, pages_needed);
+            return nullptr;
+        }
+        
+        mmu.add_vma(Area{start_page, start_page + pages_needed, prot, flags & (MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS),
+                         file_backed ? fd : -1, file_backed ? (uint64_t)offset / PAGE_SIZE : 0,
+                         NumaPlacement{numa_policy, node}});
+        uintptr_t virtual_addr = start_page * PAGE_SIZE;
+        VM_LOG(INFO) << "mmap returned: " << std::hex << virtual_addr << std::dec 
+                     << " (" << length << " bytes, " << pages_needed << " pages)\n\n";
+        return reinterpret_cast<void*>(virtual_addr);
+    }
+    
+    // Unmapping a range with nothing mapped in it is not an error
+    int munmap(void* addr, size_t length) {
+        uintptr_t virtual_addr = reinterpret_cast<uintptr_t>(addr);
+        if (virtual_addr % PAGE_SIZE != 0 || length == 0) {
+            VM_LOG(ERROR) << "munmap: invalid arguments\n";
+            return -1;
+        }
+        uint64_t start_page = virtual_addr / PAGE_SIZE;
+        uint64_t pages_needed = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.unmap_area(start_page, pages_needed);
+        VM_LOG(INFO) << "munmap successful\n\n";
+        return 0;
+    }
+    
+    // -1 if part of the range is not mapped (ENOMEM), or it would make a
+    // private file mapping writable
+    int mprotect(void* addr, size_t length, int prot) {
+        uintptr_t virtual_addr = reinterpret_cast<uintptr_t>(addr);
+        if (virtual_addr % PAGE_SIZE != 0) {
+            VM_LOG(ERROR) << "mprotect: invalid arguments\n";
+            return -1;
+        }
+        uint64_t start_page = virtual_addr / PAGE_SIZE;
+        uint64_t end_page = start_page + (length + PAGE_SIZE - 1) / PAGE_SIZE;
+        
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        for (uint64_t page = start_page; (prot & PROT_WRITE) && page < end_page; ) {
+            const Area* area = mmu.find_vma(page);
+            if (!area) break;
+            if (!area->anonymous() && (area->flags & MAP_PRIVATE)) {
+                VM_LOG(ERROR) << "mprotect: private file mapping cannot become writable\n";
+                return -1;
+            }
+            page = area->end;
+        }
+        if (!mmu.protect_area(start_page, end_page - start_page, prot)) {
+            VM_LOG(ERROR) << "mprotect: " << addr << " is not mapped throughout\n";
+            return -1;
+        }
+        return 0;
+    }
+    
+    void write_memory(void* addr, const char* data, size_t size) {
+        VM_LOG(INFO) << "Writing " << size << " bytes to " << addr << "\n";
+        with_translation(addr, true, [&](char* phys_addr) {   // write_access = true
+            if (phys_addr) {
+                std::memcpy(phys_addr, data, size);
+                VM_LOG(INFO) << "Write successful\n";
+            } else {
+                VM_LOG(ERROR) << "Write failed - invalid address\n";
+            }
+        });
+        VM_LOG(INFO) << "\n";
+    }
+    
+    void read_memory(void* addr, char* buffer, size_t size) {
+        VM_LOG(INFO) << "Reading " << size << " bytes from " << addr << "\n";
+        with_translation(addr, false, [&](char* phys_addr) {  // write_access = false
+            if (phys_addr) {
+                std::memcpy(buffer, phys_addr, size);
+                VM_LOG(INFO) << "Read successful: '" << std::string(buffer, size) << "'\n";
+            } else {
+                VM_LOG(ERROR) << "Read failed - invalid address\n";
+            }
+        });
+        VM_LOG(INFO) << "\n";
+    }
+    
+    // Silent access for replay: translate only, no data copy or logging
+    bool access(void* addr, bool write) {
+        bool ok = false;
+        with_translation(addr, write, [&](char* phys_addr) { ok = (phys_addr != nullptr); });
+        return ok;
+    }
+    
+    void print_status() {
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.print_memory_status();
+    }
+    
+    void print_vmas() {
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.print_vmas();
+    }
+    
+    void print_replacement_stats() {
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.print_replacement_stats();
+    }
+    
+    // Fine-grained locking for many threads accessing memory at once (see
+    // MMU::translate_concurrent). Call before starting them.
+    void enable_concurrency() {
+        mmu.enable_concurrency();
+    }
+    
+    MMU::LockWaits get_lock_waits() const {
+        return mmu.get_lock_waits();
+    }
+    
+    // Returns the fd to pass to mmap
+    int create_file(const std::string& filename, const std::string& content) {
+        return disk.write_file(filename, content.c_str(), content.size());
+    }
+    
+    // Returns the segment id, or -1 if the disk has no room for it
+    int shm_create(size_t size) {
+        std::lock_guard<std::mutex> shm(shm_lock);
+        int id = next_shm_id;
+        std::string zeros(size, '\0');
+        int fd = disk.write_file("shm." + std::to_string(id), zeros.c_str(), size);
+        if (fd < 0) return -1;
+        shm_segments[id] = ShmSegment{fd, size, 0};
+        next_shm_id++;
+        VM_LOG(INFO) << "shm_create: segment " << id << " (" << size << " bytes)\n";
+        return id;
+    }
+    
+    // Map the whole segment; every attachment sees the same frames
+    void* shm_attach(int id) {
+        std::lock_guard<std::mutex> shm(shm_lock);
+        auto it = shm_segments.find(id);
+        if (it == shm_segments.end()) {
+            VM_LOG(ERROR) << "shm_attach: no segment " << id << "\n";
+            return nullptr;
+        }
+        void* addr = mmap(nullptr, it->second.size, PROT_READ | PROT_WRITE, MAP_SHARED, it->second.fd, 0);
+        if (addr) {
+            it->second.attached++;
+            shm_attachments[reinterpret_cast<uintptr_t>(addr)] = id;
+        }
+        return addr;
+    }
+    
+    // Unmap an attachment; frames stay resident while others are attached
+    int shm_detach(void* addr) {
+        std::lock_guard<std::mutex> shm(shm_lock);
+        auto it = shm_attachments.find(reinterpret_cast<uintptr_t>(addr));
+        if (it == shm_attachments.end()) {
+            VM_LOG(ERROR) << "shm_detach: " << addr << " is not an attachment\n";
+            return -1;
+        }
+        ShmSegment& segment = shm_segments[it->second];
+        shm_attachments.erase(it);
+        segment.attached--;
+        return munmap(addr, segment.size);
+    }
+    
+    // Summed RSS of all mappings and the frames actually backing it
+    size_t get_resident_pages() {
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        return mmu.get_resident_pages();
+    }
+    
+    size_t get_resident_frames() {
+        std::unique_lock<std::shared_mutex> mm(mmu.get_mmap_lock());
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        return mmu.get_resident_pages() - mmu.shared_mapper_count();
+    }
+    
+    // Stops the daemons (finishing their current batch), e.g. before printing a report
+    void stop_writeback() {
+        balancer.reset();
+        writeback.reset();
+    }
+    
+    // Per-request latency for both disk and swap (0 = plain memory copies)
+    void set_device_latency(std::chrono::microseconds latency) {
+        disk.set_io_latency(latency);
+        swap_space.set_io_latency(latency);
+    }
+    
+    void set_readahead(const ReadaheadConfig& config) {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.set_readahead(config);
+    }
+    
+    // On by default; off frees every slot on swap-in as before
+    void set_swap_cache(bool enabled) {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.set_swap_cache(enabled);
+    }
+    
+    // False if this build has no such codec (see zswap.h)
+    bool enable_zswap(size_t max_pool_pages, const std::string& codec_name = "lz") {
+        std::unique_ptr<SwapCodec> codec = make_swap_codec(codec_name);
+        if (!codec) {
+            VM_LOG(ERROR) << "zswap: unknown codec '" << codec_name << "'\n";
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.enable_zswap(std::move(codec), max_pool_pages);
+        return true;
+    }
+    
+    ZswapStats get_zswap_stats() {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        return mmu.get_zswap_stats();
+    }
+    
+    // The calling thread's simulated CPU; CPU c runs on NUMA node c % nodes
+    static void set_cpu(unsigned cpu) {
+        MMU::set_cpu(cpu);
+    }
+    
+    // Simulated DRAM latency charged per access to a local or remote node
+    void set_numa_latency(uint32_t local_ns, uint32_t remote_ns) {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        mmu.set_numa_latency(local_ns, remote_ns);
+    }
+    
+    // One balancing pass now; returns the pages migrated
+    size_t migrate_hot_pages(size_t max_pages = SIZE_MAX) {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        return mmu.migrate_hot_pages(max_pages);
+    }
+    
+    // Balancing passes every period on a background thread
+    void enable_numa_balancing(std::chrono::milliseconds period) {
+        balancer = std::make_unique<NumaBalancer>(mmu, period);
+    }
+    
+    NumaStats get_numa_stats() {
+        std::lock_guard<std::mutex> guard(mmu.get_lock());
+        return mmu.get_numa_stats();
+    }
+    
+    // Takes no lock, so it can be called while other threads fault
+    MetricsSnapshot metrics_snapshot() const { return mmu.metrics_snapshot(); }
+    
+    // Write metrics_snapshot() to path every period from a background thread:
+    // Prometheus text for a .prom path, JSON lines of deltas otherwise
+    void export_metrics(const std::string& path, std::chrono::milliseconds period) {
+        exporter.reset();
+        exporter = std::make_unique<MetricsExporter>([this] { return mmu.metrics_snapshot(); }, path, period);
+    }
+    
+    // Writes one last dump and stops the thread. False if any dump failed.
+    bool stop_metrics_export() {
+        bool ok = !exporter || exporter->stop();
+        exporter.reset();
+        return ok;
+    }
+    
+    size_t get_total_frames() const { return ram.total_frames(); }
+    size_t get_vma_count() const { return mmu.get_vma_count(); }
+    size_t get_vma_gaps() const { return mmu.get_vma_gaps(); }
+    uint64_t get_swap_reads() const { return swap_space.get_read_ios(); }
+    uint64_t get_swap_writes() const { return swap_space.get_write_ios(); }
+    uint64_t get_faults() const { return mmu.get_faults(); }
+    uint64_t get_hits() const { return mmu.get_hits(); }
+    uint64_t get_evictions() const { return mmu.get_evictions(); }
+    uint64_t get_eviction_ns() const { return mmu.get_eviction_ns(); }
+};
+
+// ==================== TRACE REPLAY ====================
+
+// One trace record. Text traces use one record per line:
+//   <pid> <op> <vaddr> <size> <rw>     e.g. "1 A 0x7ffd3a10 8 W"
+// with op A (access), M (mmap) or U (munmap) and rw R or W; '#' starts a comment.
+// Binary traces start with TRACE_MAGIC followed by packed little-endian records.
+struct TraceRecord {
+    uint32_t pid;
+    uint8_t op;         // 'A', 'M' or 'U'
+    uint8_t rw;         // 'R' or 'W'
+    uint16_t reserved;
+    uint64_t vaddr;
+    uint64_t size;
+};
+static_assert(sizeof(TraceRecord) == 24, "binary trace records are 24 bytes");
+
+const char TRACE_MAGIC[8] = {'V', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// Streams records from a text or binary trace without loading the whole file
+class TraceReader {
+private:
+    std::ifstream in;
+    bool binary;
+    std::vector<TraceRecord> chunk;     // Binary records are read in large blocks
+    size_t chunk_pos;
+    std::string line;
+    uint64_t line_no;
+    uint64_t bad_lines;
+    
+    bool parse_line(TraceRecord& rec) {
+        const char* p = line.c_str();
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') return false;
+        
+        char* end;
+        rec.pid = std::strtoul(p, &end, 0);
+        if (end == p) return false;
+        p = end;
+        while (*p == ' ' || *p == '\t') p++;
+        rec.op = *p ? *p++ : 0;
+        rec.vaddr = std::strtoull(p, &end, 0);
+        if (end == p) return false;
+        p = end;
+        rec.size = std::strtoull(p, &end, 0);
+        if (end == p) rec.size = 1;
+        p = end;
+        while (*p == ' ' || *p == '\t') p++;
+        rec.rw = (*p == 'W' || *p == 'w') ? 'W' : 'R';
+        rec.reserved = 0;
+        return rec.op == 'A' || rec.op == 'M' || rec.op == 'U';
+    }
+    
+public:
+    explicit TraceReader(const std::string& path) 
+        : in(path, std::ios::binary), binary(false), chunk_pos(0), line_no(0), bad_lines(0) {
+        char magic[sizeof(TRACE_MAGIC)] = {0};
+        if (in.read(magic, sizeof(magic)) && std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+            binary = true;
+        } else {
+            in.clear();
+            in.seekg(0);
+        }
+    }
+    
+    bool is_open() const { return in.is_open(); }
+    bool is_binary() const { return binary; }
+    uint64_t get_bad_lines() const { return bad_lines; }
+    
+    bool next(TraceRecord& rec) {
+        if (binary) {
+            if (chunk_pos == chunk.size()) {
+                chunk.resize(4096);
+                in.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(TraceRecord));
+                chunk.resize(in.gcount() / sizeof(TraceRecord));
+                chunk_pos = 0;
+                if (chunk.empty()) return false;
+            }
+            rec = chunk[chunk_pos++];
+            return true;
+        }
+        while (std::getline(in, line)) {
+            line_no++;
+            if (parse_line(rec)) return true;
+            const char* p = line.c_str();
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p != '\0' && *p != '#') bad_lines++;
+        }
+        return false;
+    }
+};
+
+// Convert a text trace into the binary format (much faster to replay)
+bool convert_trace_to_binary(const std::string& text_path, const std::string& bin_path) {
+    TraceReader reader(text_path);
+    std::ofstream out(bin_path, std::ios::binary);
+    if (!reader.is_open() || !out) return false;
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    TraceRecord rec;
+    while (reader.next(rec)) {
+        out.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    }
+    return true;
+}
+
+// Silences std::cout while alive. Messages are still formatted; build with
+// -DVM_LOG_LEVEL=0 to drop them at compile time.
+class ScopedQuietOutput {
+public:
+    ScopedQuietOutput() { std::cout.setstate(std::ios::failbit); }
+    ~ScopedQuietOutput() { std::cout.clear(); }
+};
+
+// Replays a trace against a VirtualMemorySystem. Each (pid, page) seen in the
+// trace is given its own simulated page on first use, so sparse 64-bit
+// addresses from several processes fit the simulator's dense address space.
+class TraceReplayer {
+private:
+    VirtualMemorySystem& vm;
+    std::unordered_map<uint32_t, std::unordered_map<uint64_t, vpn_t>> page_map;  // pid -> trace page -> simulated page
+    bool auto_map;      // Map unknown pages on first access (traces without mmap records)
+    WorkingSetProfiler* profiler;   // Sees every page touch, by simulated page (unique across pids)
+    
+    uint64_t records;
+    uint64_t page_touches;
+    uint64_t auto_mapped;
+    uint64_t invalid_accesses;
+    
+    std::unordered_map<uint64_t, vpn_t>& pages_of(uint32_t pid) {
+        return page_map[pid];
+    }
+    
+    void map_range(uint32_t pid, uint64_t vaddr, uint64_t size) {
+        auto& pages = pages_of(pid);
+        uint64_t first = vaddr / PAGE_SIZE;
+        uint64_t last = (vaddr + std::max<uint64_t>(size, 1) - 1) / PAGE_SIZE;
+        
+        std::vector<uint64_t> missing;
+        for (uint64_t page = first; page <= last; page++) {
+            if (!pages.count(page)) missing.push_back(page);
+        }
+        if (missing.empty()) return;
+        
+        uintptr_t base = reinterpret_cast<uintptr_t>(vm.mmap(nullptr, missing.size() * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        for (size_t i = 0; i < missing.size(); i++) {
+            pages[missing[i]] = base / PAGE_SIZE + i;
+        }
+    }
+    
+    void unmap_range(uint32_t pid, uint64_t vaddr, uint64_t size) {
+        auto& pages = pages_of(pid);
+        uint64_t first = vaddr / PAGE_SIZE;
+        uint64_t last = (vaddr + std::max<uint64_t>(size, 1) - 1) / PAGE_SIZE;
+        for (uint64_t page = first; page <= last; page++) {
+            auto it = pages.find(page);
+            if (it == pages.end()) continue;
+            vm.munmap(reinterpret_cast<void*>((uintptr_t)it->second * PAGE_SIZE), PAGE_SIZE);
+            pages.erase(it);
+        }
+    }
+    
+    void access_range(uint32_t pid, uint64_t vaddr, uint64_t size, bool write) {
+        auto& pages = pages_of(pid);
+        uint64_t first = vaddr / PAGE_SIZE;
+        uint64_t last = (vaddr + std::max<uint64_t>(size, 1) - 1) / PAGE_SIZE;
+        for (uint64_t page = first; page <= last; page++) {
+            auto it = pages.find(page);
+            if (it == pages.end()) {
+                if (!auto_map) {
+                    invalid_accesses++;
+                    continue;
+                }
+                map_range(pid, page * PAGE_SIZE, PAGE_SIZE);
+                auto_mapped++;
+                it = pages.find(page);
+            }
+            page_touches++;
+            if (profiler) profiler->record(pid, it->second);
+            uintptr_t sim_addr = (uintptr_t)it->second * PAGE_SIZE + (page == first ? vaddr % PAGE_SIZE : 0);
+            if (!vm.access(reinterpret_cast<void*>(sim_addr), write)) {
+                invalid_accesses++;
+            }
+        }
+    }
+    
+public:
+    TraceReplayer(VirtualMemorySystem& v, bool map_on_first_touch = true) 
+        : vm(v), auto_map(map_on_first_touch), profiler(nullptr), records(0), page_touches(0),
+          auto_mapped(0), invalid_accesses(0) {}
+    
+    void set_profiler(WorkingSetProfiler* p) { profiler = p; }
+    
+    // The profile's prediction for this RAM size next to what the replay saw
+    void print_profile() {
+        if (!profiler) return;
+        profiler->print_summary(std::cout, PAGE_SIZE);
+        uint64_t frames = vm.get_total_frames();
+        std::cout << "  At " << frames << " frames: predicted LRU miss ratio "
+                  << profiler->reuse_distance().miss_ratio(frames) * 100 << "%, replay faulted on "
+                  << vm.get_faults() * 100.0 / std::max<uint64_t>(1, page_touches) << "% of touches\n";
+    }
+    
+    // Each pid runs on the CPU of the same number
+    void apply(const TraceRecord& rec) {
+        records++;
+        vm.set_cpu(rec.pid);
+        switch (rec.op) {
+            case 'M': map_range(rec.pid, rec.vaddr, rec.size); break;
+            case 'U': unmap_range(rec.pid, rec.vaddr, rec.size); break;
+            default:  access_range(rec.pid, rec.vaddr, rec.size, rec.rw == 'W'); break;
+        }
     }
     
-    void create_file(const std::string& filename, const std::string& content) {
-        disk.write_file(filename, content.c_str(), content.size());
+    // Replay a whole trace file; returns false if it cannot be opened
+    bool replay(const std::string& path) {
+        TraceReader reader(path);
+        if (!reader.is_open()) {
+            std::cout << "Cannot open trace '" << path << "'\n";
+            return false;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        {
+            ScopedQuietOutput quiet;
+            TraceRecord rec;
+            while (reader.next(rec)) {
+                apply(rec);
+            }
+            vm.stop_writeback();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::cout << "\n=== Trace Replay (" << (reader.is_binary() ? "binary" : "text") << ") ===\n";
+        std::cout << "Records: " << records << ", page touches: " << page_touches 
+                  << ", invalid accesses: " << invalid_accesses << "\n";
+        if (reader.get_bad_lines() > 0) {
+            std::cout << "Skipped malformed lines: " << reader.get_bad_lines() << "\n";
+        }
+        std::cout << "Distinct pages mapped on first touch: " << auto_mapped << "\n";
+        std::cout << "Replay time: " << seconds << " s";
+        if (seconds > 0) {
+            std::cout << " (" << (uint64_t)(records / seconds) << " records/s)";
+        }
+        std::cout << "\n";
+        vm.print_replacement_stats();
+        print_profile();
+#ifdef VM_TRACE_RING
+        vm_trace::ring().dump(std::cout, 32);
+#endif
+        return true;
     }
 };
 
-int main() {
+ReplacementPolicyKind parse_policy(const std::string& name) {
+    if (name == "clock") return ReplacementPolicyKind::CLOCK;
+    if (name == "2q")    return ReplacementPolicyKind::TWO_Q;
+    if (name == "arc")   return ReplacementPolicyKind::ARC;
+    return ReplacementPolicyKind::LRU;
+}
+
+// Fault throughput from 1 to max_threads threads, first under the single MMU
+// lock and then with enable_concurrency(). Each thread writes a random page of
+// its own 16-page region and reads it back three times, so all threads
+// together overcommit the 8 frames and most visits fault. Device requests
+// take latency_us (default 20), which the fine-grained mode overlaps across
+// threads; with 0 the run is CPU bound and the lock wait counts show which
+// lock limits scaling on a multi-core host.
+void run_scaling_benchmark(unsigned max_threads, ReplacementPolicyKind kind, unsigned latency_us) {
+    const size_t pages_per_thread = 16;
+    const int visits_per_thread = 300;
+    
+    std::vector<unsigned> thread_counts;
+    for (unsigned n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+    
+    StorageConfig storage;
+    storage.swap_bytes = max_threads * pages_per_thread * PAGE_SIZE;
+    
+    std::cout << "\n=== Fault Scaling: 1 to " << max_threads << " Threads (" << latency_us << "us devices) ===\n";
+    for (bool fine_grained : {false, true}) {
+        std::cout << (fine_grained ? "Fine-grained locking:\n" : "Single MMU lock:\n");
+        double single_thread_rate = 0;
+        for (unsigned threads : thread_counts) {
+            double seconds;
+            uint64_t faults;
+            MMU::LockWaits waits;
+            {
+                ScopedQuietOutput quiet;
+                VirtualMemorySystem sim(kind, false, storage);
+                sim.set_device_latency(std::chrono::microseconds(latency_us));
+                if (fine_grained) sim.enable_concurrency();
+                std::vector<char*> regions;
+                for (unsigned t = 0; t < threads; t++) {
+                    regions.push_back(static_cast<char*>(sim.mmap(nullptr, pages_per_thread * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)));
+                }
+                
+                auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for (unsigned t = 0; t < threads; t++) {
+                    workers.emplace_back([&, t] {
+                        uint32_t seed = 12345 + t;
+                        char byte;
+                        for (int v = 0; v < visits_per_thread; v++) {
+                            seed = seed * 1103515245 + 12345;
+                            char* page = regions[t] + (seed >> 16) % pages_per_thread * PAGE_SIZE;
+                            sim.write_memory(page, "x", 1);
+                            for (int k = 0; k < 3; k++) sim.read_memory(page, &byte, 1);
+                        }
+                    });
+                }
+                for (std::thread& worker : workers) worker.join();
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                faults = sim.get_faults();
+                waits = sim.get_lock_waits();
+            }
+            
+            double rate = faults / seconds;
+            if (threads == 1) single_thread_rate = rate;
+            std::cout << "  " << threads << " threads: " << (uint64_t)(threads * visits_per_thread * 4 / seconds)
+                      << " accesses/s, " << (uint64_t)rate << " faults/s ("
+                      << (single_thread_rate > 0 ? rate / single_thread_rate : 0) << "x)";
+            if (fine_grained) {
+                std::cout << "; lock waits: fault " << waits.fault_lock << ", PTE " << waits.pte_locks
+                          << ", lru " << waits.lru_lock;
+            }
+            std::cout << "\n";
+        }
+    }
+}
+
+// Page contents for the zswap demo and benchmarks: kind 0 is all zeroes
+// (same-filled), 1 log-like text lines, 2 random bytes (incompressible)
+void fill_test_page(char* page, int kind, uint32_t seed) {
+    if (kind == 0) {
+        std::memset(page, 0, PAGE_SIZE);
+        return;
+    }
+    size_t used = 0;
+    while (used < PAGE_SIZE) {
+        seed = seed * 1103515245 + 12345;
+        if (kind == 2) {
+            page[used++] = (char)(seed >> 16);
+            continue;
+        }
+        std::string line = "12:" + std::to_string(10 + seed % 50) + " worker " + std::to_string(seed % 8)
+                         + " handled request " + std::to_string(seed >> 12) + " in "
+                         + std::to_string(seed % 97) + " ms\n";
+        size_t n = std::min(line.size(), PAGE_SIZE - used);
+        std::memcpy(page + used, line.data(), n);
+        used += n;
+    }
+}
+
+// page_swapping_simulate --bench [filter] [--json] [--min-time s], see bench.h.
+// All on the default 8-frame RAM with zero device latency, so the numbers
+// are the simulator's own cost per operation.
+void register_benchmarks(BenchRunner& runner) {
+    // A resident page: the translate fast path
+    runner.add("access/hit", [](BenchState& state) {
+        VirtualMemorySystem sim;
+        char* page = static_cast<char*>(sim.mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        sim.access(page, true);
+        while (state.keep_running()) {
+            sim.access(page, false);
+        }
+        state.items_processed = state.iterations();
+    });
+    
+    // The same hit on two NUMA nodes from the other node's CPU: adds the
+    // local/remote accounting
+    runner.add("access/hit/numa_remote", [](BenchState& state) {
+        StorageConfig storage;
+        storage.numa_nodes = 2;
+        VirtualMemorySystem sim(ReplacementPolicyKind::LRU, false, storage);
+        char* page = static_cast<char*>(sim.mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0, NumaPolicy::BIND, 0));
+        sim.access(page, true);
+        sim.set_cpu(1);
+        while (state.keep_running()) {
+            sim.access(page, false);
+        }
+        sim.set_cpu(0);
+        state.items_processed = state.iterations();
+    });
+    
+    // Balancing passes over 8 pages read alternately from CPU 0 and CPU 1,
+    // so each pass moves them all to the other node
+    runner.add("numa/migrate", [](BenchState& state) {
+        const size_t pages = 8;
+        StorageConfig storage;
+        storage.ram_bytes = 4 * pages * PAGE_SIZE;
+        storage.numa_nodes = 2;
+        VirtualMemorySystem sim(ReplacementPolicyKind::LRU, false, storage);
+        char* region = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        for (size_t i = 0; i < pages; i++) sim.access(region + i * PAGE_SIZE, true);
+        unsigned cpu = 0;
+        uint64_t moved = 0;
+        while (state.keep_running()) {
+            state.pause_timing();
+            cpu ^= 1;
+            sim.set_cpu(cpu);
+            for (size_t i = 0; i < pages; i++) sim.access(region + i * PAGE_SIZE, false);
+            state.resume_timing();
+            moved += sim.migrate_hot_pages();
+        }
+        sim.set_cpu(0);
+        state.items_processed = moved;
+        state.counters["pages_per_pass"] = moved * 1.0 / state.iterations();
+    });
+    
+    // mmap/munmap churn over 256 live anonymous mappings of 1-16 pages,
+    // each iteration replacing a random one. Holes are refilled, so the
+    // VMA and gap counts stay bounded.
+    runner.add("vma/mmap_munmap", [](BenchState& state) {
+        VirtualMemorySystem sim;
+        std::vector<std::pair<void*, size_t>> live;
+        uint32_t seed = 12345;
+        auto map_one = [&] {
+            seed = seed * 1103515245 + 12345;
+            size_t bytes = (1 + (seed >> 16) % 16) * PAGE_SIZE;
+            live.emplace_back(sim.mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0), bytes);
+        };
+        while (live.size() < 256) map_one();
+        while (state.keep_running()) {
+            seed = seed * 1103515245 + 12345;
+            size_t victim = (seed >> 16) % live.size();
+            sim.munmap(live[victim].first, live[victim].second);
+            live[victim] = live.back();
+            live.pop_back();
+            map_one();
+        }
+        state.items_processed = state.iterations();
+        state.counters["vmas"] = sim.get_vma_count();
+        state.counters["gaps"] = sim.get_vma_gaps();
+    });
+    
+    // First touch of a fresh anonymous page: allocate and zero a frame
+    runner.add("fault/zero_fill", [](BenchState& state) {
+        VirtualMemorySystem sim;
+        while (state.keep_running()) {
+            state.pause_timing();
+            void* page = sim.mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            state.resume_timing();
+            sim.access(page, true);
+            state.pause_timing();
+            sim.munmap(page, PAGE_SIZE);
+            state.resume_timing();
+        }
+        state.items_processed = state.iterations();
+    });
+    
+    // Cycling writes through 16 dirty pages with LRU: every access swaps a
+    // page in and the least recently used one out
+    runner.add("fault/swap_in", [](BenchState& state) {
+        const size_t pages = 16;
+        VirtualMemorySystem sim;
+        char* region = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        for (size_t i = 0; i < pages; i++) sim.access(region + i * PAGE_SIZE, true);
+        uint64_t faults_before = sim.get_faults();
+        size_t i = 0;
+        while (state.keep_running()) {
+            sim.access(region + i * PAGE_SIZE, true);
+            i = (i + 1) % pages;
+        }
+        state.items_processed = state.iterations();
+        state.counters["faults_per_access"] = (sim.get_faults() - faults_before) * 1.0 / state.iterations();
+    });
+    
+    // Cycling reads through a 32-page file without readahead: every access
+    // is a major fault that reads a block and drops a clean page
+    runner.add("fault/file_backed", [](BenchState& state) {
+        const size_t pages = 32;
+        VirtualMemorySystem sim;
+        ReadaheadConfig config;
+        config.enabled = false;
+        config.fault_around_bytes = 0;
+        sim.set_readahead(config);
+        int fd = sim.create_file("bench.dat", std::string(pages * PAGE_SIZE, 'f'));
+        char* file = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        size_t i = 0;
+        while (state.keep_running()) {
+            sim.access(file + i * PAGE_SIZE, false);
+            i = (i + 1) % pages;
+        }
+        state.items_processed = state.iterations();
+    });
+    
+    // Reading 16 pages cycled through 8 frames after writing them once: with
+    // the swap cache each clean victim keeps its slot and needs no write
+    for (bool cached : {false, true}) {
+        runner.add(cached ? "fault/swap_in_clean/swap_cache" : "fault/swap_in_clean/no_swap_cache",
+                   [cached](BenchState& state) {
+            const size_t pages = 16;
+            VirtualMemorySystem sim;
+            sim.set_swap_cache(cached);
+            char* region = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            for (size_t i = 0; i < pages; i++) sim.access(region + i * PAGE_SIZE, true);
+            uint64_t writes_before = sim.get_swap_writes();
+            size_t i = 0;
+            while (state.keep_running()) {
+                sim.access(region + i * PAGE_SIZE, false);
+                i = (i + 1) % pages;
+            }
+            state.items_processed = state.iterations();
+            state.counters["swap_writes_per_access"] = (sim.get_swap_writes() - writes_before) * 1.0 / state.iterations();
+        });
+    }
+    
+    // Like fault/swap_in but with pages of log text, through swap or through
+    // a compressed cache big enough for all of them
+    for (bool compressed : {false, true}) {
+        runner.add(compressed ? "fault/swap_in_zswap" : "fault/swap_in_text", [compressed](BenchState& state) {
+            const size_t pages = 16;
+            VirtualMemorySystem sim;
+            if (compressed) sim.enable_zswap(pages);
+            char* region = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            char page[PAGE_SIZE];
+            for (size_t i = 0; i < pages; i++) {
+                fill_test_page(page, 1, i);
+                sim.write_memory(region + i * PAGE_SIZE, page, PAGE_SIZE);
+            }
+            uint64_t swap_ios_before = sim.get_swap_reads() + sim.get_swap_writes();
+            size_t i = 0;
+            while (state.keep_running()) {
+                sim.access(region + i * PAGE_SIZE, true);
+                i = (i + 1) % pages;
+            }
+            ZswapStats z = sim.get_zswap_stats();
+            state.items_processed = state.iterations();
+            state.counters["swap_ios_per_access"] =
+                (sim.get_swap_reads() + sim.get_swap_writes() - swap_ios_before) * 1.0 / state.iterations();
+            if (compressed) {
+                state.counters["compress_ns"] = z.compress_ns * 1.0 / std::max<uint64_t>(1, z.compressions);
+                state.counters["decompress_ns"] = z.decompress_ns * 1.0 / std::max<uint64_t>(1, z.decompressions);
+            }
+        });
+    }
+    
+    // The codec alone on one page of log text
+    runner.add("zswap/lz/compress", [](BenchState& state) {
+        LzCodec codec;
+        uint8_t page[PAGE_SIZE], out[PAGE_SIZE];
+        fill_test_page(reinterpret_cast<char*>(page), 1, 7);
+        size_t length = 0;
+        while (state.keep_running()) {
+            length = codec.compress(page, PAGE_SIZE, out, sizeof(out));
+        }
+        state.bytes_processed = state.iterations() * PAGE_SIZE;
+        state.counters["ratio"] = PAGE_SIZE * 1.0 / std::max<size_t>(1, length);
+    });
+    runner.add("zswap/lz/decompress", [](BenchState& state) {
+        LzCodec codec;
+        uint8_t page[PAGE_SIZE], packed[PAGE_SIZE], out[PAGE_SIZE];
+        fill_test_page(reinterpret_cast<char*>(page), 1, 7);
+        size_t length = codec.compress(page, PAGE_SIZE, packed, sizeof(packed));
+        while (state.keep_running()) {
+            codec.decompress(packed, length, out, PAGE_SIZE);
+        }
+        state.bytes_processed = state.iterations() * PAGE_SIZE;
+    });
+    
+    // zswap's same-filled test (page_ops.h): a zero page is the full scan, a
+    // text page returns in the first 64 bytes
+    for (bool zero : {true, false}) {
+        runner.add(zero ? "page/same_filled/zero" : "page/same_filled/text", [zero](BenchState& state) {
+            char page[PAGE_SIZE];
+            fill_test_page(page, zero ? 0 : 1, 7);
+            size_t same = 0;
+            while (state.keep_running()) {
+                uint64_t fill;
+                same += page_ops::same_filled(page, PAGE_SIZE, fill);
+            }
+            state.bytes_processed = state.iterations() * PAGE_SIZE;
+            state.counters["same_filled"] = same * 1.0 / state.iterations();
+        });
+    }
+    runner.add("page/fill", [](BenchState& state) {
+        char page[PAGE_SIZE];
+        uint64_t fill = 0;
+        while (state.keep_running()) {
+            page_ops::fill(page, PAGE_SIZE, ++fill);
+        }
+        state.bytes_processed = state.iterations() * PAGE_SIZE;
+        state.counters["last_byte"] = (uint8_t)page[PAGE_SIZE - 1];
+    });
+    
+    // Metric updates on the fault path (vm_metrics.h)
+    runner.add("metrics/counter_add", [](BenchState& state) {
+        ShardedCounter counter;
+        while (state.keep_running()) {
+            counter++;
+        }
+        state.items_processed = state.iterations();
+    });
+    runner.add("metrics/histogram_record", [](BenchState& state) {
+        LatencyHistogram histogram;
+        uint32_t seed = 12345;
+        while (state.keep_running()) {
+            seed = seed * 1103515245 + 12345;
+            histogram.record(seed >> 12);
+        }
+        state.items_processed = state.iterations();
+        state.counters["p99_ns"] = histogram.snapshot().percentile(99);
+    });
+    
+    // Profiler cost per reference over 4096 pages, exact and 1% SHARDS
+    for (double rate : {1.0, 0.01}) {
+        runner.add(rate < 1 ? "profile/record/shards_1pct" : "profile/record/exact", [rate](BenchState& state) {
+            ProfilerConfig config;
+            config.sample_rate = rate;
+            WorkingSetProfiler profiler(config);
+            uint32_t seed = 12345;
+            while (state.keep_running()) {
+                seed = seed * 1103515245 + 12345;
+                profiler.record(1, (seed >> 8) % 4096);
+            }
+            state.items_processed = state.iterations();
+        });
+    }
+    
+    // Random writes over 32 pages (4x RAM), per policy: time per access and
+    // the victim selection share of it
+    for (const char* policy : {"lru", "clock", "2q", "arc"}) {
+        runner.add(std::string("evict/") + policy, [policy](BenchState& state) {
+            const size_t pages = 32;
+            VirtualMemorySystem sim(parse_policy(policy));
+            char* region = static_cast<char*>(sim.mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            uint32_t seed = 12345;
+            while (state.keep_running()) {
+                seed = seed * 1103515245 + 12345;
+                sim.access(region + (seed >> 16) % pages * PAGE_SIZE, true);
+            }
+            uint64_t evictions = std::max<uint64_t>(1, sim.get_evictions());
+            state.items_processed = state.iterations();
+            state.counters["evictions_per_access"] = sim.get_evictions() * 1.0 / state.iterations();
+            state.counters["select_ns_per_eviction"] = sim.get_eviction_ns() * 1.0 / evictions;
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    // Trace mode: page_swapping_simulate --replay <trace> [lru|clock|2q|arc] [--writeback]
+    //                 [--ram <MB>] [--disk <image> <MB>] [--swap <file> <MB>] [--zswap <pool pages>] [--zswap-codec lz]
+    //                 [--numa <nodes>] [--numa-balance <ms>]
+    //                 [--metrics <out.prom|out.json>] [--metrics-interval <ms>]
+    //                 [--profile <out.csv|out.json>] [--sample-rate <SHARDS rate>]
+    //             page_swapping_simulate --to-binary <text trace> <binary trace>
+    // Benchmark:  page_swapping_simulate --scale [max threads] [lru|clock|2q|arc] [device latency us]
+    //             page_swapping_simulate --bench [filter] [--json] [--min-time s]
+    if (argc >= 3 && std::string(argv[1]) == "--replay") {
+        std::string policy_name = "lru";
+        bool async_writeback = false;
+        StorageConfig storage;
+        size_t zswap_pages = 0;
+        std::string zswap_codec = "lz";
+        std::string profile_path;
+        ProfilerConfig profile_config;
+        unsigned numa_balance_ms = 0;
+        std::string metrics_path;
+        unsigned metrics_interval_ms = 1000;
+        for (int i = 3; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--writeback") {
+                async_writeback = true;
+            } else if (arg == "--zswap" && i + 1 < argc) {
+                zswap_pages = std::strtoull(argv[++i], nullptr, 0);
+            } else if (arg == "--zswap-codec" && i + 1 < argc) {
+                zswap_codec = argv[++i];
+            } else if (arg == "--profile" && i + 1 < argc) {
+                profile_path = argv[++i];
+            } else if (arg == "--sample-rate" && i + 1 < argc) {
+                profile_config.sample_rate = std::strtod(argv[++i], nullptr);
+            } else if (arg == "--ram" && i + 1 < argc) {
+                storage.ram_bytes = (size_t)(std::strtod(argv[++i], nullptr) * (1 << 20));   // 0.25 = 64 4KB frames
+            } else if (arg == "--numa" && i + 1 < argc) {
+                storage.numa_nodes = std::strtoul(argv[++i], nullptr, 0);
+            } else if (arg == "--numa-balance" && i + 1 < argc) {
+                numa_balance_ms = std::strtoul(argv[++i], nullptr, 0);
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                metrics_path = argv[++i];
+            } else if (arg == "--metrics-interval" && i + 1 < argc) {
+                metrics_interval_ms = std::max(1ul, std::strtoul(argv[++i], nullptr, 0));
+            } else if ((arg == "--disk" || arg == "--swap") && i + 2 < argc) {
+                std::string& path = (arg == "--disk") ? storage.disk_image : storage.swap_file;
+                size_t& bytes = (arg == "--disk") ? storage.disk_bytes : storage.swap_bytes;
+                path = argv[i + 1];
+                bytes = std::strtoull(argv[i + 2], nullptr, 0) << 20;
+                i += 2;
+            } else {
+                policy_name = arg;
+            }
+        }
+        VirtualMemorySystem replay_system(parse_policy(policy_name), async_writeback, storage);
+        if (zswap_pages > 0 && !replay_system.enable_zswap(zswap_pages, zswap_codec)) {
+            return 1;
+        }
+        if (numa_balance_ms > 0) {
+            replay_system.enable_numa_balancing(std::chrono::milliseconds(numa_balance_ms));
+        }
+        if (!metrics_path.empty()) {
+            replay_system.export_metrics(metrics_path, std::chrono::milliseconds(metrics_interval_ms));
+        }
+        TraceReplayer replayer(replay_system);
+        WorkingSetProfiler profiler(profile_config);
+        if (!profile_path.empty()) replayer.set_profiler(&profiler);
+        if (!replayer.replay(argv[2])) return 1;
+        if (!metrics_path.empty()) {
+            if (!replay_system.stop_metrics_export()) {
+                std::cout << "Cannot write metrics to '" << metrics_path << "'\n";
+                return 1;
+            }
+            std::cout << "Metrics written to " << metrics_path << "\n";
+        }
+        if (!profile_path.empty()) {
+            std::ofstream out(profile_path);
+            bool json = profile_path.size() >= 5 && profile_path.compare(profile_path.size() - 5, 5, ".json") == 0;
+            if (json) {
+                profiler.write_json(out, PAGE_SIZE);
+            } else {
+                profiler.write_csv(out, PAGE_SIZE);
+            }
+            out.close();
+            if (out.fail()) {
+                std::cout << "Cannot write profile to '" << profile_path << "'\n";
+                return 1;
+            }
+            std::cout << "Profile written to " << profile_path << "\n";
+        }
+        return 0;
+    }
+    if (argc >= 4 && std::string(argv[1]) == "--to-binary") {
+        return convert_trace_to_binary(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench") {
+        BenchRunner runner;
+        register_benchmarks(runner);
+        return runner.main(argc, argv, 2);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--scale") {
+        unsigned max_threads = (argc >= 3) ? std::strtoul(argv[2], nullptr, 0) : 8;
+        unsigned latency_us = (argc >= 5) ? std::strtoul(argv[4], nullptr, 0) : 20;
+        run_scaling_benchmark(std::max(1u, max_threads), parse_policy(argc >= 4 ? argv[3] : "lru"), latency_us);
+        return 0;
+    }
+    
     VirtualMemorySystem vm_system;
     
     vm_system.create_file("test.txt", "Hello from file! This content will be memory mapped.");
@@ -518,7 +3621,7 @@ int main() {
     
     // Allocate enough memory to exceed RAM capacity
     for (int i = 0; i < 6; i++) {
-        void* mem = vm_system.mmap(nullptr, 8192, 0, 0, -1, 0);
+        void* mem = vm_system.mmap(nullptr, 8192, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
         mappings.push_back(mem);
         
         // Write different data to each mapping
@@ -538,7 +3641,7 @@ int main() {
     vm_system.print_status();
     
     // Allocate one more to force more swapping
-    void* final_mem = vm_system.mmap(nullptr, 4096, 0, 0, -1, 0);
+    void* final_mem = vm_system.mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     vm_system.write_memory(final_mem, "Final allocation", 16);
     
     vm_system.print_status();
@@ -550,6 +3653,312 @@ int main() {
     vm_system.munmap(final_mem, 4096);
     
     vm_system.print_status();
+    vm_system.print_replacement_stats();
+    
+    std::cout << "\n=== Comparing Replacement Policies ===\n";
+    
+    // Hot set of 4 pages re-touched between passes of a 12-page scan on 8 frames:
+    // with recency alone every scan flushes the hot pages
+    const ReplacementPolicyKind kinds[] = {
+        ReplacementPolicyKind::LRU, ReplacementPolicyKind::CLOCK,
+        ReplacementPolicyKind::TWO_Q, ReplacementPolicyKind::ARC
+    };
+    for (ReplacementPolicyKind kind : kinds) {
+        VirtualMemorySystem sim(kind);
+        char* hot = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        char* scan = static_cast<char*>(sim.mmap(nullptr, 12 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        char byte = 0;
+        for (int round = 0; round < 3; round++) {
+            for (int rep = 0; rep < 2; rep++) {
+                for (int i = 0; i < 4; i++) sim.read_memory(hot + i * PAGE_SIZE, &byte, 1);
+            }
+            for (int i = 0; i < 12; i++) sim.read_memory(scan + i * PAGE_SIZE, &byte, 1);
+        }
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== Synchronous vs Background Write-back ===\n";
+    
+    // Dirty a 24-page working set on 8 frames, so every fault has a dirty
+    // victim, on devices with 50us per request and some compute between accesses
+    for (bool async_writeback : {false, true}) {
+        VirtualMemorySystem sim(ReplacementPolicyKind::LRU, async_writeback);
+        sim.set_device_latency(std::chrono::microseconds(50));
+        char* region = static_cast<char*>(sim.mmap(nullptr, 24 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        {
+            ScopedQuietOutput quiet;
+            for (int round = 0; round < 50; round++) {
+                for (int i = 0; i < 24; i++) {
+                    sim.write_memory(region + i * PAGE_SIZE, "x", 1);
+                    auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+                    while (std::chrono::steady_clock::now() < until) {}
+                }
+            }
+            sim.stop_writeback();
+        }
+        std::cout << (async_writeback ? "Background write-back daemon:" : "Synchronous eviction:");
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== Sequential File Scan: Readahead ===\n";
+    
+    // Read one byte from each page of a 48-page file mapping, twice over
+    uint64_t scan_faults[2] = {0, 0};
+    for (bool readahead : {false, true}) {
+        VirtualMemorySystem sim;
+        ReadaheadConfig config;
+        config.enabled = readahead;
+        sim.set_readahead(config);
+        int fd = sim.create_file("scan.dat", std::string(48 * PAGE_SIZE, 'r'));
+        char* file = static_cast<char*>(sim.mmap(nullptr, 48 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        {
+            ScopedQuietOutput quiet;
+            char byte;
+            for (int pass = 0; pass < 2; pass++) {
+                for (int i = 0; i < 48; i++) sim.read_memory(file + i * PAGE_SIZE, &byte, 1);
+            }
+        }
+        std::cout << (readahead ? "Readahead + fault-around:" : "One page per fault:");
+        sim.print_replacement_stats();
+        scan_faults[readahead] = sim.get_faults();
+    }
+    std::cout << "Readahead cut faults from " << scan_faults[0] << " to " << scan_faults[1] << " ("
+              << (100.0 * (scan_faults[0] - scan_faults[1]) / std::max<uint64_t>(1, scan_faults[0]))
+              << "% fewer)\n";
+    
+    std::cout << "\n=== Shared Page Cache and shm ===\n";
+    
+    // Eight workers map the same 6-page data file: on 8 frames their 48
+    // pages of RSS only fit because every mapping shares the file's frames
+    {
+        VirtualMemorySystem sim;
+        int fd = sim.create_file("dataset.bin", std::string(6 * PAGE_SIZE, 'd'));
+        std::vector<char*> workers;
+        {
+            ScopedQuietOutput quiet;
+            char byte;
+            for (int w = 0; w < 8; w++) {
+                workers.push_back(static_cast<char*>(sim.mmap(nullptr, 6 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)));
+                for (int i = 0; i < 6; i++) sim.read_memory(workers.back() + i * PAGE_SIZE, &byte, 1);
+            }
+        }
+        size_t rss = sim.get_resident_pages();
+        size_t frames = sim.get_resident_frames();
+        std::cout << "8 workers x 6 pages: summed RSS " << rss << " pages in " << frames << " frames ("
+                  << (rss - frames) << " frames saved)\n";
+        
+        // A shared memory segment attached twice: writes through one
+        // attachment are seen through the other
+        char message[16] = {0};
+        int id;
+        {
+            ScopedQuietOutput quiet;
+            id = sim.shm_create(2 * PAGE_SIZE);
+            char* a = static_cast<char*>(sim.shm_attach(id));
+            char* b = static_cast<char*>(sim.shm_attach(id));
+            sim.write_memory(a + PAGE_SIZE, "shared hello", 12);
+            sim.read_memory(b + PAGE_SIZE, message, 12);
+            sim.shm_detach(a);
+        }
+        std::cout << "shm segment " << id << ": read '" << message << "' through the second attachment\n";
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== Working Set and Miss-Ratio Curve ===\n";
+    
+    // Two processes, one cycling through 4 hot pages and one touching 20
+    // pages at random, profiled during a single replay: the curve predicts
+    // the LRU fault rate for any RAM size, this run checks it at 8 frames
+    {
+        VirtualMemorySystem sim;
+        TraceReplayer replayer(sim);
+        ProfilerConfig config;
+        config.windows = {16, 256};
+        config.series_interval = 0;
+        WorkingSetProfiler profiler(config);
+        replayer.set_profiler(&profiler);
+        {
+            ScopedQuietOutput quiet;
+            uint32_t seed = 42;
+            for (int i = 0; i < 3000; i++) {
+                seed = seed * 1103515245 + 12345;
+                uint64_t page = (i % 2) ? (seed >> 16) % 20 : i / 2 % 4;
+                replayer.apply(TraceRecord{(uint32_t)(1 + i % 2), 'A', 'R', 0, page * PAGE_SIZE, 1});
+            }
+        }
+        replayer.print_profile();
+    }
+    
+    std::cout << "\n=== Swap Cache: Clean Re-evictions ===\n";
+    
+    // Read-mostly: 16 pages written once, then read round-robin 10 times on
+    // 8 frames. Without the swap cache every eviction rewrites its page.
+    for (bool cached : {false, true}) {
+        VirtualMemorySystem sim;
+        sim.set_swap_cache(cached);
+        char* region = static_cast<char*>(sim.mmap(nullptr, 16 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        {
+            ScopedQuietOutput quiet;
+            for (int i = 0; i < 16; i++) sim.write_memory(region + i * PAGE_SIZE, "w", 1);
+            char byte;
+            for (int round = 0; round < 10; round++) {
+                for (int i = 0; i < 16; i++) sim.read_memory(region + i * PAGE_SIZE, &byte, 1);
+            }
+        }
+        std::cout << (cached ? "Swap cache:" : "Slot freed on swap-in:") << " swap I/O " << sim.get_swap_reads()
+                  << " reads, " << sim.get_swap_writes() << " writes";
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== Compressed Swap Cache (zswap) ===\n";
+    
+    // 24 pages on 8 frames, a third each zeroes, log text and random bytes,
+    // read round-robin on 50us devices: with a 4-page pool the zeroes and
+    // text never touch swap, the random pages still do
+    for (bool compressed : {false, true}) {
+        VirtualMemorySystem sim;
+        sim.set_device_latency(std::chrono::microseconds(50));
+        if (compressed) sim.enable_zswap(4);
+        char* region = static_cast<char*>(sim.mmap(nullptr, 24 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        auto start = std::chrono::steady_clock::now();
+        {
+            ScopedQuietOutput quiet;
+            char page[PAGE_SIZE];
+            for (int i = 0; i < 24; i++) {
+                fill_test_page(page, i % 3, i);
+                sim.write_memory(region + i * PAGE_SIZE, page, PAGE_SIZE);
+            }
+            char byte;
+            for (int round = 0; round < 10; round++) {
+                for (int i = 0; i < 24; i++) sim.read_memory(region + i * PAGE_SIZE, &byte, 1);
+            }
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << (compressed ? "zswap, 4 pool pages:" : "Swap only:") << " " << ms.count() << " ms, swap I/O "
+                  << sim.get_swap_reads() << " reads, " << sim.get_swap_writes() << " writes";
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== NUMA Placement and Migration ===\n";
+    
+    // Two nodes of 16 frames, CPU 0 on node 0 and CPU 1 on node 1. Pages
+    // first touched by CPU 0 are remote for CPU 1 until a balancing pass
+    // moves them; interleave splits a mapping over both nodes and bind puts
+    // all of it on one.
+    {
+        StorageConfig storage;
+        storage.ram_bytes = 32 * PAGE_SIZE;
+        storage.numa_nodes = 2;
+        VirtualMemorySystem sim(ReplacementPolicyKind::LRU, false, storage);
+        auto read_from = [&](const char* label, char* region, size_t pages, unsigned cpu) {
+            NumaStats before = sim.get_numa_stats();
+            {
+                ScopedQuietOutput quiet;
+                sim.set_cpu(cpu);
+                char byte;
+                for (int round = 0; round < 4; round++) {
+                    for (size_t i = 0; i < pages; i++) sim.read_memory(region + i * PAGE_SIZE, &byte, 1);
+                }
+            }
+            NumaStats after = sim.get_numa_stats();
+            uint64_t remote = after.remote_accesses - before.remote_accesses;
+            std::cout << label << " on CPU " << cpu << ": " << remote << " of "
+                      << (remote + after.local_accesses - before.local_accesses) << " reads remote, penalty "
+                      << (after.remote_penalty_ns - before.remote_penalty_ns) << " ns\n";
+        };
+        auto fill = [&](char* region, size_t pages) {
+            ScopedQuietOutput quiet;
+            sim.set_cpu(0);
+            for (size_t i = 0; i < pages; i++) sim.write_memory(region + i * PAGE_SIZE, "n", 1);
+        };
+        
+        char* first_touch = static_cast<char*>(sim.mmap(nullptr, 6 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        fill(first_touch, 6);
+        read_from("First touch by CPU 0, read", first_touch, 6, 0);
+        read_from("First touch by CPU 0, read", first_touch, 6, 1);
+        size_t migrated;
+        {
+            ScopedQuietOutput quiet;
+            migrated = sim.migrate_hot_pages();
+        }
+        std::cout << "Balancing pass migrated " << migrated << " pages to node 1\n";
+        read_from("After migration, read", first_touch, 6, 1);
+        
+        char* interleaved = static_cast<char*>(sim.mmap(nullptr, 8 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0, NumaPolicy::INTERLEAVE));
+        fill(interleaved, 8);
+        read_from("Interleaved, read", interleaved, 8, 0);
+        
+        char* bound = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0, NumaPolicy::BIND, 1));
+        fill(bound, 4);
+        read_from("Bound to node 1, read", bound, 4, 0);
+        sim.set_cpu(0);
+        sim.print_replacement_stats();
+    }
+    
+    std::cout << "\n=== VMAs: Placement, Merging and Protection ===\n";
+    
+    // Three anonymous mappings side by side are one VMA. Unmapping the
+    // middle one splits it and the next mapping that fits goes into the
+    // hole; MAP_FIXED replaces part of a mapping and mprotect splits off a
+    // read-only piece, whose writes then fail.
+    {
+        VirtualMemorySystem sim;
+        const int anon = MAP_PRIVATE | MAP_ANONYMOUS;
+        const int rw = PROT_READ | PROT_WRITE;
+        char* a;
+        char* b;
+        char* c;
+        {
+            ScopedQuietOutput quiet;
+            a = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+            b = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+            c = static_cast<char*>(sim.mmap(nullptr, 4 * PAGE_SIZE, rw, anon, -1, 0));
+            sim.write_memory(c + PAGE_SIZE, "old", 3);
+        }
+        sim.print_vmas();
+        
+        char* reused;
+        char* hinted;
+        char* fixed;
+        char* dup;
+        char data[4] = {0};
+        {
+            ScopedQuietOutput quiet;
+            sim.munmap(b, 4 * PAGE_SIZE);
+            reused = static_cast<char*>(sim.mmap(nullptr, 2 * PAGE_SIZE, rw, anon, -1, 0));
+            hinted = static_cast<char*>(sim.mmap(a + 256 * PAGE_SIZE, PAGE_SIZE, PROT_READ, anon, -1, 0));
+            fixed = static_cast<char*>(sim.mmap(c + PAGE_SIZE, 2 * PAGE_SIZE, PROT_READ, anon | MAP_FIXED, -1, 0));
+            dup = static_cast<char*>(sim.mmap(c, PAGE_SIZE, rw, anon | MAP_FIXED_NOREPLACE, -1, 0));
+            sim.read_memory(fixed, data, 3);
+            sim.mprotect(a, PAGE_SIZE, PROT_READ);
+        }
+        std::cout << "2-page mmap after unmapping the middle: " << (reused == b ? "reused the hole" : "placed elsewhere")
+                  << "; hint " << (hinted == a + 256 * PAGE_SIZE ? "honoured" : "ignored")
+                  << "; MAP_FIXED over c+1 reads '" << data << "' (fresh page); MAP_FIXED_NOREPLACE over c "
+                  << (dup ? "succeeded" : "refused") << "\n";
+        bool write_a, read_a, write_fixed;
+        {
+            ScopedQuietOutput quiet;
+            write_a = sim.access(a, true);
+            read_a = sim.access(a, false);
+            write_fixed = sim.access(fixed, true);
+        }
+        std::cout << "After mprotect(a, 1 page, PROT_READ): write " << (write_a ? "allowed" : "refused") << ", read "
+                  << (read_a ? "allowed" : "refused") << "; write to the read-only MAP_FIXED pages "
+                  << (write_fixed ? "allowed" : "refused") << "\n";
+        sim.print_vmas();
+        
+        // A huge munmap only walks the VMAs inside it
+        size_t areas = sim.get_vma_count();
+        uint64_t span = (VPN_LIMIT - MMAP_BASE / PAGE_SIZE) * PAGE_SIZE;
+        {
+            ScopedQuietOutput quiet;
+            sim.munmap(reinterpret_cast<void*>(MMAP_BASE), span);
+        }
+        std::cout << "munmap of " << (span >> 30) << " GB: " << areas << " areas removed, " << sim.get_vma_count()
+                  << " left, " << sim.get_vma_gaps() << " free gap\n";
+        sim.print_replacement_stats();
+    }
     
     return 0;
 }
\ No newline at end of file
@@ -4,44 +4,351 @@
 #include <iomanip>
 #include <memory>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include "address_space.h"
+#include "vm_trace.h"
+#include "page_ops.h"
+#include "bench.h"
+
+// x86 two-level geometry (address_space.h); the PDE/PTE formats below are 32-bit x86's
+using Geometry = X86_32;
 
 // Page size and related constants
-const uint32_t PAGE_SIZE = 4096;  // 4KB pages
-const uint32_t PAGE_SHIFT = 12;   // log2(4096) = 12
-const uint32_t PAGE_MASK = 0xFFF; // 12 bits for offset
+const uint32_t PAGE_SIZE = Geometry::PAGE_SIZE;    // 4KB pages
+const uint32_t PAGE_SHIFT = Geometry::PAGE_SHIFT;  // log2(4096) = 12
+const uint32_t PAGE_MASK = Geometry::PAGE_MASK;    // 12 bits for offset
 
 // Page table constants (10 bits each for 32-bit addresses)
-const uint32_t PTE_ENTRIES = 1024;  // 2^10 = 1024 entries per table
-const uint32_t PDE_ENTRIES = 1024;  // 2^10 = 1024 entries per directory
+const uint32_t PTE_ENTRIES = Geometry::ENTRIES;  // 2^10 = 1024 entries per table
+const uint32_t PDE_ENTRIES = Geometry::ENTRIES;  // 2^10 = 1024 entries per directory
 
 // Flags for page table entries
 const uint32_t PTE_PRESENT = 0x001;  // Page is present in memory
 const uint32_t PTE_WRITE   = 0x002;  // Page is writable
 const uint32_t PTE_USER    = 0x004;  // User accessible
+const uint32_t PTE_PS      = 0x080;  // PDE only: maps a 4MB page directly (PSE)
+const uint32_t PTE_COW     = 0x200;  // Write-protected share of a writable page (software bit)
+
+// 4MB pages: one directory entry maps a whole page table's worth of memory
+const uint32_t LARGE_PAGE_SIZE = 4 * 1024 * 1024;
+const uint32_t LARGE_PAGE_FRAMES = LARGE_PAGE_SIZE / PAGE_SIZE;    // 1024, one per PTE it replaces
 
 // Extract indices from virtual address
-#define PDX(va) (((va) >> 22) & 0x3FF)  // Directory index (bits 31-22)
-#define PTX(va) (((va) >> 12) & 0x3FF)  // Table index (bits 21-12)
-#define PG_OFFSET(va) ((va) & 0xFFF)    // Page offset (bits 11-0)
+#define PDX(va) (((va) >> (PAGE_SHIFT + Geometry::BITS_PER_LEVEL)) & (PDE_ENTRIES - 1))  // Directory index (bits 31-22)
+#define PTX(va) (((va) >> PAGE_SHIFT) & (PTE_ENTRIES - 1))  // Table index (bits 21-12)
+#define PG_OFFSET(va) ((va) & PAGE_MASK)    // Page offset (bits 11-0)
 
 // Extract physical address from page table entry
-#define PTE_ADDR(pte) ((pte) & ~0xFFF)
+#define PTE_ADDR(pte) ((pte) & ~PAGE_MASK)
+#define LARGE_PAGE_ADDR(pde) ((pde) & ~(LARGE_PAGE_SIZE - 1))  // Base of a PTE_PS entry's 4MB page
+
+// Direct view of one page's storage starting at a physical address
+struct PageSpan {
+    uint8_t* data;      // Byte at the requested address, nullptr if the page is not allocated
+    uint32_t length;    // Bytes from there to the end of the page
+};
+
+// Flat frame pool: one preallocated, page-aligned arena indexed by PFN.
+// Free frames are chained through their own first 8 bytes (intrusive, doubly
+// linked free list), so alloc/free and unlinking a frame are O(1) and no heap
+// allocation happens per page.
+class FramePool {
+private:
+    enum Link { NEXT, PREV };
+
+    uint8_t* arena;
+    uint32_t base_addr;         // Physical address of frame 0
+    uint32_t num_frames;
+    uint32_t high_water;        // Frames [0, high_water) have been handed out at least once
+    uint32_t free_head;         // First frame on the free list
+    uint32_t used_frames;
+    std::vector<uint8_t> in_use;
+    
+    uint32_t link(uint32_t index, Link which) const {
+        uint32_t value;
+        std::memcpy(&value, arena + (size_t)index * PAGE_SIZE + which * sizeof(value), sizeof(value));
+        return value;
+    }
+    
+    void set_link(uint32_t index, Link which, uint32_t value) {
+        std::memcpy(arena + (size_t)index * PAGE_SIZE + which * sizeof(value), &value, sizeof(value));
+    }
+    
+    void push_free(uint32_t index) {
+        set_link(index, NEXT, free_head);
+        set_link(index, PREV, NO_FRAME);
+        if (free_head != NO_FRAME) {
+            set_link(free_head, PREV, index);
+        }
+        free_head = index;
+    }
+    
+    uint32_t pop_free() {
+        uint32_t index = free_head;
+        free_head = link(index, NEXT);
+        if (free_head != NO_FRAME) {
+            set_link(free_head, PREV, NO_FRAME);
+        }
+        return index;
+    }
+    
+    void unlink_free(uint32_t index) {
+        uint32_t next = link(index, NEXT);
+        uint32_t prev = link(index, PREV);
+        if (prev == NO_FRAME) {
+            free_head = next;
+        } else {
+            set_link(prev, NEXT, next);
+        }
+        if (next != NO_FRAME) {
+            set_link(next, PREV, prev);
+        }
+    }
+    
+    // First align-boundary run of count freed frames below high_water (all
+    // on the free list), or NO_FRAME. Used once the never-used tail cannot
+    // hold a run any more.
+    uint32_t find_free_run(uint32_t count, uint32_t align) {
+        uint32_t step = align >> PAGE_SHIFT;
+        uint32_t start = (((base_addr + align - 1) & ~(align - 1)) - base_addr) >> PAGE_SHIFT;
+        for (; start + count <= high_water; start += step) {
+            uint32_t i = 0;
+            while (i < count && !in_use[start + i]) {
+                i++;
+            }
+            if (i == count) {
+                return start;
+            }
+        }
+        return NO_FRAME;
+    }
+    
+    // Take frames [first, first + count) off the free list, O(count)
+    void unlink_free_range(uint32_t first, uint32_t count) {
+        for (uint32_t index = first; index < first + count; index++) {
+            unlink_free(index);
+        }
+    }
+    
+public:
+    static const uint32_t NO_FRAME = 0xFFFFFFFF;
+    
+    FramePool(uint32_t base, size_t bytes) 
+        : base_addr(base), high_water(0), free_head(NO_FRAME), used_frames(0) {
+        num_frames = bytes / PAGE_SIZE;
+        assert(num_frames > 0);
+        assert((uint64_t)base + (uint64_t)num_frames * PAGE_SIZE <= 0x100000000ULL);
+        // Large aligned allocations are served by fresh anonymous memory, so the
+        // OS only commits frames once they are touched
+        arena = static_cast<uint8_t*>(std::aligned_alloc(PAGE_SIZE, (size_t)num_frames * PAGE_SIZE));
+        assert(arena != nullptr);
+        in_use.assign(num_frames, 0);
+    }
+    
+    ~FramePool() { std::free(arena); }
+    
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    
+    // Pointer to an allocated frame's storage, nullptr if out of range or free
+    uint8_t* frame_ptr(uint32_t page_addr) {
+        uint32_t index = (page_addr - base_addr) >> PAGE_SHIFT;
+        if (page_addr < base_addr || index >= num_frames || !in_use[index]) {
+            return nullptr;
+        }
+        return arena + (size_t)index * PAGE_SIZE;
+    }
+    
+    // Allocate a zeroed frame, returns its physical address or 0 when exhausted
+    uint32_t alloc() {
+        uint32_t index;
+        if (free_head != NO_FRAME) {
+            index = pop_free();
+        } else if (high_water < num_frames) {
+            index = high_water++;
+        } else {
+            return 0;
+        }
+        page_ops::zero(arena + (size_t)index * PAGE_SIZE, PAGE_SIZE);
+        in_use[index] = 1;
+        used_frames++;
+        return base_addr + (index << PAGE_SHIFT);
+    }
+    
+    // Allocate count contiguous zeroed frames starting at an align boundary
+    // (a 4MB page), carved from frames never handed out (frames skipped to
+    // reach the boundary go on the free list) or else from an aligned run of
+    // freed frames. Returns 0 when neither exists.
+    uint32_t alloc_contiguous(uint32_t count, uint32_t align) {
+        uint32_t first = high_water;
+        uint32_t misalign = (base_addr + (first << PAGE_SHIFT)) & (align - 1);
+        if (misalign != 0) {
+            first += (align - misalign) >> PAGE_SHIFT;
+        }
+        if (first <= num_frames && count <= num_frames - first) {
+            for (uint32_t index = high_water; index < first; index++) {
+                push_free(index);
+            }
+            high_water = first + count;
+        } else {
+            first = find_free_run(count, align);
+            if (first == NO_FRAME) {
+                return 0;
+            }
+            unlink_free_range(first, count);
+        }
+        page_ops::zero(arena + (size_t)first * PAGE_SIZE, (size_t)count * PAGE_SIZE);
+        std::fill(in_use.begin() + first, in_use.begin() + first + count, 1);
+        used_frames += count;
+        return base_addr + (first << PAGE_SHIFT);
+    }
+    
+    // Return a frame to the free list
+    bool free(uint32_t page_addr) {
+        if (!frame_ptr(page_addr)) {
+            return false;
+        }
+        uint32_t index = (page_addr - base_addr) >> PAGE_SHIFT;
+        push_free(index);
+        in_use[index] = 0;
+        used_frames--;
+        return true;
+    }
+    
+    uint32_t allocated() const { return used_frames; }
+    uint32_t capacity() const { return num_frames; }
+    uint32_t high_water_address() const { return base_addr + (high_water << PAGE_SHIFT); }
+};
 
 class PhysicalMemory {
 private:
-    std::map<uint32_t, std::vector<uint8_t>> pages;
+    std::map<uint32_t, std::vector<uint8_t>> pages;  // Map backend: one heap buffer per page
+    std::unique_ptr<FramePool> pool;                 // Arena backend, used when set
     uint32_t next_free_page;
+    std::vector<uint32_t> free_addrs;                // Map backend: freed addresses, reused before next_free_page
+    uint64_t freed_pages;
+    std::map<uint32_t, uint32_t> shared_refs;        // Page -> mappings, only for pages mapped more than once
+    
+    // Storage of an allocated page, nullptr if the page is not allocated
+    uint8_t* frame_data(uint32_t page_addr) {
+        if (pool) {
+            return pool->frame_ptr(page_addr);
+        }
+        auto it = pages.find(page_addr);
+        return it == pages.end() ? nullptr : it->second.data();
+    }
     
 public:
-    PhysicalMemory() : next_free_page(0x100000) {} // Start at 1MB
+    PhysicalMemory() : next_free_page(0x100000), freed_pages(0) {} // Start at 1MB
+    
+    // Arena-backed physical memory of ram_bytes, also starting at 1MB
+    explicit PhysicalMemory(size_t ram_bytes) 
+        : pool(std::make_unique<FramePool>(0x100000, ram_bytes)), next_free_page(0x100000), freed_pages(0) {}
     
     // Allocate a new physical page
     uint32_t allocate_page() {
-        uint32_t page_addr = next_free_page;
-        pages[page_addr] = std::vector<uint8_t>(PAGE_SIZE, 0);
-        next_free_page += PAGE_SIZE;
-        std::cout << "  [PHYS] Allocated physical page at 0x" 
-                  << std::hex << page_addr << std::dec << std::endl;
+        uint32_t page_addr;
+        if (pool) {
+            page_addr = pool->alloc();
+            if (page_addr == 0) {
+                VM_LOG(ERROR) << "  [PHYS] ERROR: Out of physical memory\n";
+                return 0;
+            }
+        } else if (!free_addrs.empty()) {
+            page_addr = free_addrs.back();
+            free_addrs.pop_back();
+            pages[page_addr] = std::vector<uint8_t>(PAGE_SIZE, 0);
+        } else {
+            page_addr = next_free_page;
+            pages[page_addr] = std::vector<uint8_t>(PAGE_SIZE, 0);
+            next_free_page += PAGE_SIZE;
+        }
+        VM_LOG(INFO) << "  [PHYS] Allocated physical page at 0x" 
+                     << std::hex << page_addr << std::dec << '\n';
+        VM_EVENT(FRAME_ALLOC, page_addr, 0);
+        return page_addr;
+    }
+    
+    // Mappings referencing an allocated page: 1 unless shared by fork, 0 if not allocated
+    uint32_t page_refcount(uint32_t page_addr) {
+        auto it = shared_refs.find(page_addr);
+        if (it != shared_refs.end()) {
+            return it->second;
+        }
+        return frame_data(page_addr) ? 1 : 0;
+    }
+    
+    // One more mapping shares the page (like get_page)
+    void get_page(uint32_t page_addr) {
+        uint32_t refs = page_refcount(page_addr);
+        if (refs > 0) {
+            shared_refs[page_addr] = refs + 1;
+        }
+    }
+    
+    // Drop one mapping (like put_page); the page is freed with its last
+    // reference. Returns true if it was freed.
+    bool put_page(uint32_t page_addr) {
+        auto it = shared_refs.find(page_addr);
+        if (it != shared_refs.end()) {
+            if (--it->second == 1) {
+                shared_refs.erase(it);
+            }
+            return false;
+        }
+        if (pool) {
+            if (!pool->free(page_addr)) {
+                return false;
+            }
+        } else {
+            if (pages.erase(page_addr) == 0) {
+                return false;
+            }
+            free_addrs.push_back(page_addr);
+        }
+        freed_pages++;
+        VM_LOG(INFO) << "  [PHYS] Freed physical page at 0x" 
+                     << std::hex << page_addr << std::dec << '\n';
+        VM_EVENT(FRAME_FREE, page_addr, 0);
+        return true;
+    }
+    
+    size_t allocated_pages() const {
+        return pool ? pool->allocated() : pages.size();
+    }
+    
+    size_t shared_pages() const { return shared_refs.size(); }
+    
+    // End of the physical range handed out so far (the map backend's bump
+    // pointer, the pool's end); frees keep it from growing under churn
+    uint32_t high_water_address() const {
+        return pool ? pool->high_water_address() : next_free_page;
+    }
+    
+    // Allocate a 4MB page: LARGE_PAGE_FRAMES contiguous frames on a 4MB
+    // boundary. Each frame is still its own page for refcounts and access.
+    uint32_t allocate_large_page() {
+        uint32_t page_addr;
+        if (pool) {
+            page_addr = pool->alloc_contiguous(LARGE_PAGE_FRAMES, LARGE_PAGE_SIZE);
+            if (page_addr == 0) {
+                VM_LOG(ERROR) << "  [PHYS] ERROR: No free 4MB-aligned physical range\n";
+                return 0;
+            }
+        } else {
+            page_addr = (next_free_page + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+            for (uint32_t i = 0; i < LARGE_PAGE_FRAMES; i++) {
+                pages[page_addr + i * PAGE_SIZE] = std::vector<uint8_t>(PAGE_SIZE, 0);
+            }
+            next_free_page = page_addr + LARGE_PAGE_SIZE;
+        }
+        VM_LOG(INFO) << "  [PHYS] Allocated 4MB physical page at 0x" 
+                     << std::hex << page_addr << std::dec << '\n';
+        VM_EVENT(FRAME_ALLOC, page_addr, LARGE_PAGE_SIZE);
         return page_addr;
     }
     
@@ -50,13 +357,14 @@ public:
         uint32_t page_addr = phys_addr & ~PAGE_MASK;
         uint32_t offset = phys_addr & PAGE_MASK;
         
-        if (pages.find(page_addr) == pages.end()) {
-            std::cout << "  [PHYS] ERROR: Access to unmapped physical page 0x" 
-                      << std::hex << page_addr << std::dec << std::endl;
+        uint8_t* page = frame_data(page_addr);
+        if (!page) {
+            VM_LOG(ERROR) << "  [PHYS] ERROR: Access to unmapped physical page 0x" 
+                          << std::hex << page_addr << std::dec << '\n';
             return 0;
         }
         
-        return pages[page_addr][offset];
+        return page[offset];
     }
     
     // Write to physical memory
@@ -64,51 +372,408 @@ public:
         uint32_t page_addr = phys_addr & ~PAGE_MASK;
         uint32_t offset = phys_addr & PAGE_MASK;
         
-        if (pages.find(page_addr) == pages.end()) {
-            std::cout << "  [PHYS] ERROR: Write to unmapped physical page 0x" 
-                      << std::hex << page_addr << std::dec << std::endl;
+        uint8_t* page = frame_data(page_addr);
+        if (!page) {
+            VM_LOG(ERROR) << "  [PHYS] ERROR: Write to unmapped physical page 0x" 
+                          << std::hex << page_addr << std::dec << '\n';
             return;
         }
         
-        pages[page_addr][offset] = value;
+        page[offset] = value;
     }
     
-    // Write a 32-bit value (for page table entries)
-    void write_uint32(uint32_t phys_addr, uint32_t value) {
-        for (int i = 0; i < 4; i++) {
+    // Raw pointer into the page holding phys_addr, valid until the page is freed
+    PageSpan page_span(uint32_t phys_addr) {
+        uint32_t offset = phys_addr & PAGE_MASK;
+        uint8_t* page = frame_data(phys_addr & ~PAGE_MASK);
+        if (!page) {
+            return {nullptr, 0};
+        }
+        return {page + offset, PAGE_SIZE - offset};
+    }
+    
+    // Write block of data to physical address, one page lookup per page touched
+    void write_block(uint32_t phys_addr, const uint8_t* data, size_t size) {
+        while (size > 0) {
+            PageSpan span = page_span(phys_addr);
+            if (!span.data) {
+                VM_LOG(ERROR) << "  [PHYS] ERROR: Write to unmapped physical page 0x" 
+                              << std::hex << (phys_addr & ~PAGE_MASK) << std::dec << '\n';
+                return;
+            }
+            size_t n = std::min<size_t>(size, span.length);
+            std::memcpy(span.data, data, n);
+            phys_addr += n;
+            data += n;
+            size -= n;
+        }
+    }
+    
+    // Read block of data from physical address, one page lookup per page touched
+    void read_block(uint32_t phys_addr, uint8_t* buffer, size_t size) {
+        while (size > 0) {
+            PageSpan span = page_span(phys_addr);
+            size_t n = span.data ? std::min<size_t>(size, span.length)
+                                 : std::min<size_t>(size, PAGE_SIZE - (phys_addr & PAGE_MASK));
+            if (!span.data) {
+                VM_LOG(ERROR) << "  [PHYS] ERROR: Read from unmapped physical page 0x" 
+                              << std::hex << (phys_addr & ~PAGE_MASK) << std::dec << '\n';
+                std::memset(buffer, 0, n);
+            } else {
+                std::memcpy(buffer, span.data, n);
+            }
+            phys_addr += n;
+            buffer += n;
+            size -= n;
+        }
+    }
+    
+    // Native-width load/store in host byte order (little-endian, same layout as the
+    // byte-wise path). Values straddling a page boundary fall back to single bytes.
+    template <typename T>
+    T read_word(uint32_t phys_addr) {
+        PageSpan span = page_span(phys_addr);
+        T value = 0;
+        if (span.data && span.length >= sizeof(T)) {
+            std::memcpy(&value, span.data, sizeof(T));
+            return value;
+        }
+        for (size_t i = 0; i < sizeof(T); i++) {
+            value |= (T)read_byte(phys_addr + i) << (i * 8);
+        }
+        return value;
+    }
+    
+    template <typename T>
+    void write_word(uint32_t phys_addr, T value) {
+        PageSpan span = page_span(phys_addr);
+        if (span.data && span.length >= sizeof(T)) {
+            std::memcpy(span.data, &value, sizeof(T));
+            return;
+        }
+        for (size_t i = 0; i < sizeof(T); i++) {
             write_byte(phys_addr + i, (value >> (i * 8)) & 0xFF);
         }
     }
     
+    // Write a 32-bit value (for page table entries)
+    void write_uint32(uint32_t phys_addr, uint32_t value) {
+        write_word<uint32_t>(phys_addr, value);
+    }
+    
     // Read a 32-bit value (for page table entries)
     uint32_t read_uint32(uint32_t phys_addr) {
-        uint32_t value = 0;
-        for (int i = 0; i < 4; i++) {
-            value |= (read_byte(phys_addr + i) << (i * 8));
-        }
-        return value;
+        return read_word<uint32_t>(phys_addr);
+    }
+    
+    void write_uint64(uint32_t phys_addr, uint64_t value) {
+        write_word<uint64_t>(phys_addr, value);
+    }
+    
+    uint64_t read_uint64(uint32_t phys_addr) {
+        return read_word<uint64_t>(phys_addr);
     }
     
     void print_stats() {
+        size_t allocated = allocated_pages();
         std::cout << "\n=== Physical Memory Stats ===" << std::endl;
-        std::cout << "Total allocated pages: " << pages.size() << std::endl;
-        std::cout << "Memory used: " << pages.size() * PAGE_SIZE / 1024 << " KB" << std::endl;
+        std::cout << "Backend: " << (pool ? "flat frame pool" : "page map") << std::endl;
+        std::cout << "Total allocated pages: " << allocated << std::endl;
+        std::cout << "Memory used: " << allocated * PAGE_SIZE / 1024 << " KB" << std::endl;
+        if (pool) {
+            std::cout << "Pool capacity: " << pool->capacity() << " pages" << std::endl;
+        }
+        if (freed_pages > 0) {
+            std::cout << "Pages freed: " << freed_pages << " (highest physical address 0x" << std::hex 
+                      << high_water_address() << std::dec << ")" << std::endl;
+        }
+    }
+};
+
+// Software TLB: set-associative cache of VPN -> PFN + flags, tagged by ASID (PID)
+enum class TLBPolicy { LRU, FIFO, RANDOM };
+
+struct TLBConfig {
+    uint32_t entries = 64;          // Total entries (must be a multiple of ways)
+    uint32_t ways = 4;              // Associativity (entries per set)
+    TLBPolicy policy = TLBPolicy::LRU;
+    bool asid_tagged = false;       // Keep entries across context switches (PCID-style)
+    uint32_t asid_count = 0;        // Hardware ASIDs (PCID: 4096), 0 = the PID is the tag
+};
+
+struct TLBEntry {
+    bool valid;
+    uint32_t asid;      // Address space id (PID) that owns this translation
+    uint32_t vpn;       // Virtual page number (va >> PAGE_SHIFT)
+    uint32_t pfn;       // Physical frame number (pa >> PAGE_SHIFT)
+    uint32_t flags;     // PTE flag bits (PTE_PRESENT | PTE_WRITE | PTE_USER, PTE_PS for a 4MB page)
+    uint64_t stamp;     // Last use (LRU) or insertion time (FIFO)
+    
+    TLBEntry() : valid(false), asid(0), vpn(0), pfn(0), flags(0), stamp(0) {}
+};
+
+struct TLBStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;         // Valid entries replaced on insert
+    uint64_t flushes = 0;           // Full or per-ASID flush operations
+    uint64_t flushed_entries = 0;   // Valid entries thrown away by flushes
+    uint64_t invalidations = 0;     // Single-page invalidations (invlpg)
+    uint64_t large_fills = 0;       // 4MB entries inserted (their walk stopped at the PDE)
+};
+
+class TLB {
+private:
+    TLBConfig config;
+    uint32_t num_sets;
+    std::vector<TLBEntry> entries;  // num_sets * ways, set-major
+    uint64_t clock;
+    uint32_t rng_state;
+    TLBStats stats;
+    
+    TLBEntry* set_begin(uint32_t vpn) {
+        return &entries[(vpn % num_sets) * config.ways];
+    }
+    
+    uint32_t next_random() {
+        // xorshift32, deterministic so runs are reproducible
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 17;
+        rng_state ^= rng_state << 5;
+        return rng_state;
+    }
+    
+public:
+    TLB(const TLBConfig& cfg = TLBConfig()) 
+        : config(cfg), clock(0), rng_state(0x9E3779B9) {
+        assert(config.ways > 0 && config.entries >= config.ways);
+        assert(config.entries % config.ways == 0);
+        num_sets = config.entries / config.ways;
+        entries.resize(config.entries);
+    }
+    
+    const TLBConfig& get_config() const { return config; }
+    const TLBStats& get_stats() const { return stats; }
+    void reset_stats() { stats = TLBStats(); }
+    
+    // Entry caching vpn: its own 4KB entry, or a 4MB entry (PTE_PS, tagged
+    // with the large page's first VPN and stored in that VPN's set)
+    TLBEntry* find(uint32_t asid, uint32_t vpn) {
+        TLBEntry* set = set_begin(vpn);
+        for (uint32_t w = 0; w < config.ways; w++) {
+            if (set[w].valid && set[w].vpn == vpn && set[w].asid == asid) {
+                return &set[w];
+            }
+        }
+        uint32_t large_vpn = vpn & ~(LARGE_PAGE_FRAMES - 1);
+        if (large_vpn == vpn) {
+            return nullptr;
+        }
+        set = set_begin(large_vpn);
+        for (uint32_t w = 0; w < config.ways; w++) {
+            if (set[w].valid && set[w].vpn == large_vpn && set[w].asid == asid && (set[w].flags & PTE_PS)) {
+                return &set[w];
+            }
+        }
+        return nullptr;
+    }
+    
+    // Look up a translation; on hit fills pfn/flags
+    bool lookup(uint32_t asid, uint32_t vpn, uint32_t& pfn, uint32_t& flags) {
+        TLBEntry* e = find(asid, vpn);
+        if (!e) {
+            stats.misses++;
+            return false;
+        }
+        if (config.policy == TLBPolicy::LRU) {
+            e->stamp = ++clock;
+        }
+        pfn = e->pfn + (vpn - e->vpn);
+        flags = e->flags;
+        stats.hits++;
+        return true;
+    }
+    
+    // Fill a translation after a page walk. A 4MB page is inserted once,
+    // with its first VPN and PFN and PTE_PS in flags.
+    void insert(uint32_t asid, uint32_t vpn, uint32_t pfn, uint32_t flags) {
+        TLBEntry* set = set_begin(vpn);
+        TLBEntry* victim = nullptr;
+        
+        for (uint32_t w = 0; w < config.ways && !victim; w++) {
+            if (set[w].valid && set[w].vpn == vpn && set[w].asid == asid) {
+                victim = &set[w];   // Refresh existing entry
+            }
+        }
+        for (uint32_t w = 0; w < config.ways && !victim; w++) {
+            if (!set[w].valid) {
+                victim = &set[w];
+            }
+        }
+        if (!victim) {
+            if (config.policy == TLBPolicy::RANDOM) {
+                victim = &set[next_random() % config.ways];
+            } else {
+                // LRU and FIFO both evict the smallest stamp; they differ in when it is updated
+                victim = &set[0];
+                for (uint32_t w = 1; w < config.ways; w++) {
+                    if (set[w].stamp < victim->stamp) {
+                        victim = &set[w];
+                    }
+                }
+            }
+            stats.evictions++;
+        }
+        
+        if (flags & PTE_PS) {
+            stats.large_fills++;
+        }
+        victim->valid = true;
+        victim->asid = asid;
+        victim->vpn = vpn;
+        victim->pfn = pfn;
+        victim->flags = flags;
+        victim->stamp = ++clock;
+    }
+    
+    // Invalidate one page of one address space (like invlpg), including a
+    // 4MB entry covering it
+    void invalidate(uint32_t asid, uint32_t vpn) {
+        while (TLBEntry* e = find(asid, vpn)) {
+            e->valid = false;
+            stats.invalidations++;
+        }
+    }
+    
+    // Drop every entry (like reloading CR3 without PCID)
+    void flush_all() {
+        for (auto& e : entries) {
+            if (e.valid) {
+                stats.flushed_entries++;
+                e.valid = false;
+            }
+        }
+        stats.flushes++;
+    }
+    
+    // Drop only the entries of one address space
+    void flush_asid(uint32_t asid) {
+        for (auto& e : entries) {
+            if (e.valid && e.asid == asid) {
+                stats.flushed_entries++;
+                e.valid = false;
+            }
+        }
+        stats.flushes++;
+    }
+    
+    void print_stats() {
+        uint64_t lookups = stats.hits + stats.misses;
+        std::cout << "\n=== TLB Stats ===" << std::endl;
+        std::cout << "Geometry: " << config.entries << " entries, " << config.ways 
+                  << "-way, " << num_sets << " sets, "
+                  << (config.asid_tagged ? "ASID-tagged" : "flush on switch") << std::endl;
+        std::cout << "Hits: " << stats.hits << ", Misses: " << stats.misses;
+        if (lookups > 0) {
+            std::cout << " (" << std::fixed << std::setprecision(1) 
+                      << (stats.hits * 100.0 / lookups) << "% hit rate)";
+        }
+        std::cout << std::endl;
+        std::cout << "Evictions: " << stats.evictions 
+                  << ", Invalidations: " << stats.invalidations << std::endl;
+        std::cout << "Flushes: " << stats.flushes 
+                  << " (" << stats.flushed_entries << " live entries discarded)" << std::endl;
+        // Every miss is a full two-level walk: one PDE read plus one PTE read,
+        // except that a 4MB page stops at the PDE
+        std::cout << "Page walk memory reads: " << stats.misses * 2 - stats.large_fills << std::endl;
     }
 };
 
+// What tearing down one address space gave back
+struct TeardownStats {
+    uint32_t pages_unmapped = 0;    // 4KB mappings dropped (a 4MB page counts 1024)
+    uint32_t frames_freed = 0;      // Data frames whose last reference went away
+    uint32_t tables_freed = 0;      // Page tables and the page directory
+};
+
+// unmap_page outcome: NO_MEMORY means a 4MB page had to be split and no frame
+// was free for its page table, so the page is still mapped
+enum class UnmapResult { UNMAPPED, NOT_MAPPED, NO_MEMORY };
+
 class PageTableManager {
 private:
     PhysicalMemory& phys_mem;
     uint32_t page_directory_phys;  // Physical address of page directory
     std::map<uint32_t, uint32_t> allocated_page_tables; // Track allocated page tables
+    TLB* tlb;       // Optional TLB in front of the page walk (owned by ProcessManager)
+    uint32_t asid;  // Tag used for this address space's TLB entries
+    std::function<void(uint32_t)> shootdown;    // Tells other CPUs a VPN (or FLUSH_ALL_PAGES) went stale
+    uint64_t cow_copies;    // Write faults that copied a shared page
+    uint64_t cow_reuses;    // Write faults that found the page no longer shared
+    
+    // Drop a stale translation from this CPU's TLB and every other one
+    void flush_tlb_page(uint32_t vpn) {
+        if (tlb) {
+            tlb->invalidate(asid, vpn);
+        }
+        if (shootdown) {
+            shootdown(vpn);
+        }
+    }
+    
+    void flush_tlb_mm() {
+        if (tlb) {
+            tlb->flush_asid(asid);
+        }
+        if (shootdown) {
+            shootdown(FLUSH_ALL_PAGES);
+        }
+    }
+    
+    // Physical address of the PTE for virtual_addr, 0 if its page table is
+    // missing (or it is mapped by a 4MB page)
+    uint32_t pte_address(uint32_t virtual_addr) {
+        uint32_t pde = phys_mem.read_uint32(page_directory_phys + PDX(virtual_addr) * 4);
+        if (!(pde & PTE_PRESENT) || (pde & PTE_PS)) {
+            return 0;
+        }
+        return PTE_ADDR(pde) + PTX(virtual_addr) * 4;
+    }
+    
+    // Replace the 4MB page at dir_index by a page table of 1024 4KB PTEs
+    // with the same flags and frames. Returns the new table, 0 on failure.
+    uint32_t split_large_page(uint32_t dir_index) {
+        uint32_t pde_addr = page_directory_phys + dir_index * 4;
+        uint32_t pde = phys_mem.read_uint32(pde_addr);
+        uint32_t table_phys = phys_mem.allocate_page();
+        PageSpan table = phys_mem.page_span(table_phys);
+        if (!table.data) {
+            return 0;
+        }
+        uint32_t base = LARGE_PAGE_ADDR(pde);
+        uint32_t flags = pde & PAGE_MASK & ~PTE_PS;
+        for (uint32_t j = 0; j < PTE_ENTRIES; j++) {
+            uint32_t pte = (base + j * PAGE_SIZE) | flags;
+            std::memcpy(table.data + j * 4, &pte, sizeof(pte));
+        }
+        allocated_page_tables[dir_index] = table_phys;
+        phys_mem.write_uint32(pde_addr, table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER);
+        flush_tlb_page(dir_index << (22 - PAGE_SHIFT));
+        VM_LOG(INFO) << "  [PGT] Split 4MB page at 0x" << std::hex << base 
+                     << " into page table at 0x" << table_phys << std::dec << '\n';
+        return table_phys;
+    }
     
 public:
-    PageTableManager(PhysicalMemory& pm) : phys_mem(pm) {
+    static const uint32_t FLUSH_ALL_PAGES = 0xFFFFFFFF;
+    
+    PageTableManager(PhysicalMemory& pm) 
+        : phys_mem(pm), tlb(nullptr), asid(0), cow_copies(0), cow_reuses(0) {
         // Allocate page directory in "kernel memory"
         page_directory_phys = phys_mem.allocate_page();
-        std::cout << "[PGT] Created page directory at KERNEL physical 0x" 
-                  << std::hex << page_directory_phys << std::dec << std::endl;
-        std::cout << "[PGT] This page directory is stored in KERNEL memory space" << std::endl;
+        VM_LOG(INFO) << "[PGT] Created page directory at KERNEL physical 0x" 
+                     << std::hex << page_directory_phys << std::dec << '\n';
+        VM_LOG(TRACE) << "[PGT] This page directory is stored in KERNEL memory space\n";
     }
     
     // Get page directory physical address (like reading CR3)
@@ -116,15 +781,30 @@ public:
         return page_directory_phys;
     }
     
-    // Map a virtual page to a physical page (with growth simulation)
+    // Put a TLB in front of translate_address
+    void attach_tlb(TLB* t, uint32_t address_space_id) {
+        tlb = t;
+        asid = address_space_id;
+    }
+    
+    uint32_t get_asid() const { return asid; }
+    
+    // Called with each VPN whose translation changed, so CPUs other than
+    // the attached one can be shot down
+    void set_shootdown(std::function<void(uint32_t)> fn) {
+        shootdown = std::move(fn);
+    }
+    
+    // Map a virtual page to a physical page (with growth simulation). False
+    // if a page table was needed and no frame was free for it.
     bool map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
         uint32_t dir_index = PDX(virtual_addr);
         uint32_t table_index = PTX(virtual_addr);
         
-        std::cout << "\n[PGT] Mapping virtual 0x" << std::hex << virtual_addr 
-                  << " to physical 0x" << physical_addr << std::dec << std::endl;
-        std::cout << "      Directory index: " << dir_index 
-                  << ", Table index: " << table_index << std::endl;
+        VM_LOG(INFO) << "\n[PGT] Mapping virtual 0x" << std::hex << virtual_addr 
+                     << " to physical 0x" << physical_addr << std::dec << '\n';
+        VM_LOG(TRACE) << "      Directory index: " << dir_index 
+                      << ", Table index: " << table_index << '\n';
         
         // Get page directory entry
         uint32_t pde_addr = page_directory_phys + dir_index * 4;
@@ -132,15 +812,28 @@ public:
         
         uint32_t page_table_phys;
         
-        if (!(pde & PTE_PRESENT)) {
+        if ((pde & PTE_PRESENT) && (pde & PTE_PS)) {
+            // Remapping one 4KB page inside a 4MB page needs a real page table
+            page_table_phys = split_large_page(dir_index);
+            if (page_table_phys == 0) {
+                VM_LOG(ERROR) << "  [PGT] ERROR: No frame to split the 4MB page at 0x" << std::hex 
+                              << virtual_addr << std::dec << '\n';
+                return false;
+            }
+        } else if (!(pde & PTE_PRESENT)) {
             // PAGE TABLE GROWTH: Allocate new page table in KERNEL memory
             page_table_phys = phys_mem.allocate_page();
+            if (page_table_phys == 0) {
+                VM_LOG(ERROR) << "  [PGT] ERROR: No frame for a page table at 0x" << std::hex 
+                              << virtual_addr << std::dec << '\n';
+                return false;
+            }
             allocated_page_tables[dir_index] = page_table_phys;
             
-            std::cout << "  [PGT] *** GROWTH *** Created new page table " << allocated_page_tables.size() 
-                      << " at KERNEL physical 0x" << std::hex << page_table_phys << std::dec << std::endl;
-            std::cout << "  [PGT] This covers virtual address range 0x" << std::hex 
-                      << (dir_index << 22) << " - 0x" << ((dir_index + 1) << 22) - 1 << std::dec << std::endl;
+            VM_LOG(INFO) << "  [PGT] *** GROWTH *** Created new page table " << allocated_page_tables.size() 
+                         << " at KERNEL physical 0x" << std::hex << page_table_phys << std::dec << '\n';
+            VM_LOG(TRACE) << "  [PGT] This covers virtual address range 0x" << std::hex 
+                          << (dir_index << 22) << " - 0x" << ((dir_index + 1) << 22) - 1 << std::dec << '\n';
             
             // Update page directory entry (stored in kernel memory)
             pde = page_table_phys | PTE_PRESENT | PTE_WRITE | PTE_USER;
@@ -148,8 +841,8 @@ public:
         } else {
             // Page table exists
             page_table_phys = PTE_ADDR(pde);
-            std::cout << "  [PGT] Using existing page table at KERNEL physical 0x" 
-                      << std::hex << page_table_phys << std::dec << std::endl;
+            VM_LOG(TRACE) << "  [PGT] Using existing page table at KERNEL physical 0x" 
+                          << std::hex << page_table_phys << std::dec << '\n';
         }
         
         // Set page table entry (also in kernel memory)
@@ -157,41 +850,162 @@ public:
         uint32_t pte = physical_addr | flags | PTE_PRESENT;
         phys_mem.write_uint32(pte_addr, pte);
         
-        std::cout << "  [PGT] Set PTE at KERNEL physical 0x" << std::hex << pte_addr 
-                  << " = 0x" << pte << std::dec << std::endl;
+        // A remap must not leave a stale translation behind
+        flush_tlb_page(virtual_addr >> PAGE_SHIFT);
+        
+        VM_LOG(TRACE) << "  [PGT] Set PTE at KERNEL physical 0x" << std::hex << pte_addr 
+                      << " = 0x" << pte << std::dec << '\n';
+        VM_EVENT(MAP, virtual_addr, physical_addr);
         
         return true;
     }
     
-    // Translate virtual address to physical address (MMU simulation)
-    uint32_t translate_address(uint32_t virtual_addr) {
+    // Map a 4MB page with one directory entry (PSE). Both addresses must be
+    // 4MB aligned and the slot must be empty: no page table, no 4MB page.
+    bool map_large_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+        uint32_t dir_index = PDX(virtual_addr);
+        if ((virtual_addr | physical_addr) & (LARGE_PAGE_SIZE - 1)) {
+            VM_LOG(ERROR) << "  [PGT] ERROR: 4MB mapping needs 4MB-aligned addresses\n";
+            return false;
+        }
+        uint32_t pde_addr = page_directory_phys + dir_index * 4;
+        uint32_t pde = phys_mem.read_uint32(pde_addr);
+        if (pde & PTE_PRESENT) {
+            VM_LOG(ERROR) << "  [PGT] ERROR: Directory entry " << dir_index << " already has "
+                          << ((pde & PTE_PS) ? "a 4MB page" : "a page table") << '\n';
+            return false;
+        }
+        
+        VM_LOG(INFO) << "\n[PGT] Mapping 4MB page: virtual 0x" << std::hex << virtual_addr 
+                     << " to physical 0x" << physical_addr << std::dec << " (no page table)\n";
+        phys_mem.write_uint32(pde_addr, physical_addr | flags | PTE_PS | PTE_PRESENT);
+        flush_tlb_page(virtual_addr >> PAGE_SHIFT);
+        VM_EVENT(MAP, virtual_addr, physical_addr);
+        return true;
+    }
+    
+    // munmap() of one page: clear its PTE and drop the frame reference. A
+    // page inside a 4MB page splits it first.
+    UnmapResult unmap_page(uint32_t virtual_addr) {
+        uint32_t pde = phys_mem.read_uint32(page_directory_phys + PDX(virtual_addr) * 4);
+        if ((pde & PTE_PRESENT) && (pde & PTE_PS) && split_large_page(PDX(virtual_addr)) == 0) {
+            VM_LOG(ERROR) << "  [PGT] ERROR: No frame to split the 4MB page at 0x" << std::hex 
+                          << virtual_addr << std::dec << '\n';
+            return UnmapResult::NO_MEMORY;
+        }
+        uint32_t pte_addr = pte_address(virtual_addr);
+        uint32_t pte = pte_addr ? phys_mem.read_uint32(pte_addr) : 0;
+        if (!(pte & PTE_PRESENT)) {
+            return UnmapResult::NOT_MAPPED;
+        }
+        phys_mem.write_uint32(pte_addr, 0);
+        phys_mem.put_page(PTE_ADDR(pte));
+        flush_tlb_page(virtual_addr >> PAGE_SHIFT);
+        VM_LOG(INFO) << "  [PGT] Unmapped virtual 0x" << std::hex << virtual_addr << std::dec << '\n';
+        return UnmapResult::UNMAPPED;
+    }
+    
+    // Transparent huge page promotion (like khugepaged's collapse): a page
+    // table whose 1024 PTEs map one 4MB-aligned, physically contiguous run
+    // with identical flags is replaced by a single PTE_PS directory entry
+    // and freed. Returns the number of page tables collapsed.
+    uint32_t promote_large_pages() {
+        uint32_t collapsed = 0;
+        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
+            uint32_t pde_addr = page_directory_phys + i * 4;
+            uint32_t pde = phys_mem.read_uint32(pde_addr);
+            if (!(pde & PTE_PRESENT) || (pde & PTE_PS)) {
+                continue;
+            }
+            PageSpan table = phys_mem.page_span(PTE_ADDR(pde));
+            if (!table.data) {
+                continue;
+            }
+            uint32_t first;
+            std::memcpy(&first, table.data, sizeof(first));
+            uint32_t base = PTE_ADDR(first);
+            bool contiguous = (first & PTE_PRESENT) && (base & (LARGE_PAGE_SIZE - 1)) == 0;
+            for (uint32_t j = 1; contiguous && j < PTE_ENTRIES; j++) {
+                uint32_t pte;
+                std::memcpy(&pte, table.data + j * 4, sizeof(pte));
+                contiguous = (pte == first + j * PAGE_SIZE);
+            }
+            if (!contiguous) {
+                continue;
+            }
+            phys_mem.write_uint32(pde_addr, base | (first & PAGE_MASK) | PTE_PS);
+            phys_mem.put_page(PTE_ADDR(pde));
+            allocated_page_tables.erase(i);
+            collapsed++;
+            VM_LOG(INFO) << "  [PGT] Collapsed page table for VA 0x" << std::hex << (i << 22) 
+                         << " into a 4MB page at 0x" << base << std::dec << '\n';
+        }
+        // The 4KB translations cached for those ranges are now stale
+        if (collapsed > 0) {
+            flush_tlb_mm();
+        }
+        return collapsed;
+    }
+    
+    // Translate virtual address to physical address (MMU simulation).
+    // pte_flags, when given, receives the low 12 bits of the PTE.
+    uint32_t translate_address(uint32_t virtual_addr, uint32_t* pte_flags = nullptr) {
         uint32_t dir_index = PDX(virtual_addr);
         uint32_t table_index = PTX(virtual_addr);
         uint32_t offset = PG_OFFSET(virtual_addr);
         
-        std::cout << "\n[MMU] Translating virtual address 0x" << std::hex << virtual_addr << std::dec << std::endl;
-        std::cout << "      Dir[" << dir_index << "] Table[" << table_index << "] Offset[" << offset << "]" << std::endl;
+        VM_LOG(INFO) << "\n[MMU] Translating virtual address 0x" << std::hex << virtual_addr << std::dec << '\n';
+        VM_LOG(TRACE) << "      Dir[" << dir_index << "] Table[" << table_index << "] Offset[" << offset << "]\n";
+        
+        // Step 0: Check the TLB before walking the tables
+        uint32_t vpn = virtual_addr >> PAGE_SHIFT;
+        if (tlb) {
+            uint32_t pfn, flags;
+            if (tlb->lookup(asid, vpn, pfn, flags)) {
+                uint32_t phys_addr = (pfn << PAGE_SHIFT) + offset;
+                VM_LOG(TRACE) << "  [TLB] Hit: VPN 0x" << std::hex << vpn << " -> PFN 0x" << pfn 
+                              << ", physical address: 0x" << phys_addr << std::dec << '\n';
+                if (pte_flags) *pte_flags = flags;
+                return phys_addr;
+            }
+            VM_LOG(TRACE) << "  [TLB] Miss: walking page tables\n";
+            VM_EVENT(TLB_MISS, vpn, 0);
+        }
         
         // Step 1: Read page directory entry
         uint32_t pde_addr = page_directory_phys + dir_index * 4;
         uint32_t pde = phys_mem.read_uint32(pde_addr);
         
-        std::cout << "  [MMU] PDE at 0x" << std::hex << pde_addr << " = 0x" << pde << std::dec << std::endl;
+        VM_LOG(TRACE) << "  [MMU] PDE at 0x" << std::hex << pde_addr << " = 0x" << pde << std::dec << '\n';
         
         if (!(pde & PTE_PRESENT)) {
-            std::cout << "  [MMU] PAGE FAULT: Page table not present!" << std::endl;
+            VM_LOG(INFO) << "  [MMU] PAGE FAULT: Page table not present!\n";
             return 0xFFFFFFFF; // Invalid address
         }
         
+        // A 4MB page ends the walk at the directory: one read, one TLB entry
+        if (pde & PTE_PS) {
+            uint32_t large_phys = LARGE_PAGE_ADDR(pde);
+            uint32_t phys_addr = large_phys + (virtual_addr & (LARGE_PAGE_SIZE - 1));
+            VM_LOG(TRACE) << "  [MMU] 4MB page at 0x" << std::hex << large_phys 
+                          << ", physical address: 0x" << phys_addr << std::dec << '\n';
+            VM_EVENT(TRANSLATE, virtual_addr, phys_addr);
+            if (tlb) {
+                tlb->insert(asid, vpn & ~(LARGE_PAGE_FRAMES - 1), large_phys >> PAGE_SHIFT, pde & PAGE_MASK);
+            }
+            if (pte_flags) *pte_flags = pde & PAGE_MASK;
+            return phys_addr;
+        }
+        
         // Step 2: Read page table entry
         uint32_t page_table_phys = PTE_ADDR(pde);
         uint32_t pte_addr = page_table_phys + table_index * 4;
         uint32_t pte = phys_mem.read_uint32(pte_addr);
         
-        std::cout << "  [MMU] PTE at 0x" << std::hex << pte_addr << " = 0x" << pte << std::dec << std::endl;
+        VM_LOG(TRACE) << "  [MMU] PTE at 0x" << std::hex << pte_addr << " = 0x" << pte << std::dec << '\n';
         
         if (!(pte & PTE_PRESENT)) {
-            std::cout << "  [MMU] PAGE FAULT: Page not present!" << std::endl;
+            VM_LOG(INFO) << "  [MMU] PAGE FAULT: Page not present!\n";
             return 0xFFFFFFFF; // Invalid address
         }
         
@@ -199,11 +1013,173 @@ public:
         uint32_t page_phys = PTE_ADDR(pte);
         uint32_t phys_addr = page_phys + offset;
         
-        std::cout << "  [MMU] Physical address: 0x" << std::hex << phys_addr << std::dec << std::endl;
+        VM_LOG(TRACE) << "  [MMU] Physical address: 0x" << std::hex << phys_addr << std::dec << '\n';
+        VM_EVENT(TRANSLATE, virtual_addr, phys_addr);
+        
+        if (tlb) {
+            tlb->insert(asid, vpn, page_phys >> PAGE_SHIFT, pte & PAGE_MASK);
+        }
+        if (pte_flags) *pte_flags = pte & PAGE_MASK;
         
         return phys_addr;
     }
     
+    // fork(): give this (empty) address space copies of parent's page tables
+    // that point at the same frames. Writable pages become read-only + PTE_COW
+    // in both, and every shared frame gains a reference. Page tables are
+    // copied, data pages are not. Returns the number of pages shared, or -1
+    // if no frame is left for a page table; what was copied so far stays
+    // mapped, so the caller tears this address space down.
+    int copy_on_write_from(PageTableManager& parent) {
+        uint32_t shared = 0;
+        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
+            uint32_t pde = phys_mem.read_uint32(parent.page_directory_phys + i * 4);
+            if (!(pde & PTE_PRESENT)) {
+                continue;
+            }
+            if (pde & PTE_PS) {
+                // A 4MB page is shared as is; each of its frames gains a reference
+                if (pde & PTE_WRITE) {
+                    pde = (pde & ~PTE_WRITE) | PTE_COW;
+                    phys_mem.write_uint32(parent.page_directory_phys + i * 4, pde);
+                }
+                phys_mem.write_uint32(page_directory_phys + i * 4, pde);
+                for (uint32_t j = 0; j < LARGE_PAGE_FRAMES; j++) {
+                    phys_mem.get_page(LARGE_PAGE_ADDR(pde) + j * PAGE_SIZE);
+                }
+                shared += LARGE_PAGE_FRAMES;
+                continue;
+            }
+            uint32_t table_phys = phys_mem.allocate_page();
+            if (table_phys == 0) {
+                parent.flush_tlb_mm();
+                VM_LOG(ERROR) << "  [PGT] ERROR: No frame for a page table, fork copy stopped\n";
+                return -1;
+            }
+            allocated_page_tables[i] = table_phys;
+            phys_mem.write_uint32(page_directory_phys + i * 4, table_phys | (pde & PAGE_MASK));
+            
+            // Both tables live in whole pages, so walk them in place
+            PageSpan src = phys_mem.page_span(PTE_ADDR(pde));
+            PageSpan dst = phys_mem.page_span(table_phys);
+            for (uint32_t j = 0; src.data && dst.data && j < PTE_ENTRIES; j++) {
+                uint32_t pte;
+                std::memcpy(&pte, src.data + j * 4, sizeof(pte));
+                if (!(pte & PTE_PRESENT)) {
+                    continue;
+                }
+                if (pte & PTE_WRITE) {
+                    pte = (pte & ~PTE_WRITE) | PTE_COW;
+                    std::memcpy(src.data + j * 4, &pte, sizeof(pte));
+                }
+                std::memcpy(dst.data + j * 4, &pte, sizeof(pte));
+                phys_mem.get_page(PTE_ADDR(pte));
+                shared++;
+            }
+        }
+        
+        // The parent's cached translations may still allow writes
+        parent.flush_tlb_mm();
+        VM_LOG(INFO) << "[PGT] Shared " << shared << " pages copy-on-write with page directory 0x" 
+                     << std::hex << parent.page_directory_phys << std::dec << '\n';
+        return shared;
+    }
+    
+    // Write to a read-only page. A PTE_COW page, or any page still shared,
+    // gets a private copy (or, if every other sharer already copied it, is
+    // simply made writable again). Returns the physical address to write to,
+    // 0xFFFFFFFF if no frame is left for the copy or for splitting a 4MB page.
+    uint32_t handle_write_fault(uint32_t virtual_addr, uint32_t phys_addr) {
+        // A shared 4MB page is split first, so only the 4KB page written is copied
+        uint32_t pde = phys_mem.read_uint32(page_directory_phys + PDX(virtual_addr) * 4);
+        if ((pde & PTE_PS) && ((pde & PTE_COW) || phys_mem.page_refcount(PTE_ADDR(phys_addr)) > 1) &&
+            split_large_page(PDX(virtual_addr)) == 0) {
+            // Writing through would land in the 4MB page every sharer still sees
+            VM_LOG(ERROR) << "  [COW] ERROR: No frame to split the shared 4MB page at 0x" << std::hex 
+                          << virtual_addr << std::dec << '\n';
+            return 0xFFFFFFFF;
+        }
+        uint32_t pte_addr = pte_address(virtual_addr);
+        if (pte_addr == 0) {
+            return phys_addr;
+        }
+        uint32_t pte = phys_mem.read_uint32(pte_addr);
+        uint32_t old_page = PTE_ADDR(pte);
+        uint32_t refs = phys_mem.page_refcount(old_page);
+        if (!(pte & PTE_COW) && refs <= 1) {
+            return phys_addr;   // Plain read-only page; the simulator lets the write through
+        }
+        
+        uint32_t flags = pte & PAGE_MASK;
+        if (flags & PTE_COW) {
+            flags = (flags & ~PTE_COW) | PTE_WRITE;
+        }
+        uint32_t new_page = old_page;
+        if (refs > 1) {
+            new_page = phys_mem.allocate_page();
+            if (new_page == 0) {
+                return 0xFFFFFFFF;
+            }
+            PageSpan src = phys_mem.page_span(old_page);
+            PageSpan dst = phys_mem.page_span(new_page);
+            page_ops::copy(dst.data, src.data, PAGE_SIZE);
+            phys_mem.put_page(old_page);
+            cow_copies++;
+            VM_LOG(INFO) << "  [COW] Copied shared page 0x" << std::hex << old_page 
+                         << " to 0x" << new_page << " for virtual 0x" << virtual_addr << std::dec << '\n';
+        } else {
+            cow_reuses++;
+            VM_LOG(INFO) << "  [COW] Last sharer of page 0x" << std::hex << old_page 
+                         << " keeps it, now writable" << std::dec << '\n';
+        }
+        phys_mem.write_uint32(pte_addr, new_page | flags);
+        flush_tlb_page(virtual_addr >> PAGE_SHIFT);
+        VM_EVENT(MAP, virtual_addr, new_page);
+        return new_page + PG_OFFSET(virtual_addr);
+    }
+    
+    uint64_t get_cow_copies() const { return cow_copies; }
+    uint64_t get_cow_reuses() const { return cow_reuses; }
+    
+    // exit(): walk the directory and drop every mapping, then free the page
+    // tables and the directory. Frames still shared copy-on-write with
+    // another process just lose a reference. The address space is unusable
+    // afterwards.
+    TeardownStats teardown() {
+        TeardownStats stats;
+        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
+            uint32_t pde = phys_mem.read_uint32(page_directory_phys + i * 4);
+            if (!(pde & PTE_PRESENT)) {
+                continue;
+            }
+            if (pde & PTE_PS) {
+                for (uint32_t j = 0; j < LARGE_PAGE_FRAMES; j++) {
+                    stats.frames_freed += phys_mem.put_page(LARGE_PAGE_ADDR(pde) + j * PAGE_SIZE);
+                }
+                stats.pages_unmapped += LARGE_PAGE_FRAMES;
+                continue;
+            }
+            // Jump from one present PTE to the next, so sparse tables cost a scan
+            const uint32_t* table = reinterpret_cast<const uint32_t*>(phys_mem.page_span(PTE_ADDR(pde)).data);
+            for (size_t j = 0; table && j < PTE_ENTRIES; j++) {
+                j += page_ops::pte_find(table + j, PTE_ENTRIES - j, PTE_PRESENT, PTE_PRESENT);
+                if (j < PTE_ENTRIES) {
+                    stats.frames_freed += phys_mem.put_page(PTE_ADDR(table[j]));
+                    stats.pages_unmapped++;
+                }
+            }
+            stats.tables_freed += phys_mem.put_page(PTE_ADDR(pde));
+        }
+        stats.tables_freed += phys_mem.put_page(page_directory_phys);
+        allocated_page_tables.clear();
+        flush_tlb_mm();
+        VM_LOG(INFO) << "[PGT] Tore down page directory 0x" << std::hex << page_directory_phys << std::dec 
+                     << ": " << stats.pages_unmapped << " pages unmapped, " << stats.frames_freed 
+                     << " frames and " << stats.tables_freed << " page tables freed\n";
+        page_directory_phys = 0;
+        return stats;
+    }
+    
     void print_page_directory_array() {
         std::cout << "\n=== Page Directory Array Structure ===" << std::endl;
         std::cout << "Page Directory at KERNEL physical 0x" << std::hex << page_directory_phys << std::dec << std::endl;
@@ -211,11 +1187,18 @@ public:
         std::cout << "Each entry covers 4MB of virtual address space" << std::endl;
         
         std::cout << "\nArray contents (showing non-zero entries only):" << std::endl;
+        uint32_t large_pages = 0;
         for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
             uint32_t pde_addr = page_directory_phys + i * 4;
             uint32_t pde = phys_mem.read_uint32(pde_addr);
             
-            if (pde != 0) {
+            if (pde & PTE_PS) {
+                std::cout << "  Array[" << std::setw(3) << i << "] = 0x" << std::hex << pde;
+                std::cout << " → 4MB page at 0x" << LARGE_PAGE_ADDR(pde);
+                std::cout << " (covers VA 0x" << (i << 22) << "-0x" << ((i + 1) << 22) - 1 << std::dec << ")" << std::endl;
+                std::cout << "    Mapped by the directory entry itself: no page table, one TLB entry" << std::endl;
+                large_pages++;
+            } else if (pde != 0) {
                 uint32_t va_start = i << 22;                // Start of 4MB region
                 uint32_t va_end = ((i + 1) << 22) - 1;      // End of 4MB region
                 uint32_t page_table_phys = pde & 0xFFFFF000; // Extract page table address
@@ -225,14 +1208,10 @@ public:
                 std::cout << " (covers VA 0x" << std::hex << va_start << "-0x" << va_end << std::dec << ")" << std::endl;
                 
                 // Show how much of this 4MB region is actually used
-                uint32_t used_pages = 0;
-                for (uint32_t j = 0; j < PTE_ENTRIES; j++) {
-                    uint32_t pte_addr = page_table_phys + j * 4;
-                    uint32_t pte = phys_mem.read_uint32(pte_addr);
-                    if (pte & PTE_PRESENT) {
-                        used_pages++;
-                    }
-                }
+                // (one page lookup for the whole table, then a vector scan in place)
+                PageSpan table = phys_mem.page_span(page_table_phys);
+                size_t used_pages = table.data ? page_ops::pte_count(reinterpret_cast<const uint32_t*>(table.data),
+                                                                     PTE_ENTRIES, PTE_PRESENT, PTE_PRESENT) : 0;
                 std::cout << "    This 4MB region uses " << used_pages << "/1024 pages (";
                 std::cout << std::fixed << std::setprecision(1) 
                           << (used_pages * 100.0 / 1024) << "% utilized)" << std::endl;
@@ -240,68 +1219,455 @@ public:
         }
         
         std::cout << "\nUnused entries (empty slots in array): ";
-        int unused_count = 0;
-        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
-            uint32_t pde_addr = page_directory_phys + i * 4;
-            uint32_t pde = phys_mem.read_uint32(pde_addr);
-            if (pde == 0) unused_count++;
-        }
+        const uint32_t* directory = reinterpret_cast<const uint32_t*>(phys_mem.page_span(page_directory_phys).data);
+        size_t unused_count = directory ? page_ops::pte_count(directory, PDE_ENTRIES, ~0u, 0) : PDE_ENTRIES;
         std::cout << unused_count << "/1024 entries" << std::endl;
         std::cout << "Unused virtual space: " << unused_count << " × 4MB = " 
                   << (unused_count * 4) << "MB" << std::endl;
+        
+        if (large_pages > 0) {
+            std::cout << "\n4MB pages: " << large_pages << " (" << large_pages * 4 << "MB mapped without page tables: saves " 
+                      << large_pages * 4 << "KB of page tables and " << large_pages * PTE_ENTRIES << " PTEs)" << std::endl;
+            if (tlb) {
+                uint32_t entries = tlb->get_config().entries;
+                std::cout << "TLB reach (" << entries << " entries): " << entries * 4 << "KB with 4KB pages, " 
+                          << entries * 4 << "MB with 4MB pages" << std::endl;
+            }
+        }
     }
 };
 
-// Simulation of multiple processes with separate page tables
+// Context switch and shootdown costs (ProcessManager)
+struct SwitchStats {
+    uint64_t full_flushes = 0;      // Switches that flushed the whole TLB (untagged, or after a rollover)
+    uint64_t asid_hits = 0;         // Switches that kept the TLB: the ASID was still valid
+    uint64_t asid_allocations = 0;  // ASIDs handed out from the bounded pool
+    uint64_t asid_rollovers = 0;    // Pool ran out: new generation, every CPU flushes once
+    uint64_t lazy_flushes = 0;      // Per-ASID flushes done at switch-in instead of by IPI
+    uint64_t shootdown_ipis = 0;    // Invalidation batches sent to CPUs running the address space
+    uint64_t shootdown_pages = 0;   // Pages those batches invalidated
+    uint64_t shootdown_full = 0;    // Batches over the ceiling that flushed the ASID instead
+};
+
+// Simulation of multiple processes with separate page tables, on one or
+// more CPUs with a TLB each.
+//
+// With TLBConfig::asid_count set, ASIDs come from a bounded pool (PCID has
+// 4096) like arm64's allocator: an address space keeps its ASID for the
+// current generation; when the pool runs out the generation advances,
+// address spaces running right now keep theirs and every CPU flushes its
+// TLB once at its next switch.
+//
+// A mapping change is flushed on the CPU making it. Other CPUs only need
+// telling if they may cache the address space: the ones running it get an
+// IPI, batched until flush_shootdowns() (one per CPU per batch), and the
+// ones that ran it before are lazy, flushing its ASID when they next
+// switch to it.
 class ProcessManager {
 private:
+    static const size_t SHOOTDOWN_CEILING = 33;     // Bigger batches flush the ASID (x86's ceiling)
+    
+    struct CPUState {
+        TLB tlb;
+        int current_pid;
+        bool flush_pending;     // Rollover happened: flush all at the next switch
+        
+        explicit CPUState(const TLBConfig& config) : tlb(config), current_pid(-1), flush_pending(false) {}
+    };
+    
+    // Per address space: its ASID and which CPUs may cache its translations
+    struct MMContext {
+        uint32_t asid = 0;
+        uint64_t generation = 0;        // The ASID is valid while this matches asid_generation
+        uint64_t cpu_mask = 0;          // CPUs whose TLB may hold its entries (mm_cpumask)
+        uint64_t stale_mask = 0;        // CPUs to flush its ASID on when they switch to it
+        uint32_t last_cpu = 0;          // CPU the page table manager's TLB belongs to
+        std::vector<uint32_t> pending;  // Invalidations for CPUs running it
+        bool pending_all = false;
+    };
+    
     PhysicalMemory& phys_mem;
     std::map<int, std::unique_ptr<PageTableManager>> processes;  // PID -> PageTableManager
-    int current_pid;
+    std::map<int, MMContext> contexts;
+    std::vector<CPUState> cpus;     // Never resized: page table managers point at the TLBs
+    uint32_t active_cpu;            // CPU of the last switch, where get_current_process() runs
+    uint64_t asid_generation;
+    std::vector<uint8_t> asid_used; // This generation's ASIDs (0 is reserved)
+    uint32_t next_asid;
+    std::vector<int> shootdown_queue;   // PIDs with pending invalidations
+    SwitchStats switch_stats;
+    uint64_t context_switches;
+    uint64_t exits;
+    uint64_t reclaimed_bytes;       // Frames and page tables freed by exits
+    
+    const TLBConfig& tlb_config() const { return cpus[0].tlb.get_config(); }
+    
+    void add_process(int pid) {
+        processes[pid] = std::make_unique<PageTableManager>(phys_mem);
+        contexts[pid] = MMContext();
+        // A bounded pool assigns the ASID at the first switch
+        processes[pid]->attach_tlb(tlb_config().asid_count ? nullptr : &cpus[0].tlb, pid);
+        processes[pid]->set_shootdown([this, pid](uint32_t vpn) { queue_shootdown(pid, vpn); });
+    }
+    
+    // Next unused ASID of this generation, 0 if the pool is exhausted
+    uint32_t take_asid() {
+        while (next_asid < asid_used.size() && asid_used[next_asid]) {
+            next_asid++;
+        }
+        if (next_asid == asid_used.size()) {
+            return 0;
+        }
+        asid_used[next_asid] = 1;
+        switch_stats.asid_allocations++;
+        return next_asid++;
+    }
+    
+    void rollover_asids() {
+        asid_generation++;
+        switch_stats.asid_rollovers++;
+        std::fill(asid_used.begin(), asid_used.end(), 0);
+        asid_used[0] = 1;
+        next_asid = 1;
+        for (CPUState& cpu : cpus) {
+            cpu.flush_pending = true;
+            // Still running: keeps its ASID, and no other address space may get it
+            if (cpu.current_pid != -1) {
+                MMContext& mm = contexts[cpu.current_pid];
+                mm.generation = asid_generation;
+                asid_used[mm.asid] = 1;
+            }
+        }
+        VM_LOG(INFO) << "[PROC_MGR] ASID pool exhausted: generation " << asid_generation 
+                     << ", every TLB flushes at its next switch\n";
+    }
+    
+    // The ASID pid runs under; fresh is set if it had none this generation.
+    // Without a bounded pool the PID is the tag.
+    uint32_t assign_asid(int pid, MMContext& mm, bool& fresh) {
+        fresh = false;
+        if (tlb_config().asid_count == 0) {
+            mm.asid = pid;
+            return mm.asid;
+        }
+        if (mm.generation == asid_generation) {
+            return mm.asid;
+        }
+        uint32_t asid = take_asid();
+        if (asid == 0) {
+            rollover_asids();
+            if (mm.generation == asid_generation) {
+                return mm.asid;     // Running on another CPU, so it was kept
+            }
+            asid = take_asid();
+        }
+        mm.asid = asid;
+        mm.generation = asid_generation;
+        fresh = true;
+        return asid;
+    }
+    
+    // The whole TLB of cpu is gone: nothing needs shooting down there any more
+    void forget_cpu(uint32_t cpu) {
+        for (auto& entry : contexts) {
+            entry.second.cpu_mask &= ~(1ull << cpu);
+            entry.second.stale_mask &= ~(1ull << cpu);
+        }
+    }
+    
+    void queue_shootdown(int pid, uint32_t vpn) {
+        MMContext& mm = contexts[pid];
+        bool running_elsewhere = false;
+        for (uint32_t c = 0; c < cpus.size(); c++) {
+            uint64_t bit = 1ull << c;
+            if (c == mm.last_cpu || !(mm.cpu_mask & bit)) {
+                continue;
+            }
+            if (cpus[c].current_pid == pid) {
+                running_elsewhere = true;
+            } else {
+                // Lazy: no IPI, it flushes the ASID if it ever switches back
+                mm.cpu_mask &= ~bit;
+                mm.stale_mask |= bit;
+            }
+        }
+        if (!running_elsewhere) {
+            return;
+        }
+        if (mm.pending.empty() && !mm.pending_all) {
+            shootdown_queue.push_back(pid);
+        }
+        if (vpn == PageTableManager::FLUSH_ALL_PAGES || mm.pending.size() >= SHOOTDOWN_CEILING) {
+            mm.pending_all = true;
+        } else {
+            mm.pending.push_back(vpn);
+        }
+    }
     
 public:
-    ProcessManager(PhysicalMemory& pm) : phys_mem(pm), current_pid(-1) {}
+    ProcessManager(PhysicalMemory& pm, const TLBConfig& tlb_config = TLBConfig(), uint32_t num_cpus = 1) 
+        : phys_mem(pm), active_cpu(0), asid_generation(1), next_asid(1), context_switches(0), 
+          exits(0), reclaimed_bytes(0) {
+        assert(num_cpus >= 1 && num_cpus <= 64);
+        cpus.reserve(num_cpus);
+        for (uint32_t i = 0; i < num_cpus; i++) {
+            cpus.emplace_back(tlb_config);
+        }
+        if (tlb_config.asid_count) {
+            // A rollover keeps one ASID per CPU, and the switching CPU needs one more
+            assert(tlb_config.asid_tagged && tlb_config.asid_count >= num_cpus + 2);
+            asid_used.assign(tlb_config.asid_count, 0);
+            asid_used[0] = 1;
+        }
+    }
     
     // Create a new process (like fork())
     int create_process(int pid) {
-        std::cout << "\n[PROC_MGR] Creating process " << pid << " (like fork())" << std::endl;
-        processes[pid] = std::make_unique<PageTableManager>(phys_mem);
-        std::cout << "[PROC_MGR] Process " << pid << " has its own page directory at 0x" 
-                  << std::hex << processes[pid]->get_page_directory() << std::dec << std::endl;
+        VM_LOG(INFO) << "\n[PROC_MGR] Creating process " << pid << " (like fork())\n";
+        add_process(pid);
+        VM_LOG(INFO) << "[PROC_MGR] Process " << pid << " has its own page directory at 0x" 
+                     << std::hex << processes[pid]->get_page_directory() << std::dec << '\n';
         return pid;
     }
     
-    // Context switch to different process
-    void switch_to_process(int pid) {
+    // Context switch cpu to a different process
+    void switch_to_process(int pid, uint32_t cpu = 0) {
         if (processes.find(pid) == processes.end()) {
-            std::cout << "[PROC_MGR] ERROR: Process " << pid << " doesn't exist!" << std::endl;
+            VM_LOG(ERROR) << "[PROC_MGR] ERROR: Process " << pid << " doesn't exist!\n";
             return;
         }
+        assert(cpu < cpus.size());
+        CPUState& state = cpus[cpu];
+        active_cpu = cpu;
+        if (pid == state.current_pid) {
+            // Already running here (another thread may run it elsewhere): work now happens on this CPU
+            MMContext& mm = contexts[pid];
+            if (mm.last_cpu != cpu) {
+                mm.last_cpu = cpu;
+                processes[pid]->attach_tlb(&state.tlb, mm.asid);
+            }
+            return;
+        }
+        flush_shootdowns();     // Batches go out before any CPU changes what it runs
         
-        std::cout << "\n[PROC_MGR] *** CONTEXT SWITCH *** from PID " << current_pid 
-                  << " to PID " << pid << std::endl;
+        int current_pid = state.current_pid;
+        VM_LOG(INFO) << "\n[PROC_MGR] *** CONTEXT SWITCH *** from PID " << current_pid 
+                     << " to PID " << pid;
+        if (cpus.size() > 1) {
+            VM_LOG(INFO) << " on CPU " << cpu;
+        }
+        VM_LOG(INFO) << '\n';
+        VM_EVENT(CONTEXT_SWITCH, current_pid, pid);
         
         if (current_pid != -1) {
-            std::cout << "[PROC_MGR] Saving CR3 = 0x" << std::hex 
-                      << processes[current_pid]->get_page_directory() << std::dec << std::endl;
+            VM_LOG(INFO) << "[PROC_MGR] Saving CR3 = 0x" << std::hex 
+                         << processes[current_pid]->get_page_directory() << std::dec << '\n';
         }
         
-        current_pid = pid;
+        // Before current_pid changes: a rollover must not reserve the incoming ASID
+        MMContext& mm = contexts[pid];
+        bool fresh;
+        uint32_t asid = assign_asid(pid, mm, fresh);
+        state.current_pid = pid;
+        context_switches++;
         uint32_t new_pgd = processes[pid]->get_page_directory();
         
-        std::cout << "[PROC_MGR] Loading CR3 = 0x" << std::hex << new_pgd << std::dec 
-                  << " (switch to process " << pid << "'s page tables)" << std::endl;
-        std::cout << "[PROC_MGR] MMU now uses process " << pid << "'s virtual address mappings" << std::endl;
+        VM_LOG(INFO) << "[PROC_MGR] Loading CR3 = 0x" << std::hex << new_pgd << std::dec 
+                     << " (switch to process " << pid << "'s page tables)\n";
+        
+        // Without ASID tags a CR3 reload invalidates every cached translation
+        if (!tlb_config().asid_tagged || state.flush_pending) {
+            state.tlb.flush_all();
+            forget_cpu(cpu);
+            state.flush_pending = false;
+            switch_stats.full_flushes++;
+            VM_LOG(INFO) << "[PROC_MGR] TLB flushed\n";
+        } else {
+            if (mm.stale_mask & (1ull << cpu)) {
+                state.tlb.flush_asid(asid);
+                mm.stale_mask &= ~(1ull << cpu);
+                switch_stats.lazy_flushes++;
+            }
+            if (!fresh) {
+                switch_stats.asid_hits++;
+            }
+            VM_LOG(INFO) << "[PROC_MGR] TLB kept (entries are tagged with ASID " << asid << ")\n";
+        }
+        mm.cpu_mask |= 1ull << cpu;
+        mm.last_cpu = cpu;
+        processes[pid]->attach_tlb(&state.tlb, asid);
+        VM_LOG(INFO) << "[PROC_MGR] MMU now uses process " << pid << "'s virtual address mappings\n";
+    }
+    
+    // Send the queued invalidations, one IPI per CPU running a changed
+    // address space (like the flush at the end of munmap or reclaim)
+    void flush_shootdowns() {
+        for (int pid : shootdown_queue) {
+            auto it = contexts.find(pid);
+            if (it == contexts.end()) {
+                continue;
+            }
+            MMContext& mm = it->second;
+            for (uint32_t c = 0; c < cpus.size(); c++) {
+                if (c == mm.last_cpu || !(mm.cpu_mask & (1ull << c)) || cpus[c].current_pid != pid) {
+                    continue;
+                }
+                switch_stats.shootdown_ipis++;
+                if (mm.pending_all) {
+                    cpus[c].tlb.flush_asid(mm.asid);
+                    switch_stats.shootdown_full++;
+                } else {
+                    for (uint32_t vpn : mm.pending) {
+                        cpus[c].tlb.invalidate(mm.asid, vpn);
+                    }
+                    switch_stats.shootdown_pages += mm.pending.size();
+                }
+            }
+            VM_LOG(TRACE) << "[PROC_MGR] Shootdown for process " << pid << ": " 
+                          << (mm.pending_all ? std::string("whole ASID") : std::to_string(mm.pending.size()) + " pages") << '\n';
+            mm.pending.clear();
+            mm.pending_all = false;
+        }
+        shootdown_queue.clear();
+    }
+    
+    // fork() the parent: the child shares every frame copy-on-write, so only
+    // its page directory and page tables are new. Returns the child PID, -1
+    // if the parent doesn't exist or there's no memory for the child's page
+    // tables (the partial child is torn down again).
+    int fork(int parent_pid) {
+        auto parent = processes.find(parent_pid);
+        if (parent == processes.end()) {
+            VM_LOG(ERROR) << "[PROC_MGR] ERROR: Process " << parent_pid << " doesn't exist!\n";
+            return -1;
+        }
+        int child_pid = processes.rbegin()->first + 1;
+        VM_LOG(INFO) << "\n[PROC_MGR] Forking process " << parent_pid << " into " << child_pid << '\n';
+        add_process(child_pid);
+        PageTableManager& child = *processes[child_pid];
+        if (child.get_page_directory() == 0 || child.copy_on_write_from(*parent->second) < 0) {
+            if (child.get_page_directory() != 0) {
+                child.teardown();
+            }
+            processes.erase(child_pid);
+            contexts.erase(child_pid);
+            flush_shootdowns();
+            VM_LOG(ERROR) << "[PROC_MGR] ERROR: fork of process " << parent_pid << " failed, out of memory\n";
+            return -1;
+        }
+        flush_shootdowns();
+        return child_pid;
     }
     
+    // exit(): tear down the process's address space and forget it. Returns
+    // the bytes of frames and page tables freed, -1 if it doesn't exist.
+    int64_t exit_process(int pid) {
+        auto it = processes.find(pid);
+        if (it == processes.end()) {
+            VM_LOG(ERROR) << "[PROC_MGR] ERROR: Process " << pid << " doesn't exist!\n";
+            return -1;
+        }
+        VM_LOG(INFO) << "\n[PROC_MGR] Process " << pid << " exits\n";
+        TeardownStats stats = it->second->teardown();
+        processes.erase(it);
+        // A pooled ASID retires until the next rollover, but a PID tag can
+        // come back with the next process, so no CPU may keep its entries
+        MMContext& mm = contexts[pid];
+        for (uint32_t c = 0; c < cpus.size(); c++) {
+            if (tlb_config().asid_count == 0 && ((mm.cpu_mask | mm.stale_mask) >> c & 1) && c != mm.last_cpu) {
+                cpus[c].tlb.flush_asid(mm.asid);
+            }
+            if (cpus[c].current_pid == pid) {
+                cpus[c].current_pid = -1;
+            }
+        }
+        contexts.erase(pid);
+        uint64_t bytes = (uint64_t)(stats.frames_freed + stats.tables_freed) * PAGE_SIZE;
+        exits++;
+        reclaimed_bytes += bytes;
+        VM_LOG(INFO) << "[PROC_MGR] Reclaimed " << bytes / 1024 << " KB from process " << pid << '\n';
+        return bytes;
+    }
+    
+    size_t process_count() const { return processes.size(); }
+    
     PageTableManager* get_current_process() {
+        int current_pid = cpus[active_cpu].current_pid;
         if (current_pid == -1 || processes.find(current_pid) == processes.end()) {
             return nullptr;
         }
         return processes[current_pid].get();
     }
     
-    int get_current_pid() const { return current_pid; }
+    int get_current_pid() const { return cpus[active_cpu].current_pid; }
+    
+    TLB& get_tlb(uint32_t cpu = 0) { return cpus[cpu].tlb; }
+    
+    const SwitchStats& get_switch_stats() const { return switch_stats; }
+    
+    void print_tlb_stats() {
+        std::cout << "\nContext switches: " << context_switches << std::endl;
+        uint64_t flushed_entries = 0;
+        for (uint32_t c = 0; c < cpus.size(); c++) {
+            if (cpus.size() > 1) {
+                std::cout << "\nCPU " << c << ":";
+            }
+            cpus[c].tlb.print_stats();
+            flushed_entries += cpus[c].tlb.get_stats().flushed_entries;
+        }
+        if (context_switches > 0) {
+            std::cout << "Live TLB entries lost per switch: " << std::fixed << std::setprecision(1)
+                      << (flushed_entries * 1.0 / context_switches) << std::endl;
+        }
+    }
+    
+    void print_switch_stats() {
+        const SwitchStats& st = switch_stats;
+        std::cout << "\n=== Context Switch Costs ===" << std::endl;
+        std::cout << "CPUs: " << cpus.size() << ", ASIDs: ";
+        if (!tlb_config().asid_tagged) {
+            std::cout << "none (flush on switch)";
+        } else if (tlb_config().asid_count == 0) {
+            std::cout << "one per PID";
+        } else {
+            std::cout << tlb_config().asid_count - 1 << " in the pool, generation " << asid_generation;
+        }
+        std::cout << std::endl;
+        std::cout << "Switches: " << context_switches << " (" << st.full_flushes << " flushed the TLB, " 
+                  << st.asid_hits << " kept it with a live ASID)" << std::endl;
+        if (tlb_config().asid_count) {
+            std::cout << "ASID allocations: " << st.asid_allocations << ", rollovers: " << st.asid_rollovers << std::endl;
+        }
+        std::cout << "Shootdowns: " << st.shootdown_ipis << " IPIs (" << st.shootdown_pages << " pages, " 
+                  << st.shootdown_full << " whole-ASID), " << st.lazy_flushes << " lazy flushes at switch-in" << std::endl;
+        uint64_t misses = 0, large_fills = 0;
+        for (const CPUState& cpu : cpus) {
+            misses += cpu.tlb.get_stats().misses;
+            large_fills += cpu.tlb.get_stats().large_fills;
+        }
+        std::cout << "Page walk memory reads: " << misses * 2 - large_fills << std::endl;
+    }
+    
+    void print_cow_stats() {
+        uint64_t copies = 0, reuses = 0;
+        for (const auto& entry : processes) {
+            copies += entry.second->get_cow_copies();
+            reuses += entry.second->get_cow_reuses();
+        }
+        std::cout << "\n=== Copy-on-Write Stats ===" << std::endl;
+        std::cout << "Processes: " << processes.size() << std::endl;
+        std::cout << "COW faults: " << copies + reuses << " (" << copies << " copied, " 
+                  << reuses << " reused by the last sharer)" << std::endl;
+        std::cout << "Frames still shared: " << phys_mem.shared_pages() << std::endl;
+    }
+    
+    void print_exit_stats() {
+        std::cout << "\n=== Process Exit Stats ===" << std::endl;
+        std::cout << "Exits: " << exits << ", live processes: " << processes.size() << std::endl;
+        std::cout << "Reclaimed: " << reclaimed_bytes / 1024 << " KB (" << reclaimed_bytes / PAGE_SIZE 
+                  << " pages, frames and page tables)" << std::endl;
+        std::cout << "Physical pages still allocated: " << phys_mem.allocated_pages() << std::endl;
+    }
     
     void print_all_processes() {
         std::cout << "\n=== All Process Memory Spaces ===" << std::endl;
@@ -310,16 +1676,13 @@ public:
                       << std::hex << page_mgr->get_page_directory() << std::dec << "):" << std::endl;
             // Print abbreviated page table info
             uint32_t pgd_addr = page_mgr->get_page_directory();
-            int page_table_count = 0;
-            
-            for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
-                uint32_t pde_addr = pgd_addr + i * 4;
-                uint32_t pde = phys_mem.read_uint32(pde_addr);
-                if (pde & PTE_PRESENT) {
-                    page_table_count++;
-                }
-            }
+            const uint32_t* directory = reinterpret_cast<const uint32_t*>(phys_mem.page_span(pgd_addr).data);
+            size_t page_table_count = directory ? page_ops::pte_count(directory, PDE_ENTRIES, PTE_PRESENT | PTE_PS, PTE_PRESENT) : 0;
+            size_t large_page_count = directory ? page_ops::pte_count(directory, PDE_ENTRIES, PTE_PS, PTE_PS) : 0;
             std::cout << "  Active page tables: " << page_table_count << std::endl;
+            if (large_page_count > 0) {
+                std::cout << "  4MB pages: " << large_page_count << std::endl;
+            }
         }
     }
 };
@@ -339,20 +1702,20 @@ public:
     uint8_t read_virtual(uint32_t virtual_addr) {
         PageTableManager* current = proc_mgr.get_current_process();
         if (!current) {
-            std::cout << "[PROC" << pid << "] ERROR: No current process!" << std::endl;
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: No current process!\n";
             return 0;
         }
         
         uint32_t phys_addr = current->translate_address(virtual_addr);
         if (phys_addr == 0xFFFFFFFF) {
-            std::cout << "[PROC" << pid << "] Segmentation fault at virtual 0x" 
-                      << std::hex << virtual_addr << std::dec << std::endl;
+            VM_LOG(ERROR) << "[PROC" << pid << "] Segmentation fault at virtual 0x" 
+                          << std::hex << virtual_addr << std::dec << '\n';
             return 0;
         }
         
         uint8_t value = phys_mem.read_byte(phys_addr);
-        std::cout << "[PROC" << pid << "] Read 0x" << std::hex << (int)value 
-                  << " from virtual 0x" << virtual_addr << std::dec << std::endl;
+        VM_LOG(INFO) << "[PROC" << pid << "] Read 0x" << std::hex << (int)value 
+                     << " from virtual 0x" << virtual_addr << std::dec << '\n';
         return value;
     }
     
@@ -360,46 +1723,249 @@ public:
     void write_virtual(uint32_t virtual_addr, uint8_t value) {
         PageTableManager* current = proc_mgr.get_current_process();
         if (!current) {
-            std::cout << "[PROC" << pid << "] ERROR: No current process!" << std::endl;
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: No current process!\n";
             return;
         }
         
-        uint32_t phys_addr = current->translate_address(virtual_addr);
+        uint32_t flags = 0;
+        uint32_t phys_addr = current->translate_address(virtual_addr, &flags);
+        // Write fault on a read-only page: break copy-on-write sharing first
+        if (phys_addr != 0xFFFFFFFF && !(flags & PTE_WRITE)) {
+            phys_addr = current->handle_write_fault(virtual_addr, phys_addr);
+            proc_mgr.flush_shootdowns();
+        }
         if (phys_addr == 0xFFFFFFFF) {
-            std::cout << "[PROC" << pid << "] Segmentation fault at virtual 0x" 
-                      << std::hex << virtual_addr << std::dec << std::endl;
+            VM_LOG(ERROR) << "[PROC" << pid << "] Segmentation fault at virtual 0x" 
+                          << std::hex << virtual_addr << std::dec << '\n';
             return;
         }
         
         phys_mem.write_byte(phys_addr, value);
-        std::cout << "[PROC" << pid << "] Wrote 0x" << std::hex << (int)value 
-                  << " to virtual 0x" << virtual_addr << std::dec << std::endl;
+        VM_LOG(INFO) << "[PROC" << pid << "] Wrote 0x" << std::hex << (int)value 
+                     << " to virtual 0x" << virtual_addr << std::dec << '\n';
+    }
+    
+    // Map a 4MB page (PSE) at a 4MB-aligned virtual address
+    void map_large_memory(uint32_t virtual_addr, uint32_t flags) {
+        PageTableManager* current = proc_mgr.get_current_process();
+        if (!current) {
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: No current process!\n";
+            return;
+        }
+        
+        uint32_t large_page = phys_mem.allocate_large_page();
+        if (large_page == 0) {
+            return;
+        }
+        if (!current->map_large_page(virtual_addr, large_page, flags)) {
+            for (uint32_t i = 0; i < LARGE_PAGE_FRAMES; i++) {
+                phys_mem.put_page(large_page + i * PAGE_SIZE);
+            }
+            return;
+        }
+        proc_mgr.flush_shootdowns();
+    }
+    
+    // munmap() pages pages from virtual_addr; the other CPUs running this
+    // process get one shootdown for the whole range
+    void unmap_memory(uint32_t virtual_addr, uint32_t pages) {
+        PageTableManager* current = proc_mgr.get_current_process();
+        if (!current) {
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: No current process!\n";
+            return;
+        }
+        for (uint32_t i = 0; i < pages; i++) {
+            if (current->unmap_page(virtual_addr + i * PAGE_SIZE) == UnmapResult::NO_MEMORY) {
+                VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: munmap stopped, out of memory\n";
+                break;
+            }
+        }
+        proc_mgr.flush_shootdowns();
     }
     
     // Map memory in this process's address space
     void map_memory(uint32_t virtual_addr, uint32_t flags) {
         PageTableManager* current = proc_mgr.get_current_process();
         if (!current) {
-            std::cout << "[PROC" << pid << "] ERROR: No current process!" << std::endl;
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: No current process!\n";
             return;
         }
         
         uint32_t physical_page = phys_mem.allocate_page();
-        current->map_page(virtual_addr, physical_page, flags);
-        std::cout << "[PROC" << pid << "] Mapped virtual 0x" << std::hex << virtual_addr 
-                  << " in its own address space" << std::dec << std::endl;
+        if (physical_page == 0 || !current->map_page(virtual_addr, physical_page, flags)) {
+            if (physical_page != 0) phys_mem.put_page(physical_page);
+            VM_LOG(ERROR) << "[PROC" << pid << "] ERROR: Cannot map virtual 0x" << std::hex << virtual_addr 
+                          << std::dec << ", out of memory\n";
+            return;
+        }
+        proc_mgr.flush_shootdowns();
+        VM_LOG(INFO) << "[PROC" << pid << "] Mapped virtual 0x" << std::hex << virtual_addr 
+                     << " in its own address space" << std::dec << '\n';
     }
 };
 
-int main() {
+// ==================== BENCHMARKS ====================
+// page_table_directory --bench [filter] [--json] [--min-time s], see bench.h
+void register_benchmarks(BenchRunner& runner) {
+    // Translation throughput over a working set of pages: 16 pages stay in
+    // the 64-entry TLB, a 4096-page sweep misses on every access (a two-level
+    // walk each time), and the same sweep inside 4MB pages misses once per 4MB
+    auto translate = [](uint32_t pages, bool large) {
+        return [pages, large](BenchState& state) {
+            PhysicalMemory phys_mem(32 * 1024 * 1024);
+            TLB tlb;
+            PageTableManager page_mgr(phys_mem);
+            page_mgr.attach_tlb(&tlb, 1);
+            for (uint32_t va = 0; va < pages * PAGE_SIZE; va += large ? LARGE_PAGE_SIZE : PAGE_SIZE) {
+                if (large) {
+                    page_mgr.map_large_page(va, phys_mem.allocate_large_page(), PTE_USER | PTE_WRITE);
+                } else {
+                    page_mgr.map_page(va, phys_mem.allocate_page(), PTE_USER | PTE_WRITE);
+                }
+            }
+            
+            uint32_t page = 0;
+            while (state.keep_running()) {
+                page_mgr.translate_address(page * PAGE_SIZE);
+                page = (page + 1 == pages) ? 0 : page + 1;
+            }
+            const TLBStats& stats = tlb.get_stats();
+            state.items_processed = state.iterations();
+            state.counters["tlb_hit_ratio"] = stats.hits * 1.0 / std::max<uint64_t>(1, stats.hits + stats.misses);
+        };
+    };
+    runner.add("translate/tlb_hit", translate(16, false));
+    runner.add("translate/tlb_miss", translate(4096, false));
+    runner.add("translate/tlb_miss_4mb_pages", translate(4096, true));
+    
+    // Switch between two processes and touch each one's working set after
+    // the switch, so the cost includes refilling a flushed TLB. With ASID
+    // tags small working sets survive the switch.
+    auto context_switch = [](uint32_t pages, bool asid_tagged) {
+        return [pages, asid_tagged](BenchState& state) {
+            PhysicalMemory phys_mem(32 * 1024 * 1024);
+            TLBConfig config;
+            config.asid_tagged = asid_tagged;
+            ProcessManager proc_mgr(phys_mem, config);
+            for (int pid = 1; pid <= 2; pid++) {
+                proc_mgr.create_process(pid);
+                proc_mgr.switch_to_process(pid);
+                for (uint32_t i = 0; i < pages; i++) {
+                    proc_mgr.get_current_process()->map_page(i * PAGE_SIZE, phys_mem.allocate_page(), PTE_USER);
+                }
+            }
+            
+            int pid = 1;
+            while (state.keep_running()) {
+                proc_mgr.switch_to_process(pid);
+                PageTableManager* current = proc_mgr.get_current_process();
+                for (uint32_t i = 0; i < pages; i++) {
+                    current->translate_address(i * PAGE_SIZE);
+                }
+                pid = 3 - pid;
+            }
+            state.items_processed = state.iterations();
+            state.counters["pages_touched"] = pages;
+        };
+    };
+    for (uint32_t pages : {8, 32, 128, 512}) {
+        runner.add("context_switch/flush/" + std::to_string(pages), context_switch(pages, false));
+        runner.add("context_switch/asid/" + std::to_string(pages), context_switch(pages, true));
+    }
+    
+    // 12 processes round-robin on one CPU with a bounded ASID pool: 8 ASIDs
+    // roll over constantly and flush, 16 keep every process tagged
+    auto asid_pool = [](uint32_t asids) {
+        return [asids](BenchState& state) {
+            PhysicalMemory phys_mem(4 << 20);
+            TLBConfig config;
+            config.asid_tagged = true;
+            config.asid_count = asids;
+            config.entries = 256;
+            ProcessManager proc_mgr(phys_mem, config);
+            for (int pid = 1; pid <= 12; pid++) {
+                proc_mgr.create_process(pid);
+                proc_mgr.switch_to_process(pid);
+                for (uint32_t i = 0; i < 16; i++) {
+                    proc_mgr.get_current_process()->map_page((pid * 16 + i) * PAGE_SIZE, phys_mem.allocate_page(), PTE_USER);
+                }
+            }
+            // Each process's pages fall in their own TLB sets, so all 12 fit
+            int pid = 1;
+            while (state.keep_running()) {
+                proc_mgr.switch_to_process(pid);
+                PageTableManager* current = proc_mgr.get_current_process();
+                for (uint32_t i = 0; i < 16; i++) {
+                    current->translate_address((pid * 16 + i) * PAGE_SIZE);
+                }
+                pid = pid % 12 + 1;
+            }
+            state.items_processed = state.iterations();
+            state.counters["rollovers"] = proc_mgr.get_switch_stats().asid_rollovers;
+            state.counters["walk_reads_per_switch"] = proc_mgr.get_tlb().get_stats().misses * 2.0 / state.iterations();
+        };
+    };
+    runner.add("context_switch/asid_pool/8", asid_pool(8));
+    runner.add("context_switch/asid_pool/16", asid_pool(16));
+    
+    // Process churn: fork a 64-page parent, write one page, exit. The arena
+    // is 1MB, so it only keeps up because exit hands the frames back.
+    runner.add("process/fork_exit", [](BenchState& state) {
+        PhysicalMemory phys_mem(1 << 20);
+        ProcessManager proc_mgr(phys_mem);
+        proc_mgr.create_process(1);
+        proc_mgr.switch_to_process(1);
+        for (uint32_t i = 0; i < 64; i++) {
+            proc_mgr.get_current_process()->map_page(i * PAGE_SIZE, phys_mem.allocate_page(), PTE_USER | PTE_WRITE);
+        }
+        uint64_t reclaimed = 0;
+        while (state.keep_running()) {
+            int child = proc_mgr.fork(1);
+            PageTableManager* pgt = proc_mgr.get_current_process();
+            proc_mgr.switch_to_process(child);
+            proc_mgr.get_current_process()->handle_write_fault(0, PTE_ADDR(pgt->translate_address(0)));
+            reclaimed += proc_mgr.exit_process(child);
+            proc_mgr.switch_to_process(1);
+        }
+        state.items_processed = state.iterations();
+        state.counters["reclaimed_kb_per_exit"] = reclaimed / 1024.0 / std::max<uint64_t>(1, state.iterations());
+        state.counters["pages_allocated"] = phys_mem.allocated_pages();
+    });
+    
+    // Present-bit scan of one page table (page_ops.h), a third of it mapped:
+    // the per-table count print_page_directory_array() does
+    runner.add("pte/count_present", [](BenchState& state) {
+        uint32_t table[PTE_ENTRIES] = {};
+        for (uint32_t j = 0; j < PTE_ENTRIES; j += 3) {
+            table[j] = (j << PAGE_SHIFT) | PTE_USER | PTE_PRESENT;
+        }
+        size_t present = 0;
+        while (state.keep_running()) {
+            present += page_ops::pte_count(table, PTE_ENTRIES, PTE_PRESENT, PTE_PRESENT);
+        }
+        state.items_processed = state.iterations() * PTE_ENTRIES;
+        state.counters["present"] = present * 1.0 / std::max<uint64_t>(1, state.iterations());
+    });
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && std::string(argv[1]) == "--bench") {
+        BenchRunner runner;
+        register_benchmarks(runner);
+        return runner.main(argc, argv, 2);
+    }
+    
     std::cout << "=== Multi-Level Page Table Simulation ===" << std::endl;
     std::cout << "Page size: " << PAGE_SIZE << " bytes" << std::endl;
     std::cout << "Entries per table: " << PTE_ENTRIES << std::endl;
     
-    // Create physical memory and page table manager
+    // Create physical memory and a first process (its page table manager has the TLB attached)
     PhysicalMemory phys_mem;
-    PageTableManager page_mgr(phys_mem);
-    Process process(page_mgr, phys_mem);
+    ProcessManager proc_mgr(phys_mem);
+    proc_mgr.create_process(1);
+    proc_mgr.switch_to_process(1);
+    PageTableManager& page_mgr = *proc_mgr.get_current_process();
+    MultiProcess process(proc_mgr, phys_mem, 1);
     
     // Allocate some physical pages for our process
     uint32_t code_page = phys_mem.allocate_page();
@@ -423,7 +1989,7 @@ int main() {
     page_mgr.map_page(0xBFFFF000, stack_page, PTE_USER | PTE_WRITE);
     
     // Show how page tables have grown
-    page_mgr.print_page_tables();
+    page_mgr.print_page_directory_array();
     
     std::cout << "\n--- Testing Access to Grown Memory ---" << std::endl;
     process.write_virtual(0x10001000, 0xAA);  // Second heap page
@@ -483,6 +2049,259 @@ int main() {
         std::cout << "[MMAP] Mapped page " << i << " in new region" << std::endl;
     }
     
+    std::cout << "\n=== TLB and Context Switch Simulation ===" << std::endl;
+    
+    // Re-reading the same pages now hits in the TLB
+    process.read_virtual(0x10000000);
+    process.read_virtual(0x10000000);
+    
+    // A second process: every switch reloads CR3 and flushes the TLB
+    proc_mgr.create_process(2);
+    MultiProcess process2(proc_mgr, phys_mem, 2);
+    proc_mgr.switch_to_process(2);
+    process2.map_memory(0x10000000, PTE_USER | PTE_WRITE);
+    process2.write_virtual(0x10000000, 0xEE);
+    
+    proc_mgr.switch_to_process(1);
+    process.read_virtual(0x10000000);   // Miss again: the flush threw it away
+    proc_mgr.print_tlb_stats();
+    
+    // Same workload with ASID-tagged entries survives the switches
+    std::cout << "\n--- Same Workload with ASID-tagged TLB ---" << std::endl;
+    TLBConfig tagged_config;
+    tagged_config.asid_tagged = true;
+    ProcessManager tagged_mgr(phys_mem, tagged_config);
+    tagged_mgr.create_process(1);
+    tagged_mgr.create_process(2);
+    MultiProcess tagged1(tagged_mgr, phys_mem, 1);
+    MultiProcess tagged2(tagged_mgr, phys_mem, 2);
+    tagged_mgr.switch_to_process(1);
+    tagged1.map_memory(0x10000000, PTE_USER | PTE_WRITE);
+    tagged1.write_virtual(0x10000000, 0x11);
+    tagged_mgr.switch_to_process(2);
+    tagged2.map_memory(0x10000000, PTE_USER | PTE_WRITE);
+    tagged2.write_virtual(0x10000000, 0x22);
+    tagged_mgr.switch_to_process(1);
+    tagged1.read_virtual(0x10000000);   // Hit: entry tagged with ASID 1 was kept
+    tagged_mgr.print_tlb_stats();
+    
+    // A busy host: 12 processes time-sliced over 4 CPUs, 3 per CPU with a
+    // migration every 10 slices, each touching 16 pages twice per slice. A 64-entry
+    // TLB holds three working sets, so tags pay off if the ASIDs last.
+    std::cout << "\n=== PCID Pool and TLB Shootdown ===" << std::endl;
+    auto multiplex = [](const char* label, bool tagged, uint32_t asid_count) {
+        PhysicalMemory host_mem(4 << 20);
+        TLBConfig config;
+        config.asid_tagged = tagged;
+        config.asid_count = asid_count;
+        ProcessManager host(host_mem, config, 4);
+        std::cout.setstate(std::ios::failbit);
+        for (int pid = 1; pid <= 12; pid++) {
+            host.create_process(pid);
+            host.switch_to_process(pid);
+            for (uint32_t i = 0; i < 16; i++) {
+                host.get_current_process()->map_page(0x10000000 + i * PAGE_SIZE, host_mem.allocate_page(), PTE_USER | PTE_WRITE);
+            }
+        }
+        for (int slice = 0; slice < 300; slice++) {
+            for (uint32_t cpu = 0; cpu < 4; cpu++) {
+                host.switch_to_process(1 + ((cpu + slice / 10) % 4) * 3 + slice % 3, cpu);
+                PageTableManager* current = host.get_current_process();
+                for (uint32_t i = 0; i < 32; i++) {
+                    current->translate_address(0x10000000 + i % 16 * PAGE_SIZE);
+                }
+            }
+        }
+        std::cout.clear();
+        uint64_t hits = 0, misses = 0;
+        for (uint32_t cpu = 0; cpu < 4; cpu++) {
+            hits += host.get_tlb(cpu).get_stats().hits;
+            misses += host.get_tlb(cpu).get_stats().misses;
+        }
+        const SwitchStats& st = host.get_switch_stats();
+        std::cout << std::left << std::setw(22) << label << std::right << std::fixed << std::setprecision(1) 
+                  << (hits * 100.0 / (hits + misses)) << "% TLB hits, " << misses * 2 << " walk reads, " 
+                  << st.full_flushes << " full flushes, " << st.asid_rollovers << " rollovers" << std::endl;
+    };
+    multiplex("Flush on switch:", false, 0);
+    multiplex("8 ASIDs (7 usable):", true, 8);
+    multiplex("16 ASIDs (15 usable):", true, 16);
+    multiplex("4096 PCIDs:", true, 4096);
+    
+    // Threads of one process on CPUs 0-2; CPU 3 ran it earlier and has moved
+    // on. munmap on CPU 0 sends one batched IPI each to CPUs 1 and 2, and
+    // CPU 3 flushes lazily if it ever switches back.
+    PhysicalMemory smp_mem(1 << 20);
+    TLBConfig pcid_config;
+    pcid_config.asid_tagged = true;
+    pcid_config.asid_count = 4096;
+    ProcessManager smp(smp_mem, pcid_config, 4);
+    MultiProcess threads(smp, smp_mem, 1);
+    std::cout.setstate(std::ios::failbit);
+    smp.create_process(1);
+    smp.create_process(2);
+    smp.switch_to_process(1, 0);
+    for (uint32_t i = 0; i < 16; i++) {
+        threads.map_memory(0x10000000 + i * PAGE_SIZE, PTE_USER | PTE_WRITE);
+    }
+    for (uint32_t cpu = 0; cpu < 4; cpu++) {
+        smp.switch_to_process(1, cpu);
+        for (uint32_t i = 0; i < 16; i++) {
+            threads.read_virtual(0x10000000 + i * PAGE_SIZE);
+        }
+    }
+    smp.switch_to_process(2, 3);
+    smp.switch_to_process(1, 0);
+    threads.unmap_memory(0x10000000, 8);
+    std::cout.clear();
+    std::cout << "\nmunmap of 8 pages on CPU 0, then CPU 1 reads the first one:" << std::endl;
+    smp.switch_to_process(1, 1);
+    threads.read_virtual(0x10000000);      // Shot down: faults instead of using the stale entry
+    smp.switch_to_process(1, 3);            // Lazy flush
+    smp.print_switch_stats();
+    
+    // A pre-forking server: workers share the parent's pages until they write
+    std::cout << "\n=== Copy-on-Write fork() ===" << std::endl;
+    const uint32_t server_pages = 4;
+    PhysicalMemory cow_mem(1 << 20);
+    ProcessManager cow_mgr(cow_mem);
+    cow_mgr.create_process(1);
+    cow_mgr.switch_to_process(1);
+    MultiProcess server(cow_mgr, cow_mem, 1);
+    for (uint32_t i = 0; i < server_pages; i++) {
+        server.map_memory(0x10000000 + i * PAGE_SIZE, PTE_USER | PTE_WRITE);
+        server.write_virtual(0x10000000 + i * PAGE_SIZE, 0x50 + i);
+    }
+    size_t frames_before = cow_mem.allocated_pages();
+    int worker_a = cow_mgr.fork(1);
+    int worker_b = cow_mgr.fork(1);
+    size_t frames_forked = cow_mem.allocated_pages();
+    
+    MultiProcess worker1(cow_mgr, cow_mem, worker_a);
+    MultiProcess worker2(cow_mgr, cow_mem, worker_b);
+    cow_mgr.switch_to_process(worker_a);
+    worker1.read_virtual(0x10000000);           // Shared, no copy
+    worker1.write_virtual(0x10000000, 0xA1);    // First write copies the page
+    worker1.write_virtual(0x10000000, 0xA2);    // Already private
+    cow_mgr.switch_to_process(1);
+    server.write_virtual(0x10000000, 0x5F);     // Still shared with worker 2: copied
+    cow_mgr.switch_to_process(worker_b);
+    worker2.write_virtual(0x10000000, 0xB1);    // Last sharer: made writable in place
+    worker2.read_virtual(0x10001000);           // Untouched page stays shared
+    cow_mgr.switch_to_process(1);
+    server.read_virtual(0x10000000);            // Parent sees only its own write
+    
+    std::cout << "\nFrames before fork: " << frames_before 
+              << ", after 2 forks: " << frames_forked 
+              << " (a full copy would be " << frames_before * 3 << ")"
+              << ", after writes: " << cow_mem.allocated_pages() << std::endl;
+    cow_mgr.print_cow_stats();
+    
+    std::cout << "\n=== 4MB Large Pages (PSE) ===" << std::endl;
+    PhysicalMemory large_mem(16 * 1024 * 1024);
+    ProcessManager large_mgr(large_mem);
+    large_mgr.create_process(1);
+    large_mgr.switch_to_process(1);
+    PageTableManager& large_pgt = *large_mgr.get_current_process();
+    MultiProcess large_proc(large_mgr, large_mem, 1);
+    
+    // One 4MB page mapped directly, and 4MB of contiguous frames mapped 4KB at a time
+    large_proc.map_large_memory(0x40000000, PTE_USER | PTE_WRITE);
+    uint32_t run = large_mem.allocate_large_page();
+    std::cout.setstate(std::ios::failbit);     // 1024 map_page calls
+    for (uint32_t j = 0; j < PTE_ENTRIES; j++) {
+        large_pgt.map_page(0x80000000 + j * PAGE_SIZE, run + j * PAGE_SIZE, PTE_USER | PTE_WRITE);
+    }
+    std::cout.clear();
+    large_proc.write_virtual(0x40001000, 0x4D);
+    large_proc.write_virtual(0x80003000, 0x77);
+    large_pgt.print_page_directory_array();
+    
+    // Collapse the full, contiguous page table into one PS entry
+    uint32_t collapsed = large_pgt.promote_large_pages();
+    std::cout << "\n[THP] Collapsed " << collapsed << " page table(s) into 4MB pages" << std::endl;
+    large_pgt.print_page_directory_array();
+    large_proc.read_virtual(0x80003000);   // Same data through the 4MB entry
+    
+    // Touch every 64KB of both 8MB: one TLB miss per 4MB page
+    large_mgr.get_tlb().reset_stats();
+    std::cout.setstate(std::ios::failbit);
+    for (uint32_t offset = 0; offset < LARGE_PAGE_SIZE; offset += 64 * 1024) {
+        large_proc.read_virtual(0x40000000 + offset);
+        large_proc.read_virtual(0x80000000 + offset);
+    }
+    std::cout.clear();
+    large_mgr.print_tlb_stats();
+    
+    // A child writing to a 4MB page it shares with its parent needs a frame
+    // for the split and one for the copy. With none left the write must
+    // fail rather than land in the page the parent still sees.
+    std::cout << "\n=== Copy-on-Write 4MB Page with No Free Frames ===" << std::endl;
+    PhysicalMemory tight_mem(12 * 1024 * 1024);
+    ProcessManager tight_mgr(tight_mem);
+    tight_mgr.create_process(1);
+    tight_mgr.switch_to_process(1);
+    MultiProcess tight_parent(tight_mgr, tight_mem, 1);
+    tight_parent.map_large_memory(0x40000000, PTE_USER | PTE_WRITE);
+    tight_parent.write_virtual(0x40000000, 0x11);
+    int tight_child = tight_mgr.fork(1);
+    std::vector<uint32_t> hoarded;
+    std::cout.setstate(std::ios::failbit);     // One log line per frame
+    for (uint32_t frame; (frame = tight_mem.allocate_page()) != 0; ) {
+        hoarded.push_back(frame);
+    }
+    std::cout.clear();
+    std::cout << "Pool exhausted: " << tight_mem.allocated_pages() << " frames in use" << std::endl;
+    tight_mgr.switch_to_process(tight_child);
+    MultiProcess tight_worker(tight_mgr, tight_mem, tight_child);
+    tight_worker.write_virtual(0x40000000, 0x22);      // No frame to split: segfault
+    for (int i = 0; i < 2; i++) {
+        tight_mem.put_page(hoarded.back());
+        hoarded.pop_back();
+    }
+    tight_worker.write_virtual(0x40000000, 0x22);      // Split + copy now succeed
+    tight_mgr.switch_to_process(1);
+    uint8_t parent_value = tight_parent.read_virtual(0x40000000);
+    std::cout << "Parent still reads 0x" << std::hex << (int)parent_value << std::dec 
+              << " (child wrote 0x22)" << std::endl;
+    
+    // A shell forking short-lived children: each one copies a page on
+    // write, maps a heap and a stack page, then exits
+    std::cout << "\n=== Process Exit and Frame Reclamation ===" << std::endl;
+    PhysicalMemory churn_mem;
+    ProcessManager churn_mgr(churn_mem);
+    std::cout.setstate(std::ios::failbit);     // Only the first exit is logged
+    churn_mgr.create_process(1);
+    churn_mgr.switch_to_process(1);
+    MultiProcess shell(churn_mgr, churn_mem, 1);
+    for (uint32_t i = 0; i < server_pages; i++) {
+        shell.map_memory(0x08048000 + i * PAGE_SIZE, PTE_USER | PTE_WRITE);
+    }
+    auto run_child = [&](bool log_exit) {
+        int child = churn_mgr.fork(1);
+        churn_mgr.switch_to_process(child);
+        MultiProcess worker(churn_mgr, churn_mem, child);
+        worker.write_virtual(0x08048000, 0xC0);     // COW copy
+        worker.map_memory(0x10000000, PTE_USER | PTE_WRITE);
+        worker.map_memory(0xBFFFF000, PTE_USER | PTE_WRITE);
+        if (log_exit) std::cout.clear();
+        return churn_mgr.exit_process(child);
+    };
+    int64_t first_reclaimed = run_child(true);
+    std::cout << "\nFirst child gave back " << first_reclaimed / 1024 << " KB; parent's " 
+              << server_pages << " pages keep their frames" << std::endl;
+    uint32_t high_water = churn_mem.high_water_address();
+    const int churn_children = 5000;
+    std::cout.setstate(std::ios::failbit);
+    for (int i = 1; i < churn_children; i++) {
+        run_child(false);
+    }
+    std::cout.clear();
+    std::cout << churn_children << " children: highest physical address 0x" << std::hex << high_water 
+              << " after the first, 0x" << churn_mem.high_water_address() << std::dec 
+              << " after all (" << churn_children * first_reclaimed / 1024 << " KB without exit)" << std::endl;
+    churn_mgr.print_exit_stats();
+    
     // Show memory usage statistics
     phys_mem.print_stats();
     
@@ -0,0 +1,287 @@
+#pragma once
+
+// Multi-level radix page table keyed by virtual page number.
+//
+// Uses the same index split as the x86 two-level tables in
+// page_table_directory.cpp: with Levels = 2 and BitsPerLevel = 10 the top
+// index is PDX(va) and the leaf index is PTX(va). More levels add directory
+// levels above, so the two lowest levels keep the PDX/PTX meaning.
+//
+// Leaves store their entries inline in one array (sequential pages are
+// contiguous in memory) plus a presence bitmap, so range operations and
+// iteration walk whole leaf tables and skip empty slots 64 at a time.
+// Entry addresses are stable until the entry is erased.
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+template <typename Entry, unsigned Levels = 2, unsigned BitsPerLevel = 10>
+class RadixPageTable {
+public:
+    static_assert(Levels >= 2 && Levels <= 4, "radix page table supports 2 to 4 levels");
+    static_assert(BitsPerLevel >= 6 && BitsPerLevel <= 16, "6 to 16 index bits per level");
+
+    static const size_t FANOUT = size_t(1) << BitsPerLevel;
+    static const uint64_t INDEX_MASK = FANOUT - 1;
+    static const unsigned VPN_BITS = Levels * BitsPerLevel;
+
+private:
+    static const size_t BITMAP_WORDS = FANOUT / 64;
+
+    struct Leaf {
+        Entry entries[FANOUT];
+        uint64_t present[BITMAP_WORDS];
+        uint32_t used;
+
+        Leaf() : entries(), present(), used(0) {}
+    };
+
+    struct Directory {
+        void* child[FANOUT];    // Directory* above the last directory level, Leaf* below it
+        uint32_t used;
+
+        Directory() : child(), used(0) {}
+    };
+
+    Directory root;
+    size_t entry_count;
+    size_t leaf_count;
+    size_t directory_count;    // Not counting the root
+
+    static size_t index_at(uint64_t vpn, unsigned level) {
+        return (vpn >> (BitsPerLevel * (Levels - 1 - level))) & INDEX_MASK;
+    }
+
+    static bool test_bit(const Leaf* leaf, size_t i) {
+        return (leaf->present[i / 64] >> (i % 64)) & 1;
+    }
+
+    // Walk to the leaf covering vpn, recording the directory path for pruning
+    Leaf* walk(uint64_t vpn, bool create, Directory** path = nullptr, size_t* slots = nullptr) {
+        if (vpn >> VPN_BITS) {
+            return nullptr;
+        }
+        Directory* dir = &root;
+        for (unsigned level = 0; level + 1 < Levels; level++) {
+            size_t i = index_at(vpn, level);
+            if (path) {
+                path[level] = dir;
+                slots[level] = i;
+            }
+            void*& slot = dir->child[i];
+            bool last_directory = (level + 2 == Levels);
+            if (!slot) {
+                if (!create) {
+                    return nullptr;
+                }
+                if (last_directory) {
+                    slot = new Leaf();
+                    leaf_count++;
+                } else {
+                    slot = new Directory();
+                    directory_count++;
+                }
+                dir->used++;
+            }
+            if (last_directory) {
+                return static_cast<Leaf*>(slot);
+            }
+            dir = static_cast<Directory*>(slot);
+        }
+        return nullptr;
+    }
+
+    // Free an empty leaf and any directories left empty above it
+    void prune(Directory** path, size_t* slots) {
+        for (int level = Levels - 2; level >= 0; level--) {
+            Directory* dir = path[level];
+            void*& slot = dir->child[slots[level]];
+            if (level == (int)Levels - 2) {
+                delete static_cast<Leaf*>(slot);
+                leaf_count--;
+            } else {
+                delete static_cast<Directory*>(slot);
+                directory_count--;
+            }
+            slot = nullptr;
+            dir->used--;
+            if (dir->used > 0 || dir == &root) {
+                return;
+            }
+        }
+    }
+
+    void destroy(Directory* dir, unsigned level) {
+        for (size_t i = 0; i < FANOUT; i++) {
+            if (!dir->child[i]) continue;
+            if (level + 2 == Levels) {
+                delete static_cast<Leaf*>(dir->child[i]);
+            } else {
+                destroy(static_cast<Directory*>(dir->child[i]), level + 1);
+                delete static_cast<Directory*>(dir->child[i]);
+            }
+            dir->child[i] = nullptr;
+        }
+        dir->used = 0;
+    }
+
+    template <typename Fn>
+    void visit(Directory* dir, unsigned level, uint64_t prefix, Fn& fn) {
+        for (size_t i = 0; i < FANOUT; i++) {
+            if (!dir->child[i]) continue;
+            uint64_t next_prefix = (prefix << BitsPerLevel) | i;
+            if (level + 2 == Levels) {
+                Leaf* leaf = static_cast<Leaf*>(dir->child[i]);
+                for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                    uint64_t bits = leaf->present[w];
+                    while (bits) {
+                        size_t j = w * 64 + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+                        fn((next_prefix << BitsPerLevel) | j, leaf->entries[j]);
+                    }
+                }
+            } else {
+                visit(static_cast<Directory*>(dir->child[i]), level + 1, next_prefix, fn);
+            }
+        }
+    }
+
+public:
+    RadixPageTable() : entry_count(0), leaf_count(0), directory_count(0) {}
+    ~RadixPageTable() { destroy(&root, 0); }
+
+    RadixPageTable(const RadixPageTable&) = delete;
+    RadixPageTable& operator=(const RadixPageTable&) = delete;
+
+    // Entry for vpn, nullptr if not mapped
+    Entry* find(uint64_t vpn) {
+        Leaf* leaf = walk(vpn, false);
+        size_t i = vpn & INDEX_MASK;
+        if (!leaf || !test_bit(leaf, i)) {
+            return nullptr;
+        }
+        return &leaf->entries[i];
+    }
+
+    // Map vpn to a copy of entry; nullptr if vpn is out of range or already mapped
+    Entry* insert(uint64_t vpn, const Entry& entry) {
+        Entry* result = nullptr;
+        map_range(vpn, 1, [&](uint64_t, Entry& e) { e = entry; result = &e; });
+        return result;
+    }
+
+    bool erase(uint64_t vpn) {
+        return unmap_range(vpn, 1, [](uint64_t, Entry&) {}) == 1;
+    }
+
+    // Map count pages from start, one leaf lookup per leaf table touched.
+    // init(vpn, entry) fills each freshly reset entry. Fails, changing
+    // nothing, if the range exceeds the table's VPN_BITS or any page in it
+    // is already mapped: a replaced entry would orphan whatever it held, so
+    // callers unmap first.
+    template <typename Init>
+    bool map_range(uint64_t start, uint64_t count, Init init) {
+        uint64_t end = start + count;
+        if (count == 0) return true;
+        if (end < start || ((end - 1) >> VPN_BITS)) return false;
+        for (uint64_t vpn = start; vpn < end; ) {
+            Leaf* leaf = walk(vpn, false);
+            uint64_t chunk_end = std::min(end, (vpn | INDEX_MASK) + 1);
+            for (; leaf && leaf->used && vpn < chunk_end; vpn++) {
+                if (test_bit(leaf, vpn & INDEX_MASK)) return false;
+            }
+            vpn = chunk_end;
+        }
+
+        for (uint64_t vpn = start; vpn < end; ) {
+            Leaf* leaf = walk(vpn, true);
+            uint64_t chunk_end = std::min(end, (vpn | INDEX_MASK) + 1);
+            for (; vpn < chunk_end; vpn++) {
+                size_t i = vpn & INDEX_MASK;
+                leaf->present[i / 64] |= uint64_t(1) << (i % 64);
+                leaf->used++;
+                entry_count++;
+                leaf->entries[i] = Entry();
+                init(vpn, leaf->entries[i]);
+            }
+        }
+        return true;
+    }
+
+    // Unmap every present page in [start, start + count). on_remove(vpn, entry)
+    // runs before each entry is dropped. Empty leaf tables are freed. Returns
+    // the number of entries removed.
+    template <typename OnRemove>
+    size_t unmap_range(uint64_t start, uint64_t count, OnRemove on_remove) {
+        uint64_t end = start + count;
+        if (end < start) end = UINT64_MAX;
+        size_t removed = 0;
+        Directory* path[Levels];
+        size_t slots[Levels];
+
+        for (uint64_t vpn = start; vpn < end; ) {
+            uint64_t chunk_end = std::min(end, (vpn | INDEX_MASK) + 1);
+            Leaf* leaf = walk(vpn, false, path, slots);
+            if (!leaf) {
+                if (vpn >> VPN_BITS) break;
+                vpn = chunk_end;
+                continue;
+            }
+            for (; vpn < chunk_end; vpn++) {
+                size_t i = vpn & INDEX_MASK;
+                if (!test_bit(leaf, i)) continue;
+                on_remove(vpn, leaf->entries[i]);
+                leaf->present[i / 64] &= ~(uint64_t(1) << (i % 64));
+                leaf->used--;
+                entry_count--;
+                removed++;
+            }
+            if (leaf->used == 0) {
+                prune(path, slots);
+            }
+        }
+        return removed;
+    }
+
+    // fn(vpn, entry) for every mapped page in [start, start + count), one
+    // leaf lookup per leaf table touched
+    template <typename Fn>
+    void for_each_in(uint64_t start, uint64_t count, Fn fn) {
+        uint64_t end = start + count;
+        if (end < start) end = UINT64_MAX;
+        for (uint64_t vpn = start; vpn < end; ) {
+            uint64_t chunk_end = std::min(end, (vpn | INDEX_MASK) + 1);
+            Leaf* leaf = walk(vpn, false);
+            if (!leaf) {
+                if (vpn >> VPN_BITS) break;
+                vpn = chunk_end;
+                continue;
+            }
+            for (; vpn < chunk_end; vpn++) {
+                size_t i = vpn & INDEX_MASK;
+                if (test_bit(leaf, i)) fn(vpn, leaf->entries[i]);
+            }
+        }
+    }
+
+    // fn(vpn, entry) for every mapped page in increasing VPN order
+    template <typename Fn>
+    void for_each(Fn fn) {
+        visit(&root, 0, 0, fn);
+    }
+
+    void clear() {
+        destroy(&root, 0);
+        entry_count = 0;
+        leaf_count = 0;
+        directory_count = 0;
+    }
+
+    size_t size() const { return entry_count; }
+    size_t leaf_tables() const { return leaf_count; }
+    size_t directories() const { return directory_count + 1; }
+    size_t memory_bytes() const {
+        return sizeof(Directory) * (directory_count + 1) + sizeof(Leaf) * leaf_count;
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+// Readahead and fault-around for file-backed mappings, shared by the simulators.
+//
+// ReadaheadWindow follows Linux ondemand_readahead: a fault at the start of
+// a mapping, right after the previous fault, or inside / right after the
+// current window is sequential. It schedules the next window (initial_pages,
+// then doubling up to max_pages) once the access passes the window's
+// midpoint, the async marker. Any other fault is random and reads one page.
+//
+// Pages read ahead go into a PageCache of clean, unmapped file pages. A
+// later fault on one is minor (no disk I/O), and fault-around maps cached
+// neighbours in an aligned fault_around_bytes block so they never fault.
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+struct ReadaheadConfig {
+    bool enabled = true;
+    uint32_t initial_pages = 4;
+    uint32_t max_pages = 32;                // 128KB, Linux's default read_ahead_kb
+    size_t fault_around_bytes = 64 * 1024;  // 0 disables fault-around
+};
+
+struct ReadaheadStats {
+    uint64_t file_faults = 0;       // All faults on file-backed pages
+    uint64_t major_faults = 0;      // Needed a disk read
+    uint64_t minor_faults = 0;      // Found the page in the page cache
+    uint64_t readahead_ios = 0;     // Batched disk reads issued for readahead
+    uint64_t readahead_pages = 0;
+    uint64_t fault_around_pages = 0;    // Mapped without ever faulting
+    uint64_t cache_dropped = 0;     // Read ahead but reclaimed before use
+};
+
+// Per-mapping sequential stream detector (Linux file_ra_state)
+class ReadaheadWindow {
+private:
+    uint64_t start;     // First page of the current window
+    uint32_t size;      // 0 until a sequential stream is seen
+    uint64_t prev;      // Last faulting page
+
+public:
+    ReadaheadWindow() : start(0), size(0), prev(UINT64_MAX) {}
+
+    // Fault at page; at_start is true for the mapping's first page. Returns
+    // true with [first, first + count) set when a window should be read now.
+    bool on_fault(uint64_t page, bool at_start, const ReadaheadConfig& config,
+                  uint64_t& first, uint32_t& count) {
+        bool in_window = size > 0 && page >= start && page <= start + size;
+        bool follows = (page == prev + 1);
+        prev = page;
+        if (!in_window) {
+            size = 0;   // New stream, or random access: no readahead
+            if (!at_start && !follows) return false;
+        }
+        if (size == 0) {
+            start = page + 1;
+            size = config.initial_pages;
+        } else if (page >= start + size / 2) {
+            uint64_t next = std::max(start + size, page + 1);
+            size = std::min(size * 2, config.max_pages);
+            start = next;
+        } else {
+            return false;   // Current window is still ahead of the reader
+        }
+        first = start;
+        count = size;
+        return true;
+    }
+};
+
+// Clean file pages that were read ahead but are not mapped yet, keyed by
+// disk page. The oldest are dropped first when frames run out.
+class PageCache {
+private:
+    std::list<std::pair<uint32_t, uint32_t>> order;    // (disk page, frame), newest at front
+    std::unordered_map<uint32_t, std::list<std::pair<uint32_t, uint32_t>>::iterator> index;
+
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    bool contains(uint32_t disk_page) const { return index.count(disk_page) != 0; }
+
+    void insert(uint32_t disk_page, uint32_t frame) {
+        order.emplace_front(disk_page, frame);
+        index[disk_page] = order.begin();
+    }
+
+    // Remove and return the frame caching disk_page, or NONE
+    uint32_t take(uint32_t disk_page) {
+        auto it = index.find(disk_page);
+        if (it == index.end()) return NONE;
+        uint32_t frame = it->second->second;
+        order.erase(it->second);
+        index.erase(it);
+        return frame;
+    }
+
+    // Remove the oldest entry; returns its frame or NONE when empty
+    uint32_t pop_oldest() {
+        if (order.empty()) return NONE;
+        uint32_t frame = order.back().second;
+        index.erase(order.back().first);
+        order.pop_back();
+        return frame;
+    }
+
+    size_t size() const { return order.size(); }
+};
@@ -0,0 +1,401 @@
+#pragma once
+
+// Counters and latency histograms for the simulator core, cheap enough to
+// leave on through replays of billions of accesses.
+//
+// ShardedCounter is Linux's percpu counter: one cache line per shard and
+// readers sum the shards. A thread leases a shard of its own the first time
+// it counts (returned when it exits), so adding is a plain load and store
+// with no locked instruction; once METRIC_SHARDS - 1 threads hold one, the
+// rest share the last shard with atomic adds.
+//
+// LatencyHistogram uses HdrHistogram's log-linear buckets: one per value
+// below 32, then 32 per power of two, so any percentile it reports is within
+// 1/32 (3%) of the true one, from 1 ns up to 2^40 ns (18 minutes). Shards
+// are allocated on a thread's first record, 9KB each.
+//
+// snapshot() copies the values out without stopping writers; delta() of two
+// snapshots gives the counts for the time between them. MetricsExporter
+// writes snapshots from its own thread, as JSON lines or in the Prometheus
+// text format (a node_exporter textfile collector can serve the file).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+const size_t METRIC_SHARDS = 16;
+const size_t SHARED_SHARD = METRIC_SHARDS - 1;     // For threads past the first 15
+
+// One thread's claim on a shard, from thread start to exit
+class ShardLease {
+private:
+    static std::atomic<uint32_t>& leased() {
+        static std::atomic<uint32_t> bits(0);
+        return bits;
+    }
+
+public:
+    size_t shard;
+
+    ShardLease() : shard(SHARED_SHARD) {
+        uint32_t bits = leased().load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t free = ~bits & ((1u << SHARED_SHARD) - 1);
+            if (!free) break;
+            size_t s = __builtin_ctz(free);
+            if (leased().compare_exchange_weak(bits, bits | (1u << s), std::memory_order_acquire)) {
+                shard = s;
+                break;
+            }
+        }
+    }
+    // Release: the next owner continues from this thread's last values
+    ~ShardLease() {
+        if (shard != SHARED_SHARD) leased().fetch_and(~(1u << shard), std::memory_order_release);
+    }
+};
+
+// The calling thread's shard
+inline size_t metric_shard() {
+    thread_local ShardLease lease;
+    return lease.shard;
+}
+
+// Add to a cell of shard: owners need no atomic read-modify-write
+inline void shard_add(std::atomic<uint64_t>& cell, size_t shard, uint64_t n) {
+    if (shard == SHARED_SHARD) {
+        cell.fetch_add(n, std::memory_order_relaxed);
+    } else {
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+}
+
+class ShardedCounter {
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> value;
+    };
+    Cell cells[METRIC_SHARDS];
+
+public:
+    ShardedCounter() : cells() {}
+
+    void add(uint64_t n) {
+        size_t shard = metric_shard();
+        shard_add(cells[shard].value, shard, n);
+    }
+    void operator++(int) { add(1); }
+    ShardedCounter& operator+=(uint64_t n) {
+        add(n);
+        return *this;
+    }
+
+    uint64_t load() const {
+        uint64_t total = 0;
+        for (const Cell& cell : cells) total += cell.value.load(std::memory_order_relaxed);
+        return total;
+    }
+    operator uint64_t() const { return load(); }
+};
+
+// Bucket layout shared by LatencyHistogram and its snapshots
+const unsigned LATENCY_SUB_BITS = 5;
+const uint64_t LATENCY_SUB_BUCKETS = uint64_t(1) << LATENCY_SUB_BITS;
+const unsigned LATENCY_MAX_SHIFT = 40;      // Larger values land in the last bucket
+const size_t LATENCY_BUCKETS = (LATENCY_MAX_SHIFT - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+inline size_t latency_bucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) return value;
+    unsigned shift = 63 - __builtin_clzll(value);
+    if (shift >= LATENCY_MAX_SHIFT) return LATENCY_BUCKETS - 1;
+    return (shift - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS +
+           ((value >> (shift - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+// Largest value that lands in bucket
+inline uint64_t latency_bucket_high(size_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    unsigned width_shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t low = (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << width_shift;
+    return low + (uint64_t(1) << width_shift) - 1;
+}
+
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    HistogramSnapshot() : buckets(LATENCY_BUCKETS, 0), count(0), sum(0), max(0) {}
+
+    // Highest value in the bucket holding the pct-th percentile, capped at max
+    uint64_t percentile(double pct) const {
+        if (count == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(pct / 100.0 * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets.size(); b++) {
+            seen += buckets[b];
+            if (seen >= rank) return std::min(latency_bucket_high(b), max);
+        }
+        return max;
+    }
+    double mean() const { return count ? (double)sum / count : 0; }
+
+    // Values recorded since earlier; max becomes the top of the highest
+    // bucket that gained any
+    HistogramSnapshot delta(const HistogramSnapshot& earlier) const {
+        HistogramSnapshot d;
+        d.count = count - earlier.count;
+        d.sum = sum - earlier.sum;
+        for (size_t b = 0; b < buckets.size(); b++) {
+            d.buckets[b] = buckets[b] - earlier.buckets[b];
+            if (d.buckets[b]) d.max = std::min(latency_bucket_high(b), max);
+        }
+        return d;
+    }
+};
+
+class LatencyHistogram {
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+    std::atomic<Shard*> shards[METRIC_SHARDS];
+
+    Shard& local_shard(size_t index) {
+        std::atomic<Shard*>& slot = shards[index];
+        Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            Shard* fresh = new Shard();     // Value-initialized: all zero
+            if (slot.compare_exchange_strong(shard, fresh, std::memory_order_acq_rel)) {
+                shard = fresh;
+            } else {
+                delete fresh;   // Another thread on the shared shard won
+            }
+        }
+        return *shard;
+    }
+
+public:
+    LatencyHistogram() : shards() {}
+    ~LatencyHistogram() {
+        for (auto& slot : shards) delete slot.load(std::memory_order_relaxed);
+    }
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t ns) {
+        size_t index = metric_shard();
+        Shard& shard = local_shard(index);
+        shard_add(shard.buckets[latency_bucket(ns)], index, 1);
+        shard_add(shard.sum, index, ns);
+        uint64_t max = shard.max.load(std::memory_order_relaxed);
+        while (ns > max && !shard.max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        for (const auto& slot : shards) {
+            const Shard* shard = slot.load(std::memory_order_acquire);
+            if (!shard) continue;
+            for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+                uint64_t n = shard->buckets[b].load(std::memory_order_relaxed);
+                s.buckets[b] += n;
+                s.count += n;
+            }
+            s.sum += shard->sum.load(std::memory_order_relaxed);
+            s.max = std::max(s.max, shard->max.load(std::memory_order_relaxed));
+        }
+        return s;
+    }
+};
+
+struct MetricsSnapshot {
+    struct Metric {
+        std::string name;
+        std::string help;
+        uint64_t value;
+    };
+    struct Histogram {
+        std::string name;       // Values are nanoseconds
+        std::string help;
+        HistogramSnapshot data;
+    };
+
+    uint64_t uptime_ns = 0;     // Since the source started, or the interval of a delta
+    std::vector<Metric> counters;
+    std::vector<Metric> gauges;
+    std::vector<Histogram> histograms;
+
+    void add_counter(const std::string& name, const std::string& help, uint64_t value) {
+        counters.push_back({name, help, value});
+    }
+    void add_gauge(const std::string& name, const std::string& help, uint64_t value) {
+        gauges.push_back({name, help, value});
+    }
+    void add_histogram(const std::string& name, const std::string& help, const HistogramSnapshot& data) {
+        histograms.push_back({name, help, data});
+    }
+
+    // 0 if there is no such counter
+    uint64_t counter(const std::string& name) const {
+        for (const Metric& m : counters) {
+            if (m.name == name) return m.value;
+        }
+        return 0;
+    }
+
+    // Counters and histograms since earlier (missing ones count from zero);
+    // gauges keep their current level
+    MetricsSnapshot delta(const MetricsSnapshot& earlier) const {
+        MetricsSnapshot d = *this;
+        d.uptime_ns = uptime_ns - earlier.uptime_ns;
+        for (Metric& m : d.counters) m.value -= earlier.counter(m.name);
+        for (Histogram& h : d.histograms) {
+            for (const Histogram& before : earlier.histograms) {
+                if (before.name == h.name) h.data = h.data.delta(before.data);
+            }
+        }
+        return d;
+    }
+
+    // One line, no trailing newline
+    void write_json(std::ostream& out) const {
+        out << "{\"uptime_ns\":" << uptime_ns << ",\"counters\":{";
+        for (size_t i = 0; i < counters.size(); i++) {
+            out << (i ? "," : "") << '"' << counters[i].name << "\":" << counters[i].value;
+        }
+        out << "},\"gauges\":{";
+        for (size_t i = 0; i < gauges.size(); i++) {
+            out << (i ? "," : "") << '"' << gauges[i].name << "\":" << gauges[i].value;
+        }
+        out << "},\"histograms\":{";
+        for (size_t i = 0; i < histograms.size(); i++) {
+            const HistogramSnapshot& h = histograms[i].data;
+            out << (i ? "," : "") << '"' << histograms[i].name << "_ns\":{\"count\":" << h.count
+                << ",\"sum\":" << h.sum << ",\"mean\":" << (uint64_t)h.mean()
+                << ",\"p50\":" << h.percentile(50) << ",\"p90\":" << h.percentile(90)
+                << ",\"p99\":" << h.percentile(99) << ",\"p999\":" << h.percentile(99.9)
+                << ",\"max\":" << h.max << "}";
+        }
+        out << "}}";
+    }
+
+    // Prometheus text exposition format: vm_<name>_total counters, gauges,
+    // and each histogram as a summary in seconds
+    void write_prometheus(std::ostream& out) const {
+        for (const Metric& m : counters) {
+            out << "# HELP vm_" << m.name << "_total " << m.help << "\n"
+                << "# TYPE vm_" << m.name << "_total counter\n"
+                << "vm_" << m.name << "_total " << m.value << "\n";
+        }
+        for (const Metric& m : gauges) {
+            out << "# HELP vm_" << m.name << " " << m.help << "\n"
+                << "# TYPE vm_" << m.name << " gauge\n"
+                << "vm_" << m.name << " " << m.value << "\n";
+        }
+        std::streamsize precision = out.precision(9);
+        for (const Histogram& h : histograms) {
+            std::string name = "vm_" + h.name + "_seconds";
+            out << "# HELP " << name << " " << h.help << "\n"
+                << "# TYPE " << name << " summary\n";
+            for (double q : {0.5, 0.9, 0.99, 0.999}) {
+                out << name << "{quantile=\"" << q << "\"} " << h.data.percentile(q * 100) / 1e9 << "\n";
+            }
+            out << name << "_sum " << h.data.sum / 1e9 << "\n"
+                << name << "_count " << h.data.count << "\n";
+        }
+        out.precision(precision);
+    }
+};
+
+// Writes source() to path every period and once more when destroyed. A
+// path ending in .prom is rewritten whole each time (written aside, then
+// renamed, so a scraper never sees half a file); any other path gets one
+// JSON line per period holding the delta since the line before. stop()
+// reports whether every write made it to the file.
+class MetricsExporter {
+private:
+    std::function<MetricsSnapshot()> source;
+    std::string path;
+    bool prometheus;
+    std::chrono::milliseconds period;
+    MetricsSnapshot last;           // What the previous JSON line counted up to
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    bool failed;                    // Some dump could not be written
+    std::thread worker;
+
+    // False if the file could not be opened, written or renamed into place
+    bool dump() {
+        MetricsSnapshot now = source();
+        bool ok;
+        if (prometheus) {
+            std::string temp = path + ".tmp";
+            {
+                std::ofstream out(temp, std::ios::trunc);
+                now.write_prometheus(out);
+                out.close();
+                ok = !out.fail();
+            }
+            ok = ok && std::rename(temp.c_str(), path.c_str()) == 0;
+            if (!ok) std::remove(temp.c_str());
+        } else {
+            std::ofstream out(path, std::ios::app);
+            now.delta(last).write_json(out);
+            out << "\n";
+            out.close();
+            ok = !out.fail();
+        }
+        last = now;
+        return ok;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!wake.wait_for(guard, period, [this] { return stopping; })) {
+            if (!dump()) failed = true;
+        }
+        if (!dump()) failed = true;
+    }
+
+    static bool ends_with(const std::string& s, const std::string& suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+public:
+    MetricsExporter(std::function<MetricsSnapshot()> snapshot, const std::string& file,
+                    std::chrono::milliseconds every)
+        : source(std::move(snapshot)), path(file), prometheus(ends_with(file, ".prom")),
+          period(every), stopping(false), failed(false) {
+        if (!prometheus) std::ofstream(path, std::ios::trunc);
+        worker = std::thread(&MetricsExporter::run, this);
+    }
+
+    ~MetricsExporter() { stop(); }
+
+    // Write the last dump and stop the thread. False if any dump failed.
+    bool stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+        return !failed;
+    }
+};
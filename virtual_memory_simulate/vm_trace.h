@@ -0,0 +1,151 @@
+#pragma once
+
+// Leveled logging and a binary event ring shared by all simulators.
+//
+// Logging is selected at compile time, so a benchmarking build pays nothing:
+//   g++ -DVM_LOG_LEVEL=0 ...   no log output at all (statements are discarded)
+//   g++ -DVM_LOG_LEVEL=1 ...   errors only
+//   g++ -DVM_LOG_LEVEL=2 ...   errors and per-operation messages
+//   (default 3)                everything, including page walk details
+//
+// The event ring is off unless built with -DVM_TRACE_RING. When on, every
+// VM_EVENT() stores a fixed-size record in a per-thread circular buffer that
+// can be dumped after a failure to see the last few thousand operations.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#ifndef VM_LOG_LEVEL
+#define VM_LOG_LEVEL 3
+#endif
+
+namespace vm_trace {
+
+enum class LogLevel : int {
+    NONE  = 0,
+    ERROR = 1,  // Failures: out of memory, invalid access, remap
+    INFO  = 2,  // One line per operation: allocations, faults, disk/swap I/O
+    TRACE = 3   // Step-by-step detail: page walks, TLB lookups
+};
+
+constexpr LogLevel kLogLevel = static_cast<LogLevel>(VM_LOG_LEVEL);
+
+template <LogLevel Level>
+constexpr bool enabled() {
+    return static_cast<int>(Level) <= static_cast<int>(kLogLevel);
+}
+
+// Event types stored in the ring (a and b are event specific)
+enum class Event : uint16_t {
+    FRAME_ALLOC,    // a = frame / physical address
+    FRAME_FREE,     // a = frame / physical address
+    PAGE_FAULT,     // a = virtual page
+    EVICT,          // a = virtual page, b = frame
+    DISK_READ,      // a = disk page / file offset, b = bytes
+    DISK_WRITE,     // a = disk page, b = bytes
+    SWAP_READ,      // a = swap slot
+    SWAP_WRITE,     // a = swap slot
+    MAP,            // a = virtual address / page, b = physical address / count
+    UNMAP,          // a = virtual page, b = count
+    TRANSLATE,      // a = virtual address, b = physical address
+    TLB_MISS,       // a = virtual page
+    CONTEXT_SWITCH, // a = old pid, b = new pid
+    COUNT
+};
+
+inline const char* event_name(Event e) {
+    static const char* names[] = {
+        "FRAME_ALLOC", "FRAME_FREE", "PAGE_FAULT", "EVICT", "DISK_READ", "DISK_WRITE",
+        "SWAP_READ", "SWAP_WRITE", "MAP", "UNMAP", "TRANSLATE", "TLB_MISS", "CONTEXT_SWITCH"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Event::COUNT),
+                  "every event needs a name");
+    return static_cast<size_t>(e) < static_cast<size_t>(Event::COUNT) ? names[static_cast<size_t>(e)] : "?";
+}
+
+struct TraceEvent {
+    uint64_t timestamp_ns;  // Monotonic clock
+    uint64_t a;
+    uint64_t b;
+    uint32_t seq;           // Low bits of the event sequence number
+    Event type;
+    uint16_t reserved;
+};
+
+// Fixed-size circular buffer of the most recent events (Capacity must be a power of two)
+template <size_t Capacity = 4096>
+class TraceRing {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+    TraceEvent events[Capacity];
+    uint64_t next;
+
+public:
+    TraceRing() : next(0) {}
+
+    void record(Event type, uint64_t a, uint64_t b) {
+        TraceEvent& e = events[next & (Capacity - 1)];
+        e.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        e.a = a;
+        e.b = b;
+        e.seq = static_cast<uint32_t>(next);
+        e.type = type;
+        e.reserved = 0;
+        next++;
+    }
+
+    size_t size() const { return next < Capacity ? next : Capacity; }
+    uint64_t total() const { return next; }
+
+    // Oldest first; i < size()
+    const TraceEvent& at(size_t i) const {
+        uint64_t first = next - size();
+        return events[(first + i) & (Capacity - 1)];
+    }
+
+    void clear() { next = 0; }
+
+    // Human-readable dump of the last `limit` events
+    void dump(std::ostream& out, size_t limit = Capacity) const {
+        size_t n = size() < limit ? size() : limit;
+        out << "=== Last " << n << " of " << total() << " trace events ===\n";
+        for (size_t i = size() - n; i < size(); i++) {
+            const TraceEvent& e = at(i);
+            out << std::setw(10) << e.seq << " " << std::setw(14) << std::left << event_name(e.type)
+                << std::right << " a=0x" << std::hex << e.a << " b=0x" << e.b << std::dec << "\n";
+        }
+    }
+
+    // Raw records, oldest first, for offline tools
+    bool dump_binary(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) return false;
+        for (size_t i = 0; i < size(); i++) {
+            out.write(reinterpret_cast<const char*>(&at(i)), sizeof(TraceEvent));
+        }
+        return true;
+    }
+};
+
+inline TraceRing<>& ring() {
+    static thread_local TraceRing<> instance;
+    return instance;
+}
+
+} // namespace vm_trace
+
+// VM_LOG(INFO) << "message" << '\n';
+// When the level is compiled out the whole statement is a discarded branch.
+#define VM_LOG(level) \
+    if constexpr (!vm_trace::enabled<vm_trace::LogLevel::level>()) {} else std::cout
+
+#ifdef VM_TRACE_RING
+#define VM_EVENT(type, a, b) vm_trace::ring().record(vm_trace::Event::type, (uint64_t)(a), (uint64_t)(b))
+#else
+#define VM_EVENT(type, a, b) do {} while (0)
+#endif
@@ -0,0 +1,234 @@
+#pragma once
+
+// Virtual memory areas of one address space (Linux vm_area_struct), in page
+// units. The areas sit in a balanced tree keyed by start page, the way
+// Linux kept mm_rb before the maple tree, so find() is one lookup. The free
+// gaps of the placement window have their own index ordered by size, so
+// get_unmapped_area() is an O(log n) best-fit search: the smallest gap that
+// fits, lowest address first. Best fit refills holes that munmap leaves
+// behind before it cuts into the large gap at the top.
+//
+// insert() merges a new area into neighbours it extends (vma_merge): same
+// protection, flags, attributes and file, contiguous file offset. remove()
+// and protect() split the areas they cut through.
+//
+// Attr is whatever else the owner keeps per area (a NUMA policy, say); it
+// is copied on split and must compare equal for areas to merge.
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <sys/mman.h>
+
+template <typename Attr>
+struct Vma {
+    uint64_t start;     // First page
+    uint64_t end;       // One past the last page
+    int prot;           // PROT_READ | PROT_WRITE | PROT_EXEC, or PROT_NONE
+    int flags;          // MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+    int fd;             // -1 if anonymous
+    uint64_t pgoff;     // File page mapped at start
+    Attr attr;
+
+    uint64_t pages() const { return end - start; }
+    bool anonymous() const { return fd < 0; }
+};
+
+template <typename Attr>
+class VmaTree {
+public:
+    using Area = Vma<Attr>;
+    static const uint64_t NONE = UINT64_MAX;
+
+private:
+    std::map<uint64_t, Area> areas;             // By start page
+    std::map<uint64_t, uint64_t> gaps;          // Free [start, end) in the window, by start
+    std::set<std::pair<uint64_t, uint64_t>> gaps_by_size;  // (length, start)
+    uint64_t window_start;
+    uint64_t window_end;
+    uint64_t mapped;                            // Pages in all areas
+
+    void add_gap(uint64_t start, uint64_t end) {
+        start = std::max(start, window_start);
+        end = std::min(end, window_end);
+        if (start >= end) return;
+        // Coalesce with the free gaps on either side
+        auto next = gaps.lower_bound(start);
+        if (next != gaps.begin()) {
+            auto prev = std::prev(next);
+            if (prev->second == start) {
+                start = prev->first;
+                gaps_by_size.erase({prev->second - prev->first, prev->first});
+                gaps.erase(prev);
+            }
+        }
+        if (next != gaps.end() && next->first == end) {
+            end = next->second;
+            gaps_by_size.erase({next->second - next->first, next->first});
+            gaps.erase(next);
+        }
+        gaps[start] = end;
+        gaps_by_size.insert({end - start, start});
+    }
+
+    // [start, end) is free; take its part inside the window out of its gap
+    void take_gap(uint64_t start, uint64_t end) {
+        start = std::max(start, window_start);
+        end = std::min(end, window_end);
+        if (start >= end) return;
+        auto it = std::prev(gaps.upper_bound(start));
+        uint64_t g_start = it->first;
+        uint64_t g_end = it->second;
+        gaps_by_size.erase({g_end - g_start, g_start});
+        gaps.erase(it);
+        if (g_start < start) {
+            gaps[g_start] = start;
+            gaps_by_size.insert({start - g_start, g_start});
+        }
+        if (end < g_end) {
+            gaps[end] = g_end;
+            gaps_by_size.insert({g_end - end, end});
+        }
+    }
+
+    static bool can_merge(const Area& a, const Area& b) {
+        return a.end == b.start && a.prot == b.prot && a.flags == b.flags && a.fd == b.fd &&
+               a.attr == b.attr && (a.anonymous() || a.pgoff + a.pages() == b.pgoff);
+    }
+
+    // Merge the area starting at start with the ones before and after it
+    void merge_around(uint64_t start) {
+        auto it = areas.find(start);
+        if (it == areas.end()) return;
+        if (it != areas.begin()) {
+            auto prev = std::prev(it);
+            if (can_merge(prev->second, it->second)) {
+                prev->second.end = it->second.end;
+                areas.erase(it);
+                it = prev;
+            }
+        }
+        auto next = std::next(it);
+        if (next != areas.end() && can_merge(it->second, next->second)) {
+            it->second.end = next->second.end;
+            areas.erase(next);
+        }
+    }
+
+    // Make page an area boundary if an area spans it
+    void split_at(uint64_t page) {
+        auto it = areas.upper_bound(page);
+        if (it == areas.begin()) return;
+        --it;
+        Area& area = it->second;
+        if (area.start >= page || area.end <= page) return;
+        Area tail = area;
+        tail.start = page;
+        if (!tail.anonymous()) tail.pgoff += page - area.start;
+        area.end = page;
+        areas.emplace(page, tail);
+    }
+
+public:
+    // Pages [start, end) are where get_unmapped_area places areas; fixed
+    // mappings may also go outside it
+    VmaTree(uint64_t start, uint64_t end)
+        : window_start(start), window_end(end), mapped(0) {
+        add_gap(start, end);
+    }
+
+    // The area containing page, nullptr if none
+    const Area* find(uint64_t page) const {
+        auto it = areas.upper_bound(page);
+        if (it == areas.begin()) return nullptr;
+        --it;
+        return page < it->second.end ? &it->second : nullptr;
+    }
+
+    // Linux find_vma: the first area ending after page, nullptr if none
+    const Area* find_vma(uint64_t page) const {
+        auto it = areas.upper_bound(page);
+        if (it != areas.begin() && std::prev(it)->second.end > page) --it;
+        return it == areas.end() ? nullptr : &it->second;
+    }
+
+    bool is_free(uint64_t start, uint64_t pages) const {
+        const Area* next = find_vma(start);
+        return !next || next->start >= start + pages;
+    }
+
+    // Start of the smallest free gap of at least pages, or NONE
+    uint64_t get_unmapped_area(uint64_t pages) const {
+        auto it = gaps_by_size.lower_bound({pages, 0});
+        return it == gaps_by_size.end() ? NONE : it->second;
+    }
+
+    // Add an area over free pages; returns the start of the area it ended up in
+    uint64_t insert(const Area& area) {
+        take_gap(area.start, area.end);
+        areas.emplace(area.start, area);
+        mapped += area.pages();
+        merge_around(area.start);
+        return find(area.start)->start;
+    }
+
+    // Remove [start, end) from every area it overlaps. on_remove(piece)
+    // sees each removed part before it goes. Returns the pages removed.
+    template <typename OnRemove>
+    uint64_t remove(uint64_t start, uint64_t end, OnRemove on_remove) {
+        split_at(start);
+        split_at(end);
+        uint64_t removed = 0;
+        for (auto it = areas.lower_bound(start); it != areas.end() && it->first < end; ) {
+            on_remove(it->second);
+            removed += it->second.pages();
+            add_gap(it->second.start, it->second.end);
+            it = areas.erase(it);
+        }
+        mapped -= removed;
+        return removed;
+    }
+
+    // Change the protection of [start, end). Fails, changing nothing, unless
+    // areas cover the whole range. on_change(area) sees each changed area.
+    template <typename OnChange>
+    bool protect(uint64_t start, uint64_t end, int prot, OnChange on_change) {
+        for (uint64_t page = start; page < end; ) {
+            const Area* area = find(page);
+            if (!area) return false;
+            page = area->end;
+        }
+        split_at(start);
+        split_at(end);
+        for (auto it = areas.lower_bound(start); it != areas.end() && it->first < end; ++it) {
+            it->second.prot = prot;
+            on_change(it->second);
+        }
+        // Merging may erase the area after each one, so go back by start page
+        for (uint64_t page = start; page < end; ) {
+            const Area* area = find(page);
+            uint64_t next = area->end;
+            merge_around(area->start);
+            page = next;
+        }
+        merge_around(end);
+        return true;
+    }
+
+    // fn(area) for every area in address order
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& entry : areas) fn(entry.second);
+    }
+
+    size_t size() const { return areas.size(); }
+    size_t gap_count() const { return gaps.size(); }
+    uint64_t mapped_pages() const { return mapped; }
+    // Largest free gap in the window, in pages
+    uint64_t largest_gap() const {
+        return gaps_by_size.empty() ? 0 : gaps_by_size.rbegin()->first;
+    }
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+// Working-set and reuse-distance profiling of a page reference stream, so
+// one replay answers "how much RAM does this workload need".
+//
+// ReuseDistance computes Mattson LRU stack distances: the number of other
+// distinct pages touched since a page's previous reference. An LRU memory of
+// C frames hits exactly the references with distance < C, so one histogram
+// gives the miss-ratio curve for every RAM size at once. The stack is a
+// Fenwick tree over reference timestamps (one mark per page at its latest
+// reference), O(log n) per reference. With sample_rate < 1 it follows SHARDS
+// (Waldspurger et al., FAST '15): only pages whose hash falls under the
+// rate are tracked and their distances are scaled by 1 / rate.
+//
+// WorkingSetWindow is Denning's W(t, tau): distinct pages among a process's
+// last tau references, updated in O(1) per reference with a ring of them.
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ProfilerConfig {
+    double sample_rate = 1.0;           // SHARDS rate for reuse distances; 1 is exact
+    std::vector<uint64_t> windows = {1000, 10000, 100000};     // Working-set tau, in references
+    uint64_t series_interval = 1000;    // References between working-set samples, per process
+    double flat_tolerance = 0.01;       // Miss ratio within this of the cold-miss floor is "flat"
+};
+
+struct MissRatioPoint {
+    uint64_t pages;
+    double miss_ratio;
+};
+
+class ReuseDistance {
+private:
+    static const uint64_t HASH_SPACE = 1ull << 24;
+
+    uint64_t threshold;         // Tracked if hash(page) % HASH_SPACE < threshold
+    double rate;
+    std::unordered_map<uint64_t, uint64_t> last;    // Tracked page -> timestamp of its last reference
+    std::vector<uint32_t> tree;     // Fenwick tree: 1 at each page's latest timestamp
+    uint64_t now;
+    std::vector<uint64_t> histogram;    // By scaled distance in pages
+    uint64_t cold;
+    uint64_t sampled;
+    uint64_t references;
+
+    static uint64_t mix(uint64_t x) {   // splitmix64 finalizer
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    void add(uint64_t i, int delta) {
+        for (i++; i <= tree.size(); i += i & (~i + 1)) tree[i - 1] += delta;
+    }
+
+    // Marks at timestamps [0, i)
+    uint64_t prefix(uint64_t i) const {
+        uint64_t sum = 0;
+        for (; i > 0; i -= i & (~i + 1)) sum += tree[i - 1];
+        return sum;
+    }
+
+    // Out of timestamps: renumber the live ones 0..n-1 in order, with room
+    // for as many again
+    void compact() {
+        std::vector<std::pair<uint64_t, uint64_t>> live;    // (timestamp, page)
+        live.reserve(last.size());
+        for (const auto& entry : last) live.emplace_back(entry.second, entry.first);
+        std::sort(live.begin(), live.end());
+        tree.assign(std::max<size_t>(1024, live.size() * 2), 0);
+        for (size_t i = 0; i < live.size(); i++) {
+            last[live[i].second] = i;
+            add(i, 1);
+        }
+        now = live.size();
+    }
+
+public:
+    explicit ReuseDistance(double sample_rate = 1.0)
+        : threshold((uint64_t)(std::min(1.0, std::max(sample_rate, 1e-6)) * HASH_SPACE)),
+          rate((double)threshold / HASH_SPACE), tree(1024, 0), now(0), cold(0), sampled(0), references(0) {}
+
+    void record(uint64_t page) {
+        references++;
+        if (threshold < HASH_SPACE && mix(page) % HASH_SPACE >= threshold) return;
+        sampled++;
+        if (now == tree.size()) compact();
+        auto it = last.find(page);
+        if (it == last.end()) {
+            cold++;
+            last.emplace(page, now);
+        } else {
+            uint64_t distance = prefix(now) - prefix(it->second + 1);
+            add(it->second, -1);
+            it->second = now;
+            uint64_t scaled = (uint64_t)(distance / rate);
+            if (scaled >= histogram.size()) histogram.resize(scaled + 1, 0);
+            histogram[scaled]++;
+        }
+        add(now, 1);
+        now++;
+    }
+
+    uint64_t get_references() const { return references; }
+    uint64_t get_sampled() const { return sampled; }
+    uint64_t get_cold_misses() const { return cold; }
+    double get_sample_rate() const { return rate; }
+    const std::vector<uint64_t>& get_histogram() const { return histogram; }
+    // Distinct pages seen, estimated from the sample
+    uint64_t distinct_pages() const { return (uint64_t)(last.size() / rate); }
+
+    // LRU miss ratio with `pages` frames, cold misses included
+    double miss_ratio(uint64_t pages) const {
+        if (sampled == 0) return 0;
+        uint64_t misses = cold;
+        for (uint64_t d = pages; d < histogram.size(); d++) misses += histogram[d];
+        return (double)misses / sampled;
+    }
+
+    // Points at every size up to 64 pages, then 8 per doubling, ending
+    // where only cold misses are left
+    std::vector<MissRatioPoint> curve() const {
+        std::vector<MissRatioPoint> points;
+        if (sampled == 0) return points;
+        std::vector<uint64_t> misses_from(histogram.size() + 1, 0);    // Suffix sums
+        for (size_t d = histogram.size(); d-- > 0; ) misses_from[d] = misses_from[d + 1] + histogram[d];
+        uint64_t pages = 1;
+        for (;;) {
+            uint64_t misses = cold + (pages < misses_from.size() ? misses_from[pages] : 0);
+            points.push_back(MissRatioPoint{pages, (double)misses / sampled});
+            if (pages >= histogram.size()) break;
+            pages = (pages < 64) ? pages + 1 : pages + std::max<uint64_t>(1, pages / 8);
+            pages = std::min<uint64_t>(pages, histogram.size());
+        }
+        return points;
+    }
+
+    // Smallest size whose miss ratio is within tolerance of the cold-miss
+    // floor: more RAM than this barely reduces faults
+    uint64_t flat_point(double tolerance) const {
+        if (sampled == 0) return 0;
+        double floor = (double)cold / sampled;
+        uint64_t misses = cold;
+        uint64_t pages = histogram.size();
+        while (pages > 1 && (double)(misses + histogram[pages - 1]) / sampled - floor <= tolerance) {
+            misses += histogram[--pages];
+        }
+        return std::max<uint64_t>(pages, 1);
+    }
+};
+
+class WorkingSetWindow {
+private:
+    uint64_t tau;
+    std::vector<uint64_t> ring;     // The last tau references
+    std::unordered_map<uint64_t, uint64_t> last;    // Page in the window -> its latest reference
+    uint64_t t;
+    uint64_t size;
+    uint64_t sum;
+    uint64_t peak;
+
+public:
+    explicit WorkingSetWindow(uint64_t window) : tau(window), ring(window), t(0), size(0), sum(0), peak(0) {}
+
+    void record(uint64_t page) {
+        if (t >= tau) {
+            // The reference leaving the window; its page leaves too unless touched since
+            auto it = last.find(ring[t % tau]);
+            if (it->second == t - tau) {
+                last.erase(it);
+                size--;
+            }
+        }
+        auto inserted = last.emplace(page, t);
+        if (inserted.second) {
+            size++;
+        } else {
+            inserted.first->second = t;
+        }
+        ring[t % tau] = page;
+        t++;
+        sum += size;
+        peak = std::max(peak, size);
+    }
+
+    uint64_t window() const { return tau; }
+    uint64_t current() const { return size; }
+    uint64_t max() const { return peak; }
+    double average() const { return t ? (double)sum / t : 0; }
+};
+
+class WorkingSetProfiler {
+private:
+    struct Process {
+        uint64_t references = 0;
+        std::vector<WorkingSetWindow> windows;
+        std::vector<std::vector<uint64_t>> series;  // Per window, sampled every series_interval
+    };
+    ProfilerConfig config;
+    ReuseDistance reuse;
+    std::map<uint32_t, Process> processes;
+
+public:
+    explicit WorkingSetProfiler(const ProfilerConfig& c = ProfilerConfig())
+        : config(c), reuse(c.sample_rate) {}
+
+    // One page reference; page ids must be unique across processes
+    void record(uint32_t pid, uint64_t page) {
+        reuse.record(page);
+        Process& p = processes[pid];
+        if (p.windows.empty()) {
+            for (uint64_t tau : config.windows) p.windows.emplace_back(tau);
+            p.series.resize(config.windows.size());
+        }
+        p.references++;
+        for (size_t w = 0; w < p.windows.size(); w++) {
+            p.windows[w].record(page);
+            if (config.series_interval && p.references % config.series_interval == 0) {
+                p.series[w].push_back(p.windows[w].current());
+            }
+        }
+    }
+
+    const ReuseDistance& reuse_distance() const { return reuse; }
+    uint64_t flat_point() const { return reuse.flat_point(config.flat_tolerance); }
+
+    void print_summary(std::ostream& out, uint64_t page_size) const {
+        out << "Profile: " << reuse.get_references() << " references, " << reuse.distinct_pages()
+            << " distinct pages";
+        if (reuse.get_sample_rate() < 1) out << " (SHARDS rate " << reuse.get_sample_rate() << ")";
+        out << "\n";
+        for (const auto& p : processes) {
+            out << "  pid " << p.first << ": " << p.second.references << " references, working set";
+            for (const WorkingSetWindow& w : p.second.windows) {
+                out << " tau=" << w.window() << " avg " << (uint64_t)(w.average() + 0.5) << " max " << w.max();
+            }
+            out << "\n";
+        }
+        uint64_t flat = flat_point();
+        out << "  LRU miss ratio flattens at " << flat << " pages (" << flat * page_size / 1024 << " KB): "
+            << reuse.miss_ratio(flat) * 100 << "% vs " << reuse.miss_ratio(UINT64_MAX) * 100
+            << "% cold misses\n";
+    }
+
+    // Sections start with a "# name" line, then a header row
+    void write_csv(std::ostream& out, uint64_t page_size) const {
+        out << "# miss_ratio_curve\npages,bytes,miss_ratio\n";
+        for (const MissRatioPoint& point : reuse.curve()) {
+            out << point.pages << "," << point.pages * page_size << "," << point.miss_ratio << "\n";
+        }
+        out << "\n# reuse_distance\ndistance_from,distance_to,count\n";
+        const std::vector<uint64_t>& histogram = reuse.get_histogram();
+        for (uint64_t from = 0; from < histogram.size(); from = from ? from * 2 : 1) {
+            uint64_t to = std::min<uint64_t>(from ? from * 2 : 1, histogram.size());
+            uint64_t count = 0;
+            for (uint64_t d = from; d < to; d++) count += histogram[d];
+            out << from << "," << to - 1 << "," << count << "\n";
+        }
+        out << "cold,cold," << reuse.get_cold_misses() << "\n";
+        out << "\n# working_set\npid,window,references,pages\n";
+        for (const auto& p : processes) {
+            for (size_t w = 0; w < p.second.windows.size(); w++) {
+                for (size_t i = 0; i < p.second.series[w].size(); i++) {
+                    out << p.first << "," << p.second.windows[w].window() << ","
+                        << (i + 1) * config.series_interval << "," << p.second.series[w][i] << "\n";
+                }
+            }
+        }
+    }
+
+    void write_json(std::ostream& out, uint64_t page_size) const {
+        out << "{\n  \"references\": " << reuse.get_references()
+            << ",\n  \"sampled_references\": " << reuse.get_sampled()
+            << ",\n  \"sample_rate\": " << reuse.get_sample_rate()
+            << ",\n  \"distinct_pages\": " << reuse.distinct_pages()
+            << ",\n  \"cold_misses\": " << reuse.get_cold_misses()
+            << ",\n  \"page_size\": " << page_size
+            << ",\n  \"flat_at_pages\": " << flat_point()
+            << ",\n  \"miss_ratio_curve\": [";
+        std::vector<MissRatioPoint> curve = reuse.curve();
+        for (size_t i = 0; i < curve.size(); i++) {
+            out << (i ? ", " : "") << "{\"pages\": " << curve[i].pages << ", \"miss_ratio\": "
+                << curve[i].miss_ratio << "}";
+        }
+        out << "],\n  \"reuse_distance\": [";
+        const std::vector<uint64_t>& histogram = reuse.get_histogram();
+        bool first = true;
+        for (uint64_t from = 0; from < histogram.size(); from = from ? from * 2 : 1) {
+            uint64_t to = std::min<uint64_t>(from ? from * 2 : 1, histogram.size());
+            uint64_t count = 0;
+            for (uint64_t d = from; d < to; d++) count += histogram[d];
+            out << (first ? "" : ", ") << "{\"from\": " << from << ", \"to\": " << to - 1
+                << ", \"count\": " << count << "}";
+            first = false;
+        }
+        out << "],\n  \"processes\": [";
+        first = true;
+        for (const auto& p : processes) {
+            out << (first ? "" : ",") << "\n    {\"pid\": " << p.first << ", \"references\": "
+                << p.second.references << ", \"working_set\": [";
+            for (size_t w = 0; w < p.second.windows.size(); w++) {
+                const WorkingSetWindow& window = p.second.windows[w];
+                out << (w ? ", " : "") << "{\"window\": " << window.window() << ", \"average\": "
+                    << window.average() << ", \"max\": " << window.max() << ", \"series\": [";
+                for (size_t i = 0; i < p.second.series[w].size(); i++) {
+                    out << (i ? ", " : "") << p.second.series[w][i];
+                }
+                out << "]}";
+            }
+            out << "]}";
+            first = false;
+        }
+        out << "\n  ]\n}\n";
+    }
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+// Building blocks for a compressed swap cache (Linux zswap): page codecs
+// and a size-class allocator for the compressed copies.
+//
+// SwapCodec is the pluggable compressor. LzCodec is built in: an LZ77 coder
+// with LZ4's sequence layout (token, literals, 16-bit offset, match) and a
+// single-probe hash, fast rather than tight. Building with -DVM_HAVE_LZ4
+// (-llz4) or -DVM_HAVE_ZSTD (-lzstd) adds the real libraries.
+//
+// ZsPool works like zsmalloc: the pool is a set of page-sized zspages, each
+// one cut into equal objects of a single size class (steps of 1/64 page), so
+// with 4KB pages a 900 byte page takes a 960 byte slot and four fit in a
+// zspage. A zspage goes back to the pool once its last object is freed.
+// Objects over half a page would get a zspage to themselves and save
+// nothing, so they are refused.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#ifdef VM_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef VM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+class SwapCodec {
+public:
+    virtual ~SwapCodec() = default;
+    virtual const char* name() const = 0;
+    // Returns the compressed length, or 0 if it does not fit in dst_cap
+    virtual size_t compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) = 0;
+    // False on corrupt input or if it does not expand to exactly dst_len bytes
+    virtual bool decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) = 0;
+};
+
+class LzCodec : public SwapCodec {
+private:
+    static const size_t MIN_MATCH = 4;
+    static const unsigned HASH_BITS = 12;
+    static const size_t MAX_OFFSET = 65535;
+
+    static uint32_t load32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // Bytes a and b have in common, 8 at a time, stopping at limit
+    static size_t common_length(const uint8_t* a, const uint8_t* b, size_t limit) {
+        size_t n = 0;
+        while (n + 8 <= limit) {
+            uint64_t x, y;
+            std::memcpy(&x, a + n, 8);
+            std::memcpy(&y, b + n, 8);
+            if (x != y) return n + __builtin_ctzll(x ^ y) / 8;     // Little-endian
+            n += 8;
+        }
+        while (n < limit && a[n] == b[n]) n++;
+        return n;
+    }
+
+    static uint32_t hash(uint32_t seq) { return (seq * 2654435761u) >> (32 - HASH_BITS); }
+
+    // Length bytes past a nibble of 15: runs of 255 and a remainder
+    static bool put_length(size_t len, uint8_t* dst, size_t& op, size_t cap) {
+        for (; len >= 255; len -= 255) {
+            if (op >= cap) return false;
+            dst[op++] = 255;
+        }
+        if (op >= cap) return false;
+        dst[op++] = (uint8_t)len;
+        return true;
+    }
+
+    static bool get_length(const uint8_t* src, size_t& ip, size_t src_len, size_t& len) {
+        uint8_t b;
+        do {
+            if (ip >= src_len) return false;
+            b = src[ip++];
+            len += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // One sequence: literals, then a match unless it is the last one
+    static bool emit(const uint8_t* literals, size_t literal_len, size_t offset, size_t match_len, bool last,
+                     uint8_t* dst, size_t& op, size_t cap) {
+        if (op >= cap) return false;
+        size_t token = op++;
+        dst[token] = (uint8_t)(std::min<size_t>(literal_len, 15) << 4);
+        if (literal_len >= 15 && !put_length(literal_len - 15, dst, op, cap)) return false;
+        if (op + literal_len > cap) return false;
+        if (literal_len > 0) std::memcpy(dst + op, literals, literal_len);
+        op += literal_len;
+        if (last) return true;
+
+        if (op + 2 > cap) return false;
+        dst[op++] = (uint8_t)offset;
+        dst[op++] = (uint8_t)(offset >> 8);
+        size_t extra = match_len - MIN_MATCH;
+        dst[token] |= (uint8_t)std::min<size_t>(extra, 15);
+        return extra < 15 || put_length(extra - 15, dst, op, cap);
+    }
+
+    // Pos holds position + 1, so 16 bits cover pages up to 64KB - 1; larger
+    // pages use 32-bit positions and skip matches the 16-bit offset can't reach
+    template <typename Pos>
+    static size_t compress_with(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) {
+        Pos table[1 << HASH_BITS] = {};    // Position + 1 of the last 4 bytes with that hash
+        size_t ip = 0, anchor = 0, op = 0;
+        while (ip + MIN_MATCH <= src_len) {
+            uint32_t seq = load32(src + ip);
+            uint32_t h = hash(seq);
+            size_t candidate = table[h];
+            table[h] = (Pos)(ip + 1);
+            if (candidate == 0 || ip + 1 - candidate > MAX_OFFSET || load32(src + candidate - 1) != seq) {
+                ip++;
+                continue;
+            }
+            size_t ref = candidate - 1;
+            size_t len = MIN_MATCH + common_length(src + ref + MIN_MATCH, src + ip + MIN_MATCH,
+                                                   src_len - ip - MIN_MATCH);
+            if (!emit(src + anchor, ip - anchor, ip - ref, len, false, dst, op, dst_cap)) return 0;
+            ip += len;
+            anchor = ip;
+        }
+        if (!emit(src + anchor, src_len - anchor, 0, 0, true, dst, op, dst_cap)) return 0;
+        return op;
+    }
+
+public:
+    const char* name() const override { return "lz"; }
+
+    size_t compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) override {
+        if (src_len > UINT32_MAX - 1) return 0;
+        if (src_len <= 65535) return compress_with<uint16_t>(src, src_len, dst, dst_cap);
+        return compress_with<uint32_t>(src, src_len, dst, dst_cap);
+    }
+
+    bool decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) override {
+        size_t ip = 0, op = 0;
+        while (ip < src_len) {
+            uint8_t token = src[ip++];
+            size_t literal_len = token >> 4;
+            if (literal_len == 15 && !get_length(src, ip, src_len, literal_len)) return false;
+            if (ip + literal_len > src_len || op + literal_len > dst_len) return false;
+            std::memcpy(dst + op, src + ip, literal_len);
+            ip += literal_len;
+            op += literal_len;
+            if (ip == src_len) break;       // The last sequence has no match
+
+            if (ip + 2 > src_len) return false;
+            size_t offset = src[ip] | (src[ip + 1] << 8);
+            ip += 2;
+            size_t match_len = token & 15;
+            if (match_len == 15 && !get_length(src, ip, src_len, match_len)) return false;
+            match_len += MIN_MATCH;
+            if (offset == 0 || offset > op || op + match_len > dst_len) return false;
+            if (offset >= match_len) {
+                std::memcpy(dst + op, dst + op - offset, match_len);
+                op += match_len;
+            } else {
+                // Byte by byte: the match overlaps the bytes it produces
+                for (size_t i = 0; i < match_len; i++, op++) dst[op] = dst[op - offset];
+            }
+        }
+        return op == dst_len;
+    }
+};
+
+#ifdef VM_HAVE_LZ4
+class Lz4Codec : public SwapCodec {
+public:
+    const char* name() const override { return "lz4"; }
+
+    size_t compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) override {
+        int n = LZ4_compress_default(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                     (int)src_len, (int)dst_cap);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    bool decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) override {
+        int n = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                    (int)src_len, (int)dst_len);
+        return n == (int)dst_len;
+    }
+};
+#endif
+
+#ifdef VM_HAVE_ZSTD
+class ZstdCodec : public SwapCodec {
+private:
+    int level;
+
+public:
+    explicit ZstdCodec(int compression_level = 1) : level(compression_level) {}
+
+    const char* name() const override { return "zstd"; }
+
+    size_t compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) override {
+        size_t n = ZSTD_compress(dst, dst_cap, src, src_len, level);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+
+    bool decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) override {
+        size_t n = ZSTD_decompress(dst, dst_len, src, src_len);
+        return !ZSTD_isError(n) && n == dst_len;
+    }
+};
+#endif
+
+// nullptr for a codec this build does not have
+inline std::unique_ptr<SwapCodec> make_swap_codec(const std::string& name) {
+    if (name == "lz") return std::make_unique<LzCodec>();
+#ifdef VM_HAVE_LZ4
+    if (name == "lz4") return std::make_unique<Lz4Codec>();
+#endif
+#ifdef VM_HAVE_ZSTD
+    if (name == "zstd") return std::make_unique<ZstdCodec>();
+#endif
+    return nullptr;
+}
+
+struct ZswapStats {
+    uint64_t stored_pages = 0;      // In the cache now, same-filled ones included
+    uint64_t same_filled_pages = 0; // Of those, kept as one word, no pool memory
+    uint64_t compressed_bytes = 0;  // Payload of the rest
+    uint64_t stores = 0;
+    uint64_t loads = 0;             // Swap-ins served without swap I/O
+    uint64_t rejected = 0;          // Compressed poorly, went straight to swap
+    uint64_t written_back = 0;      // Pushed out to swap to make room
+    uint64_t compressions = 0;      // Codec calls, for the per-page CPU cost
+    uint64_t compress_ns = 0;
+    uint64_t decompressions = 0;
+    uint64_t decompress_ns = 0;
+};
+
+template <uint32_t ZspageSize = 4096>
+class ZsPool {
+public:
+    static_assert(ZspageSize >= 4096 && ZspageSize % 64 == 0, "zspages hold 64 objects of at least 64 bytes");
+    static const uint32_t ZSPAGE_SIZE = ZspageSize;
+    static const uint32_t CLASS_STEP = ZspageSize / 64;
+    static const uint32_t MAX_OBJECT = ZSPAGE_SIZE / 2;
+    static const uint32_t NONE = UINT32_MAX;
+
+private:
+    static const uint32_t CLASSES = MAX_OBJECT / CLASS_STEP;
+    static const uint32_t OBJECT_BITS = 6;     // Up to 64 objects per zspage
+
+    struct ZsPage {
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t size_class;
+        uint64_t free_mask;     // Bit i set: object i is free
+    };
+    std::vector<ZsPage> zspages;        // Handle = zspage index << OBJECT_BITS | object
+    std::vector<uint32_t> unused;       // zspages back in the pool (data kept)
+    std::set<uint32_t> partial[CLASSES];    // zspages of each class with a free object
+    size_t max_zspages;
+    size_t used_zspages;
+
+    static uint32_t class_of(size_t len) { return (uint32_t)((len + CLASS_STEP - 1) / CLASS_STEP - 1); }
+    static uint32_t class_size(uint32_t c) { return (c + 1) * CLASS_STEP; }
+    static uint32_t per_page(uint32_t c) { return ZSPAGE_SIZE / class_size(c); }
+
+public:
+    explicit ZsPool(size_t max_pages) : max_zspages(max_pages), used_zspages(0) {}
+
+    // NONE if len is over MAX_OBJECT or the pool has no room for its class
+    uint32_t alloc(size_t len) {
+        if (len == 0 || len > MAX_OBJECT) return NONE;
+        uint32_t c = class_of(len);
+        if (partial[c].empty()) {
+            if (used_zspages >= max_zspages) return NONE;
+            uint32_t index;
+            if (!unused.empty()) {
+                index = unused.back();
+                unused.pop_back();
+            } else {
+                index = (uint32_t)zspages.size();
+                zspages.push_back(ZsPage{std::make_unique<uint8_t[]>(ZSPAGE_SIZE), 0, 0});
+            }
+            uint32_t n = per_page(c);
+            zspages[index].size_class = c;
+            zspages[index].free_mask = (n == 64) ? ~0ull : ((1ull << n) - 1);
+            partial[c].insert(index);
+            used_zspages++;
+        }
+        uint32_t index = *partial[c].begin();
+        ZsPage& page = zspages[index];
+        uint32_t object = (uint32_t)__builtin_ctzll(page.free_mask);
+        page.free_mask &= page.free_mask - 1;
+        if (page.free_mask == 0) partial[c].erase(index);
+        return index << OBJECT_BITS | object;
+    }
+
+    void release(uint32_t handle) {
+        uint32_t index = handle >> OBJECT_BITS;
+        ZsPage& page = zspages[index];
+        uint32_t c = page.size_class;
+        if (page.free_mask == 0) partial[c].insert(index);
+        page.free_mask |= 1ull << (handle & ((1u << OBJECT_BITS) - 1));
+        uint32_t n = per_page(c);
+        if (page.free_mask == ((n == 64) ? ~0ull : ((1ull << n) - 1))) {
+            partial[c].erase(index);
+            unused.push_back(index);
+            used_zspages--;
+        }
+    }
+
+    uint8_t* data(uint32_t handle) {
+        ZsPage& page = zspages[handle >> OBJECT_BITS];
+        return page.data.get() + (handle & ((1u << OBJECT_BITS) - 1)) * class_size(page.size_class);
+    }
+
+    size_t pages_used() const { return used_zspages; }
+    size_t max_pages() const { return max_zspages; }
+};